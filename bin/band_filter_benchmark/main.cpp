@@ -0,0 +1,143 @@
+//  Compares the FFT multiband filter against the SIMD Linkwitz-Riley
+//  alternative over a range of signal lengths, and reports the length at
+//  which the FFT filter becomes the faster of the two.
+//  Also times zero-phase filtering of a single channel, scalar versus
+//  block-parallel lanes.
+
+#include "core/simd_biquad.h"
+
+#include "hrtf/multiband.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+
+namespace {
+
+constexpr auto sample_rate = 44100.0;
+constexpr auto bands = 8;
+
+using signal = util::aligned::vector<std::array<float, bands>>;
+
+/// Best-of-n wall time, in milliseconds.
+double time_ms(const std::function<void(signal&)>& func,
+               const signal& input,
+               size_t runs) {
+    auto best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i != runs; ++i) {
+        auto copy = input;
+        const auto start = std::chrono::steady_clock::now();
+        func(copy);
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(
+                best,
+                std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const auto max_power = argc > 1 ? std::atoi(argv[1]) : 22;
+    constexpr auto runs = 3;
+
+    std::default_random_engine engine{0};
+    std::uniform_real_distribution<float> dist{-1, 1};
+
+    const auto params = hrtf_data::hrtf_band_params(sample_rate);
+
+    const auto fft = [&](signal& s) {
+        frequency_domain::multiband_filter(
+                s.begin(),
+                s.end(),
+                params,
+                frequency_domain::make_indexer_iterator{});
+    };
+    const auto iir = [&](signal& s) {
+        wayverb::core::filter::linkwitz_riley_multiband_filter(
+                s.begin(),
+                s.end(),
+                params,
+                frequency_domain::make_indexer_iterator{});
+    };
+
+    std::cout << "multiband filtering, " << bands << " bands, best of " << runs
+              << " runs\n\n";
+    std::cout << std::setw(12) << "samples" << std::setw(12) << "fft ms"
+              << std::setw(12) << "simd ms" << std::setw(12) << "speedup"
+              << '\n';
+
+    auto crossover = 0ul;
+    for (auto power = 8; power <= max_power; ++power) {
+        signal input(1ul << power);
+        for (auto& frame : input) {
+            frame.fill(dist(engine));
+        }
+
+        const auto fft_ms = time_ms(fft, input, runs);
+        const auto iir_ms = time_ms(iir, input, runs);
+        if (!crossover && fft_ms < iir_ms) {
+            crossover = input.size();
+        }
+
+        std::cout << std::setw(12) << input.size() << std::fixed
+                  << std::setprecision(3) << std::setw(12) << fft_ms
+                  << std::setw(12) << iir_ms << std::setw(11)
+                  << std::setprecision(2) << fft_ms / iir_ms << "x\n";
+    }
+
+    if (crossover) {
+        std::cout << "\nfft is faster from " << crossover << " samples\n";
+    } else {
+        std::cout << "\nsimd is faster at every length tested\n";
+    }
+
+    std::cout << "\nzero-phase bandpass, single channel\n\n";
+    std::cout << std::setw(12) << "samples" << std::setw(12) << "scalar ms"
+              << std::setw(12) << "blocked ms" << std::setw(12) << "speedup"
+              << '\n';
+
+    const auto coefficients = wayverb::core::filter::compute_linkwitz_riley_band(
+            params.edges[2], params.edges[3]);
+
+    for (auto power = 14; power <= max_power; power += 2) {
+        signal input(1ul << power);
+        for (auto& frame : input) {
+            frame[0] = dist(engine);
+        }
+
+        const auto channel = [](signal& s) {
+            return util::make_mapping_iterator_adapter(
+                    s.begin(), frequency_domain::indexer{0});
+        };
+
+        const auto scalar_ms = time_ms(
+                [&](signal& s) {
+                    auto filter = wayverb::core::filter::make_series_biquads(
+                            coefficients);
+                    wayverb::core::filter::run_two_pass(
+                            filter, channel(s), channel(s) + s.size());
+                },
+                input,
+                runs);
+        const auto blocked_ms = time_ms(
+                [&](signal& s) {
+                    wayverb::core::filter::run_two_pass_blocked(
+                            coefficients, channel(s), channel(s) + s.size());
+                },
+                input,
+                runs);
+
+        std::cout << std::setw(12) << input.size() << std::fixed
+                  << std::setprecision(3) << std::setw(12) << scalar_ms
+                  << std::setw(12) << blocked_ms << std::setw(11)
+                  << std::setprecision(2) << scalar_ms / blocked_ms << "x\n";
+    }
+
+    return EXIT_SUCCESS;
+}
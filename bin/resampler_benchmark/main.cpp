@@ -0,0 +1,142 @@
+//  Compares the polyphase resampler used for waveguide output against the
+//  libsamplerate converter it replaced, for speed and passband accuracy.
+//  Waveguide output only has content below ~30% of its Nyquist frequency, so
+//  the 45% column is the one that matters for renders.
+
+#include "waveguide/config.h"
+#include "waveguide/simulation_parameters.h"
+
+#include "core/polyphase_resampler.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+
+namespace {
+
+using resampler = std::function<util::aligned::vector<float>(
+        const util::aligned::vector<float>&)>;
+
+/// Best-of-n wall time, in milliseconds.
+double time_ms(const resampler& func,
+               const util::aligned::vector<float>& input,
+               size_t runs) {
+    auto best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i != runs; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto out = func(input);
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(
+                best,
+                std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+/// Worst-case error, in dB relative to full scale, over a set of sines
+/// spread up to `max_fraction` of the lower Nyquist. Edges are ignored.
+double passband_error_db(const resampler& func,
+                         double in_sr,
+                         double out_sr,
+                         double max_fraction) {
+    const auto ratio = out_sr / in_sr;
+    const auto nyquist = 0.5 * std::min(in_sr, out_sr);
+    auto worst = 0.0;
+    for (auto step = 1; step <= 5; ++step) {
+        const auto fraction = max_fraction * step / 5;
+        const auto frequency = fraction * nyquist;
+        util::aligned::vector<float> input(8192);
+        for (size_t i = 0; i != input.size(); ++i) {
+            input[i] = std::sin(2 * M_PI * frequency * i / in_sr);
+        }
+        const auto output = func(input);
+        const auto margin = output.size() / 8;
+        for (auto i = margin; i < output.size() - margin; ++i) {
+            //  Both converters scale by 1 / ratio to preserve level.
+            const auto expected = std::sin(2 * M_PI * frequency * i / out_sr);
+            worst = std::max(worst, std::abs(output[i] * ratio - expected));
+        }
+    }
+    return 20 * std::log10(std::max(worst, 1.0e-12));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const auto seconds = argc > 1 ? std::atof(argv[1]) : 10.0;
+    constexpr auto runs = 3;
+
+    std::cout << "signal length: " << seconds << " s, best of " << runs
+              << " runs\n\n";
+    std::cout << std::setw(10) << "in_sr" << std::setw(10) << "out_sr"
+              << std::setw(24) << "method" << std::setw(12) << "time ms"
+              << std::setw(12) << "speedup" << std::setw(14)
+              << "err@45% dB" << std::setw(14) << "err@85% dB" << '\n';
+
+    std::default_random_engine engine{0};
+    std::uniform_real_distribution<float> dist{-1, 1};
+
+    //  Typical waveguide rates (cutoff / usable portion), plus a plain
+    //  audio-rate conversion.
+    const auto rates = {
+            std::make_pair(wayverb::waveguide::compute_sampling_frequency(
+                                   500.0, 0.6),
+                           44100.0),
+            std::make_pair(wayverb::waveguide::compute_sampling_frequency(
+                                   2000.0, 0.6),
+                           48000.0),
+            std::make_pair(48000.0, 44100.0)};
+
+    for (const auto& rate : rates) {
+        const auto in_sr = rate.first;
+        const auto out_sr = rate.second;
+
+        util::aligned::vector<float> input(seconds * in_sr);
+        for (auto& i : input) {
+            i = dist(engine);
+        }
+
+        const auto reference = [&](const auto& in) {
+            return wayverb::waveguide::adjust_sampling_rate_libsamplerate(
+                    in.data(), in.size(), in_sr, out_sr);
+        };
+        const auto reference_ms = time_ms(reference, input, runs);
+
+        const auto print = [&](const char* name,
+                               double ms,
+                               const resampler& func) {
+            std::cout << std::setw(10) << std::fixed << std::setprecision(1)
+                      << in_sr << std::setw(10) << out_sr << std::setw(24)
+                      << name << std::setw(12) << std::setprecision(2) << ms
+                      << std::setw(11) << reference_ms / ms << 'x'
+                      << std::setw(14) << std::setprecision(1)
+                      << passband_error_db(func, in_sr, out_sr, 0.45)
+                      << std::setw(14)
+                      << passband_error_db(func, in_sr, out_sr, 0.85) << '\n';
+        };
+
+        print("libsamplerate best", reference_ms, reference);
+
+        for (const auto quality :
+             {std::make_pair("polyphase fast",
+                             wayverb::core::resampler_quality::fast),
+              std::make_pair("polyphase medium",
+                             wayverb::core::resampler_quality::medium),
+              std::make_pair("polyphase high",
+                             wayverb::core::resampler_quality::high)}) {
+            const auto func = [&](const auto& in) {
+                return wayverb::waveguide::adjust_sampling_rate(
+                        in.data(), in.size(), in_sr, out_sr, quality.second);
+            };
+            print(quality.first, time_ms(func, input, runs), func);
+        }
+        std::cout << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+//  Compares waveguide node storage on the bundled scenes: the dense grid,
+//  sparse storage in grid order, and sparse storage in Morton order.
+//
+//  For each layout it reports the number of stored nodes, the mean distance
+//  in memory between a node and its neighbours (a proxy for cache misses, as
+//  it doesn't need hardware counters), and the wall time per step. For
+//  measured cache misses, run the benchmark under e.g.
+//      perf stat -e cache-misses,cache-references
+//  with WAYVERB_LAYOUT=dense|sparse|morton to select a single layout.
+
+#include "waveguide/mesh.h"
+#include "waveguide/preprocessor/soft_source.h"
+#include "waveguide/sparse_layout.h"
+#include "waveguide/waveguide.h"
+
+#include "core/cl/common.h"
+#include "core/scene_data_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#ifndef OBJ_PATH
+#define OBJ_PATH ""
+#endif
+
+#ifndef OBJ_PATH_TUNNEL
+#define OBJ_PATH_TUNNEL ""
+#endif
+
+#ifndef OBJ_PATH_BEDROOM
+#define OBJ_PATH_BEDROOM ""
+#endif
+
+using namespace wayverb;
+
+namespace {
+
+constexpr auto steps = 200;
+constexpr auto sample_rate = 10000.0;
+constexpr auto speed_of_sound = 340.0;
+
+/// Wall time per step, in milliseconds.
+template <typename Run>
+double time_per_step_ms(Run&& run) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto completed = run();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() /
+           std::max<size_t>(1, completed);
+}
+
+/// Dense storage is x-fastest, so the neighbours of a node are 1, dims.x and
+/// dims.x * dims.y nodes away.
+double dense_mean_neighbor_distance(const waveguide::mesh_descriptor& d) {
+    const double x = d.dimensions.s[0];
+    const double y = d.dimensions.s[1];
+    return (1 + x + x * y) / 3;
+}
+
+void print_row(const char* name,
+               size_t nodes,
+               double distance,
+               double ms_per_step) {
+    std::cout << std::setw(10) << name << std::setw(14) << nodes
+              << std::setw(18) << std::fixed << std::setprecision(1)
+              << distance << std::setw(14) << std::setprecision(3)
+              << ms_per_step << '\n';
+}
+
+void benchmark_scene(const core::compute_context& cc,
+                     const char* name,
+                     const char* path,
+                     const std::string& only) {
+    const auto scene_data = core::scene_with_extracted_surfaces(
+            *core::scene_data_loader{path}.get_scene_data(),
+            util::aligned::unordered_map<
+                    std::string,
+                    core::surface<core::simulation_bands>>{});
+
+    const auto anchor =
+            centre(core::geo::compute_aabb(scene_data.get_vertices()));
+    const auto voxels_and_mesh = waveguide::compute_voxels_and_mesh(
+            cc, scene_data, anchor, sample_rate, speed_of_sound);
+    const auto& mesh = voxels_and_mesh.mesh;
+    const auto& nodes = mesh.get_structure().get_condensed_nodes();
+
+    //  Drive any inside node, the contents of the signal don't matter here.
+    const auto source = static_cast<size_t>(std::distance(
+            begin(nodes),
+            std::find_if(begin(nodes), end(nodes), [](const auto& node) {
+                return waveguide::is_inside(node);
+            })));
+    util::aligned::vector<float> input(steps, 0.0f);
+    input.front() = 1.0f;
+    const auto ignore = [](auto&, const auto&, auto) {};
+
+    std::cout << '\n' << name << '\n';
+    std::cout << std::setw(10) << "layout" << std::setw(14) << "nodes"
+              << std::setw(18) << "mean nbr dist" << std::setw(14)
+              << "ms/step" << '\n';
+
+    if (only.empty() || only == "dense") {
+        const auto ms = time_per_step_ms([&] {
+            auto prep = waveguide::preprocessor::make_soft_source(
+                    source, begin(input), end(input));
+            return waveguide::run(cc, mesh, prep, ignore, true);
+        });
+        print_row("dense",
+                  nodes.size(),
+                  dense_mean_neighbor_distance(mesh.get_descriptor()),
+                  ms);
+    }
+
+    const auto run_sparse = [&](const char* label,
+                                waveguide::node_ordering ordering) {
+        const auto layout = waveguide::make_sparse_layout(mesh, ordering);
+        const auto ms = time_per_step_ms([&] {
+            auto prep = waveguide::preprocessor::make_soft_source(
+                    waveguide::compute_compact_index(layout, source),
+                    begin(input),
+                    end(input));
+            return waveguide::run_sparse(cc,
+                                         mesh,
+                                         layout,
+                                         waveguide::coefficient_overlay{mesh},
+                                         prep,
+                                         ignore,
+                                         true);
+        });
+        print_row(label,
+                  layout.nodes.size(),
+                  waveguide::compute_mean_neighbor_distance(layout),
+                  ms);
+    };
+
+    if (only.empty() || only == "sparse") {
+        run_sparse("sparse", waveguide::node_ordering::dense);
+    }
+    if (only.empty() || only == "morton") {
+        run_sparse("morton", waveguide::node_ordering::morton);
+    }
+}
+
+}  // namespace
+
+int main(int /*argc*/, char** /*argv*/) {
+    const auto env = std::getenv("WAYVERB_LAYOUT");
+    const std::string only = env ? env : "";
+
+    const core::compute_context cc{};
+    std::cout << "steps: " << steps << ", sample rate: " << sample_rate
+              << " Hz\n";
+
+    benchmark_scene(cc, "vault", OBJ_PATH, only);
+    benchmark_scene(cc, "echo_tunnel", OBJ_PATH_TUNNEL, only);
+    benchmark_scene(cc, "bedroom", OBJ_PATH_BEDROOM, only);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+//  Compares the impulse responses produced with single and half precision
+//  pressure storage (see waveguide/pressure_storage.h) on the bundled scenes.
+//
+//  For each scene it reports the bytes stored per node for the pressure
+//  fields, the largest absolute difference between the two responses, and the
+//  RMS of the difference relative to the RMS of the single precision
+//  response, in dB.
+
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/soft_source.h"
+#include "waveguide/pressure_storage.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+#include "core/cl/common.h"
+#include "core/scene_data_loader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#ifndef OBJ_PATH
+#define OBJ_PATH ""
+#endif
+
+#ifndef OBJ_PATH_TUNNEL
+#define OBJ_PATH_TUNNEL ""
+#endif
+
+#ifndef OBJ_PATH_BEDROOM
+#define OBJ_PATH_BEDROOM ""
+#endif
+
+using namespace wayverb;
+
+namespace {
+
+constexpr auto steps = 4000;
+constexpr auto sample_rate = 10000.0;
+constexpr auto speed_of_sound = 340.0;
+
+/// Bytes per node held in the two pressure fields (previous and current).
+size_t pressure_bytes_per_node(waveguide::pressure_storage storage) {
+    return 2 * waveguide::pressure_size(storage);
+}
+
+void print_row(const char* name,
+               waveguide::pressure_storage storage,
+               double max_error,
+               double relative_error_db) {
+    std::cout << std::setw(10) << name << std::setw(14)
+              << pressure_bytes_per_node(storage) << std::setw(14)
+              << std::scientific << std::setprecision(3) << max_error
+              << std::setw(14) << std::fixed << std::setprecision(1)
+              << relative_error_db << '\n';
+}
+
+void report_scene(const core::compute_context& cc,
+                  const char* name,
+                  const char* path) {
+    const auto scene_data = core::scene_with_extracted_surfaces(
+            *core::scene_data_loader{path}.get_scene_data(),
+            util::aligned::unordered_map<
+                    std::string,
+                    core::surface<core::simulation_bands>>{});
+
+    const auto anchor =
+            centre(core::geo::compute_aabb(scene_data.get_vertices()));
+    const auto voxels_and_mesh = waveguide::compute_voxels_and_mesh(
+            cc, scene_data, anchor, sample_rate, speed_of_sound);
+    const auto& mesh = voxels_and_mesh.mesh;
+    const auto& nodes = mesh.get_structure().get_condensed_nodes();
+
+    //  Source and receiver are well separated inside nodes.
+    util::aligned::vector<size_t> inside;
+    for (size_t i = 0; i != nodes.size(); ++i) {
+        if (waveguide::is_inside(nodes[i])) {
+            inside.emplace_back(i);
+        }
+    }
+    const auto source = inside[inside.size() / 4];
+    const auto receiver = inside[inside.size() * 3 / 4];
+
+    util::aligned::vector<float> input(steps, 0.0f);
+    input.front() = 1.0f;
+
+    const auto run = [&](waveguide::pressure_storage storage) {
+        auto prep = waveguide::preprocessor::make_soft_source(
+                source, begin(input), end(input), storage);
+        core::callback_accumulator<waveguide::postprocessor::node> post{
+                receiver, storage};
+        waveguide::run(cc, mesh, prep, post, true, storage);
+        return post.get_output();
+    };
+
+    const auto reference = run(waveguide::pressure_storage::single);
+    const auto half = run(waveguide::pressure_storage::half);
+
+    double max_error = 0;
+    double error_energy = 0;
+    double reference_energy = 0;
+    for (size_t i = 0; i != std::min(reference.size(), half.size()); ++i) {
+        const auto error = static_cast<double>(half[i]) - reference[i];
+        max_error = std::max(max_error, std::abs(error));
+        error_energy += error * error;
+        reference_energy += reference[i] * static_cast<double>(reference[i]);
+    }
+
+    std::cout << '\n'
+              << name << " (" << nodes.size() << " nodes, " << steps
+              << " steps)\n";
+    std::cout << std::setw(10) << "storage" << std::setw(14) << "bytes/node"
+              << std::setw(14) << "max abs err" << std::setw(14)
+              << "rel err dB" << '\n';
+    print_row("single", waveguide::pressure_storage::single, 0, -INFINITY);
+    print_row("half",
+              waveguide::pressure_storage::half,
+              max_error,
+              10 * std::log10(error_energy / reference_energy));
+}
+
+}  // namespace
+
+int main(int /*argc*/, char** /*argv*/) {
+    const core::compute_context cc{};
+    std::cout << "sample rate: " << sample_rate << " Hz\n";
+
+    report_scene(cc, "vault", OBJ_PATH);
+    report_scene(cc, "echo_tunnel", OBJ_PATH_TUNNEL);
+    report_scene(cc, "bedroom", OBJ_PATH_BEDROOM);
+
+    return EXIT_SUCCESS;
+}
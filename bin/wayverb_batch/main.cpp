@@ -0,0 +1,607 @@
+//  Headless batch renderer.
+//
+//  Reads a JSON manifest describing one or more jobs, renders each with the
+//  same complete_engine the app uses, and writes a JSON report of timings and
+//  outputs.
+//
+//  Manifest layout:
+//
+//  {
+//      "jobs": [
+//          {
+//              "name": "hall",
+//              "scene": "hall.obj",
+//              "output": {
+//                  "directory": "renders/hall",
+//                  "format": "wav",            (wav | aif)
+//                  "bit_depth": "pcm24",       (pcm16 | pcm24 | pcm32 | float32)
+//                  "sample_rate": 48000        (44100 | 48000 | 88200 | 96000 | 192000)
+//              },
+//              "persistent": { ... }
+//          }
+//      ]
+//  }
+//
+//  "persistent" holds sources, receivers (with their capsules), raytracer and
+//  waveguide settings, and materials, in the same format as the config.json
+//  inside a saved project. Materials are applied to scene surfaces by name.
+//  Relative paths are taken relative to the manifest.
+
+#include "combined/model/persistent.h"
+#include "combined/threaded_engine.h"
+
+#include "core/cl/common.h"
+#include "core/cl/device_set.h"
+#include "core/scene_data_loader.h"
+#include "core/serialize/range.h"
+#include "core/serialize/surface.h"
+
+#include "utilities/string_builder.h"
+
+#include "cereal/archives/json.hpp"
+#include "cereal/types/memory.hpp"
+#include "cereal/types/string.hpp"
+#include "cereal/types/tuple.hpp"
+#include "cereal/types/vector.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+using clock_type = std::chrono::steady_clock;
+
+double seconds_between(clock_type::time_point a, clock_type::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+}
+
+//  options  ///////////////////////////////////////////////////////////////////
+
+struct batch_options final {
+    std::string manifest_path;
+    std::string report_path = "wayverb_batch_report.json";
+    std::optional<std::string> device;
+    std::optional<std::string> devices;
+    std::optional<std::string> concurrency;
+    std::optional<std::string> postprocess_threads;
+    bool list_devices = false;
+};
+
+void print_usage(const char* exe) {
+    std::cout << "Usage: " << exe << " [options] <manifest.json>\n\n"
+              << "Options:\n"
+              << "  --report <path>         Where to write the JSON report "
+                 "(default wayverb_batch_report.json)\n"
+              << "  --device <selection>    Device to use: gpu, cpu, an index "
+                 "from --list-devices,\n"
+              << "                          or a selection like "
+                 "\"gpu,name=Radeon\" (see docs)\n"
+              << "  --devices <selection>   Spread source/receiver pairs over "
+                 "every selected device\n"
+              << "                          (sets WAYVERB_DEVICES)\n"
+              << "  --concurrency <N>       Source/receiver pairs rendered at "
+                 "once (sets WAYVERB_CONCURRENT_RUNS)\n"
+              << "  --postprocess-threads <N>\n"
+              << "                          Postprocessing workers (sets "
+                 "WAYVERB_POSTPROCESS_THREADS)\n"
+              << "  --list-devices          Print OpenCL devices and exit\n"
+              << "  -h, --help              Show this message\n";
+}
+
+batch_options parse_args(int argc, char** argv) {
+    batch_options opts;
+    auto require_value = [&](int& index) -> const char* {
+        if (index + 1 >= argc) {
+            throw std::runtime_error{
+                    util::build_string("Missing value for option ",
+                                       argv[index])};
+        }
+        return argv[++index];
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--report") {
+            opts.report_path = require_value(i);
+        } else if (arg == "--device") {
+            opts.device = require_value(i);
+        } else if (arg == "--devices") {
+            opts.devices = require_value(i);
+        } else if (arg == "--concurrency") {
+            opts.concurrency = require_value(i);
+        } else if (arg == "--postprocess-threads") {
+            opts.postprocess_threads = require_value(i);
+        } else if (arg == "--list-devices") {
+            opts.list_devices = true;
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        } else if (!arg.empty() && arg.front() == '-') {
+            throw std::runtime_error{
+                    util::build_string("Unknown option: ", arg)};
+        } else if (opts.manifest_path.empty()) {
+            opts.manifest_path = arg;
+        } else {
+            throw std::runtime_error{
+                    util::build_string("Unexpected argument: ", arg)};
+        }
+    }
+
+    if (opts.manifest_path.empty() && !opts.list_devices) {
+        throw std::runtime_error{"No manifest given."};
+    }
+
+    return opts;
+}
+
+//  devices  ///////////////////////////////////////////////////////////////////
+
+void list_devices() {
+    const auto devices = wayverb::core::enumerate_devices();
+    for (size_t i = 0; i != devices.size(); ++i) {
+        const auto& device = devices[i];
+        std::cout << i << ": " << device.name << " (" << device.platform
+                  << ", "
+                  << ((device.type & CL_DEVICE_TYPE_GPU)
+                              ? "gpu"
+                              : (device.type & CL_DEVICE_TYPE_CPU) ? "cpu"
+                                                                   : "other")
+                  << ", " << (device.global_memory >> 20) << " MB"
+                  << (device.double_precision ? ", fp64" : "") << ")\n";
+    }
+}
+
+wayverb::core::compute_context make_compute_context(
+        const std::optional<std::string>& device) {
+    if (!device) {
+        return wayverb::core::compute_context{};
+    }
+    const auto devices = wayverb::core::select_devices(
+            wayverb::core::parse_device_selection(*device));
+    if (devices.empty()) {
+        throw std::runtime_error{
+                util::build_string("No device matches \"", *device, "\".")};
+    }
+    return wayverb::core::compute_context{cl::Context{devices.front().device},
+                                          devices.front().device};
+}
+
+/// The devices jobs are rendered on: everything WAYVERB_DEVICES (and so
+/// --devices) selects, or else just `compute_context`.
+std::vector<std::string> rendering_devices(
+        const wayverb::core::compute_context& compute_context) {
+    const auto selection = wayverb::core::device_selection_from_environment();
+    if (!selection) {
+        return {compute_context.device.getInfo<CL_DEVICE_NAME>()};
+    }
+    const auto devices = wayverb::core::select_devices(*selection);
+    if (devices.empty()) {
+        throw std::runtime_error{"WAYVERB_DEVICES doesn't match any device."};
+    }
+    std::vector<std::string> ret;
+    for (const auto& device : devices) {
+        ret.push_back(device.name);
+    }
+    return ret;
+}
+
+//  manifest  //////////////////////////////////////////////////////////////////
+
+struct output_settings final {
+    std::string directory;
+    std::string format;
+    std::string bit_depth;
+    double sample_rate{};
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("directory", directory),
+                cereal::make_nvp("format", format),
+                cereal::make_nvp("bit_depth", bit_depth),
+                cereal::make_nvp("sample_rate", sample_rate));
+    }
+};
+
+struct job final {
+    std::string name;
+    std::string scene;
+    output_settings output;
+    wayverb::combined::model::persistent persistent;
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("name", name),
+                cereal::make_nvp("scene", scene),
+                cereal::make_nvp("output", output),
+                cereal::make_nvp("persistent", persistent));
+    }
+};
+
+std::vector<job> load_manifest(const std::string& path) {
+    std::ifstream stream{path};
+    if (!stream) {
+        throw std::runtime_error{
+                util::build_string("Can't open manifest: ", path)};
+    }
+    std::vector<job> ret;
+    cereal::JSONInputArchive archive{stream};
+    archive(cereal::make_nvp("jobs", ret));
+    return ret;
+}
+
+std::string resolve(const fs::path& base, const std::string& path) {
+    const fs::path p{path};
+    return (p.is_absolute() ? p : base / p).lexically_normal().string();
+}
+
+wayverb::combined::model::output make_output(const output_settings& settings,
+                                             const std::string& directory,
+                                             const std::string& name) {
+    using wayverb::combined::model::output;
+    output ret;
+    ret.set_output_directory(directory);
+    ret.set_unique_id(name);
+
+    if (settings.format == "wav") {
+        ret.set_format(audio_file::format::wav);
+    } else if (settings.format == "aif") {
+        ret.set_format(audio_file::format::aif);
+    } else {
+        throw std::runtime_error{util::build_string(
+                "Unknown output format: ", settings.format)};
+    }
+
+    if (settings.bit_depth == "pcm16") {
+        ret.set_bit_depth(audio_file::bit_depth::pcm16);
+    } else if (settings.bit_depth == "pcm24") {
+        ret.set_bit_depth(audio_file::bit_depth::pcm24);
+    } else if (settings.bit_depth == "pcm32") {
+        ret.set_bit_depth(audio_file::bit_depth::pcm32);
+    } else if (settings.bit_depth == "float32") {
+        ret.set_bit_depth(audio_file::bit_depth::float32);
+    } else {
+        throw std::runtime_error{util::build_string(
+                "Unknown bit depth: ", settings.bit_depth)};
+    }
+
+    for (const auto sr : {output::sample_rate::sr44_1KHz,
+                          output::sample_rate::sr48KHz,
+                          output::sample_rate::sr88_2KHz,
+                          output::sample_rate::sr96KHz,
+                          output::sample_rate::sr192KHz}) {
+        if (wayverb::combined::model::get_sample_rate(sr) ==
+            settings.sample_rate) {
+            ret.set_sample_rate(sr);
+            return ret;
+        }
+    }
+    throw std::runtime_error{util::build_string(
+            "Unsupported sample rate: ", settings.sample_rate)};
+}
+
+/// As the app does: each scene surface takes the material of the same name.
+wayverb::core::gpu_scene_data load_scene(
+        const std::string& path,
+        const wayverb::combined::model::persistent& persistent) {
+    wayverb::core::scene_data_loader loader{path};
+    const auto& scene = loader.get_scene_data();
+    if (!scene) {
+        throw std::runtime_error{
+                util::build_string("Failed to load scene: ", path)};
+    }
+
+    util::aligned::unordered_map<
+            std::string,
+            wayverb::core::surface<wayverb::core::simulation_bands>>
+            material_map;
+    for (const auto& i : *persistent.materials()) {
+        material_map[i->get_name()] = i->get_surface();
+    }
+
+    for (const auto& name : scene->get_surfaces()) {
+        if (material_map.find(name) == material_map.end()) {
+            std::cerr << "[batch] no material for surface '" << name
+                      << "', using the default surface\n";
+        }
+    }
+
+    return scene_with_extracted_surfaces(*scene, material_map);
+}
+
+//  report  ////////////////////////////////////////////////////////////////////
+
+struct state_time final {
+    std::string state;
+    double seconds{};
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("state", state),
+                cereal::make_nvp("seconds", seconds));
+    }
+};
+
+struct run_report final {
+    size_t index{};
+    std::vector<state_time> states;
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("index", index),
+                cereal::make_nvp("states", states));
+    }
+};
+
+struct output_file final {
+    std::string path;
+    std::uintmax_t bytes{};
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("path", path),
+                cereal::make_nvp("bytes", bytes));
+    }
+};
+
+struct job_report final {
+    std::string name;
+    std::string scene;
+    std::string status = "failed";
+    std::vector<std::string> errors;
+    double setup_seconds{};
+    double render_seconds{};
+    std::vector<run_report> runs;
+    std::vector<output_file> outputs;
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("name", name),
+                cereal::make_nvp("scene", scene),
+                cereal::make_nvp("status", status),
+                cereal::make_nvp("errors", errors),
+                cereal::make_nvp("setup_seconds", setup_seconds),
+                cereal::make_nvp("render_seconds", render_seconds),
+                cereal::make_nvp("runs", runs),
+                cereal::make_nvp("outputs", outputs));
+    }
+};
+
+struct batch_report final {
+    std::string manifest;
+    std::string device;
+    std::vector<std::string> devices;
+    double total_seconds{};
+    std::vector<job_report> jobs;
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("manifest", manifest),
+                cereal::make_nvp("device", device),
+                cereal::make_nvp("devices", devices),
+                cereal::make_nvp("total_seconds", total_seconds),
+                cereal::make_nvp("jobs", jobs));
+    }
+};
+
+/// Accumulates the time each run spends in each engine state.
+/// State changes arrive from the engine's worker threads.
+class state_timer final {
+public:
+    void state_changed(size_t run,
+                       size_t runs,
+                       wayverb::combined::state state) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        const auto now = clock_type::now();
+        runs_.resize(std::max(runs_.size(), std::max(runs, run + 1)));
+        auto& r = runs_[run];
+        if (r.current && r.current->first == state) {
+            return;
+        }
+        close(r, now);
+        r.current = std::make_pair(state, now);
+    }
+
+    std::vector<run_report> finish() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        const auto now = clock_type::now();
+        std::vector<run_report> ret;
+        for (size_t i = 0; i != runs_.size(); ++i) {
+            close(runs_[i], now);
+            run_report report{i, {}};
+            for (const auto& t : runs_[i].totals) {
+                report.states.push_back(
+                        state_time{wayverb::combined::to_string(t.first),
+                                   t.second});
+            }
+            ret.push_back(std::move(report));
+        }
+        return ret;
+    }
+
+private:
+    struct run_state final {
+        std::optional<std::pair<wayverb::combined::state,
+                                clock_type::time_point>>
+                current;
+        std::map<wayverb::combined::state, double> totals;
+    };
+
+    static void close(run_state& r, clock_type::time_point now) {
+        if (r.current) {
+            r.totals[r.current->first] +=
+                    seconds_between(r.current->second, now);
+            r.current = std::nullopt;
+        }
+    }
+
+    std::mutex mutex_;
+    std::vector<run_state> runs_;
+};
+
+//  running  ///////////////////////////////////////////////////////////////////
+
+std::atomic<wayverb::combined::complete_engine*> active_engine{nullptr};
+std::atomic_bool interrupted{false};
+
+extern "C" void handle_interrupt(int) {
+    interrupted = true;
+    if (auto engine = active_engine.load()) {
+        engine->cancel();
+    }
+}
+
+job_report run_job(const wayverb::core::compute_context& compute_context,
+                   const fs::path& base,
+                   const job& j) {
+    job_report report;
+    report.name = j.name;
+    report.scene = resolve(base, j.scene);
+
+    try {
+        const auto setup_start = clock_type::now();
+        const auto directory = resolve(base, j.output.directory);
+        fs::create_directories(directory);
+        const auto output = make_output(j.output, directory, j.name);
+        auto scene = load_scene(report.scene, j.persistent);
+        report.setup_seconds = seconds_between(setup_start, clock_type::now());
+
+        std::mutex errors_mutex;
+        state_timer timer;
+        std::promise<void> done;
+
+        wayverb::combined::complete_engine engine;
+        engine.connect_engine_state_changed(
+                [&](auto run, auto runs, auto state, auto) {
+                    timer.state_changed(run, runs, state);
+                });
+        engine.connect_encountered_error([&](auto message) {
+            std::lock_guard<std::mutex> lock{errors_mutex};
+            report.errors.push_back(message);
+        });
+        engine.connect_finished([&] { done.set_value(); });
+
+        std::cout << "[batch] " << j.name << ": rendering "
+                  << report.scene << '\n';
+
+        active_engine = &engine;
+        const auto render_start = clock_type::now();
+        engine.run(compute_context, std::move(scene), j.persistent, output);
+        done.get_future().wait();
+        report.render_seconds =
+                seconds_between(render_start, clock_type::now());
+        active_engine = nullptr;
+
+        report.runs = timer.finish();
+
+        for (const auto& path :
+             wayverb::combined::model::compute_all_file_names(j.persistent,
+                                                              output)) {
+            std::error_code error;
+            const auto bytes = fs::file_size(path, error);
+            if (!error) {
+                report.outputs.push_back(output_file{path, bytes});
+            }
+        }
+
+        report.status = !report.errors.empty()
+                                ? "failed"
+                                : interrupted ? "cancelled" : "ok";
+    } catch (const std::exception& e) {
+        active_engine = nullptr;
+        report.errors.push_back(e.what());
+    }
+
+    std::cout << "[batch] " << j.name << ": " << report.status << " in "
+              << report.setup_seconds + report.render_seconds << " s\n";
+    for (const auto& error : report.errors) {
+        std::cerr << "[batch] " << j.name << ": " << error << '\n';
+    }
+
+    return report;
+}
+
+void set_environment(const char* name, const std::optional<std::string>& v) {
+    if (v) {
+        setenv(name, v->c_str(), 1);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const auto options = parse_args(argc, argv);
+
+        if (options.list_devices) {
+            list_devices();
+            return EXIT_SUCCESS;
+        }
+
+        //  The engine picks these up when each job starts.
+        set_environment("WAYVERB_DEVICES", options.devices);
+        set_environment("WAYVERB_CONCURRENT_RUNS", options.concurrency);
+        set_environment("WAYVERB_POSTPROCESS_THREADS",
+                        options.postprocess_threads);
+
+        const auto jobs = load_manifest(options.manifest_path);
+        const auto base = fs::absolute(options.manifest_path).parent_path();
+        const auto compute_context = make_compute_context(options.device);
+
+        std::signal(SIGINT, handle_interrupt);
+
+        batch_report report;
+        report.manifest = options.manifest_path;
+        report.devices = rendering_devices(compute_context);
+        report.device = report.devices.front();
+        std::cout << "[batch] rendering on " << report.devices.size()
+                  << " device(s):";
+        for (const auto& device : report.devices) {
+            std::cout << " \"" << device << '"';
+        }
+        std::cout << '\n';
+
+        const auto start = clock_type::now();
+        for (const auto& j : jobs) {
+            if (interrupted) {
+                break;
+            }
+            report.jobs.push_back(run_job(compute_context, base, j));
+        }
+        report.total_seconds = seconds_between(start, clock_type::now());
+
+        {
+            std::ofstream stream{options.report_path};
+            if (!stream) {
+                throw std::runtime_error{util::build_string(
+                        "Can't write report: ", options.report_path)};
+            }
+            cereal::JSONOutputArchive archive{stream};
+            archive(cereal::make_nvp("report", report));
+        }
+        std::cout << "[batch] report written to " << options.report_path
+                  << '\n';
+
+        const auto all_ok = std::all_of(
+                report.jobs.begin(), report.jobs.end(), [](const auto& j) {
+                    return j.status == "ok";
+                });
+        return all_ok && report.jobs.size() == jobs.size() ? EXIT_SUCCESS
+                                                           : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+        std::cerr << "Batch failed: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,663 @@
+//  Times the main stages of a render, from voxelisation through to full
+//  simulation and postprocessing, on the bundled scenes: the shoeboxes
+//  described in tests/scenes/*.json and the meshes in assets/test_geometry.
+//
+//  Each benchmark is run several times and the best and median times per
+//  operation are reported. Results can be written as JSON with --json, and
+//  two such files compared with --compare, which exits with failure if any
+//  benchmark slowed down by more than the threshold:
+//
+//      wayverb_bench --json before.json
+//      (rebuild at another commit)
+//      wayverb_bench --json after.json
+//      wayverb_bench --compare before.json after.json --threshold 0.1
+
+#include "combined/engine.h"
+#include "combined/waveguide_base.h"
+
+#include "raytracer/reflection_processor/image_source.h"
+#include "raytracer/reflector.h"
+#include "raytracer/simulation_parameters.h"
+#include "raytracer/stochastic/finder.h"
+
+#include "waveguide/config.h"
+#include "waveguide/mesh.h"
+#include "waveguide/preprocessor/soft_source.h"
+#include "waveguide/simulation_parameters.h"
+#include "waveguide/waveguide.h"
+
+#include "core/attenuator/null.h"
+#include "core/azimuth_elevation.h"
+#include "core/cl/common.h"
+#include "core/environment.h"
+#include "core/geo/box.h"
+#include "core/mixdown.h"
+#include "core/scene_data.h"
+#include "core/scene_data_loader.h"
+#include "core/spatial_division/scene_buffers.h"
+#include "core/spatial_division/voxelised_scene_data.h"
+
+#include "utilities/string_builder.h"
+
+#include "cereal/archives/json.hpp"
+#include "cereal/types/string.hpp"
+#include "cereal/types/vector.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+
+#ifndef SCENES_DIR
+#define SCENES_DIR ""
+#endif
+
+#ifndef OBJ_PATH
+#define OBJ_PATH ""
+#endif
+
+using namespace wayverb;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr auto speed_of_sound = 340.0;
+constexpr auto output_sample_rate = 44100.0;
+
+//  results  ///////////////////////////////////////////////////////////////////
+
+struct result final {
+    std::string name;
+    /// Size of the problem, e.g. nodes, rays or samples.
+    size_t items{};
+    size_t runs{};
+    double best_ms{};
+    double median_ms{};
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("name", name),
+                cereal::make_nvp("items", items),
+                cereal::make_nvp("runs", runs),
+                cereal::make_nvp("best_ms", best_ms),
+                cereal::make_nvp("median_ms", median_ms));
+    }
+};
+
+struct report final {
+    std::string label;
+    std::string device;
+    std::vector<result> results;
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("label", label),
+                cereal::make_nvp("device", device),
+                cereal::make_nvp("results", results));
+    }
+};
+
+void write_report(const std::string& path, const report& r) {
+    std::ofstream stream{path};
+    if (!stream) {
+        throw std::runtime_error{util::build_string("Can't write ", path)};
+    }
+    cereal::JSONOutputArchive archive{stream};
+    archive(cereal::make_nvp("report", r));
+}
+
+report read_report(const std::string& path) {
+    std::ifstream stream{path};
+    if (!stream) {
+        throw std::runtime_error{util::build_string("Can't read ", path)};
+    }
+    report ret;
+    cereal::JSONInputArchive archive{stream};
+    archive(cereal::make_nvp("report", ret));
+    return ret;
+}
+
+/// Prints the change in best time of each benchmark present in both reports.
+/// Returns false if any got slower by more than `threshold` (a fraction).
+bool compare_reports(const report& before,
+                     const report& after,
+                     double threshold) {
+    std::map<std::string, double> previous;
+    for (const auto& r : before.results) {
+        previous[r.name] = r.best_ms;
+    }
+
+    std::cout << "before: " << before.label << " (" << before.device << ")\n"
+              << "after:  " << after.label << " (" << after.device << ")\n\n";
+    std::cout << std::left << std::setw(48) << "benchmark" << std::right
+              << std::setw(14) << "before ms" << std::setw(14) << "after ms"
+              << std::setw(10) << "ratio" << '\n';
+
+    auto ok = true;
+    for (const auto& r : after.results) {
+        const auto it = previous.find(r.name);
+        if (it == previous.end()) {
+            std::cout << std::left << std::setw(48) << r.name << std::right
+                      << std::setw(14) << "-" << std::setw(14) << std::fixed
+                      << std::setprecision(3) << r.best_ms << "    new\n";
+            continue;
+        }
+        const auto ratio = r.best_ms / it->second;
+        const auto regressed = threshold < ratio - 1;
+        ok = ok && !regressed;
+        std::cout << std::left << std::setw(48) << r.name << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(14)
+                  << it->second << std::setw(14) << r.best_ms << std::setw(9)
+                  << std::setprecision(2) << ratio << 'x'
+                  << (regressed ? "  REGRESSION" : "") << '\n';
+    }
+    return ok;
+}
+
+//  timing  ////////////////////////////////////////////////////////////////////
+
+class bench final {
+public:
+    bench(size_t runs, std::string filter)
+            : runs_{std::max<size_t>(1, runs)}
+            , filter_{std::move(filter)} {}
+
+    bool enabled(const std::string& name) const {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+
+    /// `func` returns how many operations it performed, e.g. waveguide
+    /// steps; reported times are per operation.
+    template <typename Func>
+    void measure(const std::string& name,
+                 size_t items,
+                 Func&& func,
+                 size_t runs = 0) {
+        if (!enabled(name)) {
+            return;
+        }
+        runs = runs ? runs : runs_;
+
+        std::vector<double> times;
+        for (size_t i = 0; i != runs; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            const size_t operations = func();
+            const auto end = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::milli>(end -
+                                                                      start)
+                                    .count() /
+                            std::max<size_t>(1, operations));
+        }
+        std::sort(times.begin(), times.end());
+
+        result r{name, items, runs, times.front(), times[times.size() / 2]};
+        std::cout << std::left << std::setw(48) << r.name << std::right
+                  << std::setw(12) << r.items << std::fixed
+                  << std::setprecision(3) << std::setw(14) << r.best_ms
+                  << std::setw(14) << r.median_ms << '\n';
+        results_.push_back(std::move(r));
+    }
+
+    const std::vector<result>& get_results() const { return results_; }
+
+private:
+    size_t runs_;
+    std::string filter_;
+    std::vector<result> results_;
+};
+
+//  scenes  ////////////////////////////////////////////////////////////////////
+
+struct scene final {
+    std::string name;
+    core::gpu_scene_data data;
+    glm::vec3 source;
+    glm::vec3 receiver;
+};
+
+/// The analytic shoeboxes used for validation, with uniform absorption.
+struct shoebox_description final {
+    std::string name;
+    std::vector<double> dims_m;
+    double alpha_bar_1k{};
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(cereal::make_nvp("name", name),
+                cereal::make_nvp("dims_m", dims_m),
+                cereal::make_nvp("alpha_bar_1k", alpha_bar_1k));
+    }
+};
+
+scene load_shoebox(const std::string& path) {
+    shoebox_description description;
+    {
+        std::ifstream stream{path};
+        cereal::JSONInputArchive archive{stream};
+        archive(description);
+    }
+    if (description.dims_m.size() != 3) {
+        throw std::runtime_error{
+                util::build_string("Expected three dimensions in ", path)};
+    }
+
+    const glm::vec3 dims{description.dims_m[0],
+                         description.dims_m[1],
+                         description.dims_m[2]};
+    return scene{
+            description.name,
+            core::geo::get_scene_data(
+                    core::geo::box{glm::vec3{0}, dims},
+                    core::make_surface<core::simulation_bands>(
+                            description.alpha_bar_1k, 0.1)),
+            dims * glm::vec3{0.3, 0.4, 0.5},
+            dims * glm::vec3{0.6, 0.5, 0.4}};
+}
+
+scene load_mesh(const std::string& path) {
+    const auto loaded = core::scene_data_loader{path}.get_scene_data();
+    if (!loaded) {
+        throw std::runtime_error{util::build_string("Can't load ", path)};
+    }
+    auto data = core::make_scene_data(
+            loaded->get_triangles(),
+            loaded->get_vertices(),
+            util::aligned::vector<core::surface<core::simulation_bands>>(
+                    loaded->get_surfaces().size(),
+                    core::make_surface<core::simulation_bands>(0.2, 0.1)));
+    const auto c = centre(core::geo::compute_aabb(data.get_vertices()));
+    return scene{fs::path{path}.stem().string(),
+                 std::move(data),
+                 c + glm::vec3{0, 0, 0.2},
+                 c + glm::vec3{0, 0, -0.2}};
+}
+
+std::vector<scene> load_scenes() {
+    std::vector<std::string> shoeboxes;
+    if (fs::is_directory(SCENES_DIR)) {
+        for (const auto& entry : fs::directory_iterator{SCENES_DIR}) {
+            if (entry.path().extension() == ".json") {
+                shoeboxes.push_back(entry.path().string());
+            }
+        }
+    }
+    //  Keep the output order stable, so that reports diff cleanly.
+    std::sort(shoeboxes.begin(), shoeboxes.end());
+
+    std::vector<scene> ret;
+    for (const auto& path : shoeboxes) {
+        ret.push_back(load_shoebox(path));
+    }
+    if (fs::is_regular_file(OBJ_PATH)) {
+        ret.push_back(load_mesh(OBJ_PATH));
+    }
+    return ret;
+}
+
+//  benchmarks  ////////////////////////////////////////////////////////////////
+
+using voxelised_scene =
+        core::voxelised_scene_data<cl_float3,
+                                   core::surface<core::simulation_bands>>;
+
+void bench_geometry(bench& b,
+                    const core::compute_context& cc,
+                    const scene& s) {
+    b.measure("voxelise/" + s.name, s.data.get_triangles().size(), [&] {
+        const auto voxelised = core::make_voxelised_scene_data(s.data, 5, 0.1f);
+        return 1;
+    });
+
+    b.measure("mesh_setup/" + s.name, s.data.get_triangles().size(), [&] {
+        const auto voxels_and_mesh = waveguide::compute_voxels_and_mesh(
+                cc, s.data, s.receiver, 4000, speed_of_sound);
+        return 1;
+    });
+}
+
+void bench_waveguide(bench& b,
+                     const core::compute_context& cc,
+                     const scene& s,
+                     size_t steps) {
+    for (const auto sample_rate : {2000.0, 4000.0, 8000.0}) {
+        const auto name = util::build_string(
+                "waveguide_step/", s.name, '/', sample_rate, "Hz");
+        if (!b.enabled(name)) {
+            continue;
+        }
+
+        const auto voxels_and_mesh = waveguide::compute_voxels_and_mesh(
+                cc, s.data, s.receiver, sample_rate, speed_of_sound);
+        const auto& mesh = voxels_and_mesh.mesh;
+        const auto source = waveguide::compute_index(mesh.get_descriptor(),
+                                                     s.source);
+
+        util::aligned::vector<float> input(steps, 0.0f);
+        input.front() = 1.0f;
+        const std::atomic_bool keep_going{true};
+
+        b.measure(name,
+                  mesh.get_structure().get_condensed_nodes().size(),
+                  [&] {
+                      auto prep = waveguide::preprocessor::make_soft_source(
+                              source, begin(input), end(input));
+                      return waveguide::run(
+                              cc,
+                              mesh,
+                              prep,
+                              [](auto&, const auto&, auto) {},
+                              keep_going);
+                  });
+    }
+}
+
+void bench_raytracer(bench& b,
+                     const core::compute_context& cc,
+                     const scene& s,
+                     size_t rays) {
+    if (!(b.enabled("reflector_step/" + s.name) ||
+          b.enabled("finder/" + s.name))) {
+        return;
+    }
+
+    const auto voxelised = core::make_voxelised_scene_data(s.data, 5, 0.1f);
+    const core::scene_buffers buffers{cc.context, voxelised};
+
+    const auto directions = core::get_random_directions(rays);
+    const auto initial_rays = raytracer::get_rays_from_directions(
+            begin(directions), end(directions), s.source);
+
+    //  Each run traces one bounce further, from where the last one ended.
+    raytracer::reflector reflector{
+            cc, s.receiver, begin(initial_rays), end(initial_rays)};
+    b.measure("reflector_step/" + s.name, rays, [&] {
+        reflector.run_step(buffers);
+        return 1;
+    });
+
+    const auto receiver_radius = 0.1f;
+    raytracer::stochastic::finder finder{
+            cc,
+            rays,
+            s.source,
+            s.receiver,
+            receiver_radius,
+            raytracer::stochastic::compute_ray_energy(
+                    rays, s.source, s.receiver, receiver_radius)};
+    const auto reflections = reflector.get_reflections();
+    b.measure("finder/" + s.name, rays, [&] {
+        finder.process(begin(reflections), end(reflections), buffers);
+        return 1;
+    });
+}
+
+/// Validates the paths of up to `order` reflections found by a fixed number
+/// of rays, as a render does. Enumerating every triangle sequence instead
+/// grows with the cube of the triangle count at order 3, which no real scene
+/// can finish.
+void bench_image_source(bench& b,
+                        const core::compute_context& cc,
+                        const scene& s,
+                        size_t order) {
+    const auto name = util::build_string("image_source/", s.name, '/', order);
+    if (!b.enabled(name)) {
+        return;
+    }
+
+    constexpr size_t rays = 1 << 14;
+
+    const auto voxelised = core::make_voxelised_scene_data(s.data, 5, 0.1f);
+    const core::scene_buffers buffers{cc.context, voxelised};
+
+    const auto directions = core::get_random_directions(rays);
+    const auto initial_rays = raytracer::get_rays_from_directions(
+            begin(directions), end(directions), s.source);
+
+    const raytracer::reflection_processor::make_image_source make_processor{
+            order};
+    const auto prototype = make_processor.get_processor(
+            cc, s.source, s.receiver, core::environment{}, voxelised);
+    auto group = prototype.get_group_processor(rays, cc);
+
+    raytracer::reflector reflector{
+            cc, s.receiver, begin(initial_rays), end(initial_rays)};
+    for (size_t step = 0; step != order; ++step) {
+        const auto reflections = reflector.run_step(buffers);
+        group.process(
+                begin(reflections), end(reflections), buffers, step, order);
+    }
+    const auto paths = group.get_results().size();
+
+    b.measure(name, paths, [&] {
+        auto processor = make_processor.get_processor(
+                cc, s.source, s.receiver, core::environment{}, voxelised);
+        processor.accumulate(group);
+        const auto results = processor.get_results();
+        return 1;
+    });
+}
+
+void bench_dsp(bench& b) {
+    constexpr auto bands = core::simulation_bands;
+    std::default_random_engine engine{0};
+    std::uniform_real_distribution<float> dist{-1, 1};
+
+    for (const auto power : {16, 20}) {
+        util::aligned::vector<std::array<float, bands>> input(1ul << power);
+        for (auto& frame : input) {
+            for (auto& sample : frame) {
+                sample = dist(engine);
+            }
+        }
+        b.measure(util::build_string("multiband_filter/", input.size()),
+                  input.size(),
+                  [&] {
+                      auto copy = input;
+                      core::multiband_filter_and_mixdown(
+                              begin(copy),
+                              end(copy),
+                              output_sample_rate,
+                              frequency_domain::make_indexer_iterator{});
+                      return 1;
+                  });
+    }
+
+    const auto waveguide_sample_rate =
+            waveguide::compute_sampling_frequency(1000.0, 0.6);
+    util::aligned::vector<float> signal(10 * waveguide_sample_rate);
+    for (auto& sample : signal) {
+        sample = dist(engine);
+    }
+    b.measure(util::build_string("resample/",
+                                 static_cast<int>(waveguide_sample_rate),
+                                 "Hz_to_",
+                                 static_cast<int>(output_sample_rate),
+                                 "Hz"),
+              signal.size(),
+              [&] {
+                  waveguide::adjust_sampling_rate(
+                          signal, waveguide_sample_rate, output_sample_rate);
+                  return 1;
+              });
+}
+
+void bench_pipeline(bench& b,
+                    const core::compute_context& cc,
+                    const scene& s,
+                    size_t runs) {
+    const auto simulate_name = "pipeline/" + s.name + "/simulate";
+    const auto postprocess_name = "pipeline/" + s.name + "/postprocess";
+    if (!(b.enabled(simulate_name) || b.enabled(postprocess_name))) {
+        return;
+    }
+
+    const combined::engine engine{
+            cc,
+            s.data,
+            s.source,
+            s.receiver,
+            core::environment{},
+            raytracer::simulation_parameters{1 << 14, 3},
+            combined::make_waveguide_ptr(
+                    waveguide::single_band_parameters{500, 0.6})};
+
+    const std::atomic_bool keep_going{true};
+    std::unique_ptr<combined::intermediate> intermediate;
+    b.measure(simulate_name,
+              1,
+              [&] {
+                  intermediate = engine.run(keep_going);
+                  return 1;
+              },
+              runs);
+
+    if (!intermediate) {
+        //  Simulation was filtered out, so get something to postprocess.
+        intermediate = engine.run(keep_going);
+    }
+    if (!intermediate) {
+        throw std::runtime_error{"Engine returned no results for " + s.name};
+    }
+    b.measure(postprocess_name, 1, [&] {
+        intermediate->postprocess(core::attenuator::null{},
+                                  output_sample_rate);
+        return 1;
+    });
+}
+
+//  options  ///////////////////////////////////////////////////////////////////
+
+struct bench_options final {
+    size_t runs = 5;
+    size_t pipeline_runs = 1;
+    size_t waveguide_steps = 200;
+    size_t rays = 1 << 16;
+    size_t image_source_order = 3;
+    std::string filter;
+    std::string label;
+    std::string json_path;
+    std::vector<std::string> compare;
+    double threshold = 0.1;
+};
+
+void print_usage(const char* exe) {
+    std::cout << "Usage: " << exe << " [options]\n"
+              << "       " << exe
+              << " --compare <before.json> <after.json> [--threshold <x>]\n\n"
+              << "Options:\n"
+              << "  --runs <N>              Runs per benchmark (default 5)\n"
+              << "  --pipeline-runs <N>     Runs per full render (default 1)\n"
+              << "  --steps <N>             Waveguide steps per run (default "
+                 "200)\n"
+              << "  --rays <N>              Raytracer rays (default 65536)\n"
+              << "  --order <N>             Image-source order (default 3)\n"
+              << "  --filter <text>         Only run benchmarks whose name "
+                 "contains text\n"
+              << "  --label <text>          Stored in the report, e.g. a "
+                 "commit id\n"
+              << "  --json <path>           Write results as JSON\n"
+              << "  --threshold <x>         Slowdown treated as a regression "
+                 "by --compare (default 0.1)\n"
+              << "  -h, --help              Show this message\n";
+}
+
+bench_options parse_args(int argc, char** argv) {
+    bench_options opts;
+    auto require_value = [&](int& index) -> const char* {
+        if (index + 1 >= argc) {
+            throw std::runtime_error{
+                    util::build_string("Missing value for option ",
+                                       argv[index])};
+        }
+        return argv[++index];
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--runs") {
+            opts.runs = std::stoul(require_value(i));
+        } else if (arg == "--pipeline-runs") {
+            opts.pipeline_runs = std::stoul(require_value(i));
+        } else if (arg == "--steps") {
+            opts.waveguide_steps = std::stoul(require_value(i));
+        } else if (arg == "--rays") {
+            opts.rays = std::stoul(require_value(i));
+        } else if (arg == "--order") {
+            opts.image_source_order = std::stoul(require_value(i));
+        } else if (arg == "--filter") {
+            opts.filter = require_value(i);
+        } else if (arg == "--label") {
+            opts.label = require_value(i);
+        } else if (arg == "--json") {
+            opts.json_path = require_value(i);
+        } else if (arg == "--compare") {
+            opts.compare.push_back(require_value(i));
+            opts.compare.push_back(require_value(i));
+        } else if (arg == "--threshold") {
+            opts.threshold = std::stod(require_value(i));
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        } else {
+            throw std::runtime_error{
+                    util::build_string("Unknown option: ", arg)};
+        }
+    }
+
+    return opts;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const auto options = parse_args(argc, argv);
+
+        if (!options.compare.empty()) {
+            return compare_reports(read_report(options.compare[0]),
+                                   read_report(options.compare[1]),
+                                   options.threshold)
+                           ? EXIT_SUCCESS
+                           : EXIT_FAILURE;
+        }
+
+        const core::compute_context cc{};
+        const auto scenes = load_scenes();
+
+        std::cout << std::left << std::setw(48) << "benchmark" << std::right
+                  << std::setw(12) << "items" << std::setw(14) << "best ms"
+                  << std::setw(14) << "median ms" << '\n';
+
+        bench b{options.runs, options.filter};
+        bench_dsp(b);
+        for (const auto& s : scenes) {
+            bench_geometry(b, cc, s);
+            bench_waveguide(b, cc, s, options.waveguide_steps);
+            bench_raytracer(b, cc, s, options.rays);
+            bench_image_source(b, cc, s, options.image_source_order);
+            bench_pipeline(b, cc, s, options.pipeline_runs);
+        }
+
+        if (!options.json_path.empty()) {
+            write_report(options.json_path,
+                         report{options.label,
+                                cc.device.getInfo<CL_DEVICE_NAME>(),
+                                b.get_results()});
+        }
+        return EXIT_SUCCESS;
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
@@ -1,64 +1,38 @@
 #!/bin/bash
 # Performance benchmark for Phiverb
+#
+# Runs wayverb_bench and stores its results under build/bench/<commit>.json.
+# If a previous result is given, compares against it and fails on regressions:
+#
+#   scripts/benchmark.sh                      # record the current commit
+#   scripts/benchmark.sh build/bench/abc.json # record, then compare with abc
 
-echo "⚡ Phiverb Performance Benchmark"
-echo "================================"
+set -e
 
-# System info
-if command -v system_profiler &> /dev/null; then
-    echo "System: $(system_profiler SPHardwareDataType 2>/dev/null | grep 'Chip' | awk '{print $2, $3, $4}')"
-    echo "Memory: $(system_profiler SPHardwareDataType 2>/dev/null | grep 'Memory' | awk '{print $2, $3}')"
-else
-    echo "System: $(uname -m)"
-    echo "Memory: $(free -h 2>/dev/null | grep Mem | awk '{print $2}' || echo 'N/A')"
-fi
-echo ""
+BUILD_DIR="${BUILD_DIR:-build}"
+BENCH="$BUILD_DIR/bin/wayverb_bench/wayverb_bench"
+THRESHOLD="${THRESHOLD:-0.1}"
 
-# Benchmark configurations
-SCENES=("simple_cube.obj" "concert_hall.obj" "cathedral.obj")
-METHODS=("raytracing" "waveguide" "hybrid")
+echo "⚡ Phiverb Performance Benchmark"
+echo "================================"
 
-# Check if build directory exists
-if [ ! -d "build/bin" ]; then
-    echo "❌ Build directory not found. Please run cmake and build first."
+if [ ! -x "$BENCH" ]; then
+    echo "❌ $BENCH not found. Build the wayverb_bench target first."
     exit 1
 fi
 
-# Check for wayverb CLI binary
-if [ ! -x "build/bin/wayverb_cli" ]; then
-    echo "⚠️  wayverb_cli not found. Skipping benchmarks."
-    exit 0
-fi
+COMMIT="$(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+OUT_DIR="$BUILD_DIR/bench"
+OUT="$OUT_DIR/$COMMIT.json"
+mkdir -p "$OUT_DIR"
 
-for scene in "${SCENES[@]}"; do
-    # Check if scene exists
-    if [ ! -f "data/scenes/$scene" ] && [ ! -f "tests/scenes/$scene" ]; then
-        echo "⚠️  Scene not found: $scene (skipping)"
-        continue
-    fi
-    
-    echo "📐 Scene: $scene"
-    for method in "${METHODS[@]}"; do
-        echo -n "  $method: "
-        
-        # Run benchmark
-        START=$(date +%s%N 2>/dev/null || date +%s)
-        ./build/bin/wayverb_cli \
-            --scene "data/scenes/$scene" \
-            --method "$method" \
-            --output "/tmp/benchmark_output.wav" \
-            --quiet 2>/dev/null || echo "N/A"
-        END=$(date +%s%N 2>/dev/null || date +%s)
-        
-        # Calculate time in milliseconds
-        if command -v bc &> /dev/null; then
-            ELAPSED=$(echo "scale=0; ($END - $START) / 1000000" | bc)
-            echo "${ELAPSED}ms"
-        else
-            echo "completed"
-        fi
-    done
+"$BENCH" --label "$COMMIT" --json "$OUT" "${@:2}"
+echo ""
+echo "📄 Results written to $OUT"
+
+if [ -n "$1" ]; then
     echo ""
-done
+    "$BENCH" --compare "$1" "$OUT" --threshold "$THRESHOLD"
+fi
 
 echo "✅ Benchmark completed"
@@ -6,6 +6,10 @@
 
 #include <memory>
 
+namespace util {
+class thread_pool;
+}  // namespace util
+
 namespace wayverb {
 
 namespace core {
@@ -32,6 +36,10 @@ public:
     virtual std::unique_ptr<capsule_base> clone() const = 0;
     virtual util::aligned::vector<float> postprocess(
             const intermediate& intermediate, double sample_rate) const = 0;
+    virtual util::aligned::vector<float> postprocess(
+            const intermediate& intermediate,
+            double sample_rate,
+            util::thread_pool& pool) const = 0;
 };
 
 std::unique_ptr<capsule_base> make_capsule_ptr(
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "utilities/aligned/vector.h"
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+namespace wayverb {
+namespace combined {
+
+/// A fresh directory in which to stage rendered channels, inside
+/// WAYVERB_STAGING_DIR or else the system temporary directory. Each call
+/// names a new directory, so concurrent renders never share files.
+std::string select_staging_directory();
+
+/// Holds rendered channels on disk as raw float32 files until every channel
+/// is known, so that they can be normalised together without keeping them
+/// all in memory. The peak magnitude of everything added is tracked as
+/// channels arrive.
+/// Channels may be added from several threads at once.
+class channel_staging final {
+public:
+    /// Creates `directory` if needed. Staged files, and the directory if it
+    /// was created, are removed on destruction.
+    explicit channel_staging(std::string directory);
+
+    channel_staging(const channel_staging&) = delete;
+    channel_staging& operator=(const channel_staging&) = delete;
+    channel_staging(channel_staging&&) noexcept = delete;
+    channel_staging& operator=(channel_staging&&) noexcept = delete;
+
+    ~channel_staging() noexcept;
+
+    /// Returns the index by which the channel can be read back.
+    size_t add(const util::aligned::vector<float>& channel);
+
+    /// Overwrites a staged channel. The peak only ever grows, so this is
+    /// meant for adding to a channel rather than shrinking it.
+    void replace(size_t index, const util::aligned::vector<float>& channel);
+
+    util::aligned::vector<float> read(size_t index) const;
+
+    /// Deletes a staged channel once it is no longer needed.
+    void remove(size_t index);
+
+    /// The largest magnitude of any sample added so far.
+    double get_peak() const;
+
+    size_t size() const;
+
+private:
+    std::string get_path(size_t index) const;
+
+    std::string directory_;
+    bool created_directory_{false};
+
+    mutable std::mutex mutex_;
+    size_t channels_{0};
+    double peak_{0};
+};
+
+}  // namespace combined
+}  // namespace wayverb
@@ -9,8 +9,13 @@
 
 #include "glm/fwd.hpp"
 
+#include <iosfwd>
 #include <memory>
 
+namespace util {
+class thread_pool;
+}  // namespace util
+
 namespace wayverb {
 
 //  forward declarations  //////////////////////////////////////////////////////
@@ -85,8 +90,33 @@ public:
     /// Takes attenuator and sample rate.
     virtual util::aligned::vector<float> postprocess(
             const core::attenuator::microphone&, double) const = 0;
+
+    /// Takes attenuator, sample rate, and a pool on which to run the
+    /// per-band and per-method processing.
+    virtual util::aligned::vector<float> postprocess(
+            const core::attenuator::null&,
+            double,
+            util::thread_pool&) const = 0;
+
+    virtual util::aligned::vector<float> postprocess(
+            const core::attenuator::hrtf&,
+            double,
+            util::thread_pool&) const = 0;
+
+    virtual util::aligned::vector<float> postprocess(
+            const core::attenuator::microphone&,
+            double,
+            util::thread_pool&) const = 0;
+
+    /// Writes the simulation results in a binary format, so that they can
+    /// be postprocessed again without re-simulating.
+    virtual void save(std::ostream&) const = 0;
 };
 
+/// Reads results written by intermediate::save.
+/// Throws if the stream doesn't hold compatible results.
+std::unique_ptr<intermediate> load_intermediate(std::istream&);
+
 //  engine  ////////////////////////////////////////////////////////////////////
 
 class engine final {
@@ -134,6 +164,13 @@ public:
 
     const waveguide::voxels_and_mesh& get_voxels_and_mesh() const;
 
+    //  devices  ///////////////////////////////////////////////////////////////
+
+    /// The raytracer spreads its segments over these. By default it uses
+    /// just the engine's own compute context.
+    void set_raytracer_devices(
+            util::aligned::vector<core::compute_context> devices);
+
 private:
     class impl;
     std::unique_ptr<impl> pimpl_;
@@ -5,11 +5,52 @@
 #include "combined/forwarding_call.h"
 
 #include "utilities/optional.h"
+#include "utilities/thread_pool.h"
+
+#include <optional>
 
 namespace wayverb {
 namespace combined {
 
+/// The number of postprocessing workers to use if none is specified.
+/// Reads WAYVERB_POSTPROCESS_THREADS, falling back to the hardware thread
+/// count.
+size_t default_postprocess_workers();
+
+/// Runs each capsule's postprocessing on `pool`, returning one channel per
+/// capsule in capsule order. Nothing if cancelled.
+template <typename It>
+std::optional<util::aligned::vector<util::aligned::vector<float>>>
+postprocess_capsules(const intermediate& results,
+                     It b_capsules,
+                     It e_capsules,
+                     double sample_rate,
+                     const std::atomic_bool& keep_going,
+                     util::thread_pool& pool) {
+    auto processed = util::parallel_map(
+            pool, std::distance(b_capsules, e_capsules), [&](auto i) {
+                if (!keep_going) {
+                    return util::aligned::vector<float>{};
+                }
+                const auto& capsule = *std::next(b_capsules, i);
+                return capsule->postprocess(results, sample_rate, pool);
+            });
+
+    if (!keep_going) {
+        return std::nullopt;
+    }
+
+    return util::aligned::vector<util::aligned::vector<float>>(
+            std::make_move_iterator(begin(processed)),
+            std::make_move_iterator(end(processed)));
+}
+
 /// Similar to `engine` but immediately runs the postprocessing step.
+/// Postprocessing runs capsules, bands and methods (waveguide, image-source,
+/// stochastic) as tasks on a bounded pool. Results are always assembled in
+/// the same order, so output does not depend on the worker count.
+/// The pool is started by the first call to run(), so an engine which is
+/// only asked to simulate holds no idle workers.
 
 class postprocessing_engine final {
 public:
@@ -19,7 +60,9 @@ public:
                           const glm::vec3& receiver,
                           const core::environment& environment,
                           const raytracer::simulation_parameters& raytracer,
-                          std::unique_ptr<waveguide_base> waveguide);
+                          std::unique_ptr<waveguide_base> waveguide,
+                          size_t postprocess_workers =
+                                  default_postprocess_workers());
 
     postprocessing_engine(const postprocessing_engine&) = delete;
     postprocessing_engine(postprocessing_engine&&) noexcept = delete;
@@ -27,6 +70,10 @@ public:
     postprocessing_engine& operator=(const postprocessing_engine&) = delete;
     postprocessing_engine& operator=(postprocessing_engine&&) noexcept = delete;
 
+    /// Runs the simulation, forwarding notifications, and returns results
+    /// ready for postprocessing. nullptr if cancelled.
+    std::unique_ptr<intermediate> simulate(const std::atomic_bool& keep_going);
+
     template <typename It>
     std::optional<
             util::aligned::vector<util::aligned::vector<float>>>
@@ -34,34 +81,7 @@ public:
         It e_capsules,
         double sample_rate,
         const std::atomic_bool& keep_going) {
-        //  Only add engine listeners if things are listening to this object.
-
-        engine_state_changed::scoped_connection state;
-        if (!engine_state_changed_.empty()) {
-            state = engine_state_changed::scoped_connection{
-                    engine_.connect_engine_state_changed(
-                            make_forwarding_call(engine_state_changed_))};
-        }
-
-        waveguide_node_pressures_changed::scoped_connection pressures;
-        if (!waveguide_node_pressures_changed_.empty()) {
-            pressures = waveguide_node_pressures_changed::scoped_connection{
-                    engine_.connect_waveguide_node_pressures_changed(
-                            make_forwarding_call(
-                                    waveguide_node_pressures_changed_))};
-        }
-
-        raytracer_reflections_generated::scoped_connection reflections;
-        if (!raytracer_reflections_generated_.empty()) {
-            reflections = raytracer_reflections_generated::scoped_connection{
-                    engine_.connect_raytracer_reflections_generated(
-                            make_forwarding_call(
-                                    raytracer_reflections_generated_))};
-        }
-
-        //  Start running.
-
-        const auto intermediate = engine_.run(keep_going);
+        const auto intermediate = simulate(keep_going);
 
         if (intermediate == nullptr) {
             return std::nullopt;
@@ -69,17 +89,15 @@ public:
 
         engine_state_changed_(state::postprocessing, 1.0);
 
-        util::aligned::vector<util::aligned::vector<float>> channels;
-        for (auto it = b_capsules; it != e_capsules && keep_going; ++it) {
-            channels.emplace_back(
-                    (*it)->postprocess(*intermediate, sample_rate));
+        if (!postprocess_pool_) {
+            postprocess_pool_.emplace(postprocess_workers_);
         }
-
-        if (!keep_going) {
-            return std::nullopt;
-        }
-
-        return channels;
+        return postprocess_capsules(*intermediate,
+                                    b_capsules,
+                                    e_capsules,
+                                    sample_rate,
+                                    keep_going,
+                                    *postprocess_pool_);
     }
 
     //  notifications
@@ -105,8 +123,16 @@ public:
 
     const waveguide::voxels_and_mesh& get_voxels_and_mesh() const;
 
+    //  devices
+
+    /// See engine::set_raytracer_devices.
+    void set_raytracer_devices(
+            util::aligned::vector<core::compute_context> devices);
+
 private:
     engine engine_;
+    size_t postprocess_workers_;
+    std::optional<util::thread_pool> postprocess_pool_;
 
     engine_state_changed engine_state_changed_;
     waveguide_node_pressures_changed waveguide_node_pressures_changed_;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "combined/engine.h"
+
+#include "core/gpu_scene_data.h"
+
+#include "glm/fwd.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace wayverb {
+namespace combined {
+
+/// Identifies the results of simulating one source-receiver pair: a hash of
+/// the scene, positions, environment and simulation parameters, and of a
+/// version number for the simulation code itself.
+/// Capsules and output sample rate are applied during postprocessing, so
+/// they don't take part.
+std::uint64_t compute_intermediate_key(
+        const core::gpu_scene_data& scene_data,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::environment& environment,
+        const raytracer::simulation_parameters& raytracer,
+        const waveguide_base& waveguide);
+
+/// The directory in which to cache intermediate results, from
+/// WAYVERB_CACHE_DIR. Caching is off if it isn't set.
+std::optional<std::string> select_intermediate_cache_directory();
+
+/// Keeps simulation results on disk, so that changing only capsules or the
+/// output sample rate skips straight to postprocessing.
+/// Entries are written to a temporary file and then renamed, so concurrent
+/// runs and interrupted writes never leave a partial entry behind.
+class intermediate_cache final {
+public:
+    /// Creates `directory` if needed.
+    explicit intermediate_cache(std::string directory);
+
+    /// nullptr if there is no usable entry for `key`.
+    std::unique_ptr<intermediate> load(std::uint64_t key) const;
+
+    /// Failures are logged rather than thrown, as the results are still good.
+    void store(std::uint64_t key, const intermediate& results) const;
+
+private:
+    std::string get_path(std::uint64_t key) const;
+
+    std::string directory_;
+};
+
+}  // namespace combined
+}  // namespace wayverb
@@ -4,12 +4,18 @@
 
 #include "raytracer/simulation_parameters.h"
 
+#include "cereal/cereal.hpp"
+
+#include <cstdint>
+
 namespace wayverb {
 namespace combined {
 namespace model {
 
 class raytracer final : public basic_member<raytracer> {
 public:
+    static constexpr std::uint64_t default_seed = 0x9E3779B97F4A7C15ull;
+
     explicit raytracer(double room_volume = 0,
                        double speed_of_sound = 340,
                        size_t quality = 3,
@@ -25,11 +31,27 @@ public:
 
     void set_room_volume(double volume);
 
+    /// Seeds ray directions and the stochastic tail. Renders of the same
+    /// scene with the same seed are reproducible.
+    void set_seed(std::uint64_t seed);
+    std::uint64_t get_seed() const;
+
     wayverb::raytracer::simulation_parameters get() const;
 
     template <typename Archive>
-    void serialize(Archive& archive) {
+    void save(Archive& archive) const {
+        archive(quality_, img_src_order_, cereal::make_nvp("seed", seed_));
+    }
+
+    template <typename Archive>
+    void load(Archive& archive) {
         archive(quality_, img_src_order_);
+        //  Projects saved before the seed was added don't have one.
+        try {
+            archive(cereal::make_nvp("seed", seed_));
+        } catch (const cereal::Exception&) {
+            seed_ = default_seed;
+        }
     }
 
     NOTIFYING_COPY_ASSIGN_DECLARATION(raytracer)
@@ -38,6 +60,7 @@ private:
         using std::swap;
         swap(quality_, other.quality_);
         swap(img_src_order_, other.img_src_order_);
+        swap(seed_, other.seed_);
     }
 
     double room_volume_;
@@ -48,6 +71,8 @@ private:
 
     double receiver_radius_;
     double histogram_sample_rate_;
+
+    std::uint64_t seed_ = default_seed;
 };
 
 bool operator==(const raytracer& a, const raytracer& b);
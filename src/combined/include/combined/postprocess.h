@@ -6,6 +6,8 @@
 #include "waveguide/config.h"
 #include "waveguide/postprocess.h"
 
+#include "frequency_domain/crossover.h"
+
 #include "core/dsp_vector_ops.h"
 #include "core/sinc.h"
 #include "core/sum_ranges.h"
@@ -34,34 +36,58 @@ auto make_combined_results(
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename LoIt, typename HiIt>
+/// Lowpasses the first signal, highpasses the second, and sums them, with a
+/// single inverse fft. `post(index, sample)` is applied to every output
+/// sample as it is written.
+template <typename LoIt, typename HiIt, typename Post>
 auto crossover_filter(LoIt b_lo,
                       LoIt e_lo,
                       HiIt b_hi,
                       HiIt e_hi,
                       double cutoff,
-                      double width) {
-    frequency_domain::filter filt{
-            frequency_domain::best_fft_length(std::max(
-                    std::distance(b_lo, e_lo), std::distance(b_hi, e_hi)))
-            << 2};
+                      double width,
+                      const Post& post) {
+    const size_t length =
+            std::max(std::distance(b_lo, e_lo), std::distance(b_hi, e_hi));
 
-    constexpr auto l = 0;
+    frequency_domain::crossover xover{
+            frequency_domain::best_fft_length(length) << 2};
 
-    const auto run_filter = [&](auto b, auto e, auto mag_func) {
-        auto ret = std::vector<float>(std::distance(b, e));
-        filt.run(b, e, begin(ret), [&](auto cplx, auto freq) {
-            return cplx * static_cast<float>(mag_func(freq, cutoff, width, l));
-        });
-        return ret;
-    };
+    constexpr auto l = 0;
 
-    const auto lo =
-            run_filter(b_lo, e_lo, frequency_domain::compute_lopass_magnitude);
-    const auto hi =
-            run_filter(b_hi, e_hi, frequency_domain::compute_hipass_magnitude);
+    util::aligned::vector<float> ret(length);
+    xover.run(b_lo,
+              e_lo,
+              b_hi,
+              e_hi,
+              begin(ret),
+              [&](auto lo, auto hi, auto freq) {
+                  using namespace frequency_domain;
+                  const auto lo_mag =
+                          compute_lopass_magnitude(freq, cutoff, width, l);
+                  const auto hi_mag =
+                          compute_hipass_magnitude(freq, cutoff, width, l);
+                  return lo * static_cast<float>(lo_mag) +
+                         hi * static_cast<float>(hi_mag);
+              },
+              post);
+    return ret;
+}
 
-    return core::sum_vectors(lo, hi);
+template <typename LoIt, typename HiIt>
+auto crossover_filter(LoIt b_lo,
+                      LoIt e_lo,
+                      HiIt b_hi,
+                      HiIt e_hi,
+                      double cutoff,
+                      double width) {
+    return crossover_filter(b_lo,
+                            e_lo,
+                            b_hi,
+                            e_hi,
+                            cutoff,
+                            width,
+                            [](auto, auto sample) { return sample; });
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -73,28 +99,16 @@ struct max_frequency_functor final {
     }
 };
 
-template <typename Histogram, typename Method>
-auto postprocess(const combined_results<Histogram>& input,
-                 const Method& method,
-                 const glm::vec3& source_position,
-                 const glm::vec3& receiver_position,
-                 double room_volume,
-                 const core::environment& environment,
-                 double output_sample_rate) {
-    //  Individual processing.
-    const auto waveguide_processed =
-            waveguide::postprocess(input.waveguide,
-                                   method,
-                                   environment.acoustic_impedance,
-                                   output_sample_rate);
-
-    const auto raytracer_processed = raytracer::postprocess(input.raytracer,
-                                                            method,
-                                                            receiver_position,
-                                                            room_volume,
-                                                            environment,
-                                                            output_sample_rate);
-
+/// Crossover, windowing and silence checks, once the waveguide and
+/// raytracer outputs have been processed individually.
+template <typename Histogram>
+auto mix_processed(const combined_results<Histogram>& input,
+                   const util::aligned::vector<float>& waveguide_processed,
+                   const util::aligned::vector<float>& raytracer_processed,
+                   const glm::vec3& source_position,
+                   const glm::vec3& receiver_position,
+                   const core::environment& environment,
+                   double output_sample_rate) {
     const auto make_iterator = [](auto it) {
         return util::make_mapping_iterator_adapter(std::move(it),
                                                    max_frequency_functor{});
@@ -166,19 +180,42 @@ auto postprocess(const combined_results<Histogram>& input,
                                           make_iterator(end(input.waveguide))) /
                         output_sample_rate;
     const auto width = 0.2;  //  Wider = more natural-sounding
-    auto filtered = crossover_filter(begin(waveguide_processed),
-                                     end(waveguide_processed),
-                                     begin(raytracer_processed),
-                                     end(raytracer_processed),
-                                     cutoff,
-                                     width);
 
     //  Just in case the start has a bit of a dc offset, we do a sneaky window.
-    const auto window_length =
-            std::min(filtered.size(),
-                     static_cast<size_t>(std::floor(
-                             distance(source_position, receiver_position) *
-                             output_sample_rate / environment.speed_of_sound)));
+    //  The window and the non-finite check are applied as the crossover
+    //  writes its output, rather than in separate passes.
+    const auto window_length = std::min(
+            std::max(waveguide_processed.size(), raytracer_processed.size()),
+            static_cast<size_t>(
+                    std::floor(distance(source_position, receiver_position) *
+                               output_sample_rate /
+                               environment.speed_of_sound)));
+
+    size_t sanitized = 0;
+    auto filtered = crossover_filter(
+            begin(waveguide_processed),
+            end(waveguide_processed),
+            begin(raytracer_processed),
+            end(raytracer_processed),
+            cutoff,
+            width,
+            [&](auto index, auto sample) {
+                if (index < window_length) {
+                    sample *= core::hanning_point<float>(
+                            index / (2 * (window_length - 1.0)));
+                }
+                if (!std::isfinite(sample)) {
+                    ++sanitized;
+                    return 0.0f;
+                }
+                return sample;
+            });
+
+    if (sanitized != 0) {
+        std::cerr << "[combined] sanitized " << sanitized
+                  << " non-finite samples in crossover output before fallback."
+                  << '\n';
+    }
 
     if (window_length == 0) {
         if (!has_energy(filtered)) {
@@ -191,16 +228,6 @@ auto postprocess(const combined_results<Histogram>& input,
         return filtered;
     }
 
-    const auto window = core::left_hanning(std::floor(window_length));
-
-    //  Multiply together the window and filtered signal.
-    std::transform(
-            begin(window),
-            end(window),
-            begin(filtered),
-            begin(filtered),
-            [](auto envelope, auto signal) { return envelope * signal; });
-
     const auto sanitize = [](auto& buffer) {
         size_t replaced = 0;
         for (auto& sample : buffer) {
@@ -212,12 +239,6 @@ auto postprocess(const combined_results<Histogram>& input,
         return replaced;
     };
 
-    if (const auto sanitized = sanitize(filtered); sanitized != 0) {
-        std::cerr << "[combined] sanitized " << sanitized
-                  << " non-finite samples in crossover output before fallback."
-                  << '\n';
-    }
-
     if (!has_energy(filtered)) {
         log_channel_stats("combined mix (windowed)", filtered);
         if (!allow_silent_fallback) {
@@ -256,5 +277,62 @@ auto postprocess(const combined_results<Histogram>& input,
     return filtered;
 }
 
+/// The waveguide and raytracer outputs (and their bands) are processed as
+/// tasks on the pool.
+template <typename Histogram, typename Method>
+auto postprocess(const combined_results<Histogram>& input,
+                 const Method& method,
+                 const glm::vec3& source_position,
+                 const glm::vec3& receiver_position,
+                 double room_volume,
+                 const core::environment& environment,
+                 double output_sample_rate,
+                 util::thread_pool& pool) {
+    const auto processed = util::parallel_invoke(
+            pool,
+            [&] {
+                return waveguide::postprocess(input.waveguide,
+                                              method,
+                                              environment.acoustic_impedance,
+                                              output_sample_rate,
+                                              pool);
+            },
+            [&] {
+                return raytracer::postprocess(input.raytracer,
+                                              method,
+                                              receiver_position,
+                                              room_volume,
+                                              environment,
+                                              output_sample_rate,
+                                              pool);
+            });
+
+    return mix_processed(input,
+                         processed.first,
+                         processed.second,
+                         source_position,
+                         receiver_position,
+                         environment,
+                         output_sample_rate);
+}
+
+template <typename Histogram, typename Method>
+auto postprocess(const combined_results<Histogram>& input,
+                 const Method& method,
+                 const glm::vec3& source_position,
+                 const glm::vec3& receiver_position,
+                 double room_volume,
+                 const core::environment& environment,
+                 double output_sample_rate) {
+    return postprocess(input,
+                       method,
+                       source_position,
+                       receiver_position,
+                       room_volume,
+                       environment,
+                       output_sample_rate,
+                       util::serial_executor());
+}
+
 }  // namespace combined
 }  // namespace wayverb
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "waveguide/pressure_storage.h"
+
+#include "core/cl/common.h"
+#include "core/gpu_scene_data.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace wayverb {
+namespace combined {
+
+/// The number of source-receiver pairs to render at once if none is
+/// specified. Reads WAYVERB_CONCURRENT_RUNS, falling back to 2, which is
+/// enough to keep the device busy while another pair is being voxelised or
+/// postprocessed on the CPU.
+size_t default_concurrent_runs();
+
+/// The device memory which concurrent runs may share. Reads
+/// WAYVERB_RUN_MEMORY_MB, falling back to three quarters of the device's
+/// global memory.
+size_t default_run_memory_budget(const core::compute_context& cc);
+
+/// A conservative guess at the device memory needed to render one pair in
+/// `scene`, based on the number of waveguide nodes in its bounding box.
+/// Runs with several `bands` advance them together, so each band adds its
+/// own pressure fields and boundary filter state.
+size_t estimate_run_memory(const core::gpu_scene_data& scene,
+                           double sampling_frequency,
+                           double speed_of_sound,
+                           size_t bands,
+                           waveguide::pressure_storage storage);
+
+/// Limits the combined memory estimate of runs in flight.
+/// A run which doesn't fit waits until enough earlier runs finish. A run is
+/// always admitted when nothing else is in flight, so an estimate larger
+/// than the whole budget serialises rather than deadlocks.
+/// Buffers cached by `pool`, if given, count against the budget too. They
+/// are dropped when a run would fit without them.
+class memory_admission final {
+public:
+    /// Returns its bytes to the budget on destruction.
+    class reservation final {
+    public:
+        reservation(const reservation&) = delete;
+        reservation& operator=(const reservation&) = delete;
+        reservation(reservation&& other) noexcept;
+        reservation& operator=(reservation&&) noexcept = delete;
+
+        ~reservation() noexcept;
+
+    private:
+        friend class memory_admission;
+        reservation(memory_admission& admission, size_t bytes);
+
+        memory_admission* admission_;
+        size_t bytes_;
+    };
+
+    explicit memory_admission(size_t budget,
+                              std::shared_ptr<core::buffer_pool> pool = {});
+
+    memory_admission(const memory_admission&) = delete;
+    memory_admission& operator=(const memory_admission&) = delete;
+    memory_admission(memory_admission&&) noexcept = delete;
+    memory_admission& operator=(memory_admission&&) noexcept = delete;
+
+    /// Waits until `bytes` can be admitted. Returns nothing if `keep_going`
+    /// becomes false while waiting.
+    std::optional<reservation> reserve(size_t bytes,
+                                       const std::atomic_bool& keep_going);
+
+    size_t get_budget() const;
+
+private:
+    void release(size_t bytes);
+
+    size_t budget_;
+    std::shared_ptr<core::buffer_pool> pool_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t in_use_{0};
+    size_t admitted_{0};
+};
+
+}  // namespace combined
+}  // namespace wayverb
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "combined/postprocess.h"
+
+#include "core/serialize/range.h"
+#include "core/serialize/surface.h"
+#include "core/serialize/vec.h"
+
+#include "cereal/types/vector.hpp"
+
+/// Serialisation for simulation results, so that they can be cached and
+/// postprocessed again later (see combined/intermediate_cache.h).
+
+namespace cereal {
+
+template <typename Archive>
+void serialize(Archive& archive, cl_float3& m) {
+    archive(m.s[0], m.s[1], m.s[2]);
+}
+
+template <typename Archive, size_t Channels>
+void serialize(Archive& archive, wayverb::raytracer::impulse<Channels>& m) {
+    archive(make_nvp("volume", m.volume),
+            make_nvp("position", m.position),
+            make_nvp("distance", m.distance));
+}
+
+template <typename Archive, size_t Az, size_t El>
+void serialize(
+        Archive& archive,
+        wayverb::raytracer::stochastic::directional_energy_histogram<Az, El>&
+                m) {
+    archive(make_nvp("sample_rate", m.sample_rate));
+    for (auto& azimuth : m.histogram.table) {
+        for (auto& segment : azimuth) {
+            archive(segment);
+        }
+    }
+}
+
+template <typename Archive, typename Histogram>
+void serialize(Archive& archive,
+               wayverb::raytracer::simulation_results<Histogram>& m) {
+    archive(make_nvp("image_source", m.image_source),
+            make_nvp("stochastic", m.stochastic),
+            make_nvp("seed", m.seed));
+}
+
+template <typename Archive>
+void serialize(
+        Archive& archive,
+        wayverb::waveguide::postprocessor::directional_receiver::output& m) {
+    archive(make_nvp("intensity", m.intensity),
+            make_nvp("pressure", m.pressure));
+}
+
+template <typename Archive>
+void serialize(Archive& archive, wayverb::waveguide::band& m) {
+    archive(make_nvp("directional", m.directional),
+            make_nvp("sample_rate", m.sample_rate));
+}
+
+template <typename Archive>
+void serialize(Archive& archive, wayverb::waveguide::bandpass_band& m) {
+    archive(make_nvp("band", m.band), make_nvp("valid_hz", m.valid_hz));
+}
+
+template <typename Archive, typename Histogram>
+void serialize(Archive& archive,
+               wayverb::combined::combined_results<Histogram>& m) {
+    archive(make_nvp("raytracer", m.raytracer),
+            make_nvp("waveguide", m.waveguide));
+}
+
+}  // namespace cereal
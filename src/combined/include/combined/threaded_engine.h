@@ -15,6 +15,8 @@ namespace combined {
 ///     Simulate the scene.
 ///     Do microphone post-processing according to the receiver's capsules.
 ///     Cache the results.
+/// Pairs are rendered concurrently (see run_scheduler.h), up to a limit on
+/// runs and on estimated device memory, and results are kept in pair order.
 /// Once all outputs have been calculated:
 ///     Do global normalization.
 ///     Write files out.
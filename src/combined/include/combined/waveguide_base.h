@@ -1,11 +1,13 @@
 #pragma once
 
 #include "waveguide/bandpass_band.h"
+#include "waveguide/pressure_storage.h"
 
 #include "glm/fwd.hpp"
 
 #include "utilities/optional.h"
 #include <functional>
+#include <tuple>
 
 //  forward declarations  //////////////////////////////////////////////////////
 
@@ -44,6 +46,17 @@ public:
 
     virtual double compute_sampling_frequency() const = 0;
 
+    /// The simulation parameters as a flat list, for identifying results
+    /// (see intermediate_cache.h).
+    virtual util::aligned::vector<double> get_parameters() const = 0;
+
+    /// How the pressure buffer handed to run's `pressure_callback` stores
+    /// pressure.
+    virtual waveguide::pressure_storage get_pressure_storage() const = 0;
+
+    /// `pressures_wanted` says whether `pressure_callback` reads the
+    /// pressure buffer. If it doesn't, the buffer may be laid out however the
+    /// run stores pressure, which saves building a dense copy every step.
     virtual std::optional<
             util::aligned::vector<waveguide::bandpass_band>>
     run(const core::compute_context& cc,
@@ -56,9 +69,21 @@ public:
         std::function<void(cl::CommandQueue& queue,
                            const cl::Buffer& buffer,
                            size_t step,
-                           size_t steps)> pressure_callback) = 0;
+                           size_t steps)> pressure_callback,
+        bool pressures_wanted) = 0;
 };
 
+/// Flattens parameters which have a `to_tuple`.
+template <typename T>
+util::aligned::vector<double> flatten_parameters(const T& t) {
+    return std::apply(
+            [](const auto&... parameters) {
+                return util::aligned::vector<double>{
+                        static_cast<double>(parameters)...};
+            },
+            to_tuple(t));
+}
+
 std::unique_ptr<waveguide_base> make_waveguide_ptr(
         const waveguide::single_band_parameters& t);
 std::unique_ptr<waveguide_base> make_waveguide_ptr(
@@ -6,6 +6,8 @@
 #include "core/az_el.h"
 #include "core/orientation.h"
 
+#include "utilities/thread_pool.h"
+
 #include <iostream>
 
 namespace wayverb {
@@ -26,7 +28,15 @@ public:
     util::aligned::vector<float> postprocess(
             const intermediate& intermediate,
             double sample_rate) const override {
-        return intermediate.postprocess(attenuator_, sample_rate);
+        return intermediate.postprocess(
+                attenuator_, sample_rate, util::serial_executor());
+    }
+
+    util::aligned::vector<float> postprocess(
+            const intermediate& intermediate,
+            double sample_rate,
+            util::thread_pool& pool) const override {
+        return intermediate.postprocess(attenuator_, sample_rate, pool);
     }
 
 private:
@@ -0,0 +1,111 @@
+#include "combined/channel_staging.h"
+
+#include "core/dsp_vector_ops.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace wayverb {
+namespace combined {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+void write_floats(const std::string& path,
+                  const util::aligned::vector<float>& channel) {
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<const char*>(channel.data()),
+               sizeof(float) * channel.size());
+    if (!file) {
+        throw std::runtime_error{"Failed staging channel to " + path};
+    }
+}
+
+}  // namespace
+
+std::string select_staging_directory() {
+    const char* env = std::getenv("WAYVERB_STAGING_DIR");
+    const auto parent =
+            env && *env ? fs::path{env} : fs::temp_directory_path();
+    std::random_device rd;
+    std::ostringstream name;
+    name << "wayverb-" << std::hex << rd() << rd();
+    return (parent / name.str()).string();
+}
+
+channel_staging::channel_staging(std::string directory)
+        : directory_{std::move(directory)} {
+    created_directory_ = fs::create_directories(directory_);
+}
+
+channel_staging::~channel_staging() noexcept {
+    std::error_code ignored;
+    for (size_t i = 0; i != channels_; ++i) {
+        fs::remove(get_path(i), ignored);
+    }
+    if (created_directory_) {
+        fs::remove(directory_, ignored);
+    }
+}
+
+size_t channel_staging::add(const util::aligned::vector<float>& channel) {
+    size_t index{};
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        index = channels_++;
+    }
+    replace(index, channel);
+    return index;
+}
+
+void channel_staging::replace(size_t index,
+                              const util::aligned::vector<float>& channel) {
+    write_floats(get_path(index), channel);
+    const auto peak = core::max_mag(channel);
+    std::lock_guard<std::mutex> lock{mutex_};
+    peak_ = std::max(peak_, peak);
+}
+
+util::aligned::vector<float> channel_staging::read(size_t index) const {
+    const auto path = get_path(index);
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file) {
+        throw std::runtime_error{"Can't read staged channel " + path};
+    }
+    util::aligned::vector<float> ret(file.tellg() / sizeof(float));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(ret.data()), sizeof(float) * ret.size());
+    if (!file) {
+        throw std::runtime_error{"Failed reading staged channel " + path};
+    }
+    return ret;
+}
+
+void channel_staging::remove(size_t index) {
+    std::error_code ignored;
+    fs::remove(get_path(index), ignored);
+}
+
+double channel_staging::get_peak() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return peak_;
+}
+
+size_t channel_staging::size() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return channels_;
+}
+
+std::string channel_staging::get_path(size_t index) const {
+    return (fs::path{directory_} / (std::to_string(index) + ".f32")).string();
+}
+
+}  // namespace combined
+}  // namespace wayverb
@@ -1,7 +1,9 @@
 #include "combined/engine.h"
 #include "combined/postprocess.h"
+#include "combined/serialize/results.h"
 #include "combined/waveguide_base.h"
 
+#include "waveguide/field_snapshot.h"
 #include "waveguide/mesh.h"
 
 #include "raytracer/canonical.h"
@@ -11,15 +13,29 @@
 #include "core/reverb_time.h"
 #include "core/scene_data.h"
 
+#include "cereal/archives/binary.hpp"
+
 #include "glm/glm.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <optional>
 #include <sstream>
+#include <string>
 #include "utilities/crash_reporter.h"
+#include "utilities/instrumentation.h"
 
 namespace wayverb {
 namespace combined {
 
 namespace {
+
+constexpr std::uint32_t intermediate_magic = 0x4e495657;  //  "WVIN"
+constexpr std::uint32_t intermediate_version = 1;
+
 template <typename Histogram>
 class intermediate_impl final : public intermediate {
 public:
@@ -37,32 +53,67 @@ public:
     util::aligned::vector<float> postprocess(
             const core::attenuator::null& a,
             double sample_rate) const override {
-        return postprocess_impl(a, sample_rate);
+        return postprocess_impl(a, sample_rate, util::serial_executor());
     }
 
     util::aligned::vector<float> postprocess(
             const core::attenuator::hrtf& a,
             double sample_rate) const override {
-        return postprocess_impl(a, sample_rate);
+        return postprocess_impl(a, sample_rate, util::serial_executor());
     }
 
     util::aligned::vector<float> postprocess(
             const core::attenuator::microphone& a,
             double sample_rate) const override {
-        return postprocess_impl(a, sample_rate);
+        return postprocess_impl(a, sample_rate, util::serial_executor());
+    }
+
+    util::aligned::vector<float> postprocess(
+            const core::attenuator::null& a,
+            double sample_rate,
+            util::thread_pool& pool) const override {
+        return postprocess_impl(a, sample_rate, pool);
+    }
+
+    util::aligned::vector<float> postprocess(
+            const core::attenuator::hrtf& a,
+            double sample_rate,
+            util::thread_pool& pool) const override {
+        return postprocess_impl(a, sample_rate, pool);
+    }
+
+    util::aligned::vector<float> postprocess(
+            const core::attenuator::microphone& a,
+            double sample_rate,
+            util::thread_pool& pool) const override {
+        return postprocess_impl(a, sample_rate, pool);
+    }
+
+    void save(std::ostream& os) const override {
+        cereal::BinaryOutputArchive archive{os};
+        archive(intermediate_magic, intermediate_version);
+        archive(to_process_,
+                source_position_,
+                receiver_position_,
+                room_volume_,
+                environment_.speed_of_sound,
+                environment_.acoustic_impedance);
     }
 
 private:
     template <typename Attenuator>
     auto postprocess_impl(const Attenuator& attenuator,
-                          double output_sample_rate) const {
+                          double output_sample_rate,
+                          util::thread_pool& pool) const {
+        const util::instrumentation::scoped_timer timer{"engine/postprocess"};
         return wayverb::combined::postprocess(to_process_,
                                               attenuator,
                                               source_position_,
                                               receiver_position_,
                                               room_volume_,
                                               environment_,
-                                              output_sample_rate);
+                                              output_sample_rate,
+                                              pool);
     }
 
     combined_results<Histogram> to_process_;
@@ -73,12 +124,18 @@ private:
     engine::engine_state_changed engine_state_changed_;
 };
 
+/// The only histogram the engine produces, and so the only one that
+/// load_intermediate has to read.
+using engine_histogram = raytracer::stochastic::directional_energy_histogram<20, 9>;
+
 template <typename Histogram>
 auto make_intermediate_impl_ptr(combined_results<Histogram> to_process,
                                 const glm::vec3& source_position,
                                 const glm::vec3& receiver_position,
                                 double room_volume,
                                 const core::environment& environment) {
+    static_assert(std::is_same<Histogram, engine_histogram>{},
+                  "load_intermediate must read the engine's histograms");
     return std::make_unique<intermediate_impl<Histogram>>(std::move(to_process),
                                                           source_position,
                                                           receiver_position,
@@ -86,6 +143,17 @@ auto make_intermediate_impl_ptr(combined_results<Histogram> to_process,
                                                           environment);
 }
 
+/// Whether to run the raytracer and waveguide at the same time. Reads
+/// WAYVERB_OVERLAP_STAGES, off by default.
+bool select_overlapped_stages() {
+    const char* env = std::getenv("WAYVERB_OVERLAP_STAGES");
+    return env && std::string{env} != "0";
+}
+
+/// Stretches the reverb-time estimate used to size an overlapped waveguide
+/// run, so that it rarely falls short of the raytracer's tail.
+constexpr auto overlapped_time_margin = 1.5;
+
 }  // namespace
 
 class engine::impl final {
@@ -99,6 +167,7 @@ public:
          std::unique_ptr<waveguide_base> waveguide,
          std::shared_ptr<waveguide::precomputed_inputs> precomputed_inputs)
             : compute_context_{compute_context}
+            , raytracer_devices_{compute_context}
             , voxels_and_mesh_{waveguide::compute_voxels_and_mesh(
                       compute_context,
                       scene_data,
@@ -113,19 +182,26 @@ public:
             , raytracer_{raytracer}
             , waveguide_{std::move(waveguide)} {}
 
-    std::unique_ptr<intermediate> run(
-            const std::atomic_bool& keep_going) const {
-        //  RAYTRACER  /////////////////////////////////////////////////////////
-
+private:
+    //  stages  ////////////////////////////////////////////////////////////////
+
+    /// State changes are only reported if `report_progress` is set, so that a
+    /// raytracer running alongside the waveguide doesn't fight it for the
+    /// progress bar.
+    auto run_raytracer(const std::atomic_bool& keep_going,
+                       bool report_progress) const {
+        const util::instrumentation::scoped_timer timer{"engine/raytracer"};
         const auto rays_to_visualise = std::min(32ul, raytracer_.rays);
 
-        engine_state_changed_(state::starting_raytracer, 1.0);
+        if (report_progress) {
+            engine_state_changed_(state::starting_raytracer, 1.0);
+        }
         std::cerr << "[engine] starting raytracer: rays=" << raytracer_.rays
                   << " img_src_order=" << raytracer_.maximum_image_source_order
                   << "\n";
 
         auto raytracer_output = raytracer::canonical(
-                compute_context_,
+                raytracer_devices_,
                 voxels_and_mesh_.voxels,
                 source_,
                 receiver_,
@@ -134,32 +210,39 @@ public:
                 rays_to_visualise,
                 keep_going,
                 [&](auto step, auto total_steps) {
-                    engine_state_changed_(state::running_raytracer,
-                                          step / (total_steps - 1.0));
+                    if (report_progress) {
+                        engine_state_changed_(state::running_raytracer,
+                                              step / (total_steps - 1.0));
+                    }
                 });
 
-
         if (!(keep_going && raytracer_output)) {
-            return nullptr;
+            return raytracer_output;
         }
 
-        engine_state_changed_(state::finishing_raytracer, 1.0);
+        if (report_progress) {
+            engine_state_changed_(state::finishing_raytracer, 1.0);
+        }
         std::cerr << "[engine] finishing raytracer\n";
 
         raytracer_reflections_generated_(std::move(raytracer_output->visual),
                                          source_);
 
-        //  look for the max time of an impulse
-        const auto max_stochastic_time =
-                max_time(raytracer_output->aural.stochastic);
+        return raytracer_output;
+    }
 
-        //  WAVEGUIDE  /////////////////////////////////////////////////////////
+    /// `on_step`, if supplied, is called after every waveguide step.
+    std::optional<util::aligned::vector<waveguide::bandpass_band>>
+    run_waveguide(const std::atomic_bool& keep_going,
+                  double simulation_time,
+                  const std::function<void()>& on_step = {}) const {
+        const util::instrumentation::scoped_timer timer{"engine/waveguide"};
         engine_state_changed_(state::starting_waveguide, 1.0);
         const auto fs = waveguide_->compute_sampling_frequency();
         const auto spacing = voxels_and_mesh_.mesh.get_descriptor().spacing;
         std::cerr << "[engine] starting waveguide: fs=" << fs
                   << " Hz spacing=" << spacing << " m max_time="
-                  << max_stochastic_time << " s\n";
+                  << simulation_time << " s\n";
 
         // Visualisation decimation: reading back the full node-pressure buffer
         // every step severely throttles the GPU. Allow decimation via env.
@@ -167,23 +250,41 @@ public:
         const size_t viz_decimate = viz_dec_env ? std::max<size_t>(1, std::strtoull(viz_dec_env, nullptr, 10)) : 1;
         const bool viz_disabled = std::getenv("WAYVERB_DISABLE_VIZ") != nullptr;
 
+        //  Snapshots are reduced on the device and delivered to listeners
+        //  from a worker thread, so the simulation never waits on them.
+        std::optional<waveguide::field_snapshotter> snapshots;
+        if (!viz_disabled && !waveguide_node_pressures_changed_.empty()) {
+            snapshots.emplace(
+                    compute_context_,
+                    voxels_and_mesh_.mesh.get_descriptor(),
+                    waveguide::select_snapshot_factor(),
+                    [this, fs](auto pressures, auto step) {
+                        const auto distance =
+                                step / fs * environment_.speed_of_sound;
+                        waveguide_node_pressures_changed_(std::move(pressures),
+                                                          distance);
+                    },
+                    waveguide_->get_pressure_storage());
+        }
+
         auto waveguide_output = waveguide_->run(
                 compute_context_,
                 voxels_and_mesh_,
                 source_,
                 receiver_,
                 environment_,
-                max_stochastic_time,
+                simulation_time,
                 keep_going,
                 [&](auto& queue, const auto& buffer, auto step, auto steps) {
+                    if (on_step) {
+                        on_step();
+                    }
+
                     //  If there are node pressure listeners, optionally decimate
-                    //  the GPU->CPU readback to reduce stalls.
-                    if (!viz_disabled && !waveguide_node_pressures_changed_.empty()) {
+                    //  the snapshots in time too.
+                    if (snapshots) {
                         if (viz_decimate == 1 || (step % viz_decimate) == 0 || step + 1 == steps) {
-                            auto pressures = core::read_from_buffer<float>(queue, buffer);
-                            const auto time = step / waveguide_->compute_sampling_frequency();
-                            const auto distance = time * environment_.speed_of_sound;
-                            waveguide_node_pressures_changed_(std::move(pressures), distance);
+                            snapshots->take(queue, buffer, step);
                         }
                     }
 
@@ -199,15 +300,155 @@ public:
                                                    << "/" << steps;
                         util::crash::reporter::set_status(os.str());
                     }
-                });
+                },
+                snapshots.has_value());
 
         if (!(keep_going && waveguide_output)) {
-            return nullptr;
+            return std::nullopt;
         }
 
         engine_state_changed_(state::finishing_waveguide, 1.0);
         std::cerr << "[engine] finishing waveguide\n";
 
+        return waveguide_output;
+    }
+
+    /// The raytracer's tail length is only known once it has finished, so to
+    /// start the waveguide early its duration is guessed from the scene's
+    /// Eyring reverb time, with a margin.
+    /// Returns nothing if the scene doesn't give a usable estimate.
+    std::optional<double> estimate_simulation_time() const {
+        try {
+            const auto times = core::eyring_reverb_time(
+                    voxels_and_mesh_.voxels.get_scene_data(),
+                    core::bands_type{});
+            double longest = 0;
+            for (auto i = 0; i != core::simulation_bands; ++i) {
+                longest = std::max<double>(longest, times.s[i]);
+            }
+            if (!(std::isfinite(longest) && 0 < longest)) {
+                return std::nullopt;
+            }
+            return longest * overlapped_time_margin;
+        } catch (const std::runtime_error&) {
+            return std::nullopt;
+        }
+    }
+
+    /// Runs the raytracer on a worker thread while the waveguide runs for an
+    /// estimated duration. Both make their own command queues, so the
+    /// raytracer's CPU-bound image-source work overlaps the waveguide's
+    /// device work.
+    std::unique_ptr<intermediate> run_overlapped(
+            const std::atomic_bool& keep_going, double estimated_time) const {
+        std::cerr << "[engine] overlapping raytracer and waveguide, estimated "
+                     "time="
+                  << estimated_time << " s\n";
+
+        //  Each stage has its own flag, so that it can be stopped if the
+        //  other fails. Cancellation by the caller is forwarded to both.
+        std::atomic_bool raytracer_keep_going{true};
+        std::atomic_bool waveguide_keep_going{true};
+        auto raytracer_future = std::async(std::launch::async, [&] {
+            try {
+                return run_raytracer(raytracer_keep_going, false);
+            } catch (...) {
+                waveguide_keep_going = false;
+                throw;
+            }
+        });
+
+        std::optional<util::aligned::vector<waveguide::bandpass_band>>
+                waveguide_output;
+        try {
+            waveguide_output =
+                    run_waveguide(waveguide_keep_going, estimated_time, [&] {
+                        if (!keep_going) {
+                            waveguide_keep_going = false;
+                        }
+                    });
+        } catch (...) {
+            raytracer_keep_going = false;
+            raytracer_future.wait();
+            throw;
+        }
+
+        while (raytracer_future.wait_for(std::chrono::milliseconds{10}) !=
+               std::future_status::ready) {
+            if (!keep_going) {
+                raytracer_keep_going = false;
+            }
+        }
+        //  Rethrows if the raytracer failed, which is what stopped the
+        //  waveguide.
+        auto raytracer_output = raytracer_future.get();
+
+        if (!(keep_going && raytracer_output && waveguide_output)) {
+            return nullptr;
+        }
+
+        const auto max_stochastic_time =
+                max_time(raytracer_output->aural.stochastic);
+
+        if (estimated_time < max_stochastic_time) {
+            //  Rare, given the margin, but the waveguide must cover the whole
+            //  raytracer tail. Extending the first run would need its final
+            //  field state, which isn't kept, so this starts again from step
+            //  0.
+            std::cerr << "[engine] raytracer tail of " << max_stochastic_time
+                      << " s outlasts the estimate, rerunning waveguide\n";
+            waveguide_output = run_waveguide(keep_going, max_stochastic_time);
+            if (!(keep_going && waveguide_output)) {
+                return nullptr;
+            }
+        } else {
+            //  Keep the output the same length as a sequential run's.
+            for (auto& band : *waveguide_output) {
+                auto& directional = band.band.directional;
+                const auto length = static_cast<size_t>(
+                        std::ceil(band.band.sample_rate * max_stochastic_time));
+                if (length < directional.size()) {
+                    directional.resize(length);
+                }
+            }
+        }
+
+        return make_intermediate_impl_ptr(
+                make_combined_results(std::move(raytracer_output->aural),
+                                      std::move(*waveguide_output)),
+                source_,
+                receiver_,
+                room_volume_,
+                environment_);
+    }
+
+public:
+    std::unique_ptr<intermediate> run(
+            const std::atomic_bool& keep_going) const {
+        if (select_overlapped_stages()) {
+            if (const auto estimate = estimate_simulation_time()) {
+                return run_overlapped(keep_going, *estimate);
+            }
+            std::cerr << "[engine] can't estimate the reverb time, running "
+                         "raytracer and waveguide in turn\n";
+        }
+
+        auto raytracer_output = run_raytracer(keep_going, true);
+
+        if (!(keep_going && raytracer_output)) {
+            return nullptr;
+        }
+
+        //  look for the max time of an impulse
+        const auto max_stochastic_time =
+                max_time(raytracer_output->aural.stochastic);
+
+        auto waveguide_output = run_waveguide(keep_going, max_stochastic_time);
+
+        if (!(keep_going && waveguide_output)) {
+            return nullptr;
+        }
+
         return make_intermediate_impl_ptr(
                 make_combined_results(std::move(raytracer_output->aural),
                                       std::move(*waveguide_output)),
@@ -242,8 +483,14 @@ public:
         return voxels_and_mesh_;
     }
 
+    void set_raytracer_devices(
+            util::aligned::vector<core::compute_context> devices) {
+        raytracer_devices_ = std::move(devices);
+    }
+
 private:
     core::compute_context compute_context_;
+    util::aligned::vector<core::compute_context> raytracer_devices_;
     waveguide::voxels_and_mesh voxels_and_mesh_;
     double room_volume_;
     glm::vec3 source_;
@@ -305,5 +552,40 @@ const waveguide::voxels_and_mesh& engine::get_voxels_and_mesh() const {
     return pimpl_->get_voxels_and_mesh();
 }
 
+void engine::set_raytracer_devices(
+        util::aligned::vector<core::compute_context> devices) {
+    pimpl_->set_raytracer_devices(std::move(devices));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::unique_ptr<intermediate> load_intermediate(std::istream& is) {
+    cereal::BinaryInputArchive archive{is};
+    std::uint32_t magic{};
+    std::uint32_t version{};
+    archive(magic, version);
+    if (magic != intermediate_magic || version != intermediate_version) {
+        throw std::runtime_error{"Not a compatible intermediate result."};
+    }
+
+    combined_results<engine_histogram> to_process;
+    glm::vec3 source_position;
+    glm::vec3 receiver_position;
+    double room_volume{};
+    core::environment environment;
+    archive(to_process,
+            source_position,
+            receiver_position,
+            room_volume,
+            environment.speed_of_sound,
+            environment.acoustic_impedance);
+
+    return make_intermediate_impl_ptr(std::move(to_process),
+                                      source_position,
+                                      receiver_position,
+                                      room_volume,
+                                      environment);
+}
+
 }  // namespace combined
 }  // namespace wayverb
@@ -1,9 +1,21 @@
 #include "combined/full_run.h"
 #include "combined/waveguide_base.h"
 
+#include <cstdlib>
+
 namespace wayverb {
 namespace combined {
 
+size_t default_postprocess_workers() {
+    if (const char* env = std::getenv("WAYVERB_POSTPROCESS_THREADS")) {
+        const auto parsed = std::strtoull(env, nullptr, 10);
+        if (parsed != 0) {
+            return parsed;
+        }
+    }
+    return util::thread_pool::default_concurrency();
+}
+
 postprocessing_engine::postprocessing_engine(
         const core::compute_context& compute_context,
         const core::gpu_scene_data& scene_data,
@@ -11,14 +23,46 @@ postprocessing_engine::postprocessing_engine(
         const glm::vec3& receiver,
         const core::environment& environment,
         const raytracer::simulation_parameters& raytracer,
-        std::unique_ptr<waveguide_base> waveguide)
+        std::unique_ptr<waveguide_base> waveguide,
+        size_t postprocess_workers)
         : engine_{compute_context,
                   scene_data,
                   source,
                   receiver,
                   environment,
                   raytracer,
-                  std::move(waveguide)} {}
+                  std::move(waveguide)}
+        , postprocess_workers_{postprocess_workers} {}
+
+std::unique_ptr<intermediate> postprocessing_engine::simulate(
+        const std::atomic_bool& keep_going) {
+    //  Only add engine listeners if things are listening to this object.
+
+    engine_state_changed::scoped_connection state;
+    if (!engine_state_changed_.empty()) {
+        state = engine_state_changed::scoped_connection{
+                engine_.connect_engine_state_changed(
+                        make_forwarding_call(engine_state_changed_))};
+    }
+
+    waveguide_node_pressures_changed::scoped_connection pressures;
+    if (!waveguide_node_pressures_changed_.empty()) {
+        pressures = waveguide_node_pressures_changed::scoped_connection{
+                engine_.connect_waveguide_node_pressures_changed(
+                        make_forwarding_call(
+                                waveguide_node_pressures_changed_))};
+    }
+
+    raytracer_reflections_generated::scoped_connection reflections;
+    if (!raytracer_reflections_generated_.empty()) {
+        reflections = raytracer_reflections_generated::scoped_connection{
+                engine_.connect_raytracer_reflections_generated(
+                        make_forwarding_call(
+                                raytracer_reflections_generated_))};
+    }
+
+    return engine_.run(keep_going);
+}
 
 postprocessing_engine::engine_state_changed::connection
 postprocessing_engine::connect_engine_state_changed(
@@ -45,5 +89,12 @@ const waveguide::voxels_and_mesh& postprocessing_engine::get_voxels_and_mesh()
     return engine_.get_voxels_and_mesh();
 }
 
+//  devices
+
+void postprocessing_engine::set_raytracer_devices(
+        util::aligned::vector<core::compute_context> devices) {
+    engine_.set_raytracer_devices(std::move(devices));
+}
+
 }  // namespace combined
 }  // namespace wayverb
@@ -0,0 +1,172 @@
+#include "combined/intermediate_cache.h"
+#include "combined/waveguide_base.h"
+
+#include "raytracer/simulation_parameters.h"
+
+#include "core/environment.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <type_traits>
+
+namespace wayverb {
+namespace combined {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+/// Part of every key, so that results computed by older simulation code are
+/// never reused. Bump it whenever a change alters what the raytracer or
+/// waveguide produce for the same inputs.
+constexpr std::uint32_t results_version = 1;
+
+/// FNV-1a, fed with plain values.
+class hasher final {
+public:
+    template <typename T>
+    void add(const T& t) {
+        static_assert(std::is_trivially_copyable<T>{}, "T must be plain data");
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &t, sizeof(T));
+        for (auto byte : bytes) {
+            hash_ = (hash_ ^ byte) * 0x100000001b3;
+        }
+    }
+
+    void add(const cl_float3& t) {
+        //  The fourth component is padding, and may hold anything.
+        add(t.s[0]);
+        add(t.s[1]);
+        add(t.s[2]);
+    }
+
+    void add(const glm::vec3& t) {
+        add(t.x);
+        add(t.y);
+        add(t.z);
+    }
+
+    template <typename T>
+    void add_range(const T& t) {
+        add(t.size());
+        for (const auto& i : t) {
+            add(i);
+        }
+    }
+
+    std::uint64_t get() const { return hash_; }
+
+private:
+    std::uint64_t hash_{0xcbf29ce484222325};
+};
+
+}  // namespace
+
+std::uint64_t compute_intermediate_key(
+        const core::gpu_scene_data& scene_data,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::environment& environment,
+        const raytracer::simulation_parameters& raytracer,
+        const waveguide_base& waveguide) {
+    hasher h;
+    h.add(results_version);
+    h.add_range(scene_data.get_vertices());
+    h.add_range(scene_data.get_triangles());
+    h.add_range(scene_data.get_surfaces());
+    h.add(source);
+    h.add(receiver);
+    h.add(environment.speed_of_sound);
+    h.add(environment.acoustic_impedance);
+    h.add(raytracer.rays);
+    h.add(raytracer.maximum_image_source_order);
+    h.add(raytracer.receiver_radius);
+    h.add(raytracer.histogram_sample_rate);
+    h.add(raytracer.rng_seed);
+    h.add(waveguide.compute_sampling_frequency());
+    h.add_range(waveguide.get_parameters());
+    h.add(static_cast<std::uint32_t>(waveguide.get_pressure_storage()));
+    return h.get();
+}
+
+std::optional<std::string> select_intermediate_cache_directory() {
+    const char* env = std::getenv("WAYVERB_CACHE_DIR");
+    if (env && *env) {
+        return std::string{env};
+    }
+    return std::nullopt;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+intermediate_cache::intermediate_cache(std::string directory)
+        : directory_{std::move(directory)} {
+    std::error_code error;
+    fs::create_directories(directory_, error);
+    if (error) {
+        std::cerr << "[cache] can't create " << directory_ << ": "
+                  << error.message() << '\n';
+    }
+}
+
+std::string intermediate_cache::get_path(std::uint64_t key) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".wvin";
+    return (fs::path{directory_} / name.str()).string();
+}
+
+std::unique_ptr<intermediate> intermediate_cache::load(
+        std::uint64_t key) const {
+    const auto path = get_path(key);
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        return nullptr;
+    }
+    try {
+        auto ret = load_intermediate(file);
+        std::cerr << "[cache] using results from " << path << '\n';
+        return ret;
+    } catch (const std::exception& e) {
+        std::cerr << "[cache] ignoring " << path << ": " << e.what() << '\n';
+        return nullptr;
+    }
+}
+
+void intermediate_cache::store(std::uint64_t key,
+                               const intermediate& results) const {
+    const auto path = get_path(key);
+    //  Random, as concurrent runs, possibly in other processes sharing the
+    //  directory, may store the same key.
+    std::random_device rd;
+    std::ostringstream temporary;
+    temporary << path << ".tmp." << std::hex << rd() << rd();
+    try {
+        {
+            std::ofstream file{temporary.str(), std::ios::binary};
+            if (!file) {
+                throw std::runtime_error{"can't open " + temporary.str()};
+            }
+            results.save(file);
+            if (!file) {
+                throw std::runtime_error{"failed writing " + temporary.str()};
+            }
+        }
+        fs::rename(temporary.str(), path);
+    } catch (const std::exception& e) {
+        std::cerr << "[cache] can't store results: " << e.what() << '\n';
+        std::error_code ignored;
+        fs::remove(temporary.str(), ignored);
+    }
+}
+
+}  // namespace combined
+}  // namespace wayverb
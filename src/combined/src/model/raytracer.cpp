@@ -38,6 +38,13 @@ void raytracer::set_room_volume(double volume) {
     notify();
 }
 
+void raytracer::set_seed(std::uint64_t seed) {
+    seed_ = seed;
+    notify();
+}
+
+std::uint64_t raytracer::get_seed() const { return seed_; }
+
 wayverb::raytracer::simulation_parameters raytracer::get() const {
     return wayverb::raytracer::make_simulation_parameters(
             quality_,
@@ -45,7 +52,8 @@ wayverb::raytracer::simulation_parameters raytracer::get() const {
             speed_of_sound_,
             histogram_sample_rate_,
             room_volume_,
-            img_src_order_);
+            img_src_order_,
+            seed_);
 }
 
 bool operator==(const raytracer& a, const raytracer& b) {
@@ -0,0 +1,151 @@
+#include "combined/run_scheduler.h"
+
+#include "waveguide/cl/filter_structs.h"
+#include "waveguide/cl/utils.h"
+#include "waveguide/config.h"
+
+#include "core/geo/box.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace wayverb {
+namespace combined {
+
+namespace {
+
+/// The condensed node, and the scratch used while the mesh is being built.
+constexpr size_t mesh_bytes_per_node = 24;
+
+/// Each band steps with previous, current and history pressure fields.
+constexpr size_t fields_per_band = 3;
+
+/// Boundary nodes lie on the room's surface, which for real geometry is
+/// larger than its bounding box's.
+constexpr double boundary_surface_factor = 2;
+
+/// Voxels, ray buffers and the like, which don't scale with the mesh.
+constexpr size_t fixed_bytes_per_run = size_t{64} << 20;
+
+}  // namespace
+
+size_t default_concurrent_runs() {
+    if (const char* env = std::getenv("WAYVERB_CONCURRENT_RUNS")) {
+        const auto parsed = std::strtoull(env, nullptr, 10);
+        if (parsed != 0) {
+            return parsed;
+        }
+    }
+    return 2;
+}
+
+size_t default_run_memory_budget(const core::compute_context& cc) {
+    if (const char* env = std::getenv("WAYVERB_RUN_MEMORY_MB")) {
+        const auto parsed = std::strtoull(env, nullptr, 10);
+        if (parsed != 0) {
+            return parsed << 20;
+        }
+    }
+    return cc.device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 4 * 3;
+}
+
+size_t estimate_run_memory(const core::gpu_scene_data& scene,
+                           double sampling_frequency,
+                           double speed_of_sound,
+                           size_t bands,
+                           waveguide::pressure_storage storage) {
+    const auto spacing = waveguide::config::grid_spacing(
+            speed_of_sound, 1 / sampling_frequency);
+    const auto extent =
+            util::dimensions(core::geo::compute_aabb(scene.get_vertices()));
+    //  Allow a node of padding on each side.
+    std::array<double, 3> dims;
+    for (auto i = 0; i != 3; ++i) {
+        dims[i] = std::ceil(extent[i] / spacing) + 2;
+    }
+    const auto nodes = dims[0] * dims[1] * dims[2];
+    const auto boundary_nodes =
+            boundary_surface_factor * 2 *
+            (dims[0] * dims[1] + dims[1] * dims[2] + dims[0] * dims[2]);
+
+    const auto bytes_per_node =
+            mesh_bytes_per_node +
+            bands * fields_per_band * waveguide::pressure_size(storage);
+    //  Every band has its own coefficients and filter memory for each face
+    //  of a boundary node.
+    const auto bytes_per_boundary_node =
+            bands * waveguide::num_ports *
+            (sizeof(waveguide::coefficients_canonical) +
+             sizeof(waveguide::memory_canonical));
+
+    return fixed_bytes_per_run +
+           static_cast<size_t>(nodes) * bytes_per_node +
+           static_cast<size_t>(boundary_nodes) * bytes_per_boundary_node;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+memory_admission::reservation::reservation(memory_admission& admission,
+                                           size_t bytes)
+        : admission_{&admission}
+        , bytes_{bytes} {}
+
+memory_admission::reservation::reservation(reservation&& other) noexcept
+        : admission_{other.admission_}
+        , bytes_{other.bytes_} {
+    other.admission_ = nullptr;
+}
+
+memory_admission::reservation::~reservation() noexcept {
+    if (admission_) {
+        admission_->release(bytes_);
+    }
+}
+
+memory_admission::memory_admission(size_t budget,
+                                   std::shared_ptr<core::buffer_pool> pool)
+        : budget_{budget}
+        , pool_{std::move(pool)} {}
+
+std::optional<memory_admission::reservation> memory_admission::reserve(
+        size_t bytes, const std::atomic_bool& keep_going) {
+    const auto fits = [&] {
+        if (budget_ < in_use_ + bytes) {
+            return false;
+        }
+        if (pool_ && budget_ < in_use_ + bytes + pool_->get_cached_bytes()) {
+            //  Cached buffers are only worth keeping if there's room for them.
+            pool_->clear();
+        }
+        return true;
+    };
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    //  Cancellation isn't signalled through the condition variable, so poll.
+    while (!cv_.wait_for(lock, std::chrono::milliseconds{100}, [&] {
+        return !keep_going || admitted_ == 0 || fits();
+    })) {
+    }
+    if (!keep_going) {
+        return std::nullopt;
+    }
+    in_use_ += bytes;
+    admitted_ += 1;
+    return reservation{*this, bytes};
+}
+
+size_t memory_admission::get_budget() const { return budget_; }
+
+void memory_admission::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        in_use_ -= bytes;
+        admitted_ -= 1;
+    }
+    cv_.notify_all();
+}
+
+}  // namespace combined
+}  // namespace wayverb
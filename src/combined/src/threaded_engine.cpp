@@ -1,10 +1,15 @@
 #include "combined/threaded_engine.h"
+#include "combined/channel_staging.h"
 #include "combined/forwarding_call.h"
+#include "combined/intermediate_cache.h"
+#include "combined/run_scheduler.h"
 #include "combined/validate_placements.h"
 #include "combined/waveguide_base.h"
 
 #include "waveguide/config.h"
+#include "waveguide/field_snapshot.h"
 
+#include "core/cl/device_set.h"
 #include "core/dsp_vector_ops.h"
 #include "core/environment.h"
 
@@ -14,23 +19,20 @@
 
 #include "glm/glm.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <memory>
 
 namespace wayverb {
 namespace combined {
 namespace {
 
-struct max_mag_functor final {
-    template <typename T>
-    auto operator()(const T& t) const {
-        return core::max_mag(t.data);
-    }
-};
-
 struct channel_info final {
-    util::aligned::vector<float> data;
+    /// Index in the channel_staging.
+    size_t staged{};
     std::string file_name;
     glm::vec3 source_position;
     glm::vec3 receiver_position;
@@ -92,6 +94,7 @@ size_t clamp_arrival_index(double arrival_samples,
 }
 
 bool inject_direct_path_impulse(channel_info& channel,
+                                util::aligned::vector<float>& data,
                                 const core::environment& environment) {
     const double sample_rate = sanitize_positive(channel.sample_rate,
                                                  kDefaultSampleRate,
@@ -130,10 +133,10 @@ bool inject_direct_path_impulse(channel_info& channel,
     const auto arrival_index =
             clamp_arrival_index(arrival_seconds * sample_rate, channel.file_name);
 
-    if (channel.data.size() <= arrival_index) {
-        channel.data.resize(arrival_index + 1, 0.0f);
+    if (data.size() <= arrival_index) {
+        data.resize(arrival_index + 1, 0.0f);
     }
-    auto& target_sample = channel.data[arrival_index];
+    auto& target_sample = data[arrival_index];
     if (!std::isfinite(target_sample)) {
         std::cerr << "[combined] direct-path fallback sanitized non-finite "
                      "sample before injection (file='"
@@ -149,10 +152,19 @@ bool inject_direct_path_impulse(channel_info& channel,
               << channel.file_name << "' (distance=" << distance
               << " m, sample=" << arrival_index << ", amp=" << amplitude
               << ", before=" << before << ", after=" << after
-              << ", samples=" << channel.data.size() << ")\n";
+              << ", samples=" << data.size() << ")\n";
     return true;
 }
 
+/// The bands a waveguide model advances at once.
+size_t waveguide_bands(const model::waveguide& i) {
+    switch (i.get_mode()) {
+        case model::waveguide::mode::single: return 1;
+        case model::waveguide::mode::multiple:
+            return i.multiple_band().item()->get().bands;
+    }
+}
+
 }  // namespace
 
 std::unique_ptr<capsule_base> polymorphic_capsule_model(
@@ -269,103 +281,247 @@ void complete_engine::do_run(core::compute_context compute_context,
         const auto poly_waveguide =
                 polymorphic_waveguide_model(*persistent.waveguide().item());
 
-        std::vector<channel_info> all_channels;
-
-        const auto runs = persistent.sources().item()->size() *
-                          persistent.receivers().item()->size();
+        auto& sources = *persistent.sources().item();
+        auto& receivers = *persistent.receivers().item();
 
-        auto run = 0;
+        const auto runs = sources.size() * receivers.size();
 
         const double output_sample_rate =
                 get_sample_rate(output.get_sample_rate());
 
-        //  For each source-receiver pair.
-        for (auto source = std::begin(*persistent.sources().item()),
-                  e_source = std::end(*persistent.sources().item());
-             source != e_source && keep_going_;
-             ++source) {
-            for (auto receiver = std::begin(*persistent.receivers().item()),
-                      e_receiver = std::end(*persistent.receivers().item());
-                 receiver != e_receiver && keep_going_;
-                 ++receiver, ++run) {
-                //  Set up an engine to use.
-                postprocessing_engine eng{compute_context,
-                                          scene_data,
-                                          source->item()->get_position(),
-                                          receiver->item()->get_position(),
-                                          environment,
-                                          persistent.raytracer().item()->get(),
-                                          poly_waveguide->clone()};
+        //  Pairs are rendered concurrently, so that one pair's waveguide can
+        //  run on the device while others are voxelised or postprocessed.
+        //  Each run makes its own command queues, and the memory estimate
+        //  keeps the runs in flight within the device's memory.
+        //  If WAYVERB_DEVICES selects several devices, pairs are dealt out
+        //  to them in turn, and each device gets its own memory budget.
+        //  Devices left over when there are fewer pairs share the raytracing
+        //  of the pairs that do have devices.
+        const auto devices = core::select_compute_contexts(compute_context);
+        const auto concurrent_runs = std::max<size_t>(
+                1,
+                std::min(default_concurrent_runs() * devices.size(), runs));
+        const auto postprocess_workers = std::max<size_t>(
+                1, default_postprocess_workers() / concurrent_runs);
+
+        std::vector<std::unique_ptr<memory_admission>> admissions;
+        for (const auto& device : devices) {
+            admissions.emplace_back(std::make_unique<memory_admission>(
+                    default_run_memory_budget(device), device.pool));
+        }
+        const auto run_memory = estimate_run_memory(
+                scene_data,
+                poly_waveguide->compute_sampling_frequency(),
+                environment.speed_of_sound,
+                waveguide_bands(*persistent.waveguide().item()),
+                poly_waveguide->get_pressure_storage());
+
+        std::cerr << "[combined] rendering " << runs << " pairs on "
+                  << devices.size() << " device(s), " << concurrent_runs
+                  << " at a time (about " << (run_memory >> 20) << " of "
+                  << (admissions.front()->get_budget() >> 20)
+                  << " MB each)\n";
+
+        //  Only one run at a time drives the visualisation, otherwise the
+        //  node pressures of different meshes would be interleaved.
+        std::atomic_bool visualisation_claimed{false};
+
+        //  Simulation results may be reused from earlier renders, if only
+        //  capsules or the output format have changed since.
+        const auto cache_directory = select_intermediate_cache_directory();
+        std::optional<intermediate_cache> cache;
+        if (cache_directory) {
+            cache.emplace(*cache_directory);
+        }
 
-                //  Send new node position notification.
-                waveguide_node_positions_changed_(
-                        eng.get_voxels_and_mesh().mesh.get_descriptor());
+        //  Rendered channels go straight to disk, so that memory use doesn't
+        //  grow with the number of pairs and capsules.
+        channel_staging staging{select_staging_directory()};
 
-                //  Register callbacks.
-                if (!engine_state_changed_.empty()) {
-                    eng.connect_engine_state_changed([this, runs, run](
-                            auto state, auto progress) {
-                        engine_state_changed_(run, runs, state, progress);
-                    });
-                }
+        const auto simulate = [&](size_t run,
+                                  const glm::vec3& source,
+                                  const glm::vec3& receiver) {
+            std::unique_ptr<intermediate> ret;
 
-                if (!waveguide_node_pressures_changed_.empty()) {
-                    eng.connect_waveguide_node_pressures_changed(
-                            make_forwarding_call(
-                                    waveguide_node_pressures_changed_));
-                }
+            const auto device = run % devices.size();
+            const auto reservation =
+                    admissions[device]->reserve(run_memory, keep_going_);
+            if (!reservation) {
+                return ret;
+            }
 
-                if (!raytracer_reflections_generated_.empty()) {
-                    eng.connect_raytracer_reflections_generated(
-                            make_forwarding_call(
-                                    raytracer_reflections_generated_));
+            //  Set up an engine to use.
+            postprocessing_engine eng{devices[device],
+                                      scene_data,
+                                      source,
+                                      receiver,
+                                      environment,
+                                      persistent.raytracer().item()->get(),
+                                      poly_waveguide->clone()};
+
+            //  Devices no other pair will use, if there are any.
+            util::aligned::vector<core::compute_context> raytracer_devices;
+            for (auto i = device; i < devices.size(); i += runs) {
+                raytracer_devices.emplace_back(devices[i]);
+            }
+            eng.set_raytracer_devices(std::move(raytracer_devices));
+
+            bool expected = false;
+            const auto visualised =
+                    visualisation_claimed.compare_exchange_strong(expected,
+                                                                  true);
+            const auto release_visualisation = [&] {
+                if (visualised) {
+                    visualisation_claimed = false;
                 }
+            };
 
-                const auto polymorphic_capsules = util::map_to_vector(
-                        std::begin(*receiver->item()->capsules().item()),
-                        std::end(*receiver->item()->capsules().item()),
-                        [&](const auto& i) {
-                            return polymorphic_capsule_model(
-                                    *i.item(),
-                                    receiver->item()->get_orientation());
+            if (visualised) {
+                //  Send new node position notification.
+                waveguide_node_positions_changed_(
+                        waveguide::compute_decimated_descriptor(
+                                eng.get_voxels_and_mesh().mesh.get_descriptor(),
+                                waveguide::select_snapshot_factor()));
+            }
+
+            //  Register callbacks.
+            if (!engine_state_changed_.empty()) {
+                eng.connect_engine_state_changed(
+                        [this, runs, run](auto state, auto progress) {
+                            engine_state_changed_(run, runs, state, progress);
                         });
+            }
 
-                //  Run the simulation, cache the result.
-                auto channel = eng.run(begin(polymorphic_capsules),
-                                       end(polymorphic_capsules),
-                                       output_sample_rate,
-                                       keep_going_);
+            if (visualised && !waveguide_node_pressures_changed_.empty()) {
+                eng.connect_waveguide_node_pressures_changed(
+                        make_forwarding_call(waveguide_node_pressures_changed_));
+            }
 
-                //  If user cancelled while processing the channel, channel
-                //  will be null, but we want to exit before throwing an
-                //  exception.
+            if (visualised && !raytracer_reflections_generated_.empty()) {
+                eng.connect_raytracer_reflections_generated(
+                        make_forwarding_call(raytracer_reflections_generated_));
+            }
+
+            try {
+                ret = eng.simulate(keep_going_);
+            } catch (...) {
+                release_visualisation();
+                throw;
+            }
+            release_visualisation();
+            return ret;
+        };
+
+        const auto render = [&](size_t run) {
+            std::vector<channel_info> ret;
+
+            const auto source = std::next(std::begin(sources),
+                                          run / receivers.size());
+            const auto receiver = std::next(std::begin(receivers),
+                                            run % receivers.size());
+            const auto source_position = source->item()->get_position();
+            const auto receiver_position = receiver->item()->get_position();
+
+            const auto key =
+                    cache ? compute_intermediate_key(
+                                    scene_data,
+                                    source_position,
+                                    receiver_position,
+                                    environment,
+                                    persistent.raytracer().item()->get(),
+                                    *poly_waveguide)
+                          : 0;
+
+            auto results = cache ? cache->load(key) : nullptr;
+            if (!results) {
+                results = simulate(run, source_position, receiver_position);
+
+                //  If user cancelled while simulating, results will be null,
+                //  but we want to exit before throwing an exception.
                 if (!keep_going_) {
-                    break;
+                    return ret;
                 }
 
-                if (!channel) {
+                if (!results) {
                     throw std::runtime_error{
-                            "Encountered unknown error, causing channel not to "
-                            "be rendered."};
+                            "Encountered unknown error, causing channel not "
+                            "to be rendered."};
                 }
 
-                for (size_t i = 0,
-                            e = receiver->item()->capsules().item()->size();
-                     i != e;
-                     ++i) {
-                    all_channels.emplace_back(channel_info{
-                            std::move((*channel)[i]),
-                            compute_output_path(
-                                    *source->item(),
-                                    *receiver->item(),
-                                    *(*receiver->item()->capsules().item())[i]
-                                             .item(),
-                                    output),
-                            source->item()->get_position(),
-                            receiver->item()->get_position(),
-                            output_sample_rate});
+                if (cache) {
+                    cache->store(key, *results);
                 }
             }
+
+            if (!engine_state_changed_.empty()) {
+                engine_state_changed_(run, runs, state::postprocessing, 1.0);
+            }
+
+            const auto polymorphic_capsules = util::map_to_vector(
+                    std::begin(*receiver->item()->capsules().item()),
+                    std::end(*receiver->item()->capsules().item()),
+                    [&](const auto& i) {
+                        return polymorphic_capsule_model(
+                                *i.item(), receiver->item()->get_orientation());
+                    });
+
+            //  The engine, and its device memory, are gone by now.
+            util::thread_pool pool{postprocess_workers};
+            auto channel = postprocess_capsules(*results,
+                                                begin(polymorphic_capsules),
+                                                end(polymorphic_capsules),
+                                                output_sample_rate,
+                                                keep_going_,
+                                                pool);
+
+            if (!(keep_going_ && channel)) {
+                return ret;
+            }
+
+            for (size_t i = 0, e = receiver->item()->capsules().item()->size();
+                 i != e;
+                 ++i) {
+                ret.emplace_back(channel_info{
+                        staging.add((*channel)[i]),
+                        compute_output_path(
+                                *source->item(),
+                                *receiver->item(),
+                                *(*receiver->item()->capsules().item())[i]
+                                         .item(),
+                                output),
+                        source_position,
+                        receiver_position,
+                        output_sample_rate});
+            }
+            return ret;
+        };
+
+        //  Results are gathered in pair order, so output doesn't depend on
+        //  which run finishes first.
+        std::vector<std::future<std::vector<channel_info>>> futures;
+        {
+            util::thread_pool pool{concurrent_runs};
+            futures.reserve(runs);
+            for (size_t run = 0; run != runs; ++run) {
+                futures.emplace_back(pool.submit([&, run] {
+                    try {
+                        return render(run);
+                    } catch (...) {
+                        //  Stop the other runs early.
+                        keep_going_ = false;
+                        throw;
+                    }
+                }));
+            }
+            //  The pool finishes all runs before it is destroyed.
+        }
+
+        std::vector<channel_info> all_channels;
+        for (auto& future : futures) {
+            auto channels = future.get();
+            std::move(begin(channels),
+                      end(channels),
+                      std::back_inserter(all_channels));
         }
 
         //  If keep going is false now, then the simulation was cancelled.
@@ -375,34 +531,24 @@ void complete_engine::do_run(core::compute_context compute_context,
             }
 
             //  Normalize.
-            const auto make_iterator = [](auto it) {
-                return util::make_mapping_iterator_adapter(std::move(it),
-                                                           max_mag_functor{});
-            };
-
-            const auto recompute_max_mag = [&]() {
-                return *std::max_element(make_iterator(begin(all_channels)),
-                                         make_iterator(end(all_channels)));
-            };
-
-            auto max_mag = recompute_max_mag();
+            auto max_mag = staging.get_peak();
 
             if (max_mag == 0.0f) {
                 bool injected = false;
                 for (auto& channel : all_channels) {
-                    injected |= inject_direct_path_impulse(channel, environment);
-                }
-                if (injected) {
-                    for (size_t ci = 0; ci < all_channels.size(); ++ci) {
-                        const auto& channel = all_channels[ci];
-                        const auto post_max = core::max_mag(channel.data);
-                        std::cerr << "[combined] channel[" << ci
+                    auto data = staging.read(channel.staged);
+                    if (inject_direct_path_impulse(channel, data, environment)) {
+                        injected = true;
+                        std::cerr << "[combined] channel[" << channel.staged
                                   << "] max after direct-path "
                                      "injection="
-                                  << post_max << " file='" << channel.file_name
-                                  << "'\n";
+                                  << core::max_mag(data) << " file='"
+                                  << channel.file_name << "'\n";
+                        staging.replace(channel.staged, data);
                     }
-                    max_mag = recompute_max_mag();
+                }
+                if (injected) {
+                    max_mag = staging.get_peak();
                 }
                 if (max_mag == 0.0f) {
                     // Detailed diagnostics for silent outputs
@@ -412,7 +558,7 @@ void complete_engine::do_run(core::compute_context compute_context,
                         const auto& ch = all_channels[ci];
                         float local_max = 0.0f;
                         size_t nonzero = 0;
-                        for (const auto& s : ch.data) {
+                        for (const auto& s : staging.read(ch.staged)) {
                             const float a = std::abs(s);
                             if (a > local_max) local_max = a;
                             if (a > eps) ++nonzero;
@@ -427,20 +573,21 @@ void complete_engine::do_run(core::compute_context compute_context,
 
             const auto factor = 1.0 / max_mag;
 
-            for (auto& channel : all_channels) {
-                for (auto& sample : channel.data) {
+            //  Rescale and write out files, a few channels at a time.
+            util::thread_pool pool{default_postprocess_workers()};
+            util::parallel_for(pool, all_channels.size(), [&](auto i) {
+                const auto& channel = all_channels[i];
+                auto data = staging.read(channel.staged);
+                for (auto& sample : data) {
                     sample *= factor;
                 }
-            }
-
-            //  Write out files.
-            for (const auto& i : all_channels) {
-                audio_file::write(i.file_name.c_str(),
-                                  i.data,
+                audio_file::write(channel.file_name.c_str(),
+                                  data,
                                   get_sample_rate(output.get_sample_rate()),
                                   output.get_format(),
                                   output.get_bit_depth());
-            }
+                staging.remove(channel.staged);
+            });
         }
 
     } catch (const std::exception& e) {
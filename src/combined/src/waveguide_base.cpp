@@ -21,6 +21,14 @@ public:
         return waveguide::compute_sampling_frequency(sim_params_);
     }
 
+    util::aligned::vector<double> get_parameters() const override {
+        return flatten_parameters(sim_params_);
+    }
+
+    waveguide::pressure_storage get_pressure_storage() const override {
+        return waveguide::canonical_pressure_storage(sim_params_);
+    }
+
     std::optional<util::aligned::vector<waveguide::bandpass_band>>
     run(const core::compute_context& cc,
         const waveguide::voxels_and_mesh& voxelised,
@@ -32,16 +40,18 @@ public:
         std::function<void(cl::CommandQueue& queue,
                            const cl::Buffer& buffer,
                            size_t step,
-                           size_t steps)> pressure_callback) override {
+                           size_t steps)> pressure_callback,
+        bool pressures_wanted) override {
         return waveguide::canonical(cc,
-                                    std::move(voxelised),
+                                    voxelised,
                                     source,
                                     receiver,
                                     environment,
                                     sim_params_,
                                     simulation_time,
                                     keep_going,
-                                    std::move(pressure_callback));
+                                    std::move(pressure_callback),
+                                    pressures_wanted);
     }
 
 private:
@@ -83,6 +83,14 @@ public:
         return waveguide::compute_sampling_frequency(sim_);
     }
 
+    util::aligned::vector<double> get_parameters() const override {
+        return flatten_parameters(sim_);
+    }
+
+    waveguide::pressure_storage get_pressure_storage() const override {
+        return waveguide::canonical_pressure_storage(sim_);
+    }
+
     std::optional<util::aligned::vector<waveguide::bandpass_band>> run(
             const core::compute_context& cc,
             const waveguide::voxels_and_mesh& voxelised,
@@ -91,23 +99,24 @@ public:
             const core::environment& env,
             double simulation_time,
             const std::atomic_bool& keep,
-            std::function<void(cl::CommandQueue&, const cl::Buffer&, size_t, size_t)> pressure_cb) override {
+            std::function<void(cl::CommandQueue&, const cl::Buffer&, size_t, size_t)> pressure_cb,
+            bool pressures_wanted) override {
         const char* force = std::getenv("WAYVERB_METAL");
         if (force && std::string(force) == std::string("force-opencl")) {
-            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb));
+            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb), pressures_wanted);
         }
 
         metal::context mctx;
         if (!mctx.valid()) {
             std::cerr << "[metal] No MTLDevice available; falling back to OpenCL\n";
-            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb));
+            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb), pressures_wanted);
         }
 
         metal::waveguide_pipeline pipeline{mctx};
         metal::waveguide_simulation simulation{mctx, pipeline, voxelised.mesh};
         if (!simulation.valid()) {
             std::cerr << "[metal] Waveguide simulation setup failed; falling back to OpenCL\n";
-            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb));
+            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb), pressures_wanted);
         }
 
         const auto sample_rate = waveguide::compute_sample_rate(
@@ -176,7 +185,7 @@ public:
         if (!keep || completed != ideal_steps || outputs.size() != ideal_steps) {
             std::cerr << "[metal] simulation did not complete (steps=" << completed
                       << "/" << ideal_steps << "); falling back to OpenCL\n";
-            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb));
+            return waveguide::canonical(cc, voxelised, source, receiver, env, sim_, simulation_time, keep, std::move(pressure_cb), pressures_wanted);
         }
 
         waveguide::band band_value{
@@ -0,0 +1,41 @@
+#include "combined/channel_staging.h"
+
+#include "gtest/gtest.h"
+
+#include <filesystem>
+
+using namespace wayverb::combined;
+
+TEST(channel_staging, round_trip_and_peak) {
+    const auto directory =
+            (std::filesystem::path{SCRATCH_PATH} / "channel_staging_test")
+                    .string();
+    {
+        channel_staging staging{directory};
+        ASSERT_EQ(staging.get_peak(), 0);
+
+        const util::aligned::vector<float> a{0.1f, -0.5f, 0.25f};
+        const util::aligned::vector<float> b{};
+        const auto ia = staging.add(a);
+        const auto ib = staging.add(b);
+
+        ASSERT_EQ(staging.size(), 2u);
+        ASSERT_EQ(staging.read(ia), a);
+        ASSERT_EQ(staging.read(ib), b);
+        ASSERT_FLOAT_EQ(staging.get_peak(), 0.5);
+
+        const util::aligned::vector<float> c{0, 0, 0, -2};
+        staging.replace(ib, c);
+        ASSERT_EQ(staging.read(ib), c);
+        ASSERT_FLOAT_EQ(staging.get_peak(), 2);
+    }
+    ASSERT_FALSE(std::filesystem::exists(directory));
+}
+
+TEST(channel_staging, directories_are_unique) {
+    //  Renders sharing WAYVERB_STAGING_DIR each get their own directory.
+    const std::filesystem::path a{select_staging_directory()};
+    const std::filesystem::path b{select_staging_directory()};
+    ASSERT_NE(a, b);
+    ASSERT_EQ(a.parent_path(), b.parent_path());
+}
@@ -0,0 +1,66 @@
+#include "combined/intermediate_cache.h"
+#include "combined/waveguide_base.h"
+
+#include "raytracer/simulation_parameters.h"
+
+#include "waveguide/simulation_parameters.h"
+
+#include "core/environment.h"
+#include "core/geo/box.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::combined;
+using namespace wayverb::core;
+
+TEST(intermediate_cache, key_tracks_simulation_inputs) {
+    const auto box = geo::box{glm::vec3{0, 0, 0}, glm::vec3{5, 4, 3}};
+    const auto scene_data =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0.1));
+    const glm::vec3 source{1, 1, 1};
+    const glm::vec3 receiver{2, 2, 2};
+    const environment environment{};
+    const wayverb::raytracer::simulation_parameters raytracer{1 << 16, 4};
+    const auto waveguide = make_waveguide_ptr(
+            wayverb::waveguide::single_band_parameters{500, 0.6});
+
+    const auto key = compute_intermediate_key(
+            scene_data, source, receiver, environment, raytracer, *waveguide);
+
+    ASSERT_EQ(key,
+              compute_intermediate_key(scene_data,
+                                       source,
+                                       receiver,
+                                       environment,
+                                       raytracer,
+                                       *waveguide->clone()));
+
+    ASSERT_NE(key,
+              compute_intermediate_key(scene_data,
+                                       source,
+                                       glm::vec3{2, 2, 2.5},
+                                       environment,
+                                       raytracer,
+                                       *waveguide));
+
+    ASSERT_NE(key,
+              compute_intermediate_key(
+                      geo::get_scene_data(
+                              box, make_surface<simulation_bands>(0.2, 0.1)),
+                      source,
+                      receiver,
+                      environment,
+                      raytracer,
+                      *waveguide));
+
+    ASSERT_NE(key,
+              compute_intermediate_key(
+                      scene_data,
+                      source,
+                      receiver,
+                      environment,
+                      raytracer,
+                      *make_waveguide_ptr(
+                              wayverb::waveguide::single_band_parameters{
+                                      1000, 0.6})));
+}
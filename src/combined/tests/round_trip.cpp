@@ -91,6 +91,25 @@ TEST(round_trip, receiver) {
 
 TEST(round_trip, raytracer) {
     round_trip(model::raytracer{});
+
+    model::raytracer seeded{};
+    seeded.set_seed(12345);
+    round_trip(seeded);
+}
+
+TEST(round_trip, raytracer_without_seed) {
+    //  As saved before the seed was serialized.
+    std::stringstream serialized{
+            R"({"value0": {"value0": 5, "value1": 3}})"};
+    model::raytracer deserialized{};
+    deserialized.set_seed(1);
+    {
+        cereal::JSONInputArchive archive(serialized);
+        archive(deserialized);
+    }
+    ASSERT_EQ(deserialized.get_quality(), 5u);
+    ASSERT_EQ(deserialized.get_max_img_src_order(), 3u);
+    ASSERT_EQ(deserialized.get_seed(), model::raytracer::default_seed);
 }
 
 TEST(round_trip, single_band_waveguide) {
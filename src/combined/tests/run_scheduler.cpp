@@ -0,0 +1,92 @@
+#include "combined/run_scheduler.h"
+
+#include "core/geo/box.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace wayverb::combined;
+
+TEST(run_scheduler, admission_respects_budget) {
+    memory_admission admission{100};
+    std::atomic_bool keep_going{true};
+
+    auto first = admission.reserve(60, keep_going);
+    ASSERT_TRUE(first);
+
+    std::atomic_bool second_admitted{false};
+    std::thread waiter{[&] {
+        const auto second = admission.reserve(60, keep_going);
+        second_admitted = static_cast<bool>(second);
+    }};
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    ASSERT_FALSE(second_admitted);
+
+    first = std::nullopt;
+    waiter.join();
+    ASSERT_TRUE(second_admitted);
+}
+
+TEST(run_scheduler, oversized_run_is_admitted_alone) {
+    memory_admission admission{100};
+    std::atomic_bool keep_going{true};
+    ASSERT_TRUE(admission.reserve(1000, keep_going));
+}
+
+TEST(run_scheduler, cancel_stops_waiting) {
+    memory_admission admission{100};
+    std::atomic_bool keep_going{true};
+
+    const auto first = admission.reserve(100, keep_going);
+    ASSERT_TRUE(first);
+
+    std::thread canceller{[&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        keep_going = false;
+    }};
+    ASSERT_FALSE(admission.reserve(1, keep_going));
+    canceller.join();
+}
+
+TEST(run_scheduler, pooled_buffers_count_against_budget) {
+    const wayverb::core::compute_context cc{};
+    { const wayverb::core::pooled_buffer buffer{cc, 1 << 20}; }
+    ASSERT_EQ(cc.pool->get_cached_bytes(), 1u << 20);
+
+    memory_admission admission{(1 << 20) + 100, cc.pool};
+    std::atomic_bool keep_going{true};
+
+    //  There's room for this run and the cached buffer.
+    const auto first = admission.reserve(100, keep_going);
+    ASSERT_TRUE(first);
+    ASSERT_EQ(cc.pool->get_cached_bytes(), 1u << 20);
+
+    //  This run only fits once the cached buffer has gone.
+    const auto second = admission.reserve(1 << 20, keep_going);
+    ASSERT_TRUE(second);
+    ASSERT_EQ(cc.pool->get_cached_bytes(), 0u);
+}
+
+TEST(run_scheduler, estimate_tracks_bands_and_storage) {
+    using namespace wayverb::core;
+    using wayverb::waveguide::pressure_storage;
+
+    const auto box = geo::box{glm::vec3{0, 0, 0}, glm::vec3{5, 4, 3}};
+    const auto scene_data =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0.1));
+    const auto estimate = [&](size_t bands, pressure_storage storage) {
+        return estimate_run_memory(scene_data, 4000, 340, bands, storage);
+    };
+
+    //  Every band adds the same again.
+    const auto one = estimate(1, pressure_storage::single);
+    const auto two = estimate(2, pressure_storage::single);
+    const auto eight = estimate(8, pressure_storage::single);
+    ASSERT_LT(one, two);
+    ASSERT_EQ(eight - one, (two - one) * 7);
+
+    ASSERT_LT(estimate(8, pressure_storage::half), eight);
+}
@@ -21,6 +21,13 @@ public:
     }
 
     const auto& get_output() const { return output_; }
+    const T& get_postprocessor() const { return postprocessor_; }
+
+    /// Replaces the accumulated state, e.g. when resuming a saved run.
+    void restore(T postprocessor, util::aligned::vector<Ret> output) {
+        postprocessor_ = std::move(postprocessor);
+        output_ = std::move(output);
+    }
 
 private:
     util::aligned::vector<Ret> output_;
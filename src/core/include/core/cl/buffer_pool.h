@@ -0,0 +1,125 @@
+#pragma once
+
+#include "core/cl/include.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace wayverb {
+namespace core {
+
+class compute_context;
+
+/// Device allocations which have been given back, kept for reuse.
+///
+/// Every compute_context owns one (copies of a compute_context share it),
+/// so cached memory is freed along with the last copy of the context and the
+/// last buffer borrowed from it.
+///
+/// The pool keeps at most WAYVERB_BUFFER_POOL_MB megabytes (default 128),
+/// dropping the least recently returned buffers first.
+class buffer_pool final {
+public:
+    buffer_pool();
+    explicit buffer_pool(size_t capacity);
+
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+    buffer_pool(buffer_pool&&) noexcept = delete;
+    buffer_pool& operator=(buffer_pool&&) noexcept = delete;
+
+    /// Returns a free allocation of exactly `size` bytes, or a null buffer.
+    cl::Buffer take(size_t size, cl_mem_flags flags);
+
+    void give(size_t size, cl_mem_flags flags, cl::Buffer buffer);
+
+    /// Drops every buffer the pool is holding.
+    void clear();
+
+    /// Device memory held by buffers waiting to be reused.
+    size_t get_cached_bytes() const;
+
+private:
+    struct entry final {
+        cl_mem_flags flags;
+        size_t size;
+        cl::Buffer buffer;
+    };
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    /// Most recently returned first.
+    std::list<entry> entries_;
+    size_t cached_{0};
+};
+
+/// A device buffer borrowed from a compute_context's buffer_pool.
+///
+/// Allocations are rounded up to a power-of-two size class, so that code
+/// which creates the same buffers over and over (one raytracer segment after
+/// another, say) reuses device memory instead of asking the driver for more.
+/// The buffer handed out is exactly as large as requested, so CL_MEM_SIZE
+/// and items_in_buffer work as usual.
+///
+/// The allocation goes back to the pool when the pooled_buffer is destroyed,
+/// so any commands using it must have finished by then.
+class pooled_buffer final {
+public:
+    pooled_buffer() = default;
+    pooled_buffer(const compute_context& cc,
+                  size_t bytes,
+                  cl_mem_flags flags = CL_MEM_READ_WRITE);
+
+    pooled_buffer(const pooled_buffer&) = delete;
+    pooled_buffer& operator=(const pooled_buffer&) = delete;
+    pooled_buffer(pooled_buffer&& other) noexcept;
+    pooled_buffer& operator=(pooled_buffer&& other) noexcept;
+
+    ~pooled_buffer() noexcept;
+
+    cl::Buffer& get() { return view_; }
+    const cl::Buffer& get() const { return view_; }
+
+    operator cl::Buffer&() { return view_; }
+    operator const cl::Buffer&() const { return view_; }
+
+private:
+    void release() noexcept;
+
+    std::shared_ptr<buffer_pool> pool_;
+    cl_mem_flags flags_{0};
+    cl::Buffer allocation_;
+    cl::Buffer view_;
+};
+
+/// The pool rounds requests up to this size.
+size_t buffer_size_class(size_t bytes);
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Transfers through pinned host memory (CL_MEM_ALLOC_HOST_PTR) borrowed from
+/// the context's pool, which drivers can DMA to and from directly. Large
+/// transfers are streamed through one pinned chunk of up to 32 MB rather than
+/// staged whole. Small transfers, where pinning costs more than it saves, go
+/// straight through instead. `queue` must belong to `cc`.
+
+/// Reads `bytes` from `buffer`, starting at `offset`, into `output`.
+/// Blocks until the data has arrived.
+void read_staged(const compute_context& cc,
+                 cl::CommandQueue& queue,
+                 const cl::Buffer& buffer,
+                 size_t offset,
+                 size_t bytes,
+                 void* output);
+
+/// Creates a device buffer holding a copy of `bytes` from `input`.
+/// Blocks until the upload has finished.
+cl::Buffer load_staged(const compute_context& cc,
+                       cl::CommandQueue& queue,
+                       const void* input,
+                       size_t bytes,
+                       cl_mem_flags flags);
+
+}  // namespace core
+}  // namespace wayverb
@@ -1,9 +1,15 @@
 #pragma once
 
+#include "core/cl/buffer_pool.h"
 #include "core/cl/traits.h"
 
 #include "utilities/aligned/vector.h"
 
+#include <future>
+#include <iterator>
+#include <memory>
+#include <vector>
+
 namespace wayverb {
 namespace core {
 
@@ -12,18 +18,44 @@ enum class device_type { cpu, gpu };
 /// invariant: device is a valid device for the context
 class compute_context final {
 public:
+    /// Uses the best device on any platform (see select_devices in
+    /// core/cl/device_set.h), or the best one WAYVERB_DEVICES selects.
     compute_context();
+    /// Uses the best device of this type on any platform.
     explicit compute_context(device_type type);
     explicit compute_context(const cl::Context& context);
     compute_context(const cl::Context& context, const cl::Device& device);
 
     cl::Context context;
     cl::Device device;
+    /// Shared between copies, and freed with the last of them.
+    std::shared_ptr<buffer_pool> pool;
 };
 
+/// `t` must be a contiguous container, like a vector.
+template <typename T>
+cl::Buffer load_to_buffer(const cl::Context& context,
+                          const T& t,
+                          bool read_only) {
+    return cl::Buffer{context,
+                      (read_only ? CL_MEM_READ_ONLY : CL_MEM_READ_WRITE) |
+                              CL_MEM_COPY_HOST_PTR,
+                      sizeof(*std::data(t)) * std::size(t),
+                      const_cast<void*>(static_cast<const void*>(
+                              std::data(t)))};
+}
+
+/// As above, but large uploads are staged through pinned memory on `queue`.
 template <typename T>
-cl::Buffer load_to_buffer(const cl::Context& context, T t, bool read_only) {
-    return cl::Buffer{context, std::begin(t), std::end(t), read_only};
+cl::Buffer load_to_buffer(const compute_context& cc,
+                          cl::CommandQueue& queue,
+                          const T& t,
+                          bool read_only) {
+    return load_staged(cc,
+                       queue,
+                       std::data(t),
+                       sizeof(*std::data(t)) * std::size(t),
+                       read_only ? CL_MEM_READ_ONLY : CL_MEM_READ_WRITE);
 }
 
 template <typename T>
@@ -35,7 +67,18 @@ template <typename T>
 util::aligned::vector<T> read_from_buffer(cl::CommandQueue& queue,
                                           const cl::Buffer& buffer) {
     util::aligned::vector<T> ret(items_in_buffer<T>(buffer));
-    cl::copy(queue, buffer, ret.begin(), ret.end());
+    queue.enqueueReadBuffer(
+            buffer, CL_TRUE, 0, sizeof(T) * ret.size(), ret.data());
+    return ret;
+}
+
+/// As above, but large reads are staged through pinned memory.
+template <typename T>
+util::aligned::vector<T> read_from_buffer(const compute_context& cc,
+                                          cl::CommandQueue& queue,
+                                          const cl::Buffer& buffer) {
+    util::aligned::vector<T> ret(items_in_buffer<T>(buffer));
+    read_staged(cc, queue, buffer, 0, sizeof(T) * ret.size(), ret.data());
     return ret;
 }
 
@@ -56,5 +99,99 @@ void write_value(cl::CommandQueue& queue,
             buffer, CL_TRUE, sizeof(T) * index, sizeof(T), &val);
 }
 
+//  non-blocking transfers  ////////////////////////////////////////////////////
+
+/// These enqueue a transfer and return without waiting for it.
+///
+/// Host storage passed in must stay valid, and mustn't be touched, until the
+/// returned event completes. Staging storage from a pinned pooled_buffer, or
+/// a mapped CL_MEM_ALLOC_HOST_PTR buffer, makes for the fastest transfers.
+///
+/// `wait_for` lists events the transfer must follow, such as the kernel that
+/// produces the data. Commands on an in-order queue already run in order, so
+/// it's only needed for events from other queues.
+
+template <typename T>
+cl::Event read_from_buffer_async(
+        cl::CommandQueue& queue,
+        const cl::Buffer& buffer,
+        size_t index,
+        size_t items,
+        T* output,
+        const std::vector<cl::Event>* wait_for = nullptr) {
+    cl::Event ret;
+    queue.enqueueReadBuffer(buffer,
+                            CL_FALSE,
+                            sizeof(T) * index,
+                            sizeof(T) * items,
+                            output,
+                            wait_for,
+                            &ret);
+    return ret;
+}
+
+/// Reads the whole buffer into fresh storage, which the future hands over
+/// once the read has finished.
+template <typename T>
+std::future<util::aligned::vector<T>> read_from_buffer_async(
+        cl::CommandQueue& queue,
+        const cl::Buffer& buffer,
+        const std::vector<cl::Event>* wait_for = nullptr) {
+    auto storage = std::make_shared<util::aligned::vector<T>>(
+            items_in_buffer<T>(buffer));
+    const auto event = read_from_buffer_async(
+            queue, buffer, 0, storage->size(), storage->data(), wait_for);
+    queue.flush();
+    return std::async(std::launch::deferred, [storage, event] {
+        event.wait();
+        return std::move(*storage);
+    });
+}
+
+template <typename T>
+cl::Event read_value_async(cl::CommandQueue& queue,
+                           const cl::Buffer& buffer,
+                           size_t index,
+                           T& output,
+                           const std::vector<cl::Event>* wait_for = nullptr) {
+    return read_from_buffer_async(queue, buffer, index, 1, &output, wait_for);
+}
+
+template <typename T>
+cl::Event write_to_buffer_async(
+        cl::CommandQueue& queue,
+        cl::Buffer& buffer,
+        size_t index,
+        size_t items,
+        const T* input,
+        const std::vector<cl::Event>* wait_for = nullptr) {
+    cl::Event ret;
+    queue.enqueueWriteBuffer(buffer,
+                             CL_FALSE,
+                             sizeof(T) * index,
+                             sizeof(T) * items,
+                             input,
+                             wait_for,
+                             &ret);
+    return ret;
+}
+
+/// Unlike the other transfers, `val` is copied when the write is enqueued,
+/// so it needn't outlive the call.
+template <typename T>
+cl::Event write_value_async(cl::CommandQueue& queue,
+                            cl::Buffer& buffer,
+                            size_t index,
+                            T val,
+                            const std::vector<cl::Event>* wait_for = nullptr) {
+    //  Fill patterns must be a power of two bytes, up to 128.
+    static_assert(sizeof(T) <= 128 && (sizeof(T) & (sizeof(T) - 1)) == 0,
+                  "write_value_async needs a power-of-two sized value");
+    cl::Event ret;
+    queue.enqueueFillBuffer(
+            buffer, val, sizeof(T) * index, sizeof(T), wait_for, &ret);
+    return ret;
+}
+
 }  // namespace core
 }  // namespace wayverb
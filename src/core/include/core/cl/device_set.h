@@ -0,0 +1,81 @@
+#pragma once
+
+#include "core/cl/common.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace wayverb {
+namespace core {
+
+/// An available OpenCL device, on any platform.
+struct device_info final {
+    cl::Device device;
+    std::string name;
+    std::string platform;
+    cl_device_type type;
+    cl_ulong global_memory;
+    bool double_precision;
+    /// Set for one NUMA node's share of a larger device.
+    bool sub_device;
+};
+
+bool supports_double_precision(const cl::Device& device);
+
+/// Lists every available device on every platform, in platform order.
+/// If `split_numa` is set, a device which can be partitioned by NUMA node
+/// (usually a CPU with several sockets) is listed as one sub-device per
+/// node, in place of the whole device.
+std::vector<device_info> enumerate_devices(bool split_numa = false);
+
+/// Which devices to use.
+struct device_selection final {
+    /// Only devices whose name contains this.
+    std::string name;
+    /// Only devices of this type.
+    cl_device_type type = CL_DEVICE_TYPE_ALL;
+    /// Only devices with at least this much global memory.
+    cl_ulong min_memory = 0;
+    /// Only these entries of enumerate_devices, in this order.
+    std::vector<size_t> indices;
+    /// See enumerate_devices.
+    bool split_numa = false;
+    /// Use at most this many devices. Zero means no limit.
+    size_t max_devices = 0;
+};
+
+/// Parses a selection from a comma-separated list of terms:
+///     gpu, cpu, all       device type
+///     name=<text>         name contains text
+///     min_memory_mb=<N>   at least N megabytes of global memory
+///     count=<N>           at most N devices
+///     numa                split multi-socket devices by NUMA node
+///     <N>                 device N from enumerate_devices
+/// For example "gpu,min_memory_mb=4096" or "cpu,numa" or "0,2".
+/// Throws on terms it doesn't recognise.
+device_selection parse_device_selection(const std::string& spec);
+
+/// The selection given by WAYVERB_DEVICES, if it is set.
+std::optional<device_selection> device_selection_from_environment();
+
+/// Returns the devices which match `selection`, best first: GPUs, then
+/// devices with double precision, then in enumeration order. If the
+/// selection lists indices, their order is kept instead.
+std::vector<device_info> select_devices(const device_selection& selection);
+
+/// Makes one context per device, so that devices from different platforms
+/// can be used together.
+util::aligned::vector<compute_context> make_compute_contexts(
+        const std::vector<device_info>& devices);
+
+/// The devices to spread independent work (like concurrent source-receiver
+/// runs, or the slabs of a decomposed waveguide) over: everything
+/// WAYVERB_DEVICES selects, or just `fallback` if it isn't set.
+util::aligned::vector<compute_context> select_compute_contexts(
+        const compute_context& fallback);
+
+}  // namespace core
+}  // namespace wayverb
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "core/cl/include.h"
+
+namespace wayverb {
+namespace core {
+
+/// Properties for command queues whose work should show up in profiles:
+/// CL_QUEUE_PROFILING_ENABLE while util::instrumentation is recording, and
+/// nothing otherwise, so that drivers don't pay for timestamps nobody reads.
+cl_command_queue_properties profiling_queue_properties();
+
+/// Once `event` completes, records the time the device spent executing it as
+/// a span on the device track (see utilities/instrumentation.h).
+/// Doesn't wait for the event. Does nothing when recording is off, or when
+/// the event's queue wasn't created with profiling enabled.
+void profile_event(const char* name, const cl::Event& event);
+
+}  // namespace core
+}  // namespace wayverb
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <exception>
+#include <stdexcept>
 
 namespace wayverb {
 namespace core {
@@ -29,6 +29,10 @@ class value_is_inf final : public suspicious_value {
     using suspicious_value::suspicious_value;
 };
 
+class inexact_ratio final : public exception {
+    using exception::exception;
+};
+
 }  // namespace exceptions
 }  // namespace core
 }  // namespace wayverb
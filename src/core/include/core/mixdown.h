@@ -1,5 +1,7 @@
 #pragma once
 
+#include "core/simd_biquad.h"
+
 #include "hrtf/multiband.h"
 
 #include "utilities/map_to_vector.h"
@@ -13,15 +15,47 @@ auto mixdown(It b, It e) {
     return util::map_to_vector(b, e, [](const auto& i) { return sum(i); });
 }
 
+enum class band_filter { fft, linkwitz_riley };
+
+/// Reads WAYVERB_BAND_FILTER: "iir" selects the time-domain Linkwitz-Riley
+/// bank, anything else keeps the FFT filter.
+band_filter select_band_filter();
+
+/// Filters bands as tasks on the pool.
+/// The Linkwitz-Riley bank filters all bands at once, so it ignores the pool.
 template <typename It, typename Callback>
 auto multiband_filter_and_mixdown(It b,
                                   It e,
                                   double sample_rate,
-                                  Callback&& callback) {
-    hrtf_data::multiband_filter(
-            b, e, sample_rate, std::forward<Callback>(callback));
+                                  Callback&& callback,
+                                  util::thread_pool& pool) {
+    switch (select_band_filter()) {
+        case band_filter::linkwitz_riley:
+            filter::linkwitz_riley_multiband_filter(
+                    b,
+                    e,
+                    hrtf_data::hrtf_band_params(sample_rate),
+                    std::forward<Callback>(callback));
+            break;
+        case band_filter::fft:
+            hrtf_data::multiband_filter(
+                    b, e, sample_rate, std::forward<Callback>(callback), pool);
+            break;
+    }
     return mixdown(b, e);
 }
 
+template <typename It, typename Callback>
+auto multiband_filter_and_mixdown(It b,
+                                  It e,
+                                  double sample_rate,
+                                  Callback&& callback) {
+    return multiband_filter_and_mixdown(b,
+                                        e,
+                                        sample_rate,
+                                        std::forward<Callback>(callback),
+                                        util::serial_executor());
+}
+
 }  // namespace core
 }  // namespace wayverb
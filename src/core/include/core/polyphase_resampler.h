@@ -0,0 +1,86 @@
+#pragma once
+
+#include "utilities/aligned/vector.h"
+
+#include <memory>
+
+namespace wayverb {
+namespace core {
+
+/// Trades filter length (and so speed) against passband width and stopband
+/// rejection. Passband is given as a fraction of the lower Nyquist frequency.
+///     fast:   flat to 50%, 70dB stopband
+///     medium: flat to 75%, 100dB stopband
+///     high:   flat to 90%, 120dB stopband
+/// Waveguide output is bandlimited well below 50% of its Nyquist frequency,
+/// so even `fast` is transparent for waveguide-to-output conversion.
+enum class resampler_quality { fast, medium, high };
+
+struct rational_ratio final {
+    size_t up;
+    size_t down;
+};
+
+/// Finds the best approximation up/down of `ratio` where neither term
+/// exceeds `max_term`, using continued fractions.
+rational_ratio approximate_ratio(double ratio, size_t max_term = 2048);
+
+/// How far, in output samples, a signal of `output_size` samples resampled
+/// by `approximation` instead of `ratio` drifts by its end.
+double drift(const rational_ratio& approximation,
+             double ratio,
+             size_t output_size);
+
+/// A windowed-sinc lowpass, designed for upsampling by `up` then
+/// downsampling by `down`, split into `up` polyphase branches.
+/// Each branch is stored time-reversed and zero-padded to a multiple of the
+/// SIMD width so that an output sample is a single contiguous dot product
+/// with the input.
+class polyphase_filter_bank final {
+public:
+    polyphase_filter_bank(size_t up, size_t down, resampler_quality quality);
+
+    size_t up() const;
+    size_t down() const;
+    size_t taps_per_phase() const;
+
+    /// The centre of the prototype filter, in upsampled samples.
+    size_t delay() const;
+
+    const float* phase(size_t p) const;
+
+private:
+    size_t up_;
+    size_t down_;
+    size_t taps_per_phase_;
+    size_t delay_;
+    util::aligned::vector<float> coefficients_;
+};
+
+/// Filter banks are expensive to design for large ratios, so they are
+/// designed once per (up, down, quality) and shared. Thread-safe.
+std::shared_ptr<const polyphase_filter_bank> get_polyphase_filter_bank(
+        size_t up, size_t down, resampler_quality quality);
+
+/// Resamples `size` samples into `output_size` samples.
+/// Output sample n is aligned with input time n * down / up, so there is no
+/// added delay.
+util::aligned::vector<float> resample(const polyphase_filter_bank& bank,
+                                      const float* data,
+                                      size_t size,
+                                      size_t output_size);
+
+/// Resamples from in_sr to out_sr, approximating the ratio with
+/// `approximate_ratio`. The output has floor(size * out_sr / in_sr) samples.
+/// Larger terms are tried if the first approximation drifts by more than a
+/// tenth of a sample over the output. If none is close enough, throws
+/// core::exceptions::inexact_ratio.
+util::aligned::vector<float> resample(
+        const float* data,
+        size_t size,
+        double in_sr,
+        double out_sr,
+        resampler_quality quality = resampler_quality::high);
+
+}  // namespace core
+}  // namespace wayverb
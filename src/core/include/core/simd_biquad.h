@@ -0,0 +1,443 @@
+#pragma once
+
+#include "core/filters_common.h"
+#include "core/freqz.h"
+
+#include "frequency_domain/multiband_filter.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__AVX__) || defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace wayverb {
+namespace core {
+namespace filter {
+
+namespace detail {
+
+/// Four floats, processed together where the target allows it.
+#if defined(__AVX__) || defined(__SSE__) || defined(_M_X64)
+struct float4 final {
+    __m128 v;
+};
+inline float4 load(const float* p) { return {_mm_loadu_ps(p)}; }
+inline void store(float* p, float4 a) { _mm_storeu_ps(p, a.v); }
+inline float4 operator+(float4 a, float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline float4 operator-(float4 a, float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline float4 operator*(float4 a, float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+#elif defined(__ARM_NEON)
+struct float4 final {
+    float32x4_t v;
+};
+inline float4 load(const float* p) { return {vld1q_f32(p)}; }
+inline void store(float* p, float4 a) { vst1q_f32(p, a.v); }
+inline float4 operator+(float4 a, float4 b) { return {vaddq_f32(a.v, b.v)}; }
+inline float4 operator-(float4 a, float4 b) { return {vsubq_f32(a.v, b.v)}; }
+inline float4 operator*(float4 a, float4 b) { return {vmulq_f32(a.v, b.v)}; }
+#else
+struct float4 final {
+    float v[4];
+};
+inline float4 load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float* p, float4 a) {
+    std::copy(std::begin(a.v), std::end(a.v), p);
+}
+template <typename Op>
+inline float4 zip(float4 a, float4 b, Op op) {
+    return {{op(a.v[0], b.v[0]),
+             op(a.v[1], b.v[1]),
+             op(a.v[2], b.v[2]),
+             op(a.v[3], b.v[3])}};
+}
+inline float4 operator+(float4 a, float4 b) { return zip(a, b, std::plus<>{}); }
+inline float4 operator-(float4 a, float4 b) {
+    return zip(a, b, std::minus<>{});
+}
+inline float4 operator*(float4 a, float4 b) {
+    return zip(a, b, std::multiplies<>{});
+}
+#endif
+
+/// Recursive filters decay into denormals once their input goes quiet, which
+/// is very slow on x86. Flushes them to zero for the lifetime of the object.
+class flush_denormals final {
+public:
+#if defined(__AVX__) || defined(__SSE__) || defined(_M_X64)
+    flush_denormals()
+            : csr_{_mm_getcsr()} {
+        _mm_setcsr(csr_ | 0x8040);  //  FTZ | DAZ
+    }
+    ~flush_denormals() { _mm_setcsr(csr_); }
+
+private:
+    unsigned csr_;
+#endif
+};
+
+}  // namespace detail
+
+/// `lanes` independent biquad cascades, with coefficients and state stored
+/// structure-of-arrays so that each step updates four lanes per instruction.
+/// Samples are interleaved: frame `i` holds one sample from every lane.
+/// Lanes may be channels, bands, or blocks of the same signal.
+/// Processing is single precision, unlike `biquad`.
+///
+/// Adheres to the IIR filter concept, where one sample is a whole frame.
+template <size_t lanes, size_t stages = 1>
+class biquad_lanes final {
+    static_assert(lanes != 0 && lanes % 4 == 0,
+                  "lanes must be a non-zero multiple of four");
+    static_assert(stages != 0, "Why would we want a zero-stage filter?");
+
+public:
+    static constexpr auto num_lanes = lanes;
+    static constexpr auto num_stages = stages;
+
+    using frame = std::array<float, lanes>;
+    using cascade = std::array<biquad::coefficients, stages>;
+
+    /// Each lane runs its own cascade.
+    explicit biquad_lanes(const std::array<cascade, lanes>& coefficients) {
+        for (size_t lane = 0; lane != lanes; ++lane) {
+            for (size_t stage = 0; stage != stages; ++stage) {
+                set(lane, stage, coefficients[lane][stage]);
+            }
+        }
+    }
+
+    /// Every lane runs the same cascade.
+    explicit biquad_lanes(const cascade& coefficients) {
+        for (size_t lane = 0; lane != lanes; ++lane) {
+            for (size_t stage = 0; stage != stages; ++stage) {
+                set(lane, stage, coefficients[stage]);
+            }
+        }
+    }
+
+    frame filter(frame i) {
+        process(i.data(), 1);
+        return i;
+    }
+
+    void clear() { state_.fill(0); }
+
+    /// Filters `frames` interleaved frames in place, continuing from the
+    /// current state.
+    void process(float* data, size_t frames) {
+        run(data, frames, lanes);
+    }
+
+    /// As above, but walks from the last frame to the first.
+    void process_reverse(float* data, size_t frames) {
+        if (frames) {
+            run(data + (frames - 1) * lanes,
+                frames,
+                -static_cast<std::ptrdiff_t>(lanes));
+        }
+    }
+
+private:
+    static constexpr auto packs = lanes / 4;
+
+    //  Layout: for each stage, b0, b1, b2, a1, a2, each `lanes` wide.
+    float& coefficient(size_t stage, size_t term, size_t lane) {
+        return coefficients_[(stage * 5 + term) * lanes + lane];
+    }
+
+    void set(size_t lane, size_t stage, const biquad::coefficients& c) {
+        coefficient(stage, 0, lane) = c.b0;
+        coefficient(stage, 1, lane) = c.b1;
+        coefficient(stage, 2, lane) = c.b2;
+        coefficient(stage, 3, lane) = c.a1;
+        coefficient(stage, 4, lane) = c.a2;
+    }
+
+    void run(float* data, size_t frames, std::ptrdiff_t step) {
+        using detail::float4;
+
+        const detail::flush_denormals flush;
+
+        //  Keep the delay lines in registers for the whole run.
+        float4 z1[stages][packs], z2[stages][packs];
+        for (size_t s = 0; s != stages; ++s) {
+            for (size_t p = 0; p != packs; ++p) {
+                z1[s][p] = detail::load(&state_[(s * 2 + 0) * lanes + 4 * p]);
+                z2[s][p] = detail::load(&state_[(s * 2 + 1) * lanes + 4 * p]);
+            }
+        }
+
+        for (size_t f = 0; f != frames; ++f, data += step) {
+            for (size_t p = 0; p != packs; ++p) {
+                auto x = detail::load(data + 4 * p);
+                for (size_t s = 0; s != stages; ++s) {
+                    const auto c = coefficients_.data() + s * 5 * lanes + 4 * p;
+                    const auto b0 = detail::load(c + 0 * lanes);
+                    const auto b1 = detail::load(c + 1 * lanes);
+                    const auto b2 = detail::load(c + 2 * lanes);
+                    const auto a1 = detail::load(c + 3 * lanes);
+                    const auto a2 = detail::load(c + 4 * lanes);
+
+                    const auto out = x * b0 + z1[s][p];
+                    z1[s][p] = x * b1 - a1 * out + z2[s][p];
+                    z2[s][p] = x * b2 - a2 * out;
+                    x = out;
+                }
+                detail::store(data + 4 * p, x);
+            }
+        }
+
+        for (size_t s = 0; s != stages; ++s) {
+            for (size_t p = 0; p != packs; ++p) {
+                detail::store(&state_[(s * 2 + 0) * lanes + 4 * p], z1[s][p]);
+                detail::store(&state_[(s * 2 + 1) * lanes + 4 * p], z2[s][p]);
+            }
+        }
+    }
+
+    std::array<float, 5 * lanes * stages> coefficients_{};
+    std::array<float, 2 * lanes * stages> state_{};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <size_t lanes, size_t stages>
+void run_one_pass(biquad_lanes<lanes, stages>& filter,
+                  float* data,
+                  size_t frames) {
+    filter.clear();
+    filter.process(data, frames);
+}
+
+///	Forward-backward, like run_two_pass, over interleaved frames.
+template <size_t lanes, size_t stages>
+void run_two_pass(biquad_lanes<lanes, stages>& filter,
+                  float* data,
+                  size_t frames) {
+    run_one_pass(filter, data, frames);
+    filter.clear();
+    filter.process_reverse(data, frames);
+}
+
+/// Zero-phase filters up to `lanes` separate signals in place.
+/// As with frequency_domain::multiband_filter, `callback(it, lane)` maps an
+/// iterator over [b, e) to an iterator over the lane'th signal.
+/// Only lanes below `used_lanes` are read or written.
+template <size_t lanes, size_t stages, typename It, typename Callback>
+void run_two_pass(biquad_lanes<lanes, stages>& filter,
+                  It b,
+                  It e,
+                  size_t used_lanes,
+                  const Callback& callback) {
+    const auto frames = static_cast<size_t>(std::distance(b, e));
+    util::aligned::vector<float> interleaved(frames * lanes, 0.0f);
+
+    for (size_t lane = 0; lane != used_lanes; ++lane) {
+        auto it = callback(b, lane);
+        for (size_t i = 0; i != frames; ++i, ++it) {
+            interleaved[i * lanes + lane] = *it;
+        }
+    }
+
+    run_two_pass(filter, interleaved.data(), frames);
+
+    for (size_t lane = 0; lane != used_lanes; ++lane) {
+        auto it = callback(b, lane);
+        for (size_t i = 0; i != frames; ++i, ++it) {
+            *it = interleaved[i * lanes + lane];
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// The number of samples after which the impulse response of the cascade
+/// has decayed below `tolerance` (roughly; the pole radius sets the decay).
+/// Throws if any stage is unstable or marginally stable, as its response
+/// never decays.
+template <size_t stages>
+size_t settling_time(const std::array<biquad::coefficients, stages>& c,
+                     double tolerance = 1.0e-7) {
+    size_t ret = 0;
+    for (const auto& stage : c) {
+        const auto disc = stage.a1 * stage.a1 - 4 * stage.a2;
+        const auto radius =
+                disc < 0 ? std::sqrt(stage.a2)
+                         : 0.5 * (std::abs(stage.a1) + std::sqrt(disc));
+        if (1 <= radius) {
+            throw std::runtime_error{
+                    "Filter never settles: a pole lies on or outside the "
+                    "unit circle."};
+        }
+        if (0 < radius) {
+            ret += std::ceil(std::log(tolerance) / std::log(radius));
+        }
+    }
+    return ret;
+}
+
+/// Zero-phase filters one long signal by splitting it into `lanes` blocks
+/// which are filtered side-by-side in lanes.
+/// Each block starts `warmup` samples early, so that the filter state has
+/// converged by the time the block's own output begins. The error is bounded
+/// by the filter's decay over `warmup` samples; the default makes it
+/// negligible at single precision.
+/// Worthwhile when the signal is much longer than `lanes * warmup`.
+template <size_t lanes = 8, size_t stages, typename It>
+void run_two_pass_blocked(const std::array<biquad::coefficients, stages>& c,
+                          It b,
+                          It e,
+                          size_t warmup) {
+    const auto size = static_cast<size_t>(std::distance(b, e));
+    if (size == 0) {
+        return;
+    }
+
+    //  Warming up for longer than the whole signal would only read zeros.
+    warmup = std::min(warmup, size);
+
+    const auto block = (size + lanes - 1) / lanes;
+    const auto frames = block + warmup;
+    biquad_lanes<lanes, stages> filter{c};
+    util::aligned::vector<float> interleaved(frames * lanes);
+
+    //  Lane k covers [k * block - warmup, (k + 1) * block). Lane zero starts
+    //  from silence before the signal, so it is exact.
+    const auto blocked_pass = [&](const float* in, float* out) {
+        for (size_t lane = 0; lane != lanes; ++lane) {
+            for (size_t i = 0; i != frames; ++i) {
+                const auto index =
+                        static_cast<std::ptrdiff_t>(lane * block + i) -
+                        static_cast<std::ptrdiff_t>(warmup);
+                interleaved[i * lanes + lane] =
+                        0 <= index && static_cast<size_t>(index) < size
+                                ? in[index]
+                                : 0.0f;
+            }
+        }
+
+        run_one_pass(filter, interleaved.data(), frames);
+
+        for (size_t lane = 0; lane != lanes; ++lane) {
+            for (size_t i = warmup; i != frames; ++i) {
+                const auto index = lane * block + i - warmup;
+                if (index < size) {
+                    out[index] = interleaved[i * lanes + lane];
+                }
+            }
+        }
+    };
+
+    util::aligned::vector<float> forward(b, e);
+    util::aligned::vector<float> backward(size);
+    blocked_pass(forward.data(), backward.data());
+
+    std::reverse(backward.begin(), backward.end());
+    blocked_pass(backward.data(), forward.data());
+    std::reverse(forward.begin(), forward.end());
+
+    std::copy(forward.begin(), forward.end(), b);
+}
+
+template <size_t lanes = 8, size_t stages, typename It>
+void run_two_pass_blocked(const std::array<biquad::coefficients, stages>& c,
+                          It b,
+                          It e) {
+    run_two_pass_blocked<lanes>(c, b, e, settling_time(c));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Linkwitz-Riley lopass-then-hipass for one band, as in
+/// linkwitz_riley_bandpass. Edges are normalised (cycles per sample); an
+/// edge at or beyond DC or Nyquist leaves that side of the band open.
+inline std::array<biquad::coefficients, 2> compute_linkwitz_riley_band(
+        double lo, double hi) {
+    constexpr biquad::coefficients passthrough{1, 0, 0, 0, 0};
+    return {{hi < 0.5 ? compute_linkwitz_riley_lopass_coefficients(hi, 1)
+                      : passthrough,
+             0 < lo ? compute_linkwitz_riley_hipass_coefficients(lo, 1)
+                    : passthrough}};
+}
+
+/// The area over [0, 0.5] under the power response of a biquad cascade run
+/// forwards and backwards, i.e. under the fourth power of its magnitude.
+template <size_t stages>
+double two_pass_power_area(const std::array<biquad::coefficients, stages>& c,
+                           size_t points = 1 << 12) {
+    double ret = 0;
+    for (size_t i = 0; i != points; ++i) {
+        const auto omega = M_PI * (i + 0.5) / points;
+        double power = 1;
+        for (const auto& stage : c) {
+            power *= std::norm(freqz(std::array<double, 3>{{stage.b0,
+                                                            stage.b1,
+                                                            stage.b2}},
+                                     std::array<double, 3>{{1,
+                                                            stage.a1,
+                                                            stage.a2}},
+                                     omega));
+        }
+        ret += power * power;
+    }
+    return 0.5 * ret / points;
+}
+
+/// A time-domain alternative to frequency_domain::multiband_filter, taking
+/// the same arguments and returning the same per-band levels. Each band is a
+/// zero-phase Linkwitz-Riley bandpass between adjacent edges, and all bands
+/// are filtered together in SIMD lanes.
+/// The crossover slopes are fixed, so `params.width_factor` is ignored.
+/// Cheaper than the FFT filter for short and medium signals; see
+/// bin/band_filter_benchmark for the crossover on a given machine.
+template <size_t bands_plus_one, typename It, typename Callback>
+auto linkwitz_riley_multiband_filter(
+        It b,
+        It e,
+        const frequency_domain::edges_and_width_factor<bands_plus_one>& params,
+        const Callback& callback) {
+    constexpr auto bands = bands_plus_one - 1;
+    constexpr auto lanes = (bands + 3) / 4 * 4;
+
+    std::array<std::array<biquad::coefficients, 2>, lanes> coefficients{};
+    for (size_t i = 0; i != lanes; ++i) {
+        coefficients[i] =
+                i < bands ? compute_linkwitz_riley_band(params.edges[i],
+                                                        params.edges[i + 1])
+                          : compute_linkwitz_riley_band(0, 0.5);
+    }
+
+    biquad_lanes<lanes, 2> filter{coefficients};
+    run_two_pass(filter, b, e, bands, callback);
+
+    //  Report the level of the input within each band, which is roughly what
+    //  the FFT filter's normalisation gives: the output energy over the area
+    //  under the squared response, doubled for the negative frequencies.
+    //  Levels come out within about 20% of the FFT filter's.
+    std::array<double, bands> normalized_rms{};
+    for (size_t i = 0; i != bands; ++i) {
+        double summed_squared = 0;
+        auto it = callback(b, i);
+        for (auto j = b; j != e; ++j, ++it) {
+            const double sample = *it;
+            summed_squared += sample * sample;
+        }
+        const auto area = two_pass_power_area(coefficients[i]);
+        normalized_rms[i] =
+                0 < area ? std::sqrt(summed_squared / (2 * area)) : 0;
+    }
+    return normalized_rms;
+}
+
+}  // namespace filter
+}  // namespace core
+}  // namespace wayverb
@@ -0,0 +1,211 @@
+#include "core/cl/buffer_pool.h"
+#include "core/cl/common.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace wayverb {
+namespace core {
+
+namespace {
+
+/// Transfers below this size go straight to or from pageable memory.
+constexpr size_t staging_threshold = 1 << 16;
+
+/// Larger transfers go through a pinned buffer of at most this size, a chunk
+/// at a time, so staging never needs a second copy of a whole mesh.
+constexpr size_t staging_chunk = 32 << 20;
+
+constexpr size_t smallest_size_class = 1 << 8;
+
+size_t default_pool_capacity() {
+    const char* env = std::getenv("WAYVERB_BUFFER_POOL_MB");
+    const auto mb = env ? std::strtoull(env, nullptr, 10) : 128;
+    return static_cast<size_t>(mb) << 20;
+}
+
+}  // namespace
+
+buffer_pool::buffer_pool()
+        : buffer_pool{default_pool_capacity()} {}
+
+buffer_pool::buffer_pool(size_t capacity)
+        : capacity_{capacity} {}
+
+cl::Buffer buffer_pool::take(size_t size, cl_mem_flags flags) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (auto i = begin(entries_); i != end(entries_); ++i) {
+        if (i->flags == flags && i->size == size) {
+            auto ret = std::move(i->buffer);
+            cached_ -= i->size;
+            entries_.erase(i);
+            return ret;
+        }
+    }
+    return cl::Buffer{};
+}
+
+void buffer_pool::give(size_t size, cl_mem_flags flags, cl::Buffer buffer) {
+    if (capacity_ < size) {
+        return;
+    }
+    //  Evicted buffers are destroyed outside the lock.
+    std::list<entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        entries_.push_front(entry{flags, size, std::move(buffer)});
+        cached_ += size;
+        while (capacity_ < cached_) {
+            cached_ -= entries_.back().size;
+            evicted.splice(begin(evicted), entries_, --end(entries_));
+        }
+    }
+}
+
+void buffer_pool::clear() {
+    std::list<entry> evicted;
+    std::lock_guard<std::mutex> lock{mutex_};
+    evicted.swap(entries_);
+    cached_ = 0;
+}
+
+size_t buffer_pool::get_cached_bytes() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return cached_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t buffer_size_class(size_t bytes) {
+    auto ret = smallest_size_class;
+    while (ret < bytes) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+pooled_buffer::pooled_buffer(const compute_context& cc,
+                             size_t bytes,
+                             cl_mem_flags flags)
+        : pool_{cc.pool}
+        , flags_{flags} {
+    const auto size = buffer_size_class(bytes);
+    allocation_ = pool_->take(size, flags);
+    if (allocation_() == nullptr) {
+        allocation_ = cl::Buffer{cc.context, flags, size};
+    }
+
+    if (size == bytes) {
+        view_ = allocation_;
+    } else {
+        //  A sub-buffer at offset zero needs no particular alignment.
+        const cl_buffer_region region{0, bytes};
+        view_ = allocation_.createSubBuffer(
+                0, CL_BUFFER_CREATE_TYPE_REGION, &region);
+    }
+}
+
+pooled_buffer::pooled_buffer(pooled_buffer&& other) noexcept
+        : pool_{std::move(other.pool_)}
+        , flags_{other.flags_}
+        , allocation_{other.allocation_}
+        , view_{other.view_} {
+    other.allocation_ = cl::Buffer{};
+    other.view_ = cl::Buffer{};
+}
+
+pooled_buffer& pooled_buffer::operator=(pooled_buffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = std::move(other.pool_);
+        flags_ = other.flags_;
+        allocation_ = other.allocation_;
+        view_ = other.view_;
+        other.allocation_ = cl::Buffer{};
+        other.view_ = cl::Buffer{};
+    }
+    return *this;
+}
+
+pooled_buffer::~pooled_buffer() noexcept { release(); }
+
+void pooled_buffer::release() noexcept {
+    if (allocation_() == nullptr) {
+        return;
+    }
+    try {
+        //  The view holds a reference to the allocation, so drop it first.
+        view_ = cl::Buffer{};
+        const auto size = allocation_.getInfo<CL_MEM_SIZE>();
+        pool_->give(size, flags_, allocation_);
+    } catch (...) {
+        //  The allocation is freed as usual instead.
+    }
+    allocation_ = cl::Buffer{};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void read_staged(const compute_context& cc,
+                 cl::CommandQueue& queue,
+                 const cl::Buffer& buffer,
+                 size_t offset,
+                 size_t bytes,
+                 void* output) {
+    if (bytes < staging_threshold) {
+        queue.enqueueReadBuffer(buffer, CL_TRUE, offset, bytes, output);
+        return;
+    }
+
+    const auto chunk = std::min(bytes, staging_chunk);
+    const pooled_buffer staging{
+            cc, chunk, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR};
+    auto pinned = queue.enqueueMapBuffer(staging.get(),
+                                         CL_TRUE,
+                                         CL_MAP_WRITE_INVALIDATE_REGION,
+                                         0,
+                                         chunk);
+    auto out = static_cast<char*>(output);
+    for (size_t done = 0; done != bytes;) {
+        const auto n = std::min(chunk, bytes - done);
+        queue.enqueueReadBuffer(buffer, CL_TRUE, offset + done, n, pinned);
+        std::memcpy(out + done, pinned, n);
+        done += n;
+    }
+    queue.enqueueUnmapMemObject(staging.get(), pinned);
+    queue.finish();
+}
+
+cl::Buffer load_staged(const compute_context& cc,
+                       cl::CommandQueue& queue,
+                       const void* input,
+                       size_t bytes,
+                       cl_mem_flags flags) {
+    if (bytes < staging_threshold) {
+        return cl::Buffer{cc.context,
+                          flags | CL_MEM_COPY_HOST_PTR,
+                          bytes,
+                          const_cast<void*>(input)};
+    }
+
+    cl::Buffer ret{cc.context, flags, bytes};
+    const auto chunk = std::min(bytes, staging_chunk);
+    const pooled_buffer staging{
+            cc, chunk, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR};
+    auto pinned = queue.enqueueMapBuffer(
+            staging.get(), CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, chunk);
+    const auto in = static_cast<const char*>(input);
+    for (size_t done = 0; done != bytes;) {
+        const auto n = std::min(chunk, bytes - done);
+        std::memcpy(pinned, in + done, n);
+        queue.enqueueWriteBuffer(ret, CL_TRUE, done, n, pinned);
+        done += n;
+    }
+    queue.enqueueUnmapMemObject(staging.get(), pinned);
+    queue.finish();
+    return ret;
+}
+
+}  // namespace core
+}  // namespace wayverb
@@ -1,4 +1,5 @@
 #include "core/cl/common.h"
+#include "core/cl/device_set.h"
 
 #include <algorithm>
 #include <iostream>
@@ -8,34 +9,6 @@ namespace wayverb {
 namespace core {
 namespace {
 
-cl::Context get_context(device_type type) {
-    std::vector<cl::Platform> platform;
-    cl::Platform::get(&platform);
-
-    cl_context_properties cps[] = {
-            CL_CONTEXT_PLATFORM,
-            reinterpret_cast<cl_context_properties>((platform.front())()),
-            0,
-    };
-
-    const auto convert_device_type = [](auto type) {
-        switch (type) {
-            case device_type::cpu: return CL_DEVICE_TYPE_CPU;
-            case device_type::gpu: return CL_DEVICE_TYPE_GPU;
-        }
-    };
-
-    return cl::Context(convert_device_type(type), cps);
-}
-
-bool supports_double_precision(const cl::Device& device) {
-    const auto fp_config = device.getInfo<CL_DEVICE_DOUBLE_FP_CONFIG>();
-    const auto extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
-    const auto has_extension = extensions.find("cl_khr_fp64") != std::string::npos ||
-                               extensions.find("cl_APPLE_fp64_basic_ops") != std::string::npos;
-    return fp_config != 0u || has_extension;
-}
-
 cl::Device get_device(const cl::Context& context) {
     auto devices = context.getInfo<CL_CONTEXT_DEVICES>();
 
@@ -80,32 +53,34 @@ cl::Device get_device(const cl::Context& context) {
     return *chosen;
 }
 
-}  // namespace
-
-compute_context::compute_context() {
-    //  I hate this. It is garbage.
-    const auto type_to_string = [](device_type type) {
-        switch (type) {
-            case device_type::cpu: return "CPU";
-            case device_type::gpu: return "GPU";
-        }
-        return "unknown";
-    };
-
-    for (const auto& type : {device_type::gpu, device_type::cpu}) {
-        try {
-            *this = compute_context{type};
-            return;
-        } catch (const std::exception& e) {
-            std::cerr << "Falling back from " << type_to_string(type)
-                      << " device initialisation: " << e.what() << '\n';
-        }
+/// Uses the best of `devices`, which select_devices has ranked.
+compute_context make_context(const std::vector<device_info>& devices) {
+    if (devices.empty()) {
+        throw std::runtime_error{"No usable OpenCL device."};
     }
-    throw std::runtime_error{"No OpenCL context contains a usable device."};
+    const auto& chosen = devices.front();
+    if (!chosen.double_precision) {
+        std::cerr << "Warning: device \"" << chosen.name
+                  << "\" does not support double precision (fp64).\n";
+    }
+    std::cerr << "device selected: " << chosen.name << '\n';
+    return compute_context{cl::Context{chosen.device}, chosen.device};
 }
 
+}  // namespace
+
+compute_context::compute_context()
+        : compute_context(make_context(select_devices(
+                  device_selection_from_environment().value_or(
+                          device_selection{})))) {}
+
 compute_context::compute_context(device_type type)
-        : compute_context(core::get_context(type)) {}
+        : compute_context(make_context(select_devices([&] {
+            device_selection ret;
+            ret.type = type == device_type::cpu ? CL_DEVICE_TYPE_CPU
+                                                : CL_DEVICE_TYPE_GPU;
+            return ret;
+        }()))) {}
 
 compute_context::compute_context(const cl::Context& context)
         : compute_context(context, core::get_device(context)) {}
@@ -113,6 +88,7 @@ compute_context::compute_context(const cl::Context& context)
 compute_context::compute_context(const cl::Context& context,
                                  const cl::Device& device)
         : context(context)
-        , device(device) {}
+        , device(device)
+        , pool(std::make_shared<buffer_pool>()) {}
 }  // namespace core
 }  // namespace wayverb
@@ -0,0 +1,230 @@
+#include "core/cl/device_set.h"
+
+#include "utilities/string_builder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace wayverb {
+namespace core {
+
+namespace {
+
+device_info make_device_info(const cl::Device& device,
+                             const std::string& platform,
+                             bool sub_device) {
+    return device_info{device,
+                       device.getInfo<CL_DEVICE_NAME>(),
+                       platform,
+                       device.getInfo<CL_DEVICE_TYPE>(),
+                       device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>(),
+                       supports_double_precision(device),
+                       sub_device};
+}
+
+/// One sub-device per NUMA node, or nothing if the device can't be split.
+std::vector<cl::Device> split_by_numa(const cl::Device& device) {
+    try {
+        const auto domains =
+                device.getInfo<CL_DEVICE_PARTITION_AFFINITY_DOMAIN>();
+        if (!(domains & CL_DEVICE_AFFINITY_DOMAIN_NUMA)) {
+            return {};
+        }
+        const cl_device_partition_property properties[] = {
+                CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN,
+                CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+                0};
+        std::vector<cl::Device> ret;
+        auto parent = device;
+        parent.createSubDevices(properties, &ret);
+        //  A single node is no different from the whole device.
+        return 1 < ret.size() ? ret : std::vector<cl::Device>{};
+    } catch (const cl::Error&) {
+        return {};
+    }
+}
+
+cl_ulong parse_number(const std::string& term, const std::string& value) {
+    size_t parsed = 0;
+    try {
+        const auto ret = std::stoull(value, &parsed);
+        if (parsed == value.size()) {
+            return ret;
+        }
+    } catch (const std::exception&) {
+    }
+    throw std::runtime_error{
+            util::build_string("Device selection term \"", term,
+                               "\" needs a number.")};
+}
+
+}  // namespace
+
+bool supports_double_precision(const cl::Device& device) {
+    const auto fp_config = device.getInfo<CL_DEVICE_DOUBLE_FP_CONFIG>();
+    const auto extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+    const auto has_extension = extensions.find("cl_khr_fp64") != std::string::npos ||
+                               extensions.find("cl_APPLE_fp64_basic_ops") != std::string::npos;
+    return fp_config != 0u || has_extension;
+}
+
+std::vector<device_info> enumerate_devices(bool split_numa) {
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+
+    std::vector<device_info> ret;
+    for (const auto& platform : platforms) {
+        std::vector<cl::Device> devices;
+        try {
+            platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+        } catch (const cl::Error&) {
+            //  Platforms without devices report an error, so skip them.
+            continue;
+        }
+
+        const auto platform_name = platform.getInfo<CL_PLATFORM_NAME>();
+        for (const auto& device : devices) {
+            if (device.getInfo<CL_DEVICE_AVAILABLE>() == 0u) {
+                std::cerr << "Skipping device \""
+                          << device.getInfo<CL_DEVICE_NAME>()
+                          << "\" - reported as unavailable.\n";
+                continue;
+            }
+
+            const auto nodes =
+                    split_numa ? split_by_numa(device) : std::vector<cl::Device>{};
+            if (nodes.empty()) {
+                ret.emplace_back(make_device_info(device, platform_name, false));
+            } else {
+                for (const auto& node : nodes) {
+                    ret.emplace_back(
+                            make_device_info(node, platform_name, true));
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+device_selection parse_device_selection(const std::string& spec) {
+    device_selection ret;
+    std::stringstream ss{spec};
+    for (std::string term; std::getline(ss, term, ',');) {
+        if (term.empty()) {
+            continue;
+        }
+        const auto equals = term.find('=');
+        const auto key = term.substr(0, equals);
+        const auto value =
+                equals == std::string::npos ? "" : term.substr(equals + 1);
+
+        if (term == "gpu") {
+            ret.type = CL_DEVICE_TYPE_GPU;
+        } else if (term == "cpu") {
+            ret.type = CL_DEVICE_TYPE_CPU;
+        } else if (term == "all") {
+            ret.type = CL_DEVICE_TYPE_ALL;
+        } else if (term == "numa") {
+            ret.split_numa = true;
+        } else if (key == "name" && equals != std::string::npos) {
+            ret.name = value;
+        } else if (key == "min_memory_mb" && equals != std::string::npos) {
+            ret.min_memory = parse_number(term, value) << 20;
+        } else if (key == "count" && equals != std::string::npos) {
+            ret.max_devices = parse_number(term, value);
+        } else if (std::all_of(begin(term), end(term), [](auto c) {
+                       return '0' <= c && c <= '9';
+                   })) {
+            ret.indices.emplace_back(parse_number(term, term));
+        } else {
+            throw std::runtime_error{util::build_string(
+                    "Unknown device selection term \"", term, "\".")};
+        }
+    }
+    return ret;
+}
+
+std::optional<device_selection> device_selection_from_environment() {
+    const char* env = std::getenv("WAYVERB_DEVICES");
+    if (env == nullptr || *env == '\0') {
+        return std::nullopt;
+    }
+    return parse_device_selection(env);
+}
+
+std::vector<device_info> select_devices(const device_selection& selection) {
+    auto devices = enumerate_devices(selection.split_numa);
+
+    if (!selection.indices.empty()) {
+        std::vector<device_info> picked;
+        for (const auto i : selection.indices) {
+            if (devices.size() <= i) {
+                throw std::runtime_error{util::build_string(
+                        "No device ", i, " (", devices.size(), " available)")};
+            }
+            picked.emplace_back(devices[i]);
+        }
+        devices = std::move(picked);
+    }
+
+    devices.erase(
+            std::remove_if(begin(devices),
+                           end(devices),
+                           [&](const auto& i) {
+                               return !(i.type & selection.type) ||
+                                      i.global_memory < selection.min_memory ||
+                                      i.name.find(selection.name) ==
+                                              std::string::npos;
+                           }),
+            end(devices));
+
+    if (selection.indices.empty()) {
+        std::stable_sort(
+                begin(devices), end(devices), [](const auto& a, const auto& b) {
+                    const auto a_gpu = (a.type & CL_DEVICE_TYPE_GPU) != 0;
+                    const auto b_gpu = (b.type & CL_DEVICE_TYPE_GPU) != 0;
+                    if (a_gpu != b_gpu) {
+                        return a_gpu;
+                    }
+                    return a.double_precision && !b.double_precision;
+                });
+    }
+
+    if (selection.max_devices != 0 &&
+        selection.max_devices < devices.size()) {
+        devices.resize(selection.max_devices);
+    }
+    return devices;
+}
+
+util::aligned::vector<compute_context> make_compute_contexts(
+        const std::vector<device_info>& devices) {
+    util::aligned::vector<compute_context> ret;
+    ret.reserve(devices.size());
+    for (const auto& i : devices) {
+        ret.emplace_back(cl::Context{i.device}, i.device);
+    }
+    return ret;
+}
+
+util::aligned::vector<compute_context> select_compute_contexts(
+        const compute_context& fallback) {
+    if (const auto selection = device_selection_from_environment()) {
+        auto ret = make_compute_contexts(select_devices(*selection));
+        if (ret.empty()) {
+            throw std::runtime_error{
+                    "WAYVERB_DEVICES doesn't match any device."};
+        }
+        for (const auto& i : ret) {
+            std::cerr << "device selected: "
+                      << i.device.getInfo<CL_DEVICE_NAME>() << '\n';
+        }
+        return ret;
+    }
+    return {fallback};
+}
+
+}  // namespace core
+}  // namespace wayverb
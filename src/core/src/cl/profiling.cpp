@@ -0,0 +1,62 @@
+#include "core/cl/profiling.h"
+
+#include "utilities/instrumentation.h"
+
+#include <memory>
+#include <string>
+
+namespace wayverb {
+namespace core {
+
+namespace {
+
+struct profiled_command final {
+    std::string name;
+    cl::Event event;
+};
+
+void CL_CALLBACK on_complete(cl_event, cl_int status, void* user_data) {
+    const std::unique_ptr<profiled_command> command{
+            static_cast<profiled_command*>(user_data)};
+    if (status != CL_COMPLETE) {
+        return;
+    }
+    try {
+        const auto start =
+                command->event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        const auto end =
+                command->event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+        //  Device timestamps use their own clock. The callback runs just
+        //  after completion, so treat now as the end of the command.
+        const auto host_end = util::instrumentation::clock::now();
+        const auto host_begin =
+                host_end - std::chrono::nanoseconds{end - start};
+        util::instrumentation::record_span(
+                command->name, host_begin, host_end, "device");
+    } catch (const cl::Error&) {
+        //  The queue isn't profiled.
+    }
+}
+
+}  // namespace
+
+cl_command_queue_properties profiling_queue_properties() {
+    return util::instrumentation::enabled() ? CL_QUEUE_PROFILING_ENABLE : 0;
+}
+
+void profile_event(const char* name, const cl::Event& event) {
+    if (!util::instrumentation::enabled() || event() == nullptr) {
+        return;
+    }
+    auto command = std::make_unique<profiled_command>(
+            profiled_command{name, event});
+    try {
+        command->event.setCallback(CL_COMPLETE, on_complete, command.get());
+        command.release();
+    } catch (const cl::Error&) {
+    }
+}
+
+}  // namespace core
+}  // namespace wayverb
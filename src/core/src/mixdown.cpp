@@ -0,0 +1,23 @@
+#include "core/mixdown.h"
+
+#include <cstdlib>
+#include <string>
+
+namespace wayverb {
+namespace core {
+
+band_filter select_band_filter() {
+    static const band_filter filter = [] {
+        const char* env = std::getenv("WAYVERB_BAND_FILTER");
+        if (env && std::string{env} == "iir") {
+            std::cerr << "[core] Selecting Linkwitz-Riley band filter "
+                         "(WAYVERB_BAND_FILTER=iir)\n";
+            return band_filter::linkwitz_riley;
+        }
+        return band_filter::fft;
+    }();
+    return filter;
+}
+
+}  // namespace core
+}  // namespace wayverb
@@ -0,0 +1,301 @@
+#include "core/polyphase_resampler.h"
+
+#include "core/exceptions.h"
+#include "core/sinc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+#if defined(__AVX__) || defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace wayverb {
+namespace core {
+
+namespace {
+
+//  Branches are padded to a multiple of this, so the dot product never needs
+//  a scalar remainder loop.
+constexpr size_t simd_width = 8;
+
+//  The largest drift, in output samples, allowed by the end of a resampled
+//  signal.
+constexpr auto max_drift = 0.1;
+
+//  Term limits to try, in order. Larger terms mean larger filter banks, so
+//  the bigger limit is only used for ratios which need it.
+constexpr size_t term_limits[] = {2048, 16384};
+
+struct quality_params final {
+    double passband;     //  Flat up to this fraction of the lower Nyquist.
+    double attenuation;  //  Stopband rejection in dB.
+};
+
+quality_params get_quality_params(resampler_quality quality) {
+    switch (quality) {
+        case resampler_quality::fast: return {0.5, 70};
+        case resampler_quality::medium: return {0.75, 100};
+        case resampler_quality::high: return {0.9, 120};
+    }
+    throw std::runtime_error{"Unknown resampler quality."};
+}
+
+/// Zeroth-order modified Bessel function of the first kind.
+double bessel_i0(double x) {
+    double sum = 1;
+    double term = 1;
+    const auto half_x = x / 2;
+    for (auto k = 1; k != 64; ++k) {
+        term *= (half_x / k) * (half_x / k);
+        sum += term;
+        if (term < sum * 1.0e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+double kaiser(double offset, double half_length, double beta) {
+    const auto r = offset / half_length;
+    if (std::abs(r) > 1) {
+        return 0;
+    }
+    return bessel_i0(beta * std::sqrt(1 - r * r)) / bessel_i0(beta);
+}
+
+inline float dot(const float* a, const float* b, size_t n) {
+#if defined(__AVX__)
+    auto acc0 = _mm256_setzero_ps();
+    for (size_t i = 0; i != n; i += 8) {
+        acc0 = _mm256_add_ps(
+                acc0,
+                _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    const auto lo = _mm256_castps256_ps128(acc0);
+    const auto hi = _mm256_extractf128_ps(acc0, 1);
+    auto sum = _mm_add_ps(lo, hi);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(__SSE__) || defined(_M_X64)
+    auto acc0 = _mm_setzero_ps();
+    auto acc1 = _mm_setzero_ps();
+    for (size_t i = 0; i != n; i += 8) {
+        acc0 = _mm_add_ps(acc0,
+                          _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(
+                acc1,
+                _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    auto sum = _mm_add_ps(acc0, acc1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(__ARM_NEON)
+    auto acc0 = vdupq_n_f32(0);
+    auto acc1 = vdupq_n_f32(0);
+    for (size_t i = 0; i != n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    const auto sum = vaddq_f32(acc0, acc1);
+    const auto pairs = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+    return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+#else
+    float acc[simd_width]{};
+    for (size_t i = 0; i != n; i += simd_width) {
+        for (size_t j = 0; j != simd_width; ++j) {
+            acc[j] += a[i + j] * b[i + j];
+        }
+    }
+    float sum = 0;
+    for (auto i : acc) {
+        sum += i;
+    }
+    return sum;
+#endif
+}
+
+}  // namespace
+
+rational_ratio approximate_ratio(double ratio, size_t max_term) {
+    if (!(std::isfinite(ratio) && ratio > 0)) {
+        throw std::runtime_error{"Resampling ratio must be positive."};
+    }
+
+    //  Convergents h/k of the continued fraction expansion.
+    double h0 = 0, h1 = 1, k0 = 1, k1 = 0;
+    auto x = ratio;
+    for (;;) {
+        const auto a = std::floor(x);
+        const auto h2 = a * h1 + h0;
+        const auto k2 = a * k1 + k0;
+        if (max_term < h2 || max_term < k2) {
+            break;
+        }
+        h0 = h1;
+        h1 = h2;
+        k0 = k1;
+        k1 = k2;
+        const auto frac = x - a;
+        if (frac < 1.0e-12) {
+            break;
+        }
+        x = 1 / frac;
+    }
+
+    if (k1 == 0 || h1 == 0) {
+        throw std::runtime_error{
+                "Resampling ratio can't be represented with bounded terms."};
+    }
+
+    return {static_cast<size_t>(h1), static_cast<size_t>(k1)};
+}
+
+double drift(const rational_ratio& approximation,
+             double ratio,
+             size_t output_size) {
+    const auto achieved =
+            static_cast<double>(approximation.up) / approximation.down;
+    return std::abs(achieved - ratio) / ratio * output_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+polyphase_filter_bank::polyphase_filter_bank(size_t up,
+                                             size_t down,
+                                             resampler_quality quality)
+        : up_{up}
+        , down_{down} {
+    if (up == 0 || down == 0) {
+        throw std::runtime_error{"Resampling factors must be non-zero."};
+    }
+
+    const auto params = get_quality_params(quality);
+
+    //  Kaiser's design formulae, with the transition band running from the
+    //  passband edge up to the lower of the two Nyquist frequencies.
+    const auto transition = M_PI * (1 - params.passband);
+    const auto half_width = static_cast<size_t>(std::ceil(
+            (params.attenuation - 8) / (2.285 * transition) / 2));
+    const auto beta = 0.1102 * (params.attenuation - 8.7);
+
+    //  Cutoff, in cycles per upsampled sample, halfway through the
+    //  transition band.
+    const auto factor = std::max(up, down);
+    const auto cutoff = 0.5 * (1 + params.passband) / 2 / factor;
+
+    delay_ = half_width * factor;
+    const auto length = 2 * delay_ + 1;
+
+    const auto taps = (length + up - 1) / up;
+    taps_per_phase_ = (taps + simd_width - 1) / simd_width * simd_width;
+    coefficients_.resize(up * taps_per_phase_, 0.0f);
+
+    for (size_t p = 0; p != up; ++p) {
+        auto branch = coefficients_.data() + p * taps_per_phase_;
+        for (size_t j = 0; j != taps_per_phase_; ++j) {
+            const auto i = p + j * up;
+            if (length <= i) {
+                break;
+            }
+            const auto offset = static_cast<double>(i) - delay_;
+            //  The gain of `up` makes up for the zero-stuffed samples.
+            const auto h = up * 2 * cutoff * sinc(2 * cutoff * offset) *
+                           kaiser(offset, delay_, beta);
+            branch[taps_per_phase_ - 1 - j] = h;
+        }
+    }
+}
+
+size_t polyphase_filter_bank::up() const { return up_; }
+size_t polyphase_filter_bank::down() const { return down_; }
+size_t polyphase_filter_bank::taps_per_phase() const { return taps_per_phase_; }
+size_t polyphase_filter_bank::delay() const { return delay_; }
+
+const float* polyphase_filter_bank::phase(size_t p) const {
+    return coefficients_.data() + p * taps_per_phase_;
+}
+
+std::shared_ptr<const polyphase_filter_bank> get_polyphase_filter_bank(
+        size_t up, size_t down, resampler_quality quality) {
+    using key_type = std::tuple<size_t, size_t, resampler_quality>;
+    static std::mutex mutex;
+    static std::map<key_type, std::shared_ptr<const polyphase_filter_bank>>
+            cache;
+
+    const std::lock_guard<std::mutex> lck{mutex};
+    auto& ret = cache[key_type{up, down, quality}];
+    if (ret == nullptr) {
+        ret = std::make_shared<const polyphase_filter_bank>(up, down, quality);
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+util::aligned::vector<float> resample(const polyphase_filter_bank& bank,
+                                      const float* data,
+                                      size_t size,
+                                      size_t output_size) {
+    const auto up = bank.up();
+    const auto down = bank.down();
+    const auto taps = bank.taps_per_phase();
+    const auto delay = bank.delay();
+
+    //  Output n sits at upsampled position n * down. The newest input sample
+    //  under the filter is at (n * down + delay) / up, so pad the input with
+    //  enough zeros that every branch reads in-bounds.
+    const auto newest = [&](size_t n) { return (n * down + delay) / up; };
+    const auto lead = taps - 1;
+    const auto padded_size =
+            lead + std::max(size, output_size ? newest(output_size - 1) + 1
+                                              : size_t{0});
+
+    util::aligned::vector<float> padded(padded_size, 0.0f);
+    std::copy(data, data + size, padded.begin() + lead);
+
+    util::aligned::vector<float> ret(output_size);
+    for (size_t n = 0; n != output_size; ++n) {
+        const auto position = n * down + delay;
+        //  `newest(n)` is both the newest input index and the offset of the
+        //  oldest tap in the padded buffer.
+        ret[n] = dot(bank.phase(position % up),
+                     padded.data() + position / up,
+                     taps);
+    }
+    return ret;
+}
+
+util::aligned::vector<float> resample(const float* data,
+                                      size_t size,
+                                      double in_sr,
+                                      double out_sr,
+                                      resampler_quality quality) {
+    if (!(in_sr && out_sr)) {
+        throw std::runtime_error{
+                "Sample rate of 0 gives few hints about how to proceed."};
+    }
+    const auto ratio = out_sr / in_sr;
+    const auto output_size = static_cast<size_t>(ratio * size);
+    for (const auto limit : term_limits) {
+        const auto terms = approximate_ratio(ratio, limit);
+        if (drift(terms, ratio, output_size) <= max_drift) {
+            const auto bank =
+                    get_polyphase_filter_bank(terms.up, terms.down, quality);
+            return resample(*bank, data, size, output_size);
+        }
+    }
+    throw exceptions::inexact_ratio{
+            "Resampling ratio can't be approximated closely enough."};
+}
+
+}  // namespace core
+}  // namespace wayverb
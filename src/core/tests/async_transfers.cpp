@@ -0,0 +1,50 @@
+#include "core/cl/common.h"
+
+#include "gtest/gtest.h"
+
+#include <array>
+#include <numeric>
+
+using namespace wayverb::core;
+
+TEST(async_transfers, write_then_read) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+
+    util::aligned::vector<cl_float> input(1000);
+    std::iota(begin(input), end(input), 0.0f);
+    cl::Buffer buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * 1000};
+
+    const std::vector<cl::Event> written{write_to_buffer_async(
+            queue, buffer, 0, input.size(), input.data())};
+
+    util::aligned::vector<cl_float> output(input.size());
+    read_from_buffer_async(
+            queue, buffer, 0, output.size(), output.data(), &written)
+            .wait();
+    ASSERT_EQ(output, input);
+
+    ASSERT_EQ(read_from_buffer_async<cl_float>(queue, buffer).get(), input);
+}
+
+TEST(async_transfers, values) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+    cl::Buffer buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int) * 16};
+
+    for (auto i = 0; i != 16; ++i) {
+        //  The value is copied on enqueue, so it can go out of scope.
+        write_value_async(queue, buffer, i, cl_int{i * i});
+    }
+
+    std::array<cl_int, 16> output{};
+    cl::Event last;
+    for (auto i = 0; i != 16; ++i) {
+        last = read_value_async(queue, buffer, i, output[i]);
+    }
+    last.wait();
+
+    for (auto i = 0; i != 16; ++i) {
+        ASSERT_EQ(output[i], i * i);
+    }
+}
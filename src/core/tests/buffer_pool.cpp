@@ -0,0 +1,67 @@
+#include "core/cl/buffer_pool.h"
+#include "core/cl/common.h"
+
+#include "gtest/gtest.h"
+
+#include <numeric>
+
+using namespace wayverb::core;
+
+TEST(buffer_pool, size_classes) {
+    ASSERT_EQ(buffer_size_class(0), 256);
+    ASSERT_EQ(buffer_size_class(256), 256);
+    ASSERT_EQ(buffer_size_class(257), 512);
+    ASSERT_EQ(buffer_size_class(1 << 20), 1 << 20);
+    ASSERT_EQ(buffer_size_class((1 << 20) + 1), 1 << 21);
+}
+
+TEST(buffer_pool, buffers_have_requested_size) {
+    const compute_context cc{};
+    for (const auto bytes : {4ul, 300ul, 4096ul, 100000ul}) {
+        const pooled_buffer buffer{cc, bytes};
+        ASSERT_EQ(buffer.get().getInfo<CL_MEM_SIZE>(), bytes);
+    }
+}
+
+TEST(buffer_pool, recycled_buffers_are_usable) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+    for (auto i = 0; i != 4; ++i) {
+        pooled_buffer buffer{cc, sizeof(cl_int) * 1000};
+        write_value(queue, buffer, 999, cl_int{i});
+        ASSERT_EQ(read_value<cl_int>(queue, buffer, 999), i);
+    }
+    ASSERT_EQ(cc.pool->get_cached_bytes(), buffer_size_class(4000));
+}
+
+TEST(buffer_pool, pools_belong_to_contexts) {
+    const compute_context a{};
+    const auto b = a;
+    const compute_context c{a.context, a.device};
+    { const pooled_buffer buffer{a, 1000}; }
+
+    //  Copies share a pool, but separately made contexts don't.
+    ASSERT_EQ(b.pool->get_cached_bytes(), 1024u);
+    ASSERT_EQ(c.pool->get_cached_bytes(), 0u);
+
+    a.pool->clear();
+    ASSERT_EQ(b.pool->get_cached_bytes(), 0u);
+}
+
+TEST(buffer_pool, staged_round_trip) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+
+    //  Small enough to go straight through, large enough to be staged, and
+    //  large enough to be streamed through several staging chunks.
+    for (const auto size : {100ul, 1ul << 20, (10ul << 20) + 3}) {
+        util::aligned::vector<cl_float> input(size);
+        std::iota(begin(input), end(input), 0.0f);
+        const auto buffer = load_to_buffer(cc, queue, input, true);
+        ASSERT_EQ(read_from_buffer<cl_float>(cc, queue, buffer), input);
+    }
+
+    //  Staging memory is at most one chunk per transfer, however large the
+    //  transfer: 4 MB for the second and 32 MB for the third.
+    ASSERT_EQ(cc.pool->get_cached_bytes(), (4u << 20) + (32u << 20));
+}
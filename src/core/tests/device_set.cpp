@@ -0,0 +1,47 @@
+#include "core/cl/device_set.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::core;
+
+TEST(device_set, parse_selection) {
+    const auto selection =
+            parse_device_selection("gpu,name=Radeon Pro,min_memory_mb=4096,"
+                                   "count=2,numa");
+    ASSERT_EQ(selection.type, CL_DEVICE_TYPE_GPU);
+    ASSERT_EQ(selection.name, "Radeon Pro");
+    ASSERT_EQ(selection.min_memory, cl_ulong{4096} << 20);
+    ASSERT_EQ(selection.max_devices, 2u);
+    ASSERT_TRUE(selection.split_numa);
+    ASSERT_TRUE(selection.indices.empty());
+}
+
+TEST(device_set, parse_indices) {
+    const auto selection = parse_device_selection("2,0");
+    ASSERT_EQ(selection.indices, (std::vector<size_t>{2, 0}));
+    ASSERT_EQ(selection.type, CL_DEVICE_TYPE_ALL);
+}
+
+TEST(device_set, parse_errors) {
+    ASSERT_THROW(parse_device_selection("fpga"), std::runtime_error);
+    ASSERT_THROW(parse_device_selection("count=lots"), std::runtime_error);
+    ASSERT_THROW(parse_device_selection("min_memory_mb="), std::runtime_error);
+}
+
+TEST(device_set, selection_is_ranked) {
+    const auto devices = select_devices(device_selection{});
+    ASSERT_FALSE(devices.empty());
+    for (size_t i = 1; i < devices.size(); ++i) {
+        const auto previous_gpu =
+                (devices[i - 1].type & CL_DEVICE_TYPE_GPU) != 0;
+        const auto gpu = (devices[i].type & CL_DEVICE_TYPE_GPU) != 0;
+        ASSERT_TRUE(previous_gpu || !gpu);
+    }
+
+    device_selection one;
+    one.max_devices = 1;
+    ASSERT_EQ(select_devices(one).size(), 1u);
+
+    const auto contexts = make_compute_contexts(devices);
+    ASSERT_EQ(contexts.size(), devices.size());
+}
@@ -0,0 +1,96 @@
+#include "core/exceptions.h"
+#include "core/polyphase_resampler.h"
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+
+using namespace wayverb::core;
+
+namespace {
+
+util::aligned::vector<float> sine(double frequency,
+                                  double sample_rate,
+                                  size_t length) {
+    util::aligned::vector<float> ret(length);
+    for (size_t i = 0; i != length; ++i) {
+        ret[i] = std::sin(2 * M_PI * frequency * i / sample_rate);
+    }
+    return ret;
+}
+
+}  // namespace
+
+TEST(polyphase_resampler, approximate_ratio) {
+    const auto exact = approximate_ratio(44100.0 / 48000.0);
+    ASSERT_EQ(exact.up, 147);
+    ASSERT_EQ(exact.down, 160);
+
+    const auto inexact = approximate_ratio(M_PI, 1000);
+    ASSERT_LE(inexact.up, 1000);
+    ASSERT_NEAR(static_cast<double>(inexact.up) / inexact.down, M_PI, 1e-6);
+}
+
+TEST(polyphase_resampler, cached_banks_are_shared) {
+    const auto a = get_polyphase_filter_bank(3, 2, resampler_quality::fast);
+    const auto b = get_polyphase_filter_bank(3, 2, resampler_quality::fast);
+    ASSERT_EQ(a, b);
+}
+
+TEST(polyphase_resampler, impulse_position) {
+    //  An impulse should land at the same time after resampling.
+    util::aligned::vector<float> input(1000, 0.0f);
+    input[200] = 1.0f;
+    const auto output =
+            resample(input.data(), input.size(), 1000, 2000);
+    ASSERT_EQ(output.size(), 2000);
+    const auto peak =
+            std::max_element(begin(output), end(output)) - begin(output);
+    ASSERT_EQ(peak, 400);
+}
+
+TEST(polyphase_resampler, passband_sine) {
+    for (const auto quality : {resampler_quality::fast,
+                               resampler_quality::medium,
+                               resampler_quality::high}) {
+        for (const auto rates : {std::make_pair(10000.0, 44100.0),
+                                 std::make_pair(44100.0, 16000.0),
+                                 std::make_pair(7373.5, 48000.0)}) {
+            const auto frequency =
+                    0.2 * std::min(rates.first, rates.second);
+            const auto input = sine(frequency, rates.first, 4000);
+            const auto output = resample(input.data(),
+                                         input.size(),
+                                         rates.first,
+                                         rates.second,
+                                         quality);
+            const auto expected =
+                    sine(frequency, rates.second, output.size());
+
+            //  Ignore the edges, where the filter runs off the signal.
+            const auto margin = output.size() / 8;
+            for (auto i = margin; i != output.size() - margin; ++i) {
+                ASSERT_NEAR(output[i], expected[i], 0.01) << i;
+            }
+        }
+    }
+}
+
+TEST(polyphase_resampler, drift_is_bounded) {
+    //  [1; 20000] has no close convergent with small terms.
+    const auto in_sr = 20000.0;
+    const auto out_sr = 20001.0;
+
+    util::aligned::vector<float> input(100000, 0.0f);
+    ASSERT_THROW(resample(input.data(), input.size(), in_sr, out_sr),
+                 exceptions::inexact_ratio);
+
+    //  Short signals don't drift far enough to matter.
+    const auto output = resample(input.data(), 1000, in_sr, out_sr);
+    ASSERT_EQ(output.size(), 1000u);
+
+    //  Ratios that need larger terms get them.
+    const auto ratio = 3001.0 / 3000.0;
+    ASSERT_LT(0.1, drift(approximate_ratio(ratio), ratio, 100000));
+    resample(input.data(), input.size(), 3000.0, 3001.0);
+}
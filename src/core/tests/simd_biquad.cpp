@@ -0,0 +1,199 @@
+#include "core/simd_biquad.h"
+
+#include "gtest/gtest.h"
+
+#include <limits>
+#include <random>
+
+using namespace wayverb::core;
+
+namespace {
+
+auto noise(size_t length, unsigned seed) {
+    std::default_random_engine engine{seed};
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    util::aligned::vector<float> ret(length);
+    for (auto& i : ret) {
+        i = distribution(engine);
+    }
+    return ret;
+}
+
+template <typename T, typename U>
+double max_difference(const T& a, const U& b) {
+    double ret = 0;
+    for (size_t i = 0; i != a.size(); ++i) {
+        ret = std::max(ret, std::abs(static_cast<double>(a[i]) - b[i]));
+    }
+    return ret;
+}
+
+constexpr size_t lanes = 8;
+constexpr auto signal_length = 1 << 14;
+
+auto lane_coefficients() {
+    std::array<std::array<filter::biquad::coefficients, 2>, lanes> ret{};
+    for (size_t i = 0; i != lanes; ++i) {
+        const auto lo = 0.005 * (i + 1);
+        ret[i] = filter::compute_linkwitz_riley_band(lo, lo * 2);
+    }
+    return ret;
+}
+
+}  // namespace
+
+TEST(simd_biquad, matches_scalar_biquads) {
+    const auto coefficients = lane_coefficients();
+
+    std::array<util::aligned::vector<float>, lanes> signals;
+    for (size_t i = 0; i != lanes; ++i) {
+        signals[i] = noise(signal_length, i);
+    }
+
+    util::aligned::vector<float> interleaved(signal_length * lanes);
+    for (size_t i = 0; i != signal_length; ++i) {
+        for (size_t j = 0; j != lanes; ++j) {
+            interleaved[i * lanes + j] = signals[j][i];
+        }
+    }
+
+    filter::biquad_lanes<lanes, 2> simd{coefficients};
+    run_two_pass(simd, interleaved.data(), signal_length);
+
+    for (size_t j = 0; j != lanes; ++j) {
+        auto scalar = filter::make_series_biquads(coefficients[j]);
+        run_two_pass(scalar, signals[j].begin(), signals[j].end());
+
+        util::aligned::vector<float> lane(signal_length);
+        for (size_t i = 0; i != signal_length; ++i) {
+            lane[i] = interleaved[i * lanes + j];
+        }
+        ASSERT_LT(max_difference(lane, signals[j]), 1.0e-4) << "lane " << j;
+    }
+}
+
+TEST(simd_biquad, filter_concept) {
+    const auto coefficients = lane_coefficients();
+
+    filter::biquad_lanes<lanes, 2> a{coefficients};
+    filter::biquad_lanes<lanes, 2> b{coefficients};
+
+    const auto input = noise(signal_length * lanes, 0);
+    auto frames = util::aligned::vector<std::array<float, lanes>>(signal_length);
+    for (size_t i = 0; i != signal_length; ++i) {
+        std::copy(input.begin() + i * lanes,
+                  input.begin() + (i + 1) * lanes,
+                  frames[i].begin());
+    }
+
+    auto interleaved = input;
+    run_one_pass(a, frames.begin(), frames.end());
+    run_one_pass(b, interleaved.data(), signal_length);
+
+    for (size_t i = 0; i != signal_length; ++i) {
+        for (size_t j = 0; j != lanes; ++j) {
+            ASSERT_EQ(frames[i][j], interleaved[i * lanes + j]);
+        }
+    }
+}
+
+TEST(simd_biquad, blocked_two_pass) {
+    const auto coefficients =
+            filter::compute_linkwitz_riley_band(0.01, 0.1);
+
+    const auto input = noise(signal_length * 4, 1);
+
+    auto reference = input;
+    auto scalar = filter::make_series_biquads(coefficients);
+    run_two_pass(scalar, reference.begin(), reference.end());
+
+    auto blocked = input;
+    filter::run_two_pass_blocked(coefficients, blocked.begin(), blocked.end());
+
+    ASSERT_LT(max_difference(blocked, reference), 1.0e-4);
+}
+
+TEST(simd_biquad, settling_time) {
+    const auto fast =
+            filter::settling_time(filter::compute_linkwitz_riley_band(0.1, 0.2));
+    const auto slow = filter::settling_time(
+            filter::compute_linkwitz_riley_band(0.001, 0.2));
+    ASSERT_LT(0, fast);
+    ASSERT_LT(fast, slow);
+
+    //  A pole on the unit circle never decays.
+    const std::array<filter::biquad::coefficients, 1> marginal{
+            {filter::biquad::coefficients{1, 0, 0, 0, 1}}};
+    ASSERT_THROW(filter::settling_time(marginal), std::runtime_error);
+
+    //  Warmup longer than the signal is clamped rather than overflowing.
+    auto input = noise(16, 1);
+    filter::run_two_pass_blocked(
+            filter::compute_linkwitz_riley_band(0.001, 0.2),
+            input.begin(),
+            input.end(),
+            std::numeric_limits<size_t>::max());
+}
+
+TEST(simd_biquad, multiband_isolates_bands) {
+    const auto params =
+            frequency_domain::compute_multiband_params<8>(
+                    util::make_range(0.001, 0.45), 1);
+
+    //  A sine at each band centre should land mostly in its own band.
+    for (size_t band = 0; band != 8; ++band) {
+        const auto frequency =
+                std::sqrt(params.edges[band] * params.edges[band + 1]);
+        util::aligned::vector<std::array<float, 8>> signal(signal_length);
+        for (size_t i = 0; i != signal_length; ++i) {
+            signal[i].fill(std::sin(2 * M_PI * frequency * i));
+        }
+
+        const auto levels = filter::linkwitz_riley_multiband_filter(
+                signal.begin(),
+                signal.end(),
+                params,
+                frequency_domain::make_indexer_iterator{});
+        ASSERT_EQ(std::distance(levels.begin(),
+                                std::max_element(levels.begin(), levels.end())),
+                  band);
+
+        std::array<double, 8> energy{};
+        for (const auto& frame : signal) {
+            for (size_t j = 0; j != 8; ++j) {
+                energy[j] += frame[j] * frame[j];
+            }
+        }
+
+        const auto loudest = std::max_element(energy.begin(), energy.end());
+        ASSERT_EQ(std::distance(energy.begin(), loudest), band);
+    }
+}
+
+TEST(simd_biquad, multiband_levels_match_fft) {
+    const auto params = frequency_domain::compute_multiband_params<8>(
+            util::make_range(0.001, 0.45), 1);
+
+    const auto input = noise(signal_length, 1);
+    util::aligned::vector<std::array<float, 8>> iir(signal_length);
+    for (size_t i = 0; i != signal_length; ++i) {
+        iir[i].fill(input[i]);
+    }
+    auto fft = iir;
+
+    const auto iir_levels = filter::linkwitz_riley_multiband_filter(
+            iir.begin(),
+            iir.end(),
+            params,
+            frequency_domain::make_indexer_iterator{});
+    const auto fft_levels = frequency_domain::multiband_filter(
+            fft.begin(),
+            fft.end(),
+            params,
+            frequency_domain::make_indexer_iterator{});
+
+    //  White noise should come out at roughly the same level either way.
+    for (size_t i = 0; i != 8; ++i) {
+        ASSERT_NEAR(iir_levels[i] / fft_levels[i], 1, 0.25) << i;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "frequency_domain/buffer.h"
+
+#include <algorithm>
+#include <complex>
+#include <functional>
+#include <stdexcept>
+
+namespace frequency_domain {
+
+/// Filters two signals and sums them, with a single inverse transform.
+/// Because filtering is linear, filtering each signal and then summing is
+/// the same as summing the filtered spectra, so this does two forward ffts
+/// and one inverse fft instead of two of each.
+class crossover final {
+public:
+    explicit crossover(size_t signal_length);
+
+    crossover(const crossover&) = delete;
+    crossover& operator=(const crossover&) = delete;
+    crossover(crossover&&) = delete;
+    crossover& operator=(crossover&&) = delete;
+
+    ~crossover() noexcept;
+
+    /// Takes the bin of each input spectrum and the relative frequency of
+    /// the bin, and returns the combined bin.
+    using callback = std::function<std::complex<float>(
+            std::complex<float>, std::complex<float>, float)>;
+
+    /// Writes max(len(a), len(b)) samples to `output_it`.
+    /// `post` is called as post(index, sample) on each normalised output
+    /// sample, and its result is written out, so that windowing and other
+    /// per-sample fixes don't need another pass over the output.
+    template <typename AIt, typename BIt, typename Out, typename Post>
+    void run(AIt b_a,
+             AIt e_a,
+             BIt b_b,
+             BIt e_b,
+             Out output_it,
+             const callback& callback,
+             const Post& post) {
+        const size_t dist_a = std::distance(b_a, e_a);
+        const size_t dist_b = std::distance(b_b, e_b);
+        const auto dist = std::max(dist_a, dist_b);
+
+        if (dist == 0) {
+            return;
+        }
+
+        if (a_.size() < dist) {
+            throw std::runtime_error{"Crossover input signal is too long."};
+        }
+
+        a_.zero();
+        std::copy(b_a, e_a, a_.begin());
+        b_.zero();
+        std::copy(b_b, e_b, b_.begin());
+
+        crossover_impl(callback);
+
+        //  The inverse transform is unnormalised, so fold the 1/N scale
+        //  into the output pass.
+        const auto scale = 1.0f / a_.size();
+        for (size_t i = 0; i != dist; ++i, ++output_it) {
+            *output_it = post(i, a_.begin()[i] * scale);
+        }
+    }
+
+private:
+    /// Leaves the (unnormalised) combined output in a_.
+    void crossover_impl(const callback& callback);
+
+    rbuf a_;
+    rbuf b_;
+
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+}  // namespace frequency_domain
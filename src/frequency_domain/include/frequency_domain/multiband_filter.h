@@ -8,6 +8,7 @@
 #include "utilities/map_to_vector.h"
 #include "utilities/mapping_iterator_adapter.h"
 #include "utilities/range.h"
+#include "utilities/thread_pool.h"
 
 namespace frequency_domain {
 
@@ -44,49 +45,73 @@ size_t best_fft_length(T t) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Bands are filtered as tasks on `pool`, on at most one 'lane' per thread.
+/// Each lane owns a single filter which it reuses for every band it
+/// processes, so peak memory depends on the pool size rather than on the
+/// number of bands.
+/// Bands are written to disjoint elements, so the output doesn't depend on
+/// scheduling.
 template <size_t bands_plus_one, typename It, typename Callback>
 auto multiband_filter(It b,
                       It e,
                       const edges_and_width_factor<bands_plus_one>& params,
                       const Callback& callback,
+                      util::thread_pool& pool,
                       size_t l = 0) {
     constexpr auto bands = bands_plus_one - 1;
 
     //  A bit of extra padding here so that discontinuities at the end get
     //  truncated away.
     const auto bins = best_fft_length(std::distance(b, e)) << 2;
-    filter filt{bins};
-
-    //  Will store the area under each frequency-domain window.
-    std::array<double, bands> summed_squared{};
-    std::array<double, bands> integrated_envelopes{};
-
-    for (auto i = 0ul; i != bands; ++i) {
-        const auto mapping_b = callback(b, i);
-        const auto mapping_e = callback(e, i);
-        filt.run(mapping_b, mapping_e, mapping_b, [&](auto cplx, auto freq) {
-            const auto amp = compute_bandpass_magnitude(
-                    freq,
-                    util::make_range(params.edges[i + 0], params.edges[i + 1]),
-                    params.width_factor,
-                    l);
-            integrated_envelopes[i] += amp;
-            const auto ret = cplx * static_cast<float>(amp);
-            const auto abs_ret = std::abs(ret);
-            summed_squared[i] += abs_ret * abs_ret;
-            return ret;
-        });
-    }
+
+    //  The calling thread helps out too, hence the extra lane.
+    const auto lanes = std::min<size_t>(bands, pool.size() + 1);
 
     std::array<double, bands> normalized_rms{};
-    for (auto i = 0; i != bands; ++i) {
-        normalized_rms[i] = integrated_envelopes[i] ? 
-                std::sqrt(summed_squared[i] / integrated_envelopes[i]) : 0;
-    }
+    util::parallel_for(pool, lanes, [&](auto lane) {
+        filter filt{bins};
+        for (auto i = lane; i < bands; i += lanes) {
+            double summed_squared = 0;
+            //  Will store the area under the frequency-domain window.
+            double integrated_envelope = 0;
+            const auto mapping_b = callback(b, i);
+            const auto mapping_e = callback(e, i);
+            filt.run(mapping_b,
+                     mapping_e,
+                     mapping_b,
+                     [&](auto cplx, auto freq) {
+                         const auto amp = compute_bandpass_magnitude(
+                                 freq,
+                                 util::make_range(params.edges[i + 0],
+                                                  params.edges[i + 1]),
+                                 params.width_factor,
+                                 l);
+                         integrated_envelope += amp;
+                         const auto ret = cplx * static_cast<float>(amp);
+                         const auto abs_ret = std::abs(ret);
+                         summed_squared += abs_ret * abs_ret;
+                         return ret;
+                     });
+            normalized_rms[i] =
+                    integrated_envelope
+                            ? std::sqrt(summed_squared / integrated_envelope)
+                            : 0;
+        }
+    });
 
     return normalized_rms;
 }
 
+template <size_t bands_plus_one, typename It, typename Callback>
+auto multiband_filter(It b,
+                      It e,
+                      const edges_and_width_factor<bands_plus_one>& params,
+                      const Callback& callback,
+                      size_t l = 0) {
+    return multiband_filter(
+            b, e, params, callback, util::serial_executor(), l);
+}
+
 template <typename It>
 auto square_sum(It b, It e) {
     return std::accumulate(
@@ -17,14 +17,18 @@ public:
             , c2r_o_{fft_length_}
             , acplx_{cplx_length_}
             , bcplx_{cplx_length_}
-            , r2c_{fftwf_plan_dft_r2c_1d(fft_length,
-                                         owner.r2c_i_.data(),
-                                         r2c_o_.data(),
-                                         FFTW_ESTIMATE)}
-            , c2r_{fftwf_plan_dft_c2r_1d(fft_length,
-                                         c2r_i_.data(),
-                                         c2r_o_.data(),
-                                         FFTW_ESTIMATE)} {}
+            , r2c_{make_plan([&] {
+                return fftwf_plan_dft_r2c_1d(fft_length,
+                                             owner.r2c_i_.data(),
+                                             r2c_o_.data(),
+                                             FFTW_ESTIMATE);
+            })}
+            , c2r_{make_plan([&] {
+                return fftwf_plan_dft_c2r_1d(fft_length,
+                                             c2r_i_.data(),
+                                             c2r_o_.data(),
+                                             FFTW_ESTIMATE);
+            })} {}
 
     size_t get_fft_length() const { return fft_length_; }
 
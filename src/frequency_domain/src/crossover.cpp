@@ -0,0 +1,70 @@
+#include "frequency_domain/crossover.h"
+
+#include "plan.h"
+
+namespace frequency_domain {
+
+class crossover::impl final {
+public:
+    using cbuf = buffer<fftwf_complex>;
+
+    impl(rbuf& a, rbuf& b)
+            : a_{a}
+            , a_cplx_{a.size() / 2 + 1}
+            , b_cplx_{a.size() / 2 + 1}
+            , fft_a_{make_plan([&] {
+                return fftwf_plan_dft_r2c_1d(
+                        a.size(), a.data(), a_cplx_.data(), FFTW_ESTIMATE);
+            })}
+            , fft_b_{make_plan([&] {
+                return fftwf_plan_dft_r2c_1d(
+                        b.size(), b.data(), b_cplx_.data(), FFTW_ESTIMATE);
+            })}
+            , ifft_{make_plan([&] {
+                return fftwf_plan_dft_c2r_1d(
+                        a.size(), a_cplx_.data(), a.data(), FFTW_ESTIMATE);
+            })} {}
+
+    void crossover_impl(const crossover::callback& callback) {
+        fftwf_execute(fft_a_);
+        fftwf_execute(fft_b_);
+
+        const auto rbuf_size = a_.size();
+        for (auto i = 0ul, end = a_cplx_.size(); i != end; ++i) {
+            const auto normalised_frequency = i / static_cast<float>(rbuf_size);
+            auto& a{a_cplx_.data()[i]};
+            const auto& b{b_cplx_.data()[i]};
+            const auto new_value = callback(std::complex<float>{a[0], a[1]},
+                                            std::complex<float>{b[0], b[1]},
+                                            normalised_frequency);
+            a[0] = new_value.real();
+            a[1] = new_value.imag();
+        }
+
+        //  Combined spectrum is in a_cplx_, so its inverse lands in a_.
+        fftwf_execute(ifft_);
+    }
+
+private:
+    rbuf& a_;
+    cbuf a_cplx_;
+    cbuf b_cplx_;
+    plan fft_a_;
+    plan fft_b_;
+    plan ifft_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+crossover::crossover(size_t signal_length)
+        : a_{signal_length}
+        , b_{signal_length}
+        , pimpl_{std::make_unique<impl>(a_, b_)} {}
+
+crossover::~crossover() noexcept = default;
+
+void crossover::crossover_impl(const callback& callback) {
+    pimpl_->crossover_impl(callback);
+}
+
+}  // namespace frequency_domain
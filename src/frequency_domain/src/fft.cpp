@@ -29,11 +29,13 @@ public:
     impl(dft_1d::direction dir, size_t size)
             : i_buf_{size}
             , o_buf_{size}
-            , plan_{fftwf_plan_dft_1d(size,
-                                      i_buf_.data(),
-                                      o_buf_.data(),
-                                      dir == direction::forwards ? 1 : -1,
-                                      FFTW_ESTIMATE)} {}
+            , plan_{make_plan([&] {
+                return fftwf_plan_dft_1d(size,
+                                         i_buf_.data(),
+                                         o_buf_.data(),
+                                         dir == direction::forwards ? 1 : -1,
+                                         FFTW_ESTIMATE);
+            })} {}
 
     impl(const impl&) = delete;
     impl(impl&&) = delete;
@@ -14,10 +14,14 @@ public:
     explicit impl(rbuf& rbuf)
             : rbuf_{rbuf}
             , cbuf_{rbuf.size() / 2 + 1}
-            , fft_{fftwf_plan_dft_r2c_1d(
-                      rbuf.size(), rbuf.data(), cbuf_.data(), FFTW_ESTIMATE)}
-            , ifft_{fftwf_plan_dft_c2r_1d(
-                      rbuf.size(), cbuf_.data(), rbuf.data(), FFTW_ESTIMATE)} {}
+            , fft_{make_plan([&] {
+                return fftwf_plan_dft_r2c_1d(
+                        rbuf.size(), rbuf.data(), cbuf_.data(), FFTW_ESTIMATE);
+            })}
+            , ifft_{make_plan([&] {
+                return fftwf_plan_dft_c2r_1d(
+                        rbuf.size(), cbuf_.data(), rbuf.data(), FFTW_ESTIMATE);
+            })} {}
 
     void filter_impl(const filter::callback& callback) {
         //  Run forward fft, placing fft output into cbuf_.
@@ -2,8 +2,14 @@
 
 #include "fftw3.h"
 
+#include <mutex>
+
 namespace frequency_domain {
 
+/// The fftw planner is not re-entrant, so every plan creation and
+/// destruction must hold this lock. Executing a plan is thread-safe.
+std::mutex& planner_mutex();
+
 class plan final {
 public:
     plan(const fftwf_plan& p);
@@ -15,4 +21,11 @@ private:
     fftwf_plan p;
 };
 
+/// Calls `func` (which should return a fftwf_plan) with the planner locked.
+template <typename Func>
+plan make_plan(const Func& func) {
+    const std::lock_guard<std::mutex> lck{planner_mutex()};
+    return plan{func()};
+}
+
 }  // namespace frequency_domain
@@ -0,0 +1,70 @@
+#include "frequency_domain/crossover.h"
+#include "frequency_domain/envelope.h"
+#include "frequency_domain/filter.h"
+
+#include "gtest/gtest.h"
+
+#include <random>
+
+TEST(crossover, matches_separate_filters) {
+    auto engine = std::default_random_engine{0};
+    auto dist = std::uniform_real_distribution<float>{-1, 1};
+
+    std::vector<float> lo(3000);
+    std::vector<float> hi(5000);
+    for (auto& i : lo) {
+        i = dist(engine);
+    }
+    for (auto& i : hi) {
+        i = dist(engine);
+    }
+
+    const auto cutoff = 0.1;
+    const auto width = 0.2;
+    const auto bins = 1 << 15;
+
+    const auto lo_mag = [&](auto freq) {
+        return static_cast<float>(frequency_domain::compute_lopass_magnitude(
+                freq, cutoff, width, 0));
+    };
+    const auto hi_mag = [&](auto freq) {
+        return static_cast<float>(frequency_domain::compute_hipass_magnitude(
+                freq, cutoff, width, 0));
+    };
+
+    //  Reference: filter each signal separately, then sum.
+    std::vector<float> expected(hi.size(), 0.0f);
+    {
+        frequency_domain::filter filt{bins};
+        std::vector<float> lo_out(lo.size());
+        filt.run(begin(lo), end(lo), begin(lo_out), [&](auto cplx, auto freq) {
+            return cplx * lo_mag(freq);
+        });
+        std::vector<float> hi_out(hi.size());
+        filt.run(begin(hi), end(hi), begin(hi_out), [&](auto cplx, auto freq) {
+            return cplx * hi_mag(freq);
+        });
+        for (size_t i = 0; i != expected.size(); ++i) {
+            expected[i] = (i < lo_out.size() ? lo_out[i] : 0.0f) + hi_out[i];
+        }
+    }
+
+    frequency_domain::crossover xover{bins};
+    std::vector<float> output(hi.size());
+    xover.run(begin(lo),
+              end(lo),
+              begin(hi),
+              end(hi),
+              begin(output),
+              [&](auto a, auto b, auto freq) {
+                  return a * lo_mag(freq) + b * hi_mag(freq);
+              },
+              [](auto, auto sample) { return sample * 2; });
+
+    //  Filtering separately truncates the filtered short signal to its
+    //  input length, whereas the crossover keeps its tail, so only the
+    //  overlapping region is comparable.
+    for (size_t i = 0; i != lo.size(); ++i) {
+        ASSERT_NEAR(output[i], expected[i] * 2, 1.0e-4);
+    }
+}
@@ -34,3 +34,40 @@ TEST(multiband, noise) {
         ASSERT_NEAR(std::abs(mean - i) / mean, 0.0, 0.2);
     }
 }
+
+TEST(multiband, parallel_matches_sequential) {
+    auto engine = std::default_random_engine{0};
+    auto dist = std::uniform_real_distribution<float>{-1, 1};
+
+    constexpr auto bands = 8;
+    using multiband_type = std::array<float, bands>;
+
+    util::aligned::vector<multiband_type> sequential;
+    for (auto i = 0ul; i != 10000; ++i) {
+        sequential.emplace_back(
+                frequency_domain::init_array<bands>(dist(engine)));
+    }
+    auto parallel = sequential;
+
+    constexpr auto audible_range = util::range<double>{20, 20000};
+    constexpr auto sample_rate = 44100.0;
+    const auto params = frequency_domain::compute_multiband_params<bands>(
+            audible_range / sample_rate, 1);
+
+    const auto sequential_rms = frequency_domain::multiband_filter(
+            begin(sequential),
+            end(sequential),
+            params,
+            frequency_domain::make_indexer_iterator{});
+
+    util::thread_pool pool{3};
+    const auto parallel_rms = frequency_domain::multiband_filter(
+            begin(parallel),
+            end(parallel),
+            params,
+            frequency_domain::make_indexer_iterator{},
+            pool);
+
+    ASSERT_EQ(sequential_rms, parallel_rms);
+    ASSERT_EQ(sequential, parallel);
+}
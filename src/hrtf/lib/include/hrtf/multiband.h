@@ -35,9 +35,19 @@ template <typename It, typename Callback>
 void multiband_filter(It begin,
                       It end,
                       double sample_rate,
-                      const Callback& callback) {
+                      const Callback& callback,
+                      util::thread_pool& pool) {
     frequency_domain::multiband_filter(
-            begin, end, hrtf_band_params(sample_rate), callback);
+            begin, end, hrtf_band_params(sample_rate), callback, pool);
+}
+
+template <typename It, typename Callback>
+void multiband_filter(It begin,
+                      It end,
+                      double sample_rate,
+                      const Callback& callback) {
+    multiband_filter(
+            begin, end, sample_rate, callback, util::serial_executor());
 }
 
 template <typename It>
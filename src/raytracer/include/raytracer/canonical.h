@@ -20,14 +20,18 @@ template <typename Histogram>
 struct simulation_results final {
     util::aligned::vector<impulse<core::simulation_bands>> image_source;
     Histogram stochastic;
+
+    /// Seed for the dirac sequence used to synthesise the stochastic tail.
+    std::uint64_t seed;
 };
 
 template <typename Histogram>
 auto make_simulation_results(
         util::aligned::vector<impulse<core::simulation_bands>> image_source,
-        Histogram stochastic) {
-    return simulation_results<Histogram>{std::move(image_source),
-                                         std::move(stochastic)};
+        Histogram stochastic,
+        std::uint64_t seed) {
+    return simulation_results<Histogram>{
+            std::move(image_source), std::move(stochastic), seed};
 }
 
 template <typename Histogram>
@@ -43,9 +47,10 @@ auto make_canonical_results(
     return canonical_results<Histogram>{std::move(aural), std::move(visual)};
 }
 
+/// Segments of rays are spread over `devices` (see run).
 template <typename Callback>
 auto canonical(
-        const core::compute_context& cc,
+        const util::aligned::vector<core::compute_context>& devices,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 scene,
@@ -61,7 +66,7 @@ auto canonical(
     auto tup = run(
             make_random_direction_generator_iterator(0, engine),
             make_random_direction_generator_iterator(sim_params.rays, engine),
-            cc,
+            devices,
             scene,
             source,
             receiver,
@@ -72,10 +77,35 @@ auto canonical(
             sim_params.rng_seed);
     return tup ? std::make_optional(make_canonical_results(
                          make_simulation_results(std::move(std::get<0>(*tup)),
-                                                 std::move(std::get<1>(*tup))),
+                                                 std::move(std::get<1>(*tup)),
+                                                 sim_params.rng_seed),
                          std::move(std::get<2>(*tup))))
                : std::nullopt;
 }
 
+template <typename Callback>
+auto canonical(
+        const core::compute_context& cc,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                scene,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::environment& environment,
+        const simulation_parameters& sim_params,
+        size_t visual_items,
+        const std::atomic_bool& keep_going,
+        Callback&& callback) {
+    return canonical(util::aligned::vector<core::compute_context>{cc},
+                     scene,
+                     source,
+                     receiver,
+                     environment,
+                     sim_params,
+                     visual_items,
+                     keep_going,
+                     std::forward<Callback>(callback));
+}
+
 }  // namespace raytracer
 }  // namespace wayverb
@@ -14,18 +14,21 @@
 #include "core/scene_data.h"
 
 #include "utilities/map_to_vector.h"
+#include "utilities/thread_pool.h"
 
 namespace wayverb {
 namespace raytracer {
 namespace image_source {
 
+/// The per-band filtering runs on `pool`.
 template <typename InputIt, typename Method>
 auto postprocess(InputIt b,
                  InputIt e,
                  const Method& method,
                  const glm::vec3& position,
                  double speed_of_sound,
-                 double sample_rate) {
+                 double sample_rate,
+                 util::thread_pool& pool) {
     const auto make_iterator = [&](auto it) {
         return make_histogram_iterator(
                 make_attenuator_iterator(std::move(it), method, position),
@@ -36,9 +39,29 @@ auto postprocess(InputIt b,
                           sample_rate,
                           sinc_sum_functor{});
     return core::multiband_filter_and_mixdown(
-            begin(hist), end(hist), sample_rate, [](auto it, auto index) {
+            begin(hist),
+            end(hist),
+            sample_rate,
+            [](auto it, auto index) {
                 return core::make_cl_type_iterator(std::move(it), index);
-            });
+            },
+            pool);
+}
+
+template <typename InputIt, typename Method>
+auto postprocess(InputIt b,
+                 InputIt e,
+                 const Method& method,
+                 const glm::vec3& position,
+                 double speed_of_sound,
+                 double sample_rate) {
+    return postprocess(b,
+                       e,
+                       method,
+                       position,
+                       speed_of_sound,
+                       sample_rate,
+                       util::serial_executor());
 }
 
 }  // namespace image_source
@@ -9,28 +9,55 @@
 namespace wayverb {
 namespace raytracer {
 
+/// The image-source head and stochastic tail are processed concurrently on
+/// the pool, and each of them filters its bands in parallel.
 template <typename Histogram, typename Method>
 auto postprocess(const simulation_results<Histogram>& input,
                  const Method& method,
                  const glm::vec3& position,
                  double room_volume,
                  const core::environment& environment,
-                 double output_sample_rate) {
-    const auto head =
-            raytracer::image_source::postprocess(begin(input.image_source),
-                                                 end(input.image_source),
-                                                 method,
-                                                 position,
-                                                 environment.speed_of_sound,
-                                                 output_sample_rate);
+                 double output_sample_rate,
+                 util::thread_pool& pool) {
+    auto parts = util::parallel_invoke(
+            pool,
+            [&] {
+                return raytracer::image_source::postprocess(
+                        begin(input.image_source),
+                        end(input.image_source),
+                        method,
+                        position,
+                        environment.speed_of_sound,
+                        output_sample_rate,
+                        pool);
+            },
+            [&] {
+                return raytracer::stochastic::postprocess(input.stochastic,
+                                                          method,
+                                                          room_volume,
+                                                          environment,
+                                                          output_sample_rate,
+                                                          input.seed,
+                                                          pool);
+            });
 
-    const auto tail = raytracer::stochastic::postprocess(input.stochastic,
-                                                         method,
-                                                         room_volume,
-                                                         environment,
-                                                         output_sample_rate);
+    return core::sum_vectors(std::move(parts.first), std::move(parts.second));
+}
 
-    return core::sum_vectors(head, tail);
+template <typename Histogram, typename Method>
+auto postprocess(const simulation_results<Histogram>& input,
+                 const Method& method,
+                 const glm::vec3& position,
+                 double room_volume,
+                 const core::environment& environment,
+                 double output_sample_rate) {
+    return postprocess(input,
+                       method,
+                       position,
+                       room_volume,
+                       environment,
+                       output_sample_rate,
+                       util::serial_executor());
 }
 
 }  // namesapce raytracer
@@ -19,10 +19,15 @@
 #include "raytracer/reflection_processor/visual.h"
 
 #include "utilities/apply.h"
+#include "utilities/instrumentation.h"
 #include "utilities/map.h"
 
 #include "utilities/optional.h"
+
+#include <future>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 
 namespace wayverb {
 namespace raytracer {
@@ -187,11 +192,14 @@ constexpr auto make_random_direction_generator_iterator(
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Segments of rays are dealt out to `devices`, one segment per device at a
+/// time, and their results are accumulated in order. Directions are drawn on
+/// the calling thread, so the results don't depend on the number of devices.
 template <typename It, typename PerStepCallback, typename Callbacks>
 auto run(
         It b_direction,
         It e_direction,
-        const core::compute_context& cc,
+        const util::aligned::vector<core::compute_context>& devices,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised,
@@ -202,7 +210,16 @@ auto run(
         PerStepCallback&& per_step_callback,
         Callbacks&& callbacks,
         std::uint64_t rng_seed = 0x9E3779B97F4A7C15ull) {
-    const core::scene_buffers buffers{cc.context, voxelised};
+    if (devices.empty()) {
+        throw std::runtime_error{"The raytracer needs at least one device."};
+    }
+
+    //  Each device gets its own copy of the scene.
+    std::vector<core::scene_buffers> buffers;
+    buffers.reserve(devices.size());
+    for (const auto& device : devices) {
+        buffers.emplace_back(device.context, voxelised);
+    }
 
     const auto make_ray_iterator = [&](auto it) {
         return util::make_mapping_iterator_adapter(
@@ -214,7 +231,11 @@ auto run(
     auto processors = util::apply_each(
             util::map(make_get_processor_functor_adapter{},
                       std::forward<Callbacks>(callbacks)),
-            std::tie(cc, source, receiver, environment, voxelised));
+            std::tie(devices.front(),
+                     source,
+                     receiver,
+                     environment,
+                     voxelised));
 
     using return_type = decltype(util::apply_each(
             util::map(make_get_results_functor_adapter{}, processors)));
@@ -223,54 +244,102 @@ auto run(
     const auto reflection_depth =
             compute_optimum_reflection_number(voxelised.get_scene_data());
 
-    const auto run_segment = [&](auto b, auto e) {
-        const auto num_directions = std::distance(b, e);
+    const auto run_segment = [&](size_t device, const auto& directions) {
+        const util::instrumentation::scoped_timer timer{"raytracer/segment"};
 
-        reflector ref{cc,
+        reflector ref{devices[device],
                       receiver,
-                      make_ray_iterator(b),
-                      make_ray_iterator(e),
+                      make_ray_iterator(begin(directions)),
+                      make_ray_iterator(end(directions)),
                       rng_seed};
 
         auto group_processors = util::apply_each(
                 util::map(make_get_group_processor_functor_adapter{},
                           processors),
-                std::make_tuple(num_directions));
+                std::make_tuple(directions.size(), devices[device]));
 
         for (auto i = 0ul; i != reflection_depth; ++i) {
-            const auto reflections = ref.run_step(buffers);
+            const util::instrumentation::scoped_timer bounce{
+                    "raytracer/bounce"};
+            const auto reflections = ref.run_step(buffers[device]);
             const auto b = begin(reflections);
             const auto e = end(reflections);
             util::call_each(
                     util::map(make_process_functor_adapter{}, group_processors),
-                    std::tie(b, e, buffers, i, reflection_depth));
+                    std::tie(b, e, buffers[device], i, reflection_depth));
         }
 
-        zip_apply(util::map(make_accumulate_functor_adapter{}, processors),
-                  group_processors);
+        return group_processors;
     };
 
     const auto groups = std::distance(b_direction, e_direction) / segment_size;
 
     auto it = b_direction;
-    for (auto group = 0; it + segment_size <= e_direction;
-         it += segment_size, ++group) {
-        run_segment(it, it + segment_size);
+    for (auto group = 0; it != e_direction;) {
+        std::vector<util::aligned::vector<glm::vec3>> wave;
+        while (wave.size() != devices.size() && it != e_direction) {
+            const auto items = std::min<std::ptrdiff_t>(
+                    segment_size, std::distance(it, e_direction));
+            wave.emplace_back(it, it + items);
+            it += items;
+        }
+
+        //  A lone segment runs on this thread.
+        const auto policy = wave.size() == 1 ? std::launch::deferred
+                                             : std::launch::async;
+        std::vector<std::future<decltype(run_segment(0, wave.front()))>>
+                segments;
+        for (size_t device = 0; device != wave.size(); ++device) {
+            segments.emplace_back(std::async(policy, [&, device] {
+                return run_segment(device, wave[device]);
+            }));
+        }
 
-        per_step_callback(group, groups);
+        for (auto& segment : segments) {
+            zip_apply(util::map(make_accumulate_functor_adapter{}, processors),
+                      segment.get());
+            if (group < groups) {
+                per_step_callback(group, groups);
+            }
+            ++group;
+        }
 
         if (!keep_going) {
             return std::optional<return_type>{};
         }
     }
 
-    if (it != e_direction) {
-        run_segment(it, e_direction);
-    }
-
     return std::make_optional(util::apply_each(
             util::map(make_get_results_functor_adapter{}, processors)));
 }
 
+template <typename It, typename PerStepCallback, typename Callbacks>
+auto run(
+        It b_direction,
+        It e_direction,
+        const core::compute_context& cc,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::environment& environment,
+        const std::atomic_bool& keep_going,
+        PerStepCallback&& per_step_callback,
+        Callbacks&& callbacks,
+        std::uint64_t rng_seed = 0x9E3779B97F4A7C15ull) {
+    return run(std::move(b_direction),
+               std::move(e_direction),
+               util::aligned::vector<core::compute_context>{cc},
+               voxelised,
+               source,
+               receiver,
+               environment,
+               keep_going,
+               std::forward<PerStepCallback>(per_step_callback),
+               std::forward<Callbacks>(callbacks),
+               rng_seed);
+}
+
 }  // namespace raytracer
 }  // namespace wayverb
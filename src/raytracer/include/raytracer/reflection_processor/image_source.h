@@ -50,7 +50,7 @@ public:
             float mis_delta_pdf);
 
     image_source_group_processor get_group_processor(
-            size_t num_directions) const;
+            size_t num_directions, const core::compute_context& cc) const;
     void accumulate(const image_source_group_processor& processor);
 
     util::aligned::vector<impulse<8>> get_results() const;
@@ -149,8 +149,7 @@ private:
 template <typename Histogram>
 class stochastic_processor final {
 public:
-    stochastic_processor(const core::compute_context& cc,
-                         const glm::vec3& source,
+    stochastic_processor(const glm::vec3& source,
                          const glm::vec3& receiver,
                          const core::environment& environment,
                          size_t total_rays,
@@ -159,8 +158,7 @@ public:
                          float histogram_sample_rate,
                          bool has_scatter,
                          float mis_delta_pdf)
-            : cc_{cc}
-            , source_{source}
+            : source_{source}
             , receiver_{receiver}
             , environment_{environment}
             , total_rays_{total_rays}
@@ -171,9 +169,11 @@ public:
             , has_scatter_{has_scatter}
             , mis_delta_pdf_{mis_delta_pdf} {}
 
+    /// Segments may run on different devices, so each group processor is
+    /// told which one to use.
     stochastic_group_processor<Histogram> get_group_processor(
-            size_t num_directions) const {
-        return {cc_,
+            size_t num_directions, const core::compute_context& cc) const {
+        return {cc,
                 source_,
                 receiver_,
                 environment_,
@@ -196,7 +196,6 @@ public:
     Histogram get_results() const { return histogram_; }
 
 private:
-    core::compute_context cc_;
     glm::vec3 source_;
     glm::vec3 receiver_;
     core::environment environment_;
@@ -36,7 +36,8 @@ class visual_processor final {
 public:
     explicit visual_processor(size_t items);
 
-    visual_group_processor get_group_processor(size_t num_directions) const;
+    visual_group_processor get_group_processor(
+            size_t num_directions, const core::compute_context& cc) const;
     void accumulate(const visual_group_processor& processor);
 
     util::aligned::vector<util::aligned::vector<reflection>> get_results();
@@ -2,8 +2,10 @@
 
 #include "raytracer/program.h"
 
+#include "core/cl/buffer_pool.h"
 #include "core/cl/geometry.h"
 #include "core/cl/include.h"
+#include "core/cl/profiling.h"
 #include "core/geo/geometric.h"
 #include "core/spatial_division/scene_buffers.h"
 
@@ -34,29 +36,33 @@ public:
               It e,
               std::uint64_t rng_seed = 0x9E3779B97F4A7C15ull)
             : cc_{cc}
-            , queue_{cc.context, cc.device}
+            , queue_{cc.context, cc.device, core::profiling_queue_properties()}
             , kernel_{program{cc}.get_kernel()}
             , receiver_{core::to_cl_float3{}(receiver)}
             , rays_(std::distance(b, e))
-            , ray_buffer_{core::load_to_buffer(
-                      cc.context,
-                      util::map_to_vector(
-                              b,
-                              e,
-                              [](const auto& i) { return core::convert(i); }),
-                      false)}
-            , reflection_buffer_{cc.context,
-                                 CL_MEM_READ_WRITE,
-                                 rays_ * sizeof(reflection)}
-            , rng_buffer_{cc.context,
-                          CL_MEM_READ_WRITE,
-                          rays_ * 3 * sizeof(cl_float)}
+            , ray_buffer_{cc, rays_ * sizeof(core::ray)}
+            , reflection_buffer_{cc, rays_ * sizeof(reflection)}
+            , rng_buffer_{cc, rays_ * 3 * sizeof(cl_float)}
             , rng_engine_{rng_seed} {
+        const auto rays = util::map_to_vector(
+                b, e, [](const auto& i) { return core::convert(i); });
+        queue_.enqueueWriteBuffer(ray_buffer_,
+                                  CL_TRUE,
+                                  0,
+                                  rays_ * sizeof(core::ray),
+                                  rays.data());
         program{cc_}.get_init_reflections_kernel()(
                 cl::EnqueueArgs{queue_, cl::NDRange{rays_}},
                 reflection_buffer_);
     }
 
+    /// Waits for outstanding work, so that the pooled buffers are idle when
+    /// they go back to the pool.
+    ~reflector() noexcept;
+
+    reflector(reflector&&) = default;
+    reflector& operator=(reflector&&) = default;
+
     util::aligned::vector<reflection> run_step(
             const core::scene_buffers& buffers);
 
@@ -78,13 +84,17 @@ private:
     cl_float3 receiver_;
     size_t rays_;
 
-    cl::Buffer ray_buffer_;
-    cl::Buffer reflection_buffer_;
+    //  Reflectors are made once per segment, so their buffers are pooled.
+    core::pooled_buffer ray_buffer_;
+    core::pooled_buffer reflection_buffer_;
 
-    cl::Buffer rng_buffer_;
+    core::pooled_buffer rng_buffer_;
     std::mt19937_64 rng_engine_;
+    util::aligned::vector<cl_float> rng_;
+    util::aligned::vector<cl_float> next_rng_;
+    bool next_rng_ready_{false};
 
-    util::aligned::vector<cl_float> generate_direction_rng(size_t num);
+    void generate_direction_rng(util::aligned::vector<cl_float>& rng);
 };
 
 }  // namespace raytracer
@@ -4,12 +4,17 @@
 
 #include "raytracer/cl/structs.h"
 
+#include "core/cl/buffer_pool.h"
 #include "core/cl/common.h"
+#include "core/cl/profiling.h"
 #include "core/conversions.h"
 #include "core/pressure_intensity.h"
 #include "core/spatial_division/scene_buffers.h"
 
 #include "utilities/aligned/vector.h"
+#include "utilities/instrumentation.h"
+
+#include <memory>
 
 namespace wayverb {
 namespace raytracer {
@@ -40,6 +45,13 @@ public:
            float receiver_radius,
            float starting_energy);
 
+    /// Waits for outstanding work, so that the pooled buffers are idle when
+    /// they go back to the pool.
+    ~finder() noexcept;
+
+    finder(finder&&) = default;
+    finder& operator=(finder&&) = default;
+
     struct results final {
         util::aligned::vector<impulse<core::simulation_bands>> specular;
         util::aligned::vector<impulse<core::simulation_bands>> stochastic;
@@ -47,35 +59,61 @@ public:
 
     template <typename It>
     auto process(It b, It e, const core::scene_buffers& scene_buffers) {
+        const util::instrumentation::scoped_timer timer{"raytracer/finder"};
+
         //  copy the current batch of reflections to the device
-        cl::copy(queue_, b, e, reflections_buffer_);
+        //  The range is contiguous, and outlives the wait below.
+        if (b != e) {
+            core::write_to_buffer_async(queue_,
+                                        reflections_buffer_,
+                                        0,
+                                        std::distance(b, e),
+                                        std::addressof(*b));
+        }
 
         //  get the kernel and run it
-        kernel_(cl::EnqueueArgs(queue_, cl::NDRange(rays_)),
-                reflections_buffer_,
-                receiver_,
-                receiver_radius_,
-                scene_buffers.get_triangles_buffer(),
-                scene_buffers.get_vertices_buffer(),
-                scene_buffers.get_surfaces_buffer(),
-                stochastic_path_buffer_,
-                stochastic_output_buffer_,
-                specular_output_buffer_);
-
-        const auto read_out_impulses = [&](const auto& buffer) {
-            auto raw = core::read_from_buffer<impulse<core::simulation_bands>>(
-                    queue_, buffer);
-            raw.erase(std::remove_if(begin(raw),
-                                     end(raw),
-                                     [](const auto& impulse) {
-                                         return !impulse.distance;
-                                     }),
-                      end(raw));
-            return raw;
+        core::profile_event(
+                "raytracer/find",
+                kernel_(cl::EnqueueArgs(queue_, cl::NDRange(rays_)),
+                        reflections_buffer_,
+                        receiver_,
+                        receiver_radius_,
+                        scene_buffers.get_triangles_buffer(),
+                        scene_buffers.get_vertices_buffer(),
+                        scene_buffers.get_surfaces_buffer(),
+                        stochastic_path_buffer_,
+                        stochastic_output_buffer_,
+                        specular_output_buffer_));
+
+        //  Both outputs are read back with a single wait.
+        util::aligned::vector<impulse<core::simulation_bands>> specular(rays_);
+        util::aligned::vector<impulse<core::simulation_bands>> stochastic(
+                rays_);
+        const std::vector<cl::Event> reads{
+                core::read_from_buffer_async(queue_,
+                                             specular_output_buffer_,
+                                             0,
+                                             rays_,
+                                             specular.data()),
+                core::read_from_buffer_async(queue_,
+                                             stochastic_output_buffer_,
+                                             0,
+                                             rays_,
+                                             stochastic.data())};
+        cl::Event::waitForEvents(reads);
+
+        const auto remove_empty = [](auto& impulses) {
+            impulses.erase(std::remove_if(begin(impulses),
+                                          end(impulses),
+                                          [](const auto& impulse) {
+                                              return !impulse.distance;
+                                          }),
+                           end(impulses));
         };
+        remove_empty(specular);
+        remove_empty(stochastic);
 
-        return results{read_out_impulses(specular_output_buffer_),
-                       read_out_impulses(stochastic_output_buffer_)};
+        return results{std::move(specular), std::move(stochastic)};
     }
 
 private:
@@ -88,10 +126,11 @@ private:
     cl_float receiver_radius_;
     size_t rays_;
 
-    cl::Buffer reflections_buffer_;
-    cl::Buffer stochastic_path_buffer_;
-    cl::Buffer stochastic_output_buffer_;
-    cl::Buffer specular_output_buffer_;
+    //  Finders are made once per segment, so their buffers are pooled.
+    core::pooled_buffer reflections_buffer_;
+    core::pooled_buffer stochastic_path_buffer_;
+    core::pooled_buffer stochastic_output_buffer_;
+    core::pooled_buffer specular_output_buffer_;
 };
 
 }  // namespace stochastic
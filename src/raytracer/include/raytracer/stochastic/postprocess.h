@@ -2,6 +2,8 @@
 
 #include "raytracer/stochastic/postprocessing.h"
 
+#include <cstdint>
+
 namespace wayverb {
 namespace raytracer {
 namespace stochastic {
@@ -13,12 +15,8 @@ struct size_functor final {
     }
 };
 
-template <size_t Az, size_t El, typename Method>
-auto postprocess(const directional_energy_histogram<Az, El>& histogram,
-                 const Method& method,
-                 double room_volume,
-                 const core::environment& environment,
-                 double sample_rate) {
+template <size_t Az, size_t El>
+auto max_seconds(const directional_energy_histogram<Az, El>& histogram) {
     const auto& table = histogram.histogram.table;
 
     const auto max_size = std::accumulate(
@@ -39,12 +37,46 @@ auto postprocess(const directional_energy_histogram<Az, El>& histogram,
                                           make_size_iterator(std::end(b))));
             });
 
-    const auto max_seconds = max_size / histogram.sample_rate;
+    return max_size / histogram.sample_rate;
+}
 
-    const auto dirac_sequence = generate_dirac_sequence(
-            environment.speed_of_sound, room_volume, sample_rate, max_seconds);
-    return postprocessing(
-            histogram, method, dirac_sequence, environment.acoustic_impedance);
+/// The dirac sequence is derived from `seed`, so renders with equal inputs
+/// produce identical tails. The per-band filtering runs on `pool`.
+template <size_t Az, size_t El, typename Method>
+auto postprocess(const directional_energy_histogram<Az, El>& histogram,
+                 const Method& method,
+                 double room_volume,
+                 const core::environment& environment,
+                 double sample_rate,
+                 std::uint64_t seed,
+                 util::thread_pool& pool) {
+    const auto dirac_sequence =
+            get_dirac_sequence(environment.speed_of_sound,
+                               room_volume,
+                               sample_rate,
+                               max_seconds(histogram),
+                               seed);
+    return postprocessing(histogram,
+                          method,
+                          *dirac_sequence,
+                          environment.acoustic_impedance,
+                          pool);
+}
+
+template <size_t Az, size_t El, typename Method>
+auto postprocess(const directional_energy_histogram<Az, El>& histogram,
+                 const Method& method,
+                 double room_volume,
+                 const core::environment& environment,
+                 double sample_rate,
+                 std::uint64_t seed = 0x9E3779B97F4A7C15ull) {
+    return postprocess(histogram,
+                       method,
+                       room_volume,
+                       environment,
+                       sample_rate,
+                       seed,
+                       util::serial_executor());
 }
 
 }  // namespace stochastic
@@ -9,9 +9,12 @@
 #include "hrtf/multiband.h"
 
 #include "utilities/aligned/vector.h"
+#include "utilities/thread_pool.h"
 
 #include <array>
 #include <cmath>
+#include <cstdint>
+#include <memory>
 #include <random>
 
 namespace wayverb {
@@ -53,7 +56,23 @@ struct dirac_sequence final {
 dirac_sequence generate_dirac_sequence(double speed_of_sound,
                                        double room_volume,
                                        double sample_rate,
-                                       double max_time);
+                                       double max_time,
+                                       std::uint64_t seed);
+
+/// Returns the sequence that generate_dirac_sequence would produce for these
+/// arguments, reusing a previously generated one where possible.
+/// Generation is prefix-stable (a longer max_time only appends events), so a
+/// cached sequence covering a longer time also serves shorter requests; the
+/// excess is trimmed to the histogram length during weighting.
+/// Thread-safe.
+std::shared_ptr<const dirac_sequence> get_dirac_sequence(double speed_of_sound,
+                                                         double room_volume,
+                                                         double sample_rate,
+                                                         double max_time,
+                                                         std::uint64_t seed);
+
+/// Drops all cached dirac sequences.
+void clear_dirac_sequence_cache();
 
 struct energy_histogram final {
     double sample_rate;
@@ -189,6 +208,12 @@ util::aligned::vector<core::bands_type> weight_sequence(
         const std::array<double, core::simulation_bands>&
                 sqrt_bandwidth_fractions);
 
+/// The per-band filtering runs on `pool`.
+util::aligned::vector<float> postprocessing(const energy_histogram& histogram,
+                                            const dirac_sequence& sequence,
+                                            double acoustic_impedance,
+                                            util::thread_pool& pool);
+
 util::aligned::vector<float> postprocessing(const energy_histogram& histogram,
                                             const dirac_sequence& sequence,
                                             double acoustic_impedance);
@@ -198,9 +223,23 @@ util::aligned::vector<float> postprocessing(
         const directional_energy_histogram<Az, El>& histogram,
         const Method& method,
         const dirac_sequence& sequence,
-        double acoustic_impedance) {
+        double acoustic_impedance,
+        util::thread_pool& pool) {
     const auto summed = compute_summed_histogram(histogram, method);
-    return postprocessing(summed, sequence, acoustic_impedance);
+    return postprocessing(summed, sequence, acoustic_impedance, pool);
+}
+
+template <size_t Az, size_t El, typename Method>
+util::aligned::vector<float> postprocessing(
+        const directional_energy_histogram<Az, El>& histogram,
+        const Method& method,
+        const dirac_sequence& sequence,
+        double acoustic_impedance) {
+    return postprocessing(histogram,
+                          method,
+                          sequence,
+                          acoustic_impedance,
+                          util::serial_executor());
 }
 
 }  // namespace stochastic
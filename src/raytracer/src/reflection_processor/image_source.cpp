@@ -4,6 +4,8 @@
 
 #include "core/pressure_intensity.h"
 
+#include "utilities/instrumentation.h"
+
 #include <iterator>
 
 namespace wayverb {
@@ -39,7 +41,7 @@ image_source_processor::image_source_processor(
 }
 
 image_source_group_processor image_source_processor::get_group_processor(
-        size_t num_directions) const {
+        size_t num_directions, const core::compute_context& /*cc*/) const {
     return {max_order_, num_directions};
 }
 
@@ -51,6 +53,7 @@ void image_source_processor::accumulate(
 }
 
 util::aligned::vector<impulse<8>> image_source_processor::get_results() const {
+    const util::instrumentation::scoped_timer timer{"raytracer/image_source"};
     util::aligned::vector<impulse<8>> ret;
 
     const auto calculator = image_source::make_fast_pressure_calculator(
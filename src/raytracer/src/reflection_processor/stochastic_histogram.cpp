@@ -21,7 +21,7 @@ make_stochastic_histogram::make_stochastic_histogram(
 
 stochastic_processor<stochastic::energy_histogram>
 make_stochastic_histogram::get_processor(
-        const core::compute_context& cc,
+        const core::compute_context& /*cc*/,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::environment& environment,
@@ -42,8 +42,7 @@ make_stochastic_histogram::get_processor(
                                              }
                                              return false;
                                          });
-    return {cc,
-            source,
+    return {source,
             receiver,
             environment,
             total_rays_,
@@ -70,7 +69,7 @@ make_directional_histogram::make_directional_histogram(
 
 stochastic_processor<stochastic::directional_energy_histogram<20, 9>>
 make_directional_histogram::get_processor(
-        const core::compute_context& cc,
+        const core::compute_context& /*cc*/,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::environment& environment,
@@ -91,8 +90,7 @@ make_directional_histogram::get_processor(
                                              }
                                              return false;
                                          });
-    return {cc,
-            source,
+    return {source,
             receiver,
             environment,
             total_rays_,
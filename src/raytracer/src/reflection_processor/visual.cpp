@@ -13,7 +13,7 @@ visual_processor::visual_processor(size_t items)
         : items_{items} {}
 
 visual_group_processor visual_processor::get_group_processor(
-        size_t /*num_directions*/) const {
+        size_t /*num_directions*/, const core::compute_context& /*cc*/) const {
     return visual_group_processor{items_};
 }
 
@@ -1,6 +1,8 @@
 #include "raytracer/reflector.h"
 
 #include "core/azimuth_elevation.h"
+#include "core/cl/common.h"
+#include "core/cl/profiling.h"
 #include "core/conversions.h"
 #include "core/spatial_division/scene_buffers.h"
 
@@ -8,52 +10,73 @@
 
 namespace wayverb {
 namespace raytracer {
-util::aligned::vector<cl_float> reflector::generate_direction_rng(
-        size_t num) {
-    util::aligned::vector<cl_float> ret;
-    ret.reserve(3 * num);
+reflector::~reflector() noexcept {
+    try {
+        queue_.finish();
+    } catch (...) {
+    }
+}
+
+void reflector::generate_direction_rng(util::aligned::vector<cl_float>& rng) {
+    //  The storage is reused from step to step.
+    rng.resize(3 * rays_);
     std::uniform_real_distribution<float> distribution{0.0f, 1.0f};
-    
-    for (auto i = 0ul; i != num; ++i) {
-        ret.emplace_back(distribution(rng_engine_));
-        ret.emplace_back(distribution(rng_engine_));
-        ret.emplace_back(distribution(rng_engine_));
+    for (auto& i : rng) {
+        i = distribution(rng_engine_);
     }
-    return ret;
 }
 
 util::aligned::vector<reflection> reflector::run_step(
         const core::scene_buffers& buffers) {
-    //  get some new rng and copy it to device memory
-    const auto rng{generate_direction_rng(rays_)};
-    cl::copy(queue_, std::begin(rng), std::end(rng), rng_buffer_);
+    //  Copy this step's rng to device memory. It was usually generated
+    //  during the previous step. The previous step waited for its own copy,
+    //  so the storage swapped out here is free to be overwritten.
+    if (!next_rng_ready_) {
+        generate_direction_rng(next_rng_);
+    }
+    std::swap(rng_, next_rng_);
+    next_rng_ready_ = false;
+    core::write_to_buffer_async(
+            queue_, rng_buffer_, 0, rng_.size(), rng_.data());
 
     //  get the kernel and run it
-    kernel_(cl::EnqueueArgs(queue_, cl::NDRange(rays_)),
-            ray_buffer_,
-            receiver_,
-            buffers.get_voxel_index_buffer(),
-            buffers.get_global_aabb(),
-            buffers.get_side(),
-            buffers.get_triangles_buffer(),
-            buffers.get_vertices_buffer(),
-            buffers.get_surfaces_buffer(),
-            rng_buffer_,
-            reflection_buffer_);
-
-    return core::read_from_buffer<reflection>(queue_, reflection_buffer_);
+    core::profile_event("raytracer/reflect",
+                        kernel_(cl::EnqueueArgs(queue_, cl::NDRange(rays_)),
+                                ray_buffer_,
+                                receiver_,
+                                buffers.get_voxel_index_buffer(),
+                                buffers.get_global_aabb(),
+                                buffers.get_side(),
+                                buffers.get_triangles_buffer(),
+                                buffers.get_vertices_buffer(),
+                                buffers.get_surfaces_buffer(),
+                                rng_buffer_,
+                                reflection_buffer_));
+
+    util::aligned::vector<reflection> ret(rays_);
+    const auto read = core::read_from_buffer_async(
+            queue_, reflection_buffer_, 0, rays_, ret.data());
+    queue_.flush();
+
+    //  Get the next step's rng ready while the device is busy.
+    generate_direction_rng(next_rng_);
+    next_rng_ready_ = true;
+
+    read.wait();
+    return ret;
 }
 
 util::aligned::vector<core::ray> reflector::get_rays() {
-    return core::read_from_buffer<core::ray>(queue_, ray_buffer_);
+    return core::read_from_buffer<core::ray>(cc_, queue_, ray_buffer_);
 }
 
 util::aligned::vector<reflection> reflector::get_reflections() {
-    return core::read_from_buffer<reflection>(queue_, reflection_buffer_);
+    return core::read_from_buffer<reflection>(
+            cc_, queue_, reflection_buffer_);
 }
 
 util::aligned::vector<cl_float> reflector::get_rng() {
-    return core::read_from_buffer<cl_float>(queue_, rng_buffer_);
+    return core::read_from_buffer<cl_float>(cc_, queue_, rng_buffer_);
 }
 
 }  // namespace raytracer
@@ -23,24 +23,19 @@ finder::finder(const core::compute_context& cc,
                float receiver_radius,
                float starting_energy)
         : cc_{cc}
-        , queue_{cc.context, cc.device}
+        , queue_{cc.context, cc.device, core::profiling_queue_properties()}
         , kernel_{program{cc}.get_kernel()}
         , receiver_{core::to_cl_float3{}(receiver)}
         , receiver_radius_{receiver_radius}
         , rays_{group_size}
-        , reflections_buffer_{cc.context,
-                              CL_MEM_READ_WRITE,
-                              sizeof(reflection) * group_size}
-        , stochastic_path_buffer_{cc.context,
-                                  CL_MEM_READ_WRITE,
+        , reflections_buffer_{cc, sizeof(reflection) * group_size}
+        , stochastic_path_buffer_{cc,
                                   sizeof(stochastic_path_info) * group_size}
-        , stochastic_output_buffer_{cc.context,
-                                    CL_MEM_READ_WRITE,
-                                    sizeof(impulse<core::simulation_bands>) *
-                                            group_size}
+        , stochastic_output_buffer_{
+                  cc,
+                  sizeof(impulse<core::simulation_bands>) * group_size}
         , specular_output_buffer_{
-                  cc.context,
-                  CL_MEM_READ_WRITE,
+                  cc,
                   sizeof(impulse<core::simulation_bands>) * group_size} {
     program{cc_}.get_init_stochastic_path_info_kernel()(
             cl::EnqueueArgs{queue_, cl::NDRange{rays_}},
@@ -49,6 +44,13 @@ finder::finder(const core::compute_context& cc,
             core::to_cl_float3{}(source));
 }
 
+finder::~finder() noexcept {
+    try {
+        queue_.finish();
+    } catch (...) {
+    }
+}
+
 }  // namespace stochastic
 }  // namespace raytracer
 }  // namespace wayverb
@@ -9,6 +9,9 @@
 
 #include <array>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 namespace wayverb {
 namespace raytracer {
@@ -30,11 +33,12 @@ double t0(double constant) {
 dirac_sequence generate_dirac_sequence(double speed_of_sound,
                                        double room_volume,
                                        double sample_rate,
-                                       double max_time) {
+                                       double max_time,
+                                       std::uint64_t seed) {
     const auto constant_mean_occurrence =
             constant_mean_event_occurrence(speed_of_sound, room_volume);
 
-    std::default_random_engine engine{std::random_device{}()};
+    std::mt19937_64 engine{seed};
 
     util::aligned::vector<float> ret(std::ceil(max_time * sample_rate), 0);
     for (auto t = t0(constant_mean_occurrence); t < max_time;
@@ -48,6 +52,76 @@ dirac_sequence generate_dirac_sequence(double speed_of_sound,
     return {ret, sample_rate};
 }
 
+namespace {
+
+class dirac_sequence_cache final {
+public:
+    std::shared_ptr<const dirac_sequence> get(double speed_of_sound,
+                                              double room_volume,
+                                              double sample_rate,
+                                              double max_time,
+                                              std::uint64_t seed) {
+        const auto key =
+                std::make_tuple(seed, speed_of_sound, room_volume, sample_rate);
+
+        std::lock_guard<std::mutex> lck{mutex_};
+        const auto it = entries_.find(key);
+        if (it != entries_.end() && max_time <= it->second.max_time) {
+            return it->second.sequence;
+        }
+
+        //  Generating under the lock means that concurrent capsules asking
+        //  for the same sequence wait for one generation rather than all
+        //  doing the same work.
+        if (it == entries_.end() && max_entries <= entries_.size()) {
+            entries_.clear();
+        }
+        auto sequence = std::make_shared<const dirac_sequence>(
+                generate_dirac_sequence(speed_of_sound,
+                                        room_volume,
+                                        sample_rate,
+                                        max_time,
+                                        seed));
+        entries_[key] = entry{max_time, sequence};
+        return sequence;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lck{mutex_};
+        entries_.clear();
+    }
+
+private:
+    static constexpr size_t max_entries = 16;
+
+    struct entry final {
+        double max_time;
+        std::shared_ptr<const dirac_sequence> sequence;
+    };
+
+    std::mutex mutex_;
+    std::map<std::tuple<std::uint64_t, double, double, double>, entry>
+            entries_;
+};
+
+dirac_sequence_cache& get_dirac_sequence_cache() {
+    static dirac_sequence_cache cache;
+    return cache;
+}
+
+}  // namespace
+
+std::shared_ptr<const dirac_sequence> get_dirac_sequence(double speed_of_sound,
+                                                         double room_volume,
+                                                         double sample_rate,
+                                                         double max_time,
+                                                         std::uint64_t seed) {
+    return get_dirac_sequence_cache().get(
+            speed_of_sound, room_volume, sample_rate, max_time, seed);
+}
+
+void clear_dirac_sequence_cache() { get_dirac_sequence_cache().clear(); }
+
 void sum_histograms(energy_histogram& a, const energy_histogram& b) {
     sum_vectors(a.histogram, b.histogram);
     a.sample_rate = b.sample_rate;
@@ -104,9 +178,11 @@ util::aligned::vector<core::bands_type> weight_sequence(
     return ret;
 }
 
-util::aligned::vector<float> postprocessing(const energy_histogram& histogram,
-                                            const dirac_sequence& sequence,
-                                            double acoustic_impedance) {
+namespace {
+
+auto bandwidth_weighted_sequence(const energy_histogram& histogram,
+                                 const dirac_sequence& sequence,
+                                 double acoustic_impedance) {
     //  Each diffuse rain band represents a fraction of the Nyquist bandwidth.
     //  Use the real filter bandwidths (Hz) to mirror Eq. 5.47.
     const auto params_hz = hrtf_data::hrtf_band_params_hz();
@@ -120,17 +196,39 @@ util::aligned::vector<float> postprocessing(const energy_histogram& histogram,
         sqrt_bandwidth_fractions[band] = std::sqrt(fraction);
     }
 
-    auto weighted = weight_sequence(histogram,
-                                    sequence,
-                                    acoustic_impedance,
-                                    sqrt_bandwidth_fractions);
-    return core::multiband_filter_and_mixdown(
-            begin(weighted),
-            end(weighted),
-            sequence.sample_rate,
-            [](auto it, auto index) {
-                return core::make_cl_type_iterator(std::move(it), index);
-            });
+    return weight_sequence(histogram,
+                           sequence,
+                           acoustic_impedance,
+                           sqrt_bandwidth_fractions);
+}
+
+struct cl_type_iterator_functor final {
+    template <typename It>
+    auto operator()(It it, size_t index) const {
+        return core::make_cl_type_iterator(std::move(it), index);
+    }
+};
+
+}  // namespace
+
+util::aligned::vector<float> postprocessing(const energy_histogram& histogram,
+                                            const dirac_sequence& sequence,
+                                            double acoustic_impedance,
+                                            util::thread_pool& pool) {
+    auto weighted = bandwidth_weighted_sequence(
+            histogram, sequence, acoustic_impedance);
+    return core::multiband_filter_and_mixdown(begin(weighted),
+                                              end(weighted),
+                                              sequence.sample_rate,
+                                              cl_type_iterator_functor{},
+                                              pool);
+}
+
+util::aligned::vector<float> postprocessing(const energy_histogram& histogram,
+                                            const dirac_sequence& sequence,
+                                            double acoustic_impedance) {
+    return postprocessing(
+            histogram, sequence, acoustic_impedance, util::serial_executor());
 }
 
 }  // namespace stochastic
@@ -1,4 +1,5 @@
 #include "raytracer/stochastic/finder.h"
+#include "raytracer/stochastic/postprocessing.h"
 
 #include "core/conversions.h"
 #include "core/geo/box.h"
@@ -194,3 +195,48 @@ TEST(stochastic, diffuse_rain_deterministic) {
                 << "band " << i << " mismatch";
     }
 }
+
+TEST(stochastic, dirac_sequence_seeded) {
+    const auto a = stochastic::generate_dirac_sequence(340, 100, 16000, 1, 1);
+    const auto b = stochastic::generate_dirac_sequence(340, 100, 16000, 1, 1);
+    const auto c = stochastic::generate_dirac_sequence(340, 100, 16000, 1, 2);
+
+    ASSERT_EQ(a.sequence.size(), b.sequence.size());
+    EXPECT_TRUE(std::equal(
+            begin(a.sequence), end(a.sequence), begin(b.sequence)));
+    EXPECT_FALSE(std::equal(
+            begin(a.sequence), end(a.sequence), begin(c.sequence)));
+
+    //  Generation must be prefix-stable for the cache to serve shorter
+    //  requests from longer sequences.
+    const auto longer =
+            stochastic::generate_dirac_sequence(340, 100, 16000, 2, 1);
+    ASSERT_LT(a.sequence.size(), longer.sequence.size());
+    EXPECT_TRUE(std::equal(
+            begin(a.sequence), end(a.sequence), begin(longer.sequence)));
+}
+
+TEST(stochastic, dirac_sequence_cache) {
+    stochastic::clear_dirac_sequence_cache();
+
+    const auto a = stochastic::get_dirac_sequence(340, 100, 16000, 1, 1);
+    const auto b = stochastic::get_dirac_sequence(340, 100, 16000, 1, 1);
+    EXPECT_EQ(a, b);
+
+    //  Shorter requests reuse the cached sequence.
+    EXPECT_EQ(a, stochastic::get_dirac_sequence(340, 100, 16000, 0.5, 1));
+
+    //  Any other key component yields a different sequence.
+    EXPECT_NE(a, stochastic::get_dirac_sequence(340, 100, 16000, 1, 2));
+    EXPECT_NE(a, stochastic::get_dirac_sequence(343, 100, 16000, 1, 1));
+    EXPECT_NE(a, stochastic::get_dirac_sequence(340, 200, 16000, 1, 1));
+    EXPECT_NE(a, stochastic::get_dirac_sequence(340, 100, 44100, 1, 1));
+
+    //  Longer requests regenerate, extending the original.
+    const auto longer = stochastic::get_dirac_sequence(340, 100, 16000, 2, 1);
+    EXPECT_NE(a, longer);
+    EXPECT_TRUE(std::equal(begin(a->sequence),
+                           end(a->sequence),
+                           begin(longer->sequence)));
+    EXPECT_EQ(longer, stochastic::get_dirac_sequence(340, 100, 16000, 1, 1));
+}
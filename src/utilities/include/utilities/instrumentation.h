@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace util {
+namespace instrumentation {
+
+/// Lightweight timing of the main stages of a render.
+///
+/// Recording is off unless WAYVERB_PROFILE names a file, or set_enabled is
+/// called. While off, timers cost a single relaxed atomic load. While on,
+/// spans and counters are kept in memory; when WAYVERB_PROFILE is set they
+/// are written there as Chrome trace-event JSON (open in chrome://tracing or
+/// Perfetto) at exit, and a summary table is printed to stderr.
+
+using clock = std::chrono::steady_clock;
+
+namespace detail {
+extern std::atomic_bool enabled;
+}  // namespace detail
+
+inline bool enabled() {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+void set_enabled(bool enabled);
+
+/// Records a completed span.
+/// Spans from host threads go on the calling thread's track. Spans measured
+/// elsewhere, like device commands, name their own `track`.
+void record_span(const std::string& name,
+                 clock::time_point begin,
+                 clock::time_point end,
+                 const char* track = nullptr);
+
+/// Records the value of a counter at this moment.
+void record_counter(const std::string& name, double value);
+
+/// Records a span covering its own lifetime.
+/// `name` must outlive the timer; string literals are the usual choice.
+class scoped_timer final {
+public:
+    explicit scoped_timer(const char* name)
+            : name_{enabled() ? name : nullptr}
+            , begin_{name_ ? clock::now() : clock::time_point{}} {}
+
+    scoped_timer(const scoped_timer&) = delete;
+    scoped_timer& operator=(const scoped_timer&) = delete;
+    scoped_timer(scoped_timer&&) noexcept = delete;
+    scoped_timer& operator=(scoped_timer&&) noexcept = delete;
+
+    ~scoped_timer() noexcept;
+
+private:
+    const char* name_;
+    clock::time_point begin_;
+};
+
+/// Records one span per `batch` calls to tick, for loops whose iterations
+/// are too short and too many to time one by one.
+class batch_timer final {
+public:
+    batch_timer(const char* name, size_t batch)
+            : name_{enabled() ? name : nullptr}
+            , batch_{batch ? batch : 1}
+            , begin_{name_ ? clock::now() : clock::time_point{}} {}
+
+    batch_timer(const batch_timer&) = delete;
+    batch_timer& operator=(const batch_timer&) = delete;
+    batch_timer(batch_timer&&) noexcept = delete;
+    batch_timer& operator=(batch_timer&&) noexcept = delete;
+
+    /// Records any partial batch.
+    ~batch_timer() noexcept;
+
+    void tick() {
+        if (name_ && ++ticks_ == batch_) {
+            flush();
+        }
+    }
+
+private:
+    void flush();
+
+    const char* name_;
+    size_t batch_;
+    size_t ticks_{0};
+    clock::time_point begin_;
+};
+
+//  results  ///////////////////////////////////////////////////////////////////
+
+struct summary_row final {
+    std::string name;
+    size_t count{};
+    double total_ms{};
+    double mean_ms{};
+    double min_ms{};
+    double median_ms{};
+    double p95_ms{};
+    double max_ms{};
+};
+
+/// Span durations grouped by name, slowest total first.
+std::vector<summary_row> summarise();
+
+void write_summary(std::ostream& os);
+void write_chrome_trace(std::ostream& os);
+
+/// Discards everything recorded so far.
+void clear();
+
+}  // namespace instrumentation
+}  // namespace util
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+/// A fixed-size pool of worker threads with a single shared task queue.
+/// Tasks may submit further tasks to the same pool. To avoid deadlocking a
+/// bounded pool, callers should wait on results using `get` rather than
+/// calling `future::get` directly: `get` runs queued tasks on the calling
+/// thread until the awaited result is ready.
+class thread_pool final {
+public:
+    /// A worker count of zero means 'use default_concurrency()'.
+    explicit thread_pool(size_t workers = 0);
+
+    struct serial_t final {};
+    static constexpr serial_t serial{};
+
+    /// A pool with no workers, which runs each task inline as it is
+    /// submitted.
+    explicit thread_pool(serial_t);
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool(thread_pool&&) noexcept = delete;
+
+    thread_pool& operator=(const thread_pool&) = delete;
+    thread_pool& operator=(thread_pool&&) noexcept = delete;
+
+    /// Finishes any queued tasks, then joins all workers.
+    ~thread_pool() noexcept;
+
+    size_t size() const;
+
+    template <typename Func>
+    auto submit(Func&& func) {
+        using result_type = std::invoke_result_t<std::decay_t<Func>>;
+        auto task = std::make_shared<std::packaged_task<result_type()>>(
+                std::forward<Func>(func));
+        auto ret = task->get_future();
+        push([task] { (*task)(); });
+        return ret;
+    }
+
+    /// Waits for a result, helping with queued work in the meantime.
+    template <typename T>
+    T get(std::future<T>& future) {
+        wait(future);
+        return future.get();
+    }
+
+    template <typename T>
+    void wait(const std::future<T>& future) {
+        while (future.wait_for(std::chrono::seconds{0}) !=
+               std::future_status::ready) {
+            if (!run_pending_task()) {
+                future.wait_for(std::chrono::milliseconds{1});
+            }
+        }
+    }
+
+    /// The number of hardware threads, or 1 if it can't be determined.
+    static size_t default_concurrency();
+
+private:
+    void push(std::function<void()> task);
+
+    /// Runs one queued task on the calling thread.
+    /// Returns false if there was nothing to run.
+    bool run_pending_task();
+
+    void worker_loop();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_{false};
+    std::vector<std::thread> workers_;
+};
+
+/// A shared pool with no workers. Passing it to a pool-aware function runs
+/// that function sequentially on the calling thread.
+thread_pool& serial_executor();
+
+/// Calls `func(i)` for each `i` in [0, count) on the pool, and collects the
+/// results in index order, so the output does not depend on scheduling.
+/// All tasks are finished before any exception is rethrown, so `func` may
+/// safely capture locals by reference.
+template <typename Func>
+auto parallel_map(thread_pool& pool, size_t count, const Func& func) {
+    using result_type = std::invoke_result_t<const Func&, size_t>;
+    std::vector<std::future<result_type>> futures;
+    futures.reserve(count);
+    for (size_t i = 0; i != count; ++i) {
+        futures.emplace_back(pool.submit([&func, i] { return func(i); }));
+    }
+    for (const auto& i : futures) {
+        pool.wait(i);
+    }
+
+    std::vector<result_type> ret;
+    ret.reserve(count);
+    for (auto& i : futures) {
+        ret.emplace_back(pool.get(i));
+    }
+    return ret;
+}
+
+/// Like parallel_map, for functions with no result.
+template <typename Func>
+void parallel_for(thread_pool& pool, size_t count, const Func& func) {
+    std::vector<std::future<void>> futures;
+    futures.reserve(count);
+    for (size_t i = 0; i != count; ++i) {
+        futures.emplace_back(pool.submit([&func, i] { func(i); }));
+    }
+    for (const auto& i : futures) {
+        pool.wait(i);
+    }
+    for (auto& i : futures) {
+        i.get();
+    }
+}
+
+/// Runs `a` on the pool and `b` on the calling thread, returning both
+/// results as a pair. Both calls finish before any exception propagates.
+template <typename A, typename B>
+auto parallel_invoke(thread_pool& pool, const A& a, const B& b) {
+    auto future = pool.submit([&a] { return a(); });
+    try {
+        auto second = b();
+        return std::make_pair(pool.get(future), std::move(second));
+    } catch (...) {
+        pool.wait(future);
+        throw;
+    }
+}
+
+}  // namespace util
@@ -0,0 +1,302 @@
+#include "utilities/instrumentation.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace util {
+namespace instrumentation {
+
+namespace {
+
+const char* profile_path() {
+    const char* env = std::getenv("WAYVERB_PROFILE");
+    return env && *env ? env : nullptr;
+}
+
+struct event final {
+    std::string name;
+    /// Empty for host threads.
+    std::string track;
+    std::thread::id thread;
+    std::chrono::nanoseconds begin;
+    std::chrono::nanoseconds duration;
+    /// Set for counters, which have no duration.
+    bool is_counter;
+    double value;
+};
+
+void write_escaped(std::ostream& os, const std::string& s) {
+    os << '"';
+    for (const auto c : s) {
+        switch (c) {
+            case '"': os << "\\\""; break;
+            case '\\': os << "\\\\"; break;
+            case '\n': os << "\\n"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    os << ' ';
+                } else {
+                    os << c;
+                }
+        }
+    }
+    os << '"';
+}
+
+double to_us(std::chrono::nanoseconds t) { return t.count() / 1000.0; }
+double to_ms(std::chrono::nanoseconds t) { return t.count() / 1.0e6; }
+
+std::vector<summary_row> summarise(const std::vector<event>& events) {
+    std::map<std::string, std::vector<double>> durations;
+    for (const auto& e : events) {
+        if (!e.is_counter) {
+            durations[e.name].push_back(to_ms(e.duration));
+        }
+    }
+
+    std::vector<summary_row> ret;
+    for (auto& i : durations) {
+        auto& times = i.second;
+        std::sort(times.begin(), times.end());
+        summary_row row;
+        row.name = i.first;
+        row.count = times.size();
+        for (const auto t : times) {
+            row.total_ms += t;
+        }
+        row.mean_ms = row.total_ms / row.count;
+        row.min_ms = times.front();
+        row.median_ms = times[times.size() / 2];
+        row.p95_ms = times[std::min(times.size() - 1, times.size() * 95 / 100)];
+        row.max_ms = times.back();
+        ret.push_back(std::move(row));
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const auto& a, const auto& b) {
+        return a.total_ms > b.total_ms;
+    });
+    return ret;
+}
+
+/// Holds everything recorded, and writes it out at exit if asked to.
+class recorder final {
+public:
+    ~recorder() noexcept {
+        const auto path = profile_path();
+        if (!path) {
+            return;
+        }
+        try {
+            std::ofstream file{path};
+            write_chrome_trace(file);
+            std::cerr << "[profile] trace written to " << path << '\n';
+            write_summary(std::cerr);
+        } catch (const std::exception& e) {
+            std::cerr << "[profile] can't write " << path << ": " << e.what()
+                      << '\n';
+        }
+    }
+
+    void add(event e) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        events_.emplace_back(std::move(e));
+    }
+
+    std::chrono::nanoseconds since_epoch(clock::time_point t) const {
+        return t - epoch_;
+    }
+
+    std::vector<event> get_events() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return events_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        events_.clear();
+    }
+
+    void write_summary(std::ostream& os) const;
+    void write_chrome_trace(std::ostream& os) const;
+
+private:
+    const clock::time_point epoch_ = clock::now();
+    mutable std::mutex mutex_;
+    std::vector<event> events_;
+};
+
+recorder& get_recorder() {
+    static recorder r;
+    return r;
+}
+
+/// The recorder is created up front when recording is on, so that its epoch
+/// precedes every span.
+bool initialise() {
+    if (profile_path()) {
+        get_recorder();
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+namespace detail {
+std::atomic_bool enabled{initialise()};
+}  // namespace detail
+
+void set_enabled(bool enabled) {
+    if (enabled) {
+        get_recorder();
+    }
+    detail::enabled = enabled;
+}
+
+void record_span(const std::string& name,
+                 clock::time_point begin,
+                 clock::time_point end,
+                 const char* track) {
+    auto& r = get_recorder();
+    r.add(event{name,
+                track ? track : "",
+                std::this_thread::get_id(),
+                r.since_epoch(begin),
+                end - begin,
+                false,
+                0});
+}
+
+void record_counter(const std::string& name, double value) {
+    if (!enabled()) {
+        return;
+    }
+    auto& r = get_recorder();
+    r.add(event{name,
+                "",
+                std::this_thread::get_id(),
+                r.since_epoch(clock::now()),
+                std::chrono::nanoseconds{0},
+                true,
+                value});
+}
+
+scoped_timer::~scoped_timer() noexcept {
+    if (name_) {
+        try {
+            record_span(name_, begin_, clock::now());
+        } catch (...) {
+            //  Losing a span is better than losing the render.
+        }
+    }
+}
+
+batch_timer::~batch_timer() noexcept {
+    if (name_ && ticks_) {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+}
+
+void batch_timer::flush() {
+    const auto now = clock::now();
+    record_span(name_, begin_, now);
+    ticks_ = 0;
+    begin_ = now;
+}
+
+//  results  ///////////////////////////////////////////////////////////////////
+
+std::vector<summary_row> summarise() {
+    return summarise(get_recorder().get_events());
+}
+
+void write_summary(std::ostream& os) { get_recorder().write_summary(os); }
+
+void write_chrome_trace(std::ostream& os) {
+    get_recorder().write_chrome_trace(os);
+}
+
+void clear() { get_recorder().clear(); }
+
+void recorder::write_summary(std::ostream& os) const {
+    const auto rows = summarise(get_events());
+    os << std::left << std::setw(36) << "stage" << std::right << std::setw(8)
+       << "count" << std::setw(12) << "total ms" << std::setw(10) << "mean"
+       << std::setw(10) << "min" << std::setw(10) << "median" << std::setw(10)
+       << "p95" << std::setw(10) << "max" << '\n';
+    for (const auto& row : rows) {
+        os << std::left << std::setw(36) << row.name << std::right
+           << std::setw(8) << row.count << std::fixed << std::setprecision(3)
+           << std::setw(12) << row.total_ms << std::setw(10) << row.mean_ms
+           << std::setw(10) << row.min_ms << std::setw(10) << row.median_ms
+           << std::setw(10) << row.p95_ms << std::setw(10) << row.max_ms
+           << '\n';
+    }
+}
+
+void recorder::write_chrome_trace(std::ostream& os) const {
+    const auto events = get_events();
+
+    //  Chrome wants small integer thread ids. Host threads are numbered in
+    //  order of appearance, then other tracks follow.
+    std::map<std::thread::id, size_t> threads;
+    std::map<std::string, size_t> tracks;
+    for (const auto& e : events) {
+        if (e.track.empty()) {
+            threads.emplace(e.thread, threads.size() + 1);
+        }
+    }
+    for (const auto& e : events) {
+        if (!e.track.empty()) {
+            tracks.emplace(e.track, threads.size() + tracks.size() + 1);
+        }
+    }
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    auto first = true;
+    const auto separator = [&] {
+        if (!first) {
+            os << ",\n";
+        }
+        first = false;
+    };
+
+    for (const auto& track : tracks) {
+        separator();
+        os << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+           << track.second << ",\"args\":{\"name\":";
+        write_escaped(os, track.first);
+        os << "}}";
+    }
+
+    os << std::fixed << std::setprecision(3);
+    for (const auto& e : events) {
+        separator();
+        const auto tid = e.track.empty() ? threads.at(e.thread)
+                                         : tracks.at(e.track);
+        os << "{\"name\":";
+        write_escaped(os, e.name);
+        if (e.is_counter) {
+            os << ",\"ph\":\"C\",\"ts\":" << to_us(e.begin)
+               << ",\"pid\":1,\"tid\":" << tid
+               << ",\"args\":{\"value\":" << e.value << "}}";
+        } else {
+            os << ",\"ph\":\"X\",\"ts\":" << to_us(e.begin)
+               << ",\"dur\":" << to_us(e.duration) << ",\"pid\":1,\"tid\":"
+               << tid << '}';
+        }
+    }
+    os << "]}\n";
+}
+
+}  // namespace instrumentation
+}  // namespace util
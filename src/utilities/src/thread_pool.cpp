@@ -0,0 +1,82 @@
+#include "utilities/thread_pool.h"
+
+#include <algorithm>
+
+namespace util {
+
+thread_pool::thread_pool(size_t workers) {
+    const auto count = workers ? workers : default_concurrency();
+    workers_.reserve(count);
+    for (size_t i = 0; i != count; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+thread_pool::thread_pool(serial_t) {}
+
+thread_pool::~thread_pool() noexcept {
+    {
+        const std::lock_guard<std::mutex> lck{mutex_};
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& i : workers_) {
+        i.join();
+    }
+}
+
+size_t thread_pool::size() const { return workers_.size(); }
+
+size_t thread_pool::default_concurrency() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void thread_pool::push(std::function<void()> task) {
+    if (workers_.empty()) {
+        task();
+        return;
+    }
+    {
+        const std::lock_guard<std::mutex> lck{mutex_};
+        queue_.emplace_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+bool thread_pool::run_pending_task() {
+    std::function<void()> task;
+    {
+        const std::lock_guard<std::mutex> lck{mutex_};
+        if (queue_.empty()) {
+            return false;
+        }
+        task = std::move(queue_.front());
+        queue_.pop_front();
+    }
+    task();
+    return true;
+}
+
+void thread_pool::worker_loop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lck{mutex_};
+            cv_.wait(lck, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                //  Only reachable when stopping.
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+thread_pool& serial_executor() {
+    static thread_pool pool{thread_pool::serial};
+    return pool;
+}
+
+}  // namespace util
@@ -0,0 +1,77 @@
+#include "utilities/instrumentation.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+const util::instrumentation::summary_row* find_row(
+        const std::vector<util::instrumentation::summary_row>& rows,
+        const std::string& name) {
+    const auto it = std::find_if(begin(rows), end(rows), [&](const auto& row) {
+        return row.name == name;
+    });
+    return it == end(rows) ? nullptr : &*it;
+}
+
+}  // namespace
+
+TEST(instrumentation, disabled_timers_record_nothing) {
+    util::instrumentation::set_enabled(false);
+    util::instrumentation::clear();
+    { const util::instrumentation::scoped_timer timer{"disabled"}; }
+    util::instrumentation::record_counter("disabled", 1);
+    ASSERT_TRUE(util::instrumentation::summarise().empty());
+}
+
+TEST(instrumentation, scoped_and_batch_timers) {
+    util::instrumentation::set_enabled(true);
+    util::instrumentation::clear();
+
+    for (auto i = 0; i != 3; ++i) {
+        const util::instrumentation::scoped_timer timer{"scoped"};
+    }
+
+    {
+        util::instrumentation::batch_timer timer{"batch", 4};
+        for (auto i = 0; i != 10; ++i) {
+            timer.tick();
+        }
+        //  Two full batches, then a partial one when the timer goes.
+    }
+
+    const auto rows = util::instrumentation::summarise();
+    const auto scoped = find_row(rows, "scoped");
+    const auto batch = find_row(rows, "batch");
+    ASSERT_NE(scoped, nullptr);
+    ASSERT_NE(batch, nullptr);
+    ASSERT_EQ(scoped->count, 3);
+    ASSERT_EQ(batch->count, 3);
+    ASSERT_LE(scoped->min_ms, scoped->median_ms);
+    ASSERT_LE(scoped->median_ms, scoped->max_ms);
+
+    util::instrumentation::set_enabled(false);
+}
+
+TEST(instrumentation, chrome_trace) {
+    util::instrumentation::set_enabled(true);
+    util::instrumentation::clear();
+
+    const auto now = util::instrumentation::clock::now();
+    util::instrumentation::record_span("host \"span\"", now, now);
+    util::instrumentation::record_span("kernel", now, now, "device");
+    util::instrumentation::record_counter("queued", 2);
+
+    std::stringstream ss;
+    util::instrumentation::write_chrome_trace(ss);
+    const auto trace = ss.str();
+    ASSERT_NE(trace.find("\"traceEvents\""), std::string::npos);
+    ASSERT_NE(trace.find("\"host \\\"span\\\"\""), std::string::npos);
+    ASSERT_NE(trace.find("\"thread_name\""), std::string::npos);
+    ASSERT_NE(trace.find("\"ph\":\"C\""), std::string::npos);
+
+    util::instrumentation::set_enabled(false);
+    util::instrumentation::clear();
+}
@@ -0,0 +1,64 @@
+#include "utilities/thread_pool.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <numeric>
+
+TEST(thread_pool, ordered_results) {
+    util::thread_pool pool{4};
+    const auto results =
+            util::parallel_map(pool, 1000, [](auto i) { return i * i; });
+    ASSERT_EQ(results.size(), 1000);
+    for (size_t i = 0; i != results.size(); ++i) {
+        ASSERT_EQ(results[i], i * i);
+    }
+}
+
+TEST(thread_pool, nested_submission_does_not_deadlock) {
+    //  A single worker must still make progress when tasks wait on subtasks.
+    util::thread_pool pool{1};
+    const auto outer = util::parallel_map(pool, 8, [&](auto i) {
+        const auto inner =
+                util::parallel_map(pool, 8, [&](auto j) { return i + j; });
+        return std::accumulate(begin(inner), end(inner), size_t{0});
+    });
+    for (size_t i = 0; i != outer.size(); ++i) {
+        ASSERT_EQ(outer[i], 8 * i + 28);
+    }
+}
+
+TEST(thread_pool, exceptions_propagate) {
+    util::thread_pool pool{2};
+    auto future = pool.submit([]() -> int { throw std::runtime_error{"oops"}; });
+    ASSERT_THROW(pool.get(future), std::runtime_error);
+}
+
+TEST(thread_pool, parallel_for) {
+    util::thread_pool pool{3};
+    std::atomic<size_t> total{0};
+    util::parallel_for(pool, 100, [&](auto i) { total += i; });
+    ASSERT_EQ(total, 4950);
+}
+
+TEST(thread_pool, parallel_invoke) {
+    util::thread_pool pool{2};
+    const auto results = util::parallel_invoke(
+            pool, [] { return 1; }, [] { return std::string{"two"}; });
+    ASSERT_EQ(results.first, 1);
+    ASSERT_EQ(results.second, "two");
+}
+
+TEST(thread_pool, serial_runs_inline) {
+    auto& pool = util::serial_executor();
+    ASSERT_EQ(pool.size(), 0u);
+
+    const auto caller = std::this_thread::get_id();
+    const auto results = util::parallel_map(pool, 16, [&](auto i) {
+        EXPECT_EQ(std::this_thread::get_id(), caller);
+        return i;
+    });
+    for (size_t i = 0; i != results.size(); ++i) {
+        ASSERT_EQ(results[i], i);
+    }
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "waveguide/pressure_storage.h"
+#include "waveguide/program.h"
+#include "waveguide/sparse_layout.h"
+
+#include <optional>
 #include <string>
 
 namespace wayverb {
@@ -7,16 +12,47 @@ namespace waveguide {
 
 enum class waveguide_backend {
     opencl,
-    bempp_cpu
+    bempp_cpu,
+    /// Single-band runs update the mesh on the host (see cpu_waveguide.h).
+    cpu
 };
 
 /// Inspect environment/configuration and return the backend to use.
+/// WAYVERB_WG_BACKEND=cpu selects the host backend.
 waveguide_backend select_backend();
 
+/// Inspect environment/configuration and return how the OpenCL backend
+/// should store mesh nodes. Sparse storage is chosen with
+/// WAYVERB_WG_SPARSE=1 (or =morton) and only affects single-band runs.
+node_storage select_node_storage();
+
+/// How dense single-band runs store pressure: half precision with
+/// WAYVERB_WG_HALF=1, otherwise single. Sparse storage only supports single
+/// precision, so it takes priority if both are selected.
+pressure_storage select_pressure_storage();
+
+/// The order of sparsely stored nodes. WAYVERB_WG_SPARSE=morton selects
+/// Morton order.
+node_ordering select_node_ordering();
+
+/// How many slabs sparse single-band runs are split into (see
+/// domain_decomposition.h), from WAYVERB_WG_SLABS (default 1, not split).
+/// The slabs are dealt out over the devices WAYVERB_DEVICES selects.
+size_t select_subdomains();
+
+/// The directory where dense single-band runs save checkpoints, from
+/// WAYVERB_CHECKPOINT. Empty if checkpointing is disabled.
+std::optional<std::string> select_checkpoint_directory();
+
+/// Steps between checkpoints, from WAYVERB_CHECKPOINT_INTERVAL (default
+/// 10000).
+size_t select_checkpoint_interval();
+
 inline const char* backend_name(waveguide_backend backend) {
     switch (backend) {
         case waveguide_backend::opencl: return "opencl";
         case waveguide_backend::bempp_cpu: return "bempp_cpu";
+        case waveguide_backend::cpu: return "cpu";
         default: return "unknown";
     }
 }
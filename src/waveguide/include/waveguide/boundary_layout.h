@@ -28,6 +28,9 @@ struct boundary_layout final {
     util::aligned::vector<glm::vec3> sdf_normal;
     util::aligned::vector<uint32_t> coeff_block_offsets;
     util::aligned::vector<coefficients_canonical> coeff_blocks;
+    /// The surface each coefficient block was taken from, or ~0 for faces
+    /// without a surface (which use identity coefficients).
+    util::aligned::vector<uint32_t> coeff_block_surfaces;
     util::aligned::vector<memory_canonical> filter_memories;
     util::aligned::vector<uint32_t> node_indices;
     util::aligned::vector<uint32_t> node_lookup;
@@ -42,5 +45,11 @@ boundary_layout build_boundary_layout(
                                          core::surface<core::simulation_bands>>&
                 voxelised);
 
+/// Rebuilds the per-face coefficient blocks of `layout` from a new set of
+/// per-surface coefficients, without touching the geometry.
+util::aligned::vector<coefficients_canonical> make_coeff_blocks(
+        const boundary_layout& layout,
+        const util::aligned::vector<coefficients_canonical>& surface_coeffs);
+
 }  // namespace waveguide
 }  // namespace wayverb
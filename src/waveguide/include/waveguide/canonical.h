@@ -2,6 +2,8 @@
 
 #include "waveguide/bandpass_band.h"
 #include "waveguide/calibration.h"
+#include "waveguide/cpu_waveguide.h"
+#include "waveguide/domain_decomposition.h"
 #include "waveguide/fitted_boundary.h"
 #include "waveguide/make_transparent.h"
 #include "waveguide/pcs.h"
@@ -14,14 +16,20 @@
 #include "utilities/aligned/vector.h"
 
 #include "core/callback_accumulator.h"
+#include "core/cl/device_set.h"
 #include "core/environment.h"
 #include "core/reverb_time.h"
 
 #include "hrtf/multiband.h"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
+#include <vector>
 
 /// \file canonical.h
 /// The waveguide algorithm in waveguide.h is modular, in that
@@ -91,6 +99,183 @@ inline util::aligned::vector<float> make_pcs_transparent_signal(
     return signal;
 }
 
+/// Identifies a run for checkpointing, by FNV-1a over everything its saved
+/// state depends on.
+class run_key_builder final {
+public:
+    template <typename T>
+    run_key_builder& add(const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable<T>{}, "T must be plain data");
+        const auto bytes = reinterpret_cast<const std::uint8_t*>(data);
+        for (size_t i = 0; i != sizeof(T) * count; ++i) {
+            key_ = (key_ ^ bytes[i]) * 0x100000001b3;
+        }
+        return *this;
+    }
+
+    template <typename T>
+    run_key_builder& add(const util::aligned::vector<T>& values) {
+        add(values.size());
+        return add(values.data(), values.size());
+    }
+
+    run_key_builder& add(std::uint64_t value) { return add(&value, 1); }
+
+    std::uint64_t get() const { return key_; }
+
+private:
+    std::uint64_t key_ = 0xcbf29ce484222325;
+};
+
+inline std::uint64_t to_bits(double value) {
+    std::uint64_t ret;
+    std::memcpy(&ret, &value, sizeof(ret));
+    return ret;
+}
+
+/// Runs a sparse single-band simulation split into `slabs` slabs, dealt out
+/// over the devices WAYVERB_DEVICES selects (or just `cc`), so that a mesh
+/// too large for one device can still be rendered. The receiver's
+/// neighbours are read back every step and its output computed on the host.
+/// The callback sees the first slab's queue and buffer, which hold only that
+/// slab's nodes.
+template <typename Callback>
+std::optional<band> decomposed_canonical_impl(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        size_t slabs,
+        const util::aligned::vector<float>& input,
+        size_t source_index,
+        size_t receiver_index,
+        double sample_rate,
+        const core::environment& environment,
+        const std::atomic_bool& keep_going,
+        Callback&& callback,
+        double ideal_steps) {
+    const auto contexts = core::select_compute_contexts(cc);
+    const auto decomposition = decompose(mesh, slabs);
+    std::cerr << "[waveguide] split into " << slabs << " slabs over "
+              << contexts.size() << " device(s)\n";
+
+    const auto neighbors =
+            compute_neighbors(mesh.get_descriptor(), receiver_index);
+    postprocessor::directional_receiver receiver{
+            mesh.get_descriptor().spacing,
+            sample_rate,
+            get_ambient_density(environment),
+            receiver_index,
+            neighbors};
+
+    util::aligned::vector<size_t> receivers{receiver_index};
+    receivers.insert(end(receivers), begin(neighbors), end(neighbors));
+
+    const auto pressures = run_decomposed(
+            contexts,
+            decomposition,
+            coefficient_overlay{mesh},
+            source_index,
+            input,
+            receivers,
+            keep_going,
+            [&](auto& queue, const auto& buffer, auto step) {
+                callback(queue, buffer, step, ideal_steps);
+            });
+
+    const auto steps = pressures.front().size();
+    if (steps != input.size()) {
+        return std::nullopt;
+    }
+
+    util::aligned::vector<postprocessor::directional_receiver::output> output;
+    output.reserve(steps);
+    for (size_t step = 0; step != steps; ++step) {
+        std::array<float, 7> surrounding;
+        for (size_t i = 0; i != surrounding.size(); ++i) {
+            surrounding[i] = pressures[i][step];
+        }
+        output.emplace_back(receiver(surrounding));
+    }
+    return band{std::move(output), sample_rate};
+}
+
+/// Runs a single-band simulation on the host with cpu_waveguide, over the
+/// nodes inside the room. The receiver's neighbours are recorded every step
+/// and its output computed afterwards. There is no device pressure buffer,
+/// so the callback is handed an empty one, and is called for each step once
+/// the block holding it has finished.
+template <typename Callback>
+std::optional<band> cpu_canonical_impl(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        const util::aligned::vector<float>& input,
+        size_t source_index,
+        size_t receiver_index,
+        double sample_rate,
+        const core::environment& environment,
+        const std::atomic_bool& keep_going,
+        Callback&& callback,
+        double ideal_steps) {
+    //  A few steps per block on tiles a few tens of nodes across keeps the
+    //  halo overhead low (see cpu_waveguide.h).
+    constexpr size_t block_steps = 4;
+    constexpr size_t tile_size = 32;
+
+    const auto layout = make_sparse_layout(mesh, select_node_ordering());
+    std::cerr << "[waveguide] running on the host: "
+              << layout.dense_indices.size() << " of "
+              << mesh.get_structure().get_condensed_nodes().size()
+              << " nodes stored\n";
+
+    //  Both nodes are inside, so they are always stored.
+    const auto source_compact = compute_compact_index(layout, source_index);
+    const auto receiver_compact = compute_compact_index(layout, receiver_index);
+
+    const auto neighbors = compute_neighbors(layout, receiver_compact);
+    postprocessor::directional_receiver receiver{
+            mesh.get_descriptor().spacing,
+            sample_rate,
+            get_ambient_density(environment),
+            receiver_compact,
+            neighbors};
+
+    util::aligned::vector<size_t> receivers{receiver_compact};
+    receivers.insert(end(receivers), begin(neighbors), end(neighbors));
+
+    cl::CommandQueue queue{cc.context, cc.device};
+    const cl::Buffer no_buffer;
+    auto reported = size_t{0};
+
+    cpu_waveguide waveguide{
+            layout, coefficient_overlay{mesh}, block_steps, tile_size};
+    const auto pressures = waveguide.run(
+            source_compact, input, receivers, keep_going, [&](auto steps) {
+                for (; reported != steps; ++reported) {
+                    callback(queue, no_buffer, reported, ideal_steps);
+                }
+            });
+
+    const auto steps = pressures.front().size();
+    if (steps != input.size()) {
+        return std::nullopt;
+    }
+
+    util::aligned::vector<postprocessor::directional_receiver::output> output;
+    output.reserve(steps);
+    for (size_t step = 0; step != steps; ++step) {
+        std::array<float, 7> surrounding;
+        for (size_t i = 0; i != surrounding.size(); ++i) {
+            surrounding[i] = pressures[i][step];
+        }
+        output.emplace_back(receiver(surrounding));
+    }
+    return band{std::move(output), sample_rate};
+}
+
+/// If `pressures_wanted` is false the callback promises not to read the
+/// pressure buffer, so sparse runs hand it their compact buffer instead of
+/// building a dense copy every step.
+/// Dense runs store pressure as select_pressure_storage() says, and the
+/// callback's buffer is in that format (see canonical_pressure_storage).
 template <typename Callback>
 std::optional<band> canonical_impl(
         const core::compute_context& cc,
@@ -100,7 +285,8 @@ std::optional<band> canonical_impl(
         const glm::vec3& receiver,
         const core::environment& environment,
         const std::atomic_bool& keep_going,
-        Callback&& callback) {
+        Callback&& callback,
+        bool pressures_wanted = true) {
     const auto sample_rate = compute_sample_rate(mesh.get_descriptor(),
                                                 environment.speed_of_sound);
 
@@ -124,15 +310,184 @@ std::optional<band> canonical_impl(
                                              sample_rate,
                                              mesh.get_descriptor().spacing);
 
-    auto prep = preprocessor::make_soft_source(
-            compute_mesh_index(source), begin(input), end(input));
+    const auto source_index = compute_mesh_index(source);
+    const auto receiver_index = compute_mesh_index(receiver);
+
+    if (select_backend() == waveguide_backend::cpu) {
+        if (!pressures_wanted) {
+            return cpu_canonical_impl(cc,
+                                      mesh,
+                                      input,
+                                      source_index,
+                                      receiver_index,
+                                      sample_rate,
+                                      environment,
+                                      keep_going,
+                                      callback,
+                                      ideal_steps);
+        }
+        std::cerr << "[waveguide] running on OpenCL, as visualisation reads "
+                     "the pressure field from a device "
+                     "(set WAYVERB_DISABLE_VIZ=1)\n";
+    }
+
+    if (select_node_storage() == node_storage::sparse) {
+        if (const auto slabs = select_subdomains(); slabs != 1) {
+            if (!pressures_wanted) {
+                return decomposed_canonical_impl(cc,
+                                                 mesh,
+                                                 slabs,
+                                                 input,
+                                                 source_index,
+                                                 receiver_index,
+                                                 sample_rate,
+                                                 environment,
+                                                 keep_going,
+                                                 callback,
+                                                 ideal_steps);
+            }
+            std::cerr << "[waveguide] not splitting the mesh, as "
+                         "visualisation needs the whole field on one device "
+                         "(set WAYVERB_DISABLE_VIZ=1)\n";
+        }
+
+        const auto layout = make_sparse_layout(mesh, select_node_ordering());
+        std::cerr << "[waveguide] sparse node storage: "
+                  << layout.dense_indices.size() << " of "
+                  << mesh.get_structure().get_condensed_nodes().size()
+                  << " nodes stored\n";
+
+        //  Both nodes are inside, so they are always stored.
+        const auto source_compact =
+                compute_compact_index(layout, source_index);
+        const auto receiver_compact =
+                compute_compact_index(layout, receiver_index);
+
+        auto prep = preprocessor::make_soft_source(
+                source_compact, begin(input), end(input));
+
+        auto output_accumulator =
+                core::callback_accumulator<postprocessor::directional_receiver>{
+                        mesh.get_descriptor().spacing,
+                        sample_rate,
+                        get_ambient_density(environment),
+                        receiver_compact,
+                        compute_neighbors(layout, receiver_compact)};
+
+        //  A callback which reads pressure indexes it by dense node, so it is
+        //  given a dense copy. Cells which aren't stored stay at zero.
+        const program program{cc};
+        auto zero_buffer = program.get_zero_buffer_kernel();
+        auto scatter = program.get_scatter_sparse_kernel();
+        const auto dense_nodes =
+                mesh.get_structure().get_condensed_nodes().size();
+        cl::Buffer dense_indices;
+        cl::Buffer dense_view;
+        if (pressures_wanted) {
+            dense_indices = core::load_to_buffer(
+                    cc.context, layout.dense_indices, true);
+            dense_view = cl::Buffer{cc.context,
+                                    CL_MEM_READ_WRITE,
+                                    sizeof(cl_float) * dense_nodes};
+        }
+
+        const auto steps = run_sparse(
+                cc,
+                mesh,
+                layout,
+                coefficient_overlay{mesh},
+                prep,
+                [&](auto& queue, const auto& buffer, auto step) {
+                    output_accumulator(queue, buffer, step);
+                    if (!pressures_wanted) {
+                        callback(queue, buffer, step, ideal_steps);
+                        return;
+                    }
+                    if (step == 0) {
+                        zero_buffer(cl::EnqueueArgs{queue,
+                                                    cl::NDRange{dense_nodes}},
+                                    dense_view);
+                    }
+                    scatter(cl::EnqueueArgs{queue,
+                                            cl::NDRange{
+                                                    layout.nodes.size()}},
+                            buffer,
+                            dense_indices,
+                            dense_view);
+                    callback(queue, dense_view, step, ideal_steps);
+                },
+                keep_going);
+
+        if (steps != total_steps) {
+            return std::nullopt;
+        }
+
+        return band{std::move(output_accumulator.get_output()), sample_rate};
+    }
+
+    //  Dense runs may store pressure in half precision, and everything which
+    //  touches the pressure buffer must agree.
+    const auto storage = select_pressure_storage();
 
     auto output_accumulator =
             core::callback_accumulator<postprocessor::directional_receiver>{
                     mesh.get_descriptor(),
                     sample_rate,
                     get_ambient_density(environment),
-                    compute_mesh_index(receiver)};
+                    receiver_index,
+                    storage};
+
+    //  A checkpoint holds the receiver's velocity followed by its outputs.
+    std::optional<checkpointer> checkpoints;
+    size_t resumed_steps = 0;
+    if (const auto directory = select_checkpoint_directory()) {
+        const auto& boundaries = mesh.get_structure().get_boundary_layout();
+        const auto run_key =
+                run_key_builder{}
+                        .add(mesh.get_structure().get_condensed_nodes())
+                        .add(boundaries.headers)
+                        .add(boundaries.node_indices)
+                        .add(boundaries.coeff_block_offsets)
+                        .add(boundaries.coeff_blocks)
+                        .add(source_index)
+                        .add(receiver_index)
+                        .add(static_cast<std::uint64_t>(storage))
+                        .add(to_bits(sample_rate))
+                        .add(to_bits(environment.speed_of_sound))
+                        .add(to_bits(environment.acoustic_impedance))
+                        .add(input)
+                        .get();
+        checkpoints.emplace(make_checkpoint_path(*directory, run_key),
+                            select_checkpoint_interval(),
+                            run_key);
+        checkpoints->set_receiver_saver([&] {
+            util::aligned::vector<std::uint8_t> ret;
+            const auto velocity =
+                    output_accumulator.get_postprocessor().get_velocity();
+            append_bytes(ret, &velocity, 1);
+            const auto& output = output_accumulator.get_output();
+            append_bytes(ret, output.data(), output.size());
+            return ret;
+        });
+
+        if (const auto resume = checkpoints->get_resume()) {
+            size_t offset = 0;
+            glm::dvec3 velocity;
+            extract_bytes(resume->receivers, offset, &velocity, 1);
+            util::aligned::vector<postprocessor::directional_receiver::output>
+                    output(resume->step);
+            extract_bytes(
+                    resume->receivers, offset, output.data(), output.size());
+
+            auto receiver = output_accumulator.get_postprocessor();
+            receiver.set_velocity(velocity);
+            output_accumulator.restore(std::move(receiver), std::move(output));
+            resumed_steps = resume->step;
+        }
+    }
+
+    auto prep = preprocessor::make_soft_source(
+            source_index, begin(input) + resumed_steps, end(input), storage);
 
     const auto steps = run(cc,
                            mesh,
@@ -141,15 +496,98 @@ std::optional<band> canonical_impl(
                                output_accumulator(queue, buffer, step);
                                callback(queue, buffer, step, ideal_steps);
                            },
-                           keep_going);
+                           keep_going,
+                           storage,
+                           checkpoints ? &*checkpoints : nullptr);
 
     if (steps != total_steps) {
         return std::nullopt;
     }
 
+    if (checkpoints) {
+        checkpoints->discard();
+    }
+
     return band{std::move(output_accumulator.get_output()), sample_rate};
 }
 
+/// As canonical_impl, but renders every entry of `band_coefficients` in one
+/// pass. The progress callback sees the first band's pressure.
+template <typename Callback>
+std::optional<util::aligned::vector<band>> canonical_multiband_impl(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        const util::aligned::vector<coefficient_overlay>& band_coefficients,
+        double simulation_time,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::environment& environment,
+        const std::atomic_bool& keep_going,
+        Callback&& callback) {
+    const auto sample_rate = compute_sample_rate(mesh.get_descriptor(),
+                                                environment.speed_of_sound);
+
+    const auto compute_mesh_index = [&](const auto& pt) {
+        const auto ret = compute_index(mesh.get_descriptor(), pt);
+        if (!waveguide::is_inside(
+                    mesh.get_structure().get_condensed_nodes()[ret])) {
+            throw std::runtime_error{
+                    "Source/receiver node position appears to be outside "
+                    "mesh."};
+        }
+        return ret;
+    };
+
+    const auto ideal_steps = std::ceil(sample_rate * simulation_time);
+    const auto total_steps = static_cast<size_t>(ideal_steps);
+
+    const auto input = make_pcs_transparent_signal(
+            total_steps,
+            environment.acoustic_impedance,
+            environment.speed_of_sound,
+            sample_rate,
+            mesh.get_descriptor().spacing);
+
+    const auto bands = band_coefficients.size();
+    const auto source_index = compute_mesh_index(source);
+    const auto receiver_index = compute_mesh_index(receiver);
+
+    using accumulator =
+            core::callback_accumulator<postprocessor::directional_receiver>;
+    std::vector<accumulator> output_accumulators;
+    output_accumulators.reserve(bands);
+    for (size_t i = 0; i != bands; ++i) {
+        output_accumulators.emplace_back(mesh.get_descriptor(),
+                                         sample_rate,
+                                         get_ambient_density(environment),
+                                         receiver_index);
+    }
+
+    const auto steps = run_multiband(
+            cc,
+            mesh,
+            band_coefficients,
+            source_index,
+            begin(input),
+            end(input),
+            [&](auto& queue, const auto& planes, auto step) {
+                for (size_t i = 0; i != bands; ++i) {
+                    output_accumulators[i](queue, planes[i], step);
+                }
+                callback(queue, planes.front(), step, ideal_steps);
+            },
+            keep_going);
+
+    if (steps != total_steps) {
+        return std::nullopt;
+    }
+
+    return util::map_to_vector(
+            begin(output_accumulators),
+            end(output_accumulators),
+            [&](const auto& i) { return band{i.get_output(), sample_rate}; });
+}
+
 template <typename Callback>
 std::optional<band> bempp_canonical_impl(
         const core::compute_context& /*cc*/,
@@ -182,17 +620,19 @@ std::optional<band> bempp_canonical_impl(
 ///     source at closest available location
 ///     single hard source
 ///     single directional receiver
+/// See canonical_impl for `pressures_wanted`.
 template <typename PressureCallback>
 std::optional<util::aligned::vector<bandpass_band>> canonical(
         const core::compute_context& cc,
-        voxels_and_mesh voxelised,
+        const voxels_and_mesh& voxelised,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::environment& environment,
         const single_band_parameters& sim_params,
         double simulation_time,
         const std::atomic_bool& keep_going,
-        PressureCallback&& pressure_callback) {
+        PressureCallback&& pressure_callback,
+        bool pressures_wanted = true) {
     const auto backend = select_backend();
     if (backend == waveguide_backend::bempp_cpu) {
         if (auto ret = detail::bempp_canonical_impl(cc,
@@ -216,7 +656,8 @@ std::optional<util::aligned::vector<bandpass_band>> canonical(
                                           receiver,
                                           environment,
                                           keep_going,
-                                          pressure_callback)) {
+                                          pressure_callback,
+                                          pressures_wanted)) {
         return util::aligned::vector<bandpass_band>{bandpass_band{
                 std::move(*ret), util::make_range(0.0, sim_params.cutoff)}};
     }
@@ -226,29 +667,40 @@ std::optional<util::aligned::vector<bandpass_band>> canonical(
 
 ////////////////////////////////////////////////////////////////////////////////
 
-inline auto set_flat_coefficients_for_band(voxels_and_mesh& voxels_and_mesh,
-                                           size_t band) {
-    voxels_and_mesh.mesh.set_coefficients(util::map_to_vector(
+inline auto compute_flat_coefficients_for_band(
+        const voxels_and_mesh& voxels_and_mesh, size_t band) {
+    return util::map_to_vector(
             begin(voxels_and_mesh.voxels.get_scene_data().get_surfaces()),
             end(voxels_and_mesh.voxels.get_scene_data().get_surfaces()),
             [&](const auto& surface) {
                 return to_flat_coefficients(surface.absorption.s[band]);
-            }));
+            });
+}
+
+inline auto set_flat_coefficients_for_band(voxels_and_mesh& voxels_and_mesh,
+                                           size_t band) {
+    voxels_and_mesh.mesh.set_coefficients(
+            compute_flat_coefficients_for_band(voxels_and_mesh, band));
 }
 
 /// This is a sort of middle ground - more accurate boundary modelling, but
-/// really unbelievably slow.
+/// slower than a single band.
+/// All bands share the mesh and source, so they are advanced together in a
+/// single pass (see run_multiband) rather than one full run per band.
+/// Every node is stored, so the callback always sees dense pressures and
+/// `pressures_wanted` has no effect.
 template <typename PressureCallback>
 std::optional<util::aligned::vector<bandpass_band>> canonical(
         const core::compute_context& cc,
-        voxels_and_mesh voxelised,
+        const voxels_and_mesh& voxelised,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::environment& environment,
         const multiple_band_constant_spacing_parameters& sim_params,
         double simulation_time,
         const std::atomic_bool& keep_going,
-        PressureCallback&& pressure_callback) {
+        PressureCallback&& pressure_callback,
+        bool pressures_wanted = true) {
     const auto band_params = hrtf_data::hrtf_band_params_hz();
 
     if (select_backend() == waveguide_backend::bempp_cpu) {
@@ -262,34 +714,56 @@ std::optional<util::aligned::vector<bandpass_band>> canonical(
         (void)simulation_time;
         (void)keep_going;
         (void)pressure_callback;
+        (void)pressures_wanted;
         return std::nullopt;
     }
 
-    util::aligned::vector<bandpass_band> ret{};
-
-    //  For each band, up to the maximum band specified.
+    //  For each band, up to the maximum band specified. Only the coefficient
+    //  tables differ between bands, the mesh itself is shared.
+    util::aligned::vector<coefficient_overlay> band_coefficients;
     for (auto band = 0; band != sim_params.bands; ++band) {
-        set_flat_coefficients_for_band(voxelised, band);
-
-        if (auto rendered_band = detail::canonical_impl(cc,
-                                                        voxelised.mesh,
-                                                        simulation_time,
-                                                        source,
-                                                        receiver,
-                                                        environment,
-                                                        keep_going,
-                                                        pressure_callback)) {
-            ret.emplace_back(bandpass_band{
-                    std::move(*rendered_band),
-                    util::make_range(band_params.edges[band],
-                                     band_params.edges[band + 1])});
-        } else {
-            return std::nullopt;
-        }
+        band_coefficients.emplace_back(
+                voxelised.mesh,
+                compute_flat_coefficients_for_band(voxelised, band));
     }
 
+    auto rendered = detail::canonical_multiband_impl(cc,
+                                                     voxelised.mesh,
+                                                     band_coefficients,
+                                                     simulation_time,
+                                                     source,
+                                                     receiver,
+                                                     environment,
+                                                     keep_going,
+                                                     pressure_callback);
+    if (!rendered) {
+        return std::nullopt;
+    }
+
+    util::aligned::vector<bandpass_band> ret{};
+    for (auto band = 0; band != sim_params.bands; ++band) {
+        ret.emplace_back(bandpass_band{
+                std::move((*rendered)[band]),
+                util::make_range(band_params.edges[band],
+                                 band_params.edges[band + 1])});
+    }
     return ret;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+/// How the pressure buffer handed to canonical's callback is stored, for
+/// callbacks which read it.
+inline pressure_storage canonical_pressure_storage(
+        const single_band_parameters&) {
+    return select_pressure_storage();
+}
+
+/// Multiband runs always store single precision pressure.
+inline pressure_storage canonical_pressure_storage(
+        const multiple_band_constant_spacing_parameters&) {
+    return pressure_storage::single;
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "waveguide/pressure_storage.h"
+
+#include "core/cl/include.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace wayverb {
+namespace waveguide {
+
+/// The state of a dense waveguide run between two steps.
+///
+/// Device buffers are stored as raw bytes, exactly as they were on the
+/// device, so a checkpoint can only be resumed by a run with the same mesh,
+/// pressure storage and inputs. `run_key` identifies those, and is chosen by
+/// whoever drives the run (see canonical.h).
+struct checkpoint final {
+    std::uint64_t run_key{};
+    /// The number of steps completed.
+    std::uint64_t step{};
+    util::aligned::vector<std::uint8_t> previous;
+    util::aligned::vector<std::uint8_t> current;
+    util::aligned::vector<std::uint8_t> filter_memories;
+    /// Receiver state, opaque to the waveguide (see checkpointer).
+    util::aligned::vector<std::uint8_t> receivers;
+};
+
+/// Where the run identified by `run_key` keeps its checkpoint inside
+/// `directory`, so that concurrent runs sharing a directory don't clobber one
+/// another. Creates `directory` if it doesn't exist.
+std::string make_checkpoint_path(const std::string& directory,
+                                 std::uint64_t run_key);
+
+/// Writes to a temporary file beside `path` which then replaces `path`, so
+/// an interrupted write never leaves a truncated checkpoint behind.
+void write_checkpoint(const std::string& path, const checkpoint& checkpoint);
+
+/// Throws if the file is missing or isn't a checkpoint.
+checkpoint read_checkpoint(const std::string& path);
+
+/// Appends the bytes of trivially copyable values to `blob`.
+template <typename T>
+void append_bytes(util::aligned::vector<std::uint8_t>& blob,
+                  const T* data,
+                  size_t count) {
+    static_assert(std::is_trivially_copyable<T>{}, "T must be plain data");
+    const auto bytes = reinterpret_cast<const std::uint8_t*>(data);
+    blob.insert(end(blob), bytes, bytes + sizeof(T) * count);
+}
+
+/// Reads values written by append_bytes, advancing `offset`.
+template <typename T>
+void extract_bytes(const util::aligned::vector<std::uint8_t>& blob,
+                   size_t& offset,
+                   T* data,
+                   size_t count) {
+    static_assert(std::is_trivially_copyable<T>{}, "T must be plain data");
+    const auto bytes = sizeof(T) * count;
+    if (blob.size() < offset + bytes) {
+        throw std::runtime_error{"Checkpoint receiver state is truncated."};
+    }
+    std::memcpy(data, blob.data() + offset, bytes);
+    offset += bytes;
+}
+
+/// Periodically saves a run's state, and offers a saved state to resume from.
+///
+/// Snapshots are taken on the run's command queue by copying the pressure
+/// fields and filter memories into device-side staging buffers. Reading the
+/// staging buffers back and writing the file happen on a second queue and a
+/// background thread, so the simulation only waits for the device copies.
+/// At most one snapshot is in flight; taking another first waits for it.
+class checkpointer final {
+public:
+    /// If `path` holds a checkpoint with the same `run_key`, it is loaded
+    /// and get_resume() returns it. Checkpoints are taken every `interval`
+    /// steps.
+    checkpointer(std::string path, size_t interval, std::uint64_t run_key);
+
+    checkpointer(const checkpointer&) = delete;
+    checkpointer& operator=(const checkpointer&) = delete;
+    checkpointer(checkpointer&&) = delete;
+    checkpointer& operator=(checkpointer&&) = delete;
+
+    /// Waits for any snapshot in flight.
+    ~checkpointer() noexcept;
+
+    /// nullptr if there is nothing to resume.
+    const checkpoint* get_resume() const;
+
+    /// Whether a snapshot should be taken once `step` steps are complete.
+    bool is_due(size_t step) const;
+
+    /// Called when a snapshot is taken, to capture receiver state which
+    /// lives on the host.
+    void set_receiver_saver(
+            std::function<util::aligned::vector<std::uint8_t>()> saver);
+
+    /// Takes a snapshot once `step` steps are complete. Only enqueues work
+    /// on `queue`.
+    void snapshot(cl::CommandQueue& queue,
+                  const cl::Buffer& previous,
+                  const cl::Buffer& current,
+                  const cl::Buffer& filter_memories,
+                  size_t step);
+
+    /// Waits for any snapshot in flight and removes the checkpoint, once the
+    /// run it belongs to has finished.
+    void discard();
+
+private:
+    void wait();
+
+    std::string path_;
+    size_t interval_;
+    std::uint64_t run_key_;
+    std::optional<checkpoint> resume_;
+    std::function<util::aligned::vector<std::uint8_t>()> save_receivers_;
+
+    cl::CommandQueue transfer_queue_;
+    util::aligned::vector<cl::Buffer> staging_;
+    std::future<void> pending_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
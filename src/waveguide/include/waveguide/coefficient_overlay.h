@@ -0,0 +1,38 @@
+#pragma once
+
+#include "waveguide/mesh.h"
+
+#include "utilities/aligned/vector.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// Boundary coefficients for a single run over a shared mesh.
+///
+/// A mesh's topology is large and never changes between runs, but the
+/// boundary filters often do (e.g. once per frequency band). An overlay holds
+/// only the per-surface table and the per-face blocks derived from it, so a
+/// run can swap coefficients without copying or mutating the mesh.
+class coefficient_overlay final {
+public:
+    /// Uses the coefficients the mesh was built with.
+    explicit coefficient_overlay(const mesh& mesh);
+
+    /// Uses `surface_coefficients` in place of the mesh's own coefficients.
+    /// There must be one entry per surface of the mesh.
+    coefficient_overlay(
+            const mesh& mesh,
+            util::aligned::vector<coefficients_canonical> surface_coefficients);
+
+    const util::aligned::vector<coefficients_canonical>&
+    get_surface_coefficients() const;
+    const util::aligned::vector<coefficients_canonical>& get_coeff_blocks()
+            const;
+
+private:
+    util::aligned::vector<coefficients_canonical> surface_coefficients_;
+    util::aligned::vector<coefficients_canonical> coeff_blocks_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
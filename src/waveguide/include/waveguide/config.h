@@ -1,5 +1,7 @@
 #pragma once
 
+#include "core/polyphase_resampler.h"
+
 #include "utilities/aligned/vector.h"
 
 #include <vector>
@@ -14,15 +16,31 @@ double grid_spacing(double speed_of_sound, double time_step);
 
 }  // namespace config
 
-util::aligned::vector<float> adjust_sampling_rate(const float* data,
-                                                  size_t size,
-                                                  double in_sr,
-                                                  double out_sr);
+/// Converts waveguide output to the output sampling rate, using a cached
+/// rational polyphase filter bank, and rescales so that the output level
+/// matches the input.
+/// Falls back to libsamplerate for ratios which no bank approximates closely
+/// enough over the length of the signal.
+util::aligned::vector<float> adjust_sampling_rate(
+        const float* data,
+        size_t size,
+        double in_sr,
+        double out_sr,
+        core::resampler_quality quality = core::resampler_quality::high);
 
 template <typename T>
-auto adjust_sampling_rate(const T& t, double in_sr, double out_sr) {
-    return adjust_sampling_rate(t.data(), t.size(), in_sr, out_sr);
+auto adjust_sampling_rate(
+        const T& t,
+        double in_sr,
+        double out_sr,
+        core::resampler_quality quality = core::resampler_quality::high) {
+    return adjust_sampling_rate(t.data(), t.size(), in_sr, out_sr, quality);
 }
 
+/// The previous libsamplerate (SRC_SINC_BEST_QUALITY) implementation, kept
+/// as a reference for tests and benchmarks.
+util::aligned::vector<float> adjust_sampling_rate_libsamplerate(
+        const float* data, size_t size, double in_sr, double out_sr);
+
 }  // namespace waveguide
 }  // namespace wayverb
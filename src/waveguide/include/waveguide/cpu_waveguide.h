@@ -0,0 +1,74 @@
+#pragma once
+
+#include "waveguide/coefficient_overlay.h"
+#include "waveguide/sparse_layout.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace wayverb {
+namespace waveguide {
+
+/// Runs the rectilinear waveguide update on the host, for machines without a
+/// usable OpenCL device, or where the CPU is the better target.
+///
+/// Each node only reads its six neighbours, so several steps can be taken in
+/// one pass over a small region. The mesh is split into tiles. Each tile is
+/// extended by a halo `block_steps` nodes deep, copied into tile-local
+/// storage, and advanced `block_steps` steps while it is resident in cache.
+/// Errors from the missing halo neighbours spread inwards by one node per
+/// step, so after a block only the halo is stale, and the tile's core is
+/// written back. Boundary filter memories are copied and written back in the
+/// same way.
+///
+/// Each node in a halo is only updated while its result can still reach the
+/// core, so the halo shrinks by one node per step. Even so, the redundant work
+/// grows quickly with block_steps relative to tile_size: a few steps per block
+/// on tiles of a few tens of nodes is usually the sweet spot.
+///
+/// With block_steps == 1 this is the plain per-step update, and any block size
+/// or tile size gives bit-identical results.
+class cpu_waveguide final {
+public:
+    /// All indices are compact indices into `layout`, which should outlive
+    /// this object. `tile_size` is the edge length of a tile, in nodes.
+    cpu_waveguide(const sparse_layout& layout,
+                  const coefficient_overlay& coefficients,
+                  size_t block_steps,
+                  size_t tile_size = 32);
+
+    cpu_waveguide(const cpu_waveguide&) = delete;
+    cpu_waveguide& operator=(const cpu_waveguide&) = delete;
+    cpu_waveguide(cpu_waveguide&&) = delete;
+    cpu_waveguide& operator=(cpu_waveguide&&) = delete;
+
+    ~cpu_waveguide() noexcept;
+
+    /// Drives `source` with a soft source `signal`, one sample per step, and
+    /// returns the pressure at each of `receivers` for every step.
+    /// Returns fewer steps than the signal length if `keep_going` is
+    /// cleared.
+    /// `block_callback`, if supplied, is called after every block with the
+    /// number of steps finished so far.
+    util::aligned::vector<util::aligned::vector<float>> run(
+            size_t source,
+            const util::aligned::vector<float>& signal,
+            const util::aligned::vector<size_t>& receivers,
+            const std::atomic_bool& keep_going,
+            const std::function<void(size_t steps)>& block_callback = {});
+
+    size_t get_block_steps() const;
+
+    /// The worst-case number of node updates per useful update, due to halos.
+    double compute_redundancy() const;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "waveguide/coefficient_overlay.h"
+#include "waveguide/sparse_layout.h"
+
+#include "core/cl/common.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <atomic>
+#include <functional>
+
+namespace wayverb {
+namespace waveguide {
+
+/// One slab of a decomposed mesh.
+///
+/// The layout stores the nodes this slab owns, ordered plane by plane along
+/// the split axis, followed by a one-plane halo copied from each adjacent
+/// slab (lower, then upper). Only owned nodes are updated. After every step
+/// each halo is refreshed from the slab which owns it, so an owned node on
+/// the edge of the slab sees the same neighbour pressures as it would in an
+/// undivided run.
+///
+/// Because the owned nodes are plane-major, the first and last owned planes
+/// are contiguous, and so are both halos, so an exchange is a single copy in
+/// each direction.
+///
+/// The layout's boundary data and neighbour table use the slab's own
+/// indices. compute_compact_index does not apply, use compute_owner instead.
+struct subdomain final {
+    sparse_layout layout;
+    size_t owned_nodes;
+    size_t lower_halo_nodes;
+    size_t upper_halo_nodes;
+    /// The planes owned along the split axis, as [begin_plane, end_plane).
+    size_t begin_plane;
+    size_t end_plane;
+    /// For each boundary entry of the slab, the offset of its coefficient
+    /// blocks in the undivided mesh's layout (see coefficient_overlay).
+    util::aligned::vector<uint32_t> source_coeff_block_offsets;
+};
+
+struct domain_decomposition final {
+    mesh_descriptor descriptor;
+    /// The axis along which the mesh is split (the longest, 0 = x).
+    size_t axis;
+    util::aligned::vector<subdomain> subdomains;
+};
+
+/// Splits the mesh into `num_subdomains` slabs along its longest axis, with
+/// roughly equal numbers of stored nodes in each. Every slab owns at least
+/// one node.
+/// Throws if fewer planes than slabs hold any stored nodes.
+domain_decomposition decompose(const mesh& mesh, size_t num_subdomains);
+
+struct node_owner final {
+    size_t subdomain;
+    /// Index into the subdomain's layout.
+    cl_uint index;
+};
+
+/// Finds the slab which owns a dense mesh node.
+/// Throws if the node is not stored (it is outside the room).
+node_owner compute_owner(const domain_decomposition& decomposition,
+                         size_t dense_index);
+
+/// Runs a decomposed simulation, driving dense node `source` with a soft
+/// source `signal` (one sample per step) and returning the pressure at each
+/// of the dense nodes `receivers` for every step.
+///
+/// Subdomain i runs on contexts[i % contexts.size()], each with its own
+/// command queue. Every slab's step is enqueued before any halo is read
+/// back, so slabs on different devices run concurrently. Halos are
+/// exchanged through host memory, so contexts need not share a platform.
+/// Several slabs may share one context, which is how the decomposition can
+/// be exercised on a machine with a single device.
+///
+/// `step_callback`, if supplied, is called after every step with the first
+/// slab's queue and pressure buffer, which holds only that slab's nodes.
+///
+/// Returns fewer steps than the signal length if `keep_going` is cleared.
+util::aligned::vector<util::aligned::vector<float>> run_decomposed(
+        const util::aligned::vector<core::compute_context>& contexts,
+        const domain_decomposition& decomposition,
+        const coefficient_overlay& coefficients,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<size_t>& receivers,
+        const std::atomic_bool& keep_going,
+        const std::function<void(cl::CommandQueue& queue,
+                                 const cl::Buffer& buffer,
+                                 size_t step)>& step_callback = {});
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "waveguide/mesh_descriptor.h"
+#include "waveguide/pressure_storage.h"
+
+#include "core/cl/include.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <functional>
+#include <memory>
+
+namespace wayverb {
+namespace core {
+class compute_context;
+}  // namespace core
+
+namespace waveguide {
+
+/// The layout of a snapshot taken with decimation `factor`: one node per
+/// factor * factor * factor block of the mesh, at the block's centre.
+/// With factor 1 this is the mesh's own descriptor.
+mesh_descriptor compute_decimated_descriptor(const mesh_descriptor& descriptor,
+                                             size_t factor);
+
+/// The decimation factor for visualisation snapshots, from
+/// WAYVERB_VIZ_DOWNSAMPLE (default 1, no decimation).
+size_t select_snapshot_factor();
+
+/// Streams decimated copies of a dense pressure field to the host while a
+/// simulation runs.
+///
+/// Each snapshot is reduced on the device, keeping the signed peak of every
+/// block, then read back without blocking into one of two pinned host
+/// buffers. The result is handed to the callback on a worker thread, so the
+/// simulation only pays for enqueueing the reduction. If both buffers are
+/// still busy, the snapshot is skipped: a slow listener lowers the frame
+/// rate rather than the simulation speed.
+class field_snapshotter final {
+public:
+    /// Args: decimated pressures, laid out as get_descriptor(), and the step
+    /// they were taken at.
+    using callback_type =
+            std::function<void(util::aligned::vector<float>, size_t)>;
+
+    /// `storage` is how the fields passed to take() store pressure.
+    /// Snapshots are always delivered as floats.
+    field_snapshotter(const core::compute_context& cc,
+                      const mesh_descriptor& descriptor,
+                      size_t factor,
+                      callback_type callback,
+                      pressure_storage storage = pressure_storage::single);
+
+    field_snapshotter(const field_snapshotter&) = delete;
+    field_snapshotter& operator=(const field_snapshotter&) = delete;
+    field_snapshotter(field_snapshotter&&) = delete;
+    field_snapshotter& operator=(field_snapshotter&&) = delete;
+
+    /// Delivers any snapshots in flight before returning.
+    ~field_snapshotter() noexcept;
+
+    /// The layout of delivered snapshots.
+    const mesh_descriptor& get_descriptor() const;
+
+    /// Enqueues a snapshot of `pressure` on `queue`, which must belong to the
+    /// context this object was built with.
+    /// Returns false if the snapshot was skipped.
+    bool take(cl::CommandQueue& queue, const cl::Buffer& pressure, size_t step);
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -6,26 +6,35 @@
 #include "core/gpu_scene_data.h"
 #include "core/spatial_division/voxelised_scene_data.h"
 
+#include <memory>
+
 namespace wayverb {
 namespace waveguide {
 
 struct precomputed_boundary_state;
 struct precomputed_inputs;
 
+/// The node structure is immutable and shared, so copying a mesh is cheap and
+/// copies refer to the same topology. set_coefficients detaches the mesh from
+/// its copies first. To change coefficients for a single run, prefer a
+/// coefficient_overlay, which leaves the mesh untouched.
 class mesh final {
 public:
     mesh(mesh_descriptor descriptor, vectors vectors);
 
     const mesh_descriptor& get_descriptor() const;
     const vectors& get_structure() const;
+    std::shared_ptr<const vectors> get_shared_structure() const;
 
     void set_coefficients(coefficients_canonical coefficients);
     void set_coefficients(
             util::aligned::vector<coefficients_canonical> coefficients);
 
 private:
+    vectors& get_unique_structure();
+
     mesh_descriptor descriptor_;
-    vectors vectors_;
+    std::shared_ptr<vectors> vectors_;
 };
 
 /// Uses the number of 'inside' nodes and the mesh spacing to estimate the
@@ -7,6 +7,7 @@
 #include "glm/glm.hpp"
 
 #include <array>
+#include <cstdint>
 
 namespace wayverb {
 namespace waveguide {
@@ -44,6 +45,11 @@ void compute_neighbors(const mesh_descriptor& d, size_t index, cl_uint* output);
 std::array<cl_uint, 6> compute_neighbors(const mesh_descriptor& d,
                                          size_t index);
 
+/// Interleaves the bits of a (non-negative) locator into a Morton (Z-order)
+/// code. Nodes with nearby codes are nearby in all three axes, so sorting by
+/// this key keeps each node's neighbours close in memory.
+std::uint64_t compute_morton_index(const glm::ivec3& locator);
+
 core::geo::box compute_aabb(const mesh_descriptor& d);
 
 double compute_sample_rate(const mesh_descriptor& d, double speed_of_sound);
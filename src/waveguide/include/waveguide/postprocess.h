@@ -11,6 +11,7 @@
 #include "core/mixdown.h"
 
 #include "utilities/map_to_vector.h"
+#include "utilities/thread_pool.h"
 
 namespace wayverb {
 namespace waveguide {
@@ -32,15 +33,23 @@ constexpr auto dereferenced_type_matches_v =
 
 /// If the iterator is over `bands_type` use this one.
 /// Audible range is normalised in terms of the waveguide sampling rate.
+/// The bands are filtered on `pool`.
 template <typename It,
           std::enable_if_t<std::is_same<std::decay_t<dereferenced_t<It>>,
                                         core::bands_type>::value,
                            int> = 0>
-auto postprocess(It begin, It end, double sample_rate) {
+auto postprocess(It begin,
+                 It end,
+                 double sample_rate,
+                 util::thread_pool& pool) {
     return core::multiband_filter_and_mixdown(
-            begin, end, sample_rate, [](auto it, auto index) {
+            begin,
+            end,
+            sample_rate,
+            [](auto it, auto index) {
                 return core::make_cl_type_iterator(std::move(it), index);
-            });
+            },
+            pool);
 }
 
 /// If the iterator is over a floating-point type use this one.
@@ -48,23 +57,29 @@ template <typename It,
           std::enable_if_t<std::is_floating_point<
                                    std::decay_t<dereferenced_t<It>>>::value,
                            int> = 0>
-auto postprocess(It begin, It end, double sample_rate) {
+auto postprocess(It begin, It end, double sample_rate, util::thread_pool&) {
     return util::aligned::vector<float>(begin, end);
 }
 
+template <typename It>
+auto postprocess(It begin, It end, double sample_rate) {
+    return postprocess(begin, end, sample_rate, util::serial_executor());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 template <typename Method>
 auto postprocess(const band& band,
                  const Method& method,
                  double acoustic_impedance,
-                 double output_sample_rate) {
+                 double output_sample_rate,
+                 util::thread_pool& pool) {
     auto attenuated = util::map_to_vector(
             begin(band.directional),
             end(band.directional),
             make_attenuate_mapper(method, acoustic_impedance));
-    const auto ret =
-            postprocess(begin(attenuated), end(attenuated), band.sample_rate);
+    const auto ret = postprocess(
+            begin(attenuated), end(attenuated), band.sample_rate, pool);
 
     return waveguide::adjust_sampling_rate(ret.data(),
                                            ret.size(),
@@ -73,36 +88,52 @@ auto postprocess(const band& band,
 }
 
 template <typename Method>
-auto postprocess(const util::aligned::vector<bandpass_band>& results,
+auto postprocess(const band& band,
                  const Method& method,
                  double acoustic_impedance,
                  double output_sample_rate) {
-    util::aligned::vector<float> ret;
-
-    for (const auto& band : results) {
-        auto processed = postprocess(
-                band.band, method, acoustic_impedance, output_sample_rate);
-
-        const auto cutoff = band.valid_hz / output_sample_rate;
-
-        //  Bandpass based on previous band cutoff.
-        frequency_domain::filter filt{
-                frequency_domain::best_fft_length(processed.size()) << 2};
+    return postprocess(band,
+                       method,
+                       acoustic_impedance,
+                       output_sample_rate,
+                       util::serial_executor());
+}
 
-        constexpr auto l = 0;
-        constexpr auto width = 0.1;
+/// Bandpass based on previous band cutoff.
+inline void bandpass_to_valid_range(util::aligned::vector<float>& processed,
+                                    const util::range<double>& valid_hz,
+                                    double output_sample_rate) {
+    const auto cutoff = valid_hz / output_sample_rate;
+
+    frequency_domain::filter filt{
+            frequency_domain::best_fft_length(processed.size()) << 2};
+
+    constexpr auto l = 0;
+    constexpr auto width = 0.1;
+
+    const auto b = begin(processed);
+    const auto e = end(processed);
+    filt.run(b, e, b, [&](auto cplx, auto freq) {
+        return cplx * static_cast<float>(
+                              frequency_domain::compute_bandpass_magnitude(
+                                      freq, cutoff, width, l));
+    });
+}
 
-        const auto b = begin(processed);
-        const auto e = end(processed);
-        filt.run(b, e, b, [&](auto cplx, auto freq) {
-            return cplx * static_cast<float>(
-                                  frequency_domain::compute_bandpass_magnitude(
-                                          freq, cutoff, width, l));
-        });
+/// Sums bands in order and removes any residual DC.
+template <typename It>
+auto mix_and_dc_block(It b_bands, It e_bands, double output_sample_rate) {
+    util::aligned::vector<float> ret;
 
+    for (; b_bands != e_bands; ++b_bands) {
+        const auto& processed = *b_bands;
         //  Add results to ret.
         ret.resize(std::max(ret.size(), processed.size()), 0.0f);
-        std::transform(b, e, begin(ret), begin(ret), std::plus<>{});
+        std::transform(begin(processed),
+                       end(processed),
+                       begin(ret),
+                       begin(ret),
+                       std::plus<>{});
     }
 
     {
@@ -125,5 +156,40 @@ auto postprocess(const util::aligned::vector<bandpass_band>& results,
     return ret;
 }
 
+/// Processes each waveguide band as a separate task on the pool.
+/// Bands are mixed in their original order, so the output doesn't depend on
+/// the pool size.
+template <typename Method>
+auto postprocess(const util::aligned::vector<bandpass_band>& results,
+                 const Method& method,
+                 double acoustic_impedance,
+                 double output_sample_rate,
+                 util::thread_pool& pool) {
+    const auto bands = util::parallel_map(pool, results.size(), [&](auto i) {
+        auto processed = postprocess(results[i].band,
+                                     method,
+                                     acoustic_impedance,
+                                     output_sample_rate,
+                                     pool);
+        bandpass_to_valid_range(
+                processed, results[i].valid_hz, output_sample_rate);
+        return processed;
+    });
+
+    return mix_and_dc_block(begin(bands), end(bands), output_sample_rate);
+}
+
+template <typename Method>
+auto postprocess(const util::aligned::vector<bandpass_band>& results,
+                 const Method& method,
+                 double acoustic_impedance,
+                 double output_sample_rate) {
+    return postprocess(results,
+                       method,
+                       acoustic_impedance,
+                       output_sample_rate,
+                       util::serial_executor());
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
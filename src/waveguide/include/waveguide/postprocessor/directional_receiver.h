@@ -1,5 +1,7 @@
 #pragma once
 
+#include "waveguide/pressure_storage.h"
+
 #include "glm/glm.hpp"
 
 #include <array>
@@ -25,7 +27,18 @@ public:
     directional_receiver(const mesh_descriptor& mesh_descriptor,
                          double sample_rate,
                          double ambient_density,
-                         size_t output_node);
+                         size_t output_node,
+                         pressure_storage storage = pressure_storage::single);
+
+    /// For meshes which aren't laid out densely (see sparse_layout.h), the
+    /// six neighbours of the output node must be supplied, ordered as
+    /// PortDirection.
+    directional_receiver(double mesh_spacing,
+                         double sample_rate,
+                         double ambient_density,
+                         size_t output_node,
+                         std::array<unsigned, 6> surrounding_nodes,
+                         pressure_storage storage = pressure_storage::single);
 
     struct output final {
         glm::vec3 intensity;
@@ -37,14 +50,24 @@ public:
                            const cl::Buffer& buffer,
                            size_t step);
 
+    /// As above, from pressures already read back: the output node's,
+    /// followed by its neighbours' in PortDirection order.
+    return_type operator()(const std::array<float, 7>& pressures);
+
     size_t get_output_node() const;
 
+    /// The particle velocity integrated so far. Saved and restored when a
+    /// run is checkpointed.
+    glm::dvec3 get_velocity() const;
+    void set_velocity(const glm::dvec3& velocity);
+
 private:
     double mesh_spacing_;
     double sample_rate_;
     double ambient_density_;
     size_t output_node_;
     std::array<unsigned, 6> surrounding_nodes_;
+    pressure_storage storage_;
     glm::dvec3 velocity_{0};
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "waveguide/pressure_storage.h"
+
 #include "core/cl/include.h"
 
 namespace wayverb {
@@ -8,7 +10,8 @@ namespace postprocessor {
 
 class node final {
 public:
-    node(size_t output_node);
+    node(size_t output_node,
+         pressure_storage storage = pressure_storage::single);
 
     using return_type = float;
     return_type operator()(cl::CommandQueue& queue,
@@ -19,6 +22,7 @@ public:
 
 private:
     size_t output_node_;
+    pressure_storage storage_;
 };
 
 }  // namespace postprocessor
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "waveguide/pressure_storage.h"
+
 #include "core/cl/common.h"
 
 namespace wayverb {
@@ -9,16 +11,20 @@ namespace preprocessor {
 template <typename It>
 class hard_source final {
 public:
-    hard_source(size_t node, It begin, It end)
+    hard_source(size_t node,
+                It begin,
+                It end,
+                pressure_storage storage = pressure_storage::single)
             : node_{node}
             , begin_{begin}
-            , end_{end} {}
+            , end_{end}
+            , storage_{storage} {}
 
     bool operator()(cl::CommandQueue& queue, cl::Buffer& buffer, size_t) {
         if (begin_ == end_) {
             return false;
         }
-        core::write_value(queue, buffer, node_, *begin_++);
+        write_pressure(queue, buffer, node_, *begin_++, storage_);
         return true;
     }
 
@@ -26,11 +32,15 @@ private:
     size_t node_;
     It begin_;
     It end_;
+    pressure_storage storage_;
 };
 
 template <typename It>
-auto make_hard_source(size_t node, It begin, It end) {
-    return hard_source<It>{node, begin, end};
+auto make_hard_source(size_t node,
+                 It begin,
+                 It end,
+                 pressure_storage storage = pressure_storage::single) {
+    return hard_source<It>{node, begin, end, storage};
 }
 
 }  // namespace preprocessor
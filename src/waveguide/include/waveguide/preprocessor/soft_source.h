@@ -1,5 +1,7 @@
 #pragma once
 
+#include "waveguide/pressure_storage.h"
+
 #include "core/cl/common.h"
 
 namespace wayverb {
@@ -9,18 +11,23 @@ namespace preprocessor {
 template <typename It>
 class soft_source final {
 public:
-    soft_source(size_t node, It begin, It end)
+    soft_source(size_t node,
+                It begin,
+                It end,
+                pressure_storage storage = pressure_storage::single)
             : node_{node}
             , begin_{begin}
-            , end_{end} {}
+            , end_{end}
+            , storage_{storage} {}
 
     bool operator()(cl::CommandQueue& queue, cl::Buffer& buffer, size_t) {
         if (begin_ == end_) {
             return false;
         }
         const auto current_pressure =
-                core::read_value<cl_float>(queue, buffer, node_);
-        core::write_value(queue, buffer, node_, current_pressure + *begin_++);
+                read_pressure(queue, buffer, node_, storage_);
+        write_pressure(
+                queue, buffer, node_, current_pressure + *begin_++, storage_);
         return true;
     }
 
@@ -28,11 +35,15 @@ private:
     size_t node_;
     It begin_;
     It end_;
+    pressure_storage storage_;
 };
 
 template <typename It>
-auto make_soft_source(size_t node, It begin, It end) {
-    return soft_source<It>{node, begin, end};
+auto make_soft_source(size_t node,
+                 It begin,
+                 It end,
+                 pressure_storage storage = pressure_storage::single) {
+    return soft_source<It>{node, begin, end, storage};
 }
 
 }  // namespace preprocessor
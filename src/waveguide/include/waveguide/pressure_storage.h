@@ -0,0 +1,62 @@
+#pragma once
+
+#include "utilities/aligned/vector.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cl {
+class Buffer;
+class CommandQueue;
+}  // namespace cl
+
+namespace wayverb {
+namespace waveguide {
+
+/// How a program stores the pressure fields.
+///     single: one cl_float per node
+///     half:   one IEEE half per node, read and written with vload_half and
+///             vstore_half. Arithmetic and boundary filter memories stay in
+///             single precision, so this only trades pressure resolution
+///             (around three significant figures) for half the memory and
+///             bandwidth.
+///
+/// Pre- and post-processors which read or write pressure must be told the
+/// storage in use. The helpers below do the conversion.
+enum class pressure_storage { single, half };
+
+/// The size in bytes of one node's pressure.
+size_t pressure_size(pressure_storage storage);
+
+/// Rounds to the nearest representable half, ties to even, like vstore_half.
+std::uint16_t float_to_half(float value);
+float half_to_float(std::uint16_t value);
+
+float read_pressure(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t node,
+                    pressure_storage storage);
+
+void write_pressure(cl::CommandQueue& queue,
+                    cl::Buffer& buffer,
+                    size_t node,
+                    float value,
+                    pressure_storage storage);
+
+/// Reads the pressure at `count` nodes into `output`.
+/// The reads are enqueued together and waited for once, rather than once per
+/// node. `queue` must be in-order.
+void read_pressures(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    const size_t* nodes,
+                    size_t count,
+                    float* output,
+                    pressure_storage storage);
+
+/// Reads a whole pressure buffer, widening to float if necessary.
+util::aligned::vector<float> read_pressures(cl::CommandQueue& queue,
+                                            const cl::Buffer& buffer,
+                                            pressure_storage storage);
+
+}  // namespace waveguide
+}  // namespace wayverb
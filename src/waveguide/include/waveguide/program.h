@@ -1,6 +1,7 @@
 #pragma once
 
 #include "waveguide/cl/structs.h"
+#include "waveguide/pressure_storage.h"
 
 #include "core/cl/common.h"
 #include "core/program_wrapper.h"
@@ -16,11 +17,46 @@
 namespace wayverb {
 namespace waveguide {
 
+/// How a program expects mesh nodes to be stored.
+///     dense:  every cell of the mesh's bounding box, neighbours are found
+///             from the grid dimensions
+///     sparse: only inside and boundary nodes, neighbours are read from a
+///             table (see sparse_layout.h)
+enum class node_storage { dense, sparse };
+
+/// Which diagnostics the waveguide kernels are built with.
+///     production: no NaN diagnostics or traces, and no arguments for them
+///     debug:      records NaN diagnostics and per-node traces (see the
+///                 get_debug_* kernels)
+enum class kernel_variant { production, debug };
+
 class program final {
 public:
-    program(const core::compute_context& cc);
+    explicit program(const core::compute_context& cc,
+                     node_storage storage = node_storage::dense,
+                     kernel_variant variant = kernel_variant::production,
+                     pressure_storage pressure = pressure_storage::single);
 
     auto get_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// nodes
+                            cl_int3,     /// dimensions
+                            cl::Buffer,  /// boundary_headers
+                            cl::Buffer,  /// boundary_sdf_distance
+                            cl::Buffer,  /// boundary_sdf_normal
+                            cl::Buffer,  /// coeff_offsets
+                            cl::Buffer,  /// coeff_blocks
+                            cl::Buffer,  /// filter_memories
+                            cl::Buffer,  /// boundary_lookup
+                            cl::Buffer,  /// error_flag
+                            cl_uint      /// num_prev
+                            >("condensed_waveguide");
+    }
+
+    /// As get_kernel, for a program built with kernel_variant::debug.
+    auto get_debug_kernel() const {
         return program_wrapper_
                 .get_kernel<cl::Buffer,  /// previous
                             cl::Buffer,  /// current
@@ -45,10 +81,44 @@ public:
                             >("condensed_waveguide");
     }
 
+    /// As get_kernel, for a program built with node_storage::sparse.
+    /// There is no debug equivalent.
+    auto get_sparse_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// nodes
+                            cl::Buffer,  /// neighbors
+                            cl::Buffer,  /// boundary_headers
+                            cl::Buffer,  /// boundary_sdf_distance
+                            cl::Buffer,  /// boundary_sdf_normal
+                            cl::Buffer,  /// coeff_offsets
+                            cl::Buffer,  /// coeff_blocks
+                            cl::Buffer,  /// filter_memories
+                            cl::Buffer,  /// boundary_lookup
+                            cl::Buffer,  /// error_flag
+                            cl_uint      /// num_prev
+                            >("condensed_waveguide");
+    }
+
+    auto get_scatter_sparse_kernel() const {
+        return program_wrapper_.get_kernel<cl::Buffer, cl::Buffer, cl::Buffer>(
+                "scatter_sparse");
+    }
+
     auto get_zero_buffer_kernel() const {
         return program_wrapper_.get_kernel<cl::Buffer>("zero_buffer");
     }
 
+    auto get_add_to_node_multiband_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// current
+                            cl_uint,     /// node
+                            cl_float,    /// value
+                            cl_uint      /// plane_stride
+                            >("add_to_node_multiband");
+    }
+
     auto get_filter_test_kernel() const {
         return program_wrapper_
                 .get_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer>(
@@ -72,26 +142,91 @@ public:
 
     auto get_update_boundary_kernel() const {
         return program_wrapper_
-                .get_kernel<cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl_int3,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl_uint,
-                            cl::Buffer,
-                            cl::Buffer,
-                            cl_uint,
-                            cl_uint,
-                            cl_uint,
-                            cl_uint>("update_boundaries");
+                .get_kernel<cl::Buffer,  /// previous_history
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// next
+                            cl::Buffer,  /// nodes
+                            cl_int3,     /// grid_dimensions
+                            cl::Buffer,  /// boundary_node_indices
+                            cl::Buffer,  /// boundary_headers
+                            cl::Buffer,  /// coeff_offsets
+                            cl::Buffer,  /// coeff_blocks
+                            cl::Buffer,  /// filter_memories
+                            cl::Buffer,  /// boundary_lookup
+                            cl::Buffer,  /// error_flag
+                            cl_uint      /// boundary_count
+                            >("update_boundaries");
+    }
+
+    /// As get_update_boundary_kernel, for a program built with
+    /// kernel_variant::debug.
+    auto get_debug_update_boundary_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous_history
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// next
+                            cl::Buffer,  /// nodes
+                            cl_int3,     /// grid_dimensions
+                            cl::Buffer,  /// boundary_node_indices
+                            cl::Buffer,  /// boundary_headers
+                            cl::Buffer,  /// coeff_offsets
+                            cl::Buffer,  /// coeff_blocks
+                            cl::Buffer,  /// filter_memories
+                            cl::Buffer,  /// boundary_lookup
+                            cl::Buffer,  /// error_flag
+                            cl::Buffer,  /// debug_info
+                            cl_uint,     /// trace_target
+                            cl::Buffer,  /// trace_records
+                            cl::Buffer,  /// trace_head
+                            cl_uint,     /// trace_capacity
+                            cl_uint,     /// trace_enabled flag
+                            cl_uint,     /// step index
+                            cl_uint      /// boundary_count
+                            >("update_boundaries");
+    }
+
+    /// As get_kernel, but advances every band of a multi-band mesh.
+    /// Built with kernel_variant::debug, this kernel and the multiband
+    /// boundary kernel also take a debug_info buffer after error_flag.
+    auto get_multiband_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// nodes
+                            cl_int3,     /// dimensions
+                            cl::Buffer,  /// boundary_headers
+                            cl::Buffer,  /// coeff_offsets
+                            cl::Buffer,  /// coeff_blocks
+                            cl::Buffer,  /// filter_memories
+                            cl::Buffer,  /// boundary_lookup
+                            cl::Buffer,  /// error_flag
+                            cl_uint,     /// num_prev
+                            cl_uint,     /// bands
+                            cl_uint,     /// plane_stride
+                            cl_uint,     /// coeff_stride
+                            cl_uint      /// memory_stride
+                            >("condensed_waveguide_multiband");
+    }
+
+    auto get_update_boundary_multiband_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous_history
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// next
+                            cl::Buffer,  /// nodes
+                            cl::Buffer,  /// boundary_node_indices
+                            cl::Buffer,  /// boundary_headers
+                            cl::Buffer,  /// coeff_offsets
+                            cl::Buffer,  /// coeff_blocks
+                            cl::Buffer,  /// filter_memories
+                            cl::Buffer,  /// boundary_lookup
+                            cl::Buffer,  /// error_flag
+                            cl_uint,     /// boundary_count
+                            cl_uint,     /// bands
+                            cl_uint,     /// plane_stride
+                            cl_uint,     /// coeff_stride
+                            cl_uint      /// memory_stride
+                            >("update_boundaries_multiband");
     }
 
     template <cl_program_info T>
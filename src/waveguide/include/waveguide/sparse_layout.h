@@ -0,0 +1,64 @@
+#pragma once
+
+#include "waveguide/boundary_layout.h"
+#include "waveguide/mesh.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <array>
+
+namespace wayverb {
+namespace waveguide {
+
+/// Compacted node storage for a mesh.
+///
+/// A mesh covers every cell of the scene's bounding box, but only nodes inside
+/// the room or on its boundary take part in the simulation. This layout keeps
+/// just those nodes, in dense order, and replaces grid arithmetic with an
+/// explicit table of neighbours. Pressure buffers for a sparse run are indexed
+/// by position in this layout (the 'compact index').
+///
+/// Because neighbours are looked up rather than computed, nodes may be stored
+/// in any order. Morton order keeps every node's six neighbours (not just the
+/// x neighbours) nearby in memory, which helps caching on large meshes.
+///
+/// Neighbours which were not kept are marked no_neighbor. The only nodes which
+/// ever read such a neighbour are re-entrant boundary nodes, which then see
+/// zero pressure there instead of the (unphysical) pressure of a node outside
+/// the room.
+enum class node_ordering {
+    dense,  ///< As the dense mesh: x fastest, then y, then z.
+    morton  ///< Z-order (see compute_morton_index).
+};
+
+struct sparse_layout final {
+    mesh_descriptor descriptor;
+    node_ordering ordering;
+    /// The dense index of each stored node.
+    util::aligned::vector<cl_uint> dense_indices;
+    util::aligned::vector<condensed_node> nodes;
+    /// num_ports compact indices per node, ordered as PortDirection.
+    util::aligned::vector<cl_uint> neighbors;
+    /// The mesh's boundary layout, indexed by compact index.
+    boundary_layout boundaries;
+};
+
+sparse_layout make_sparse_layout(const mesh& mesh,
+                                 node_ordering ordering = node_ordering::dense);
+
+/// Returns the compact index of a dense mesh node, or no_neighbor if the node
+/// is not stored.
+cl_uint compute_compact_index(const sparse_layout& layout, size_t dense_index);
+
+std::array<cl_uint, num_ports> compute_neighbors(const sparse_layout& layout,
+                                                 size_t compact_index);
+
+/// The fraction of the mesh's nodes which are stored.
+double compute_occupancy(const sparse_layout& layout, const mesh& mesh);
+
+/// The mean distance, in nodes, between each stored node and its stored
+/// neighbours. A rough guide to how cache-friendly an ordering is.
+double compute_mean_neighbor_distance(const sparse_layout& layout);
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -1,13 +1,19 @@
 #pragma once
 
+#include "waveguide/checkpoint.h"
+#include "waveguide/coefficient_overlay.h"
 #include "waveguide/mesh.h"
+#include "waveguide/sparse_layout.h"
 
+#include "core/cl/buffer_pool.h"
 #include "core/cl/common.h"
 #include "core/cl/include.h"
+#include "core/cl/profiling.h"
 #include "core/conversions.h"
 #include "core/exceptions.h"
 
 #include "utilities/aligned/vector.h"
+#include "utilities/instrumentation.h"
 #include "utilities/string_builder.h"
 
 #include <atomic>
@@ -23,6 +29,7 @@
 #include <string>
 #include <cstdio>
 #include <memory>
+#include <vector>
 
 namespace wayverb {
 namespace waveguide {
@@ -31,9 +38,18 @@ namespace waveguide {
 ///
 /// cc:             OpenCL context and device to use
 /// mesh:           contains node placements and surface filter information
+/// coefficients:   boundary filters for this run (optional, defaults to the
+///                 mesh's own coefficients)
 /// pre:            will be run before each step, should inject inputs
 /// post:           will be run after each step, should collect outputs
 /// keep_going:     toggle this from another thread to quit early
+/// storage:        how pressure is stored on the device. pre and post must
+///                 read and write pressure in the same format (see
+///                 pressure_storage.h)
+/// checkpoints:    if supplied, state is saved periodically and when the run
+///                 is cancelled, and a run resumes from the checkpoint's
+///                 state and step count. pre must already be positioned at
+///                 the resumed step (see checkpoint.h)
 ///
 /// returns:        the number of steps completed successfully
 
@@ -49,16 +65,19 @@ namespace waveguide {
 template <typename step_preprocessor, typename step_postprocessor>
 size_t run(const core::compute_context& cc,
            const mesh& mesh,
+           const coefficient_overlay& coefficients,
            step_preprocessor&& pre,
            step_postprocessor&& post,
-           const std::atomic_bool& keep_going) {
+           const std::atomic_bool& keep_going,
+           pressure_storage storage = pressure_storage::single,
+           checkpointer* checkpoints = nullptr) {
 
     const auto num_nodes = mesh.get_structure().get_condensed_nodes().size();
 
-    const program program{cc};
-    cl::CommandQueue queue{cc.context, cc.device};
+    cl::CommandQueue queue{
+            cc.context, cc.device, core::profiling_queue_properties()};
     const auto& nodes_host = mesh.get_structure().get_condensed_nodes();
-    const auto& coefficients_host = mesh.get_structure().get_coefficients();
+    const auto& coefficients_host = coefficients.get_surface_coefficients();
     std::optional<size_t> debug_node;
     if (const char* debug_env = std::getenv("WAYVERB_DEBUG_NODE")) {
         try {
@@ -78,9 +97,19 @@ size_t run(const core::compute_context& cc,
     if (!trace_node && debug_node) {
         trace_node = debug_node;
     }
+    const bool trace_enabled = trace_node.has_value();
+
+    //  Diagnostics are compiled into the kernels only when they're wanted.
+    const program program{cc,
+                          node_storage::dense,
+                          trace_enabled ? kernel_variant::debug
+                                        : kernel_variant::production,
+                          storage};
     const auto make_zeroed_buffer = [&] {
         auto ret = cl::Buffer{
-                cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * num_nodes};
+                cc.context,
+                CL_MEM_READ_WRITE,
+                pressure_size(storage) * num_nodes};
         auto kernel = program.get_zero_buffer_kernel();
         kernel(cl::EnqueueArgs{queue, cl::NDRange{num_nodes}}, ret);
         return ret;
@@ -105,7 +134,6 @@ size_t run(const core::compute_context& cc,
         cl_float b0;
     };
 
-    const bool trace_enabled = trace_node.has_value();
     const size_t trace_capacity = trace_enabled ? static_cast<size_t>(16384) : static_cast<size_t>(1);
     cl::Buffer trace_buffer{
             cc.context,
@@ -159,7 +187,7 @@ size_t run(const core::compute_context& cc,
     const cl_uint num_prev = static_cast<cl_uint>(num_nodes);
 
     const auto node_buffer = core::load_to_buffer(
-            cc.context, mesh.get_structure().get_condensed_nodes(), true);
+            cc, queue, mesh.get_structure().get_condensed_nodes(), true);
 
     cl::Buffer error_flag_buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int)};
     cl::Buffer debug_info_buffer{
@@ -168,36 +196,52 @@ size_t run(const core::compute_context& cc,
     const auto boundary_count = boundary_layout.headers.size();
 
     auto boundary_headers_buffer =
-            core::load_to_buffer(cc.context, boundary_layout.headers, false);
+            core::load_to_buffer(cc, queue, boundary_layout.headers, false);
     auto boundary_sdf_distance_buffer =
-            core::load_to_buffer(cc.context, boundary_layout.sdf_distance, false);
+            core::load_to_buffer(
+                    cc, queue, boundary_layout.sdf_distance, false);
     util::aligned::vector<cl_float3> boundary_normals;
     boundary_normals.reserve(boundary_layout.sdf_normal.size());
     for (const auto& n : boundary_layout.sdf_normal) {
         boundary_normals.emplace_back(core::to_cl_float3{}(n));
     }
     auto boundary_sdf_normal_buffer =
-            core::load_to_buffer(cc.context, boundary_normals, false);
+            core::load_to_buffer(cc, queue, boundary_normals, false);
     auto boundary_coeff_offsets_buffer =
-            core::load_to_buffer(cc.context,
+            core::load_to_buffer(cc,
+                                 queue,
                                  boundary_layout.coeff_block_offsets,
                                  false);
     auto boundary_coeff_blocks_buffer =
             core::load_to_buffer(
-                    cc.context, boundary_layout.coeff_blocks, false);
+                    cc, queue, coefficients.get_coeff_blocks(), false);
     auto boundary_filter_memories_buffer =
-            core::load_to_buffer(cc.context,
+            core::load_to_buffer(cc,
+                                 queue,
                                  boundary_layout.filter_memories,
                                  true);
     auto boundary_lookup_buffer = core::load_to_buffer(
-            cc.context, boundary_layout.node_lookup, true);
+            cc, queue, boundary_layout.node_lookup, true);
     auto boundary_node_indices_buffer =
-            core::load_to_buffer(cc.context,
+            core::load_to_buffer(cc,
+                                 queue,
                                  boundary_layout.node_indices,
                                  true);
 
-    auto kernel = program.get_kernel();
-    auto update_boundary_kernel = program.get_update_boundary_kernel();
+    std::optional<decltype(program.get_kernel())> kernel;
+    std::optional<decltype(program.get_update_boundary_kernel())>
+            update_boundary_kernel;
+    std::optional<decltype(program.get_debug_kernel())> debug_kernel;
+    std::optional<decltype(program.get_debug_update_boundary_kernel())>
+            debug_update_boundary_kernel;
+    if (trace_enabled) {
+        debug_kernel.emplace(program.get_debug_kernel());
+        debug_update_boundary_kernel.emplace(
+                program.get_debug_update_boundary_kernel());
+    } else {
+        kernel.emplace(program.get_kernel());
+        update_boundary_kernel.emplace(program.get_update_boundary_kernel());
+    }
     const bool stage_trace_enabled = std::getenv("WAYVERB_WG_TRACE") != nullptr;
     struct stage_trace_payload {
         std::string name;
@@ -223,7 +267,11 @@ size_t run(const core::compute_context& cc,
     auto attach_trace = [&](const char* name,
                             size_t global_work_size,
                             cl::Event& event) {
-        if (!stage_trace_enabled || event() == nullptr) {
+        if (event() == nullptr) {
+            return;
+        }
+        core::profile_event(name, event);
+        if (!stage_trace_enabled) {
             return;
         }
         auto payload = std::make_unique<stage_trace_payload>();
@@ -250,16 +298,44 @@ size_t run(const core::compute_context& cc,
     //  run
     auto step = 0u;
 
+    const auto resume = checkpoints ? checkpoints->get_resume() : nullptr;
+    if (resume) {
+        const auto restore = [&](cl::Buffer& buffer, const auto& bytes) {
+            if (bytes.size() != buffer.getInfo<CL_MEM_SIZE>()) {
+                throw std::runtime_error{
+                        "Checkpoint doesn't match this mesh."};
+            }
+            queue.enqueueWriteBuffer(
+                    buffer, CL_TRUE, 0, bytes.size(), bytes.data());
+        };
+        restore(previous, resume->previous);
+        restore(current, resume->current);
+        restore(boundary_filter_memories_buffer, resume->filter_memories);
+        step = resume->step;
+    }
+    auto last_checkpoint = step;
+
     //  The preprocessor returns 'true' while it should be run.
     //  It also updates the mesh with new pressure values.
-    for (; pre(queue, current, step) && keep_going && step < max_steps;
+    //  Cancellation is checked first, so that a cancelled run's state hasn't
+    //  seen the next step's input and can be checkpointed.
+    const auto probe_prev_output =
+            debug_node ? core::pooled_buffer{cc,
+                                             sizeof(cl_float),
+                                             CL_MEM_WRITE_ONLY}
+                       : core::pooled_buffer{};
+    util::instrumentation::batch_timer steps_timer{"waveguide/steps", 64};
+    for (; keep_going && step < max_steps && pre(queue, current, step);
          ++step) {
         queue.enqueueCopyBuffer(
-                previous, previous_history, 0, 0, sizeof(cl_float) * num_nodes);
+                previous,
+                previous_history,
+                0,
+                0,
+                pressure_size(storage) * num_nodes);
         if (debug_node && step == 0) {
             const auto idx = *debug_node;
             auto probe_prev_kernel = program.get_probe_previous_kernel();
-            cl::Buffer probe_prev_output{cc.context, CL_MEM_WRITE_ONLY, sizeof(cl_float)};
             probe_prev_kernel(cl::EnqueueArgs{queue, cl::NDRange{1}},
                               previous,
                               static_cast<cl_uint>(idx),
@@ -273,8 +349,10 @@ size_t run(const core::compute_context& cc,
                     mesh.get_descriptor(), idx);
             const auto neighbors =
                     waveguide::compute_neighbors(mesh.get_descriptor(), idx);
-            const auto current_val = core::read_value<float>(queue, current, idx);
-            const auto previous_val = core::read_value<float>(queue, previous, idx);
+            const auto current_val =
+                    read_pressure(queue, current, idx, storage);
+            const auto previous_val =
+                    read_pressure(queue, previous, idx, storage);
             const auto boundary_type_value = nodes_host[idx].boundary_type;
             std::cerr << "[waveguide] DEBUG pre-step node " << idx
                       << " locator(" << locator.x << ", " << locator.y
@@ -293,23 +371,23 @@ size_t run(const core::compute_context& cc,
             if (layout_index != std::numeric_limits<uint32_t>::max()) {
                 const auto& header = boundary_layout.headers[layout_index];
                 const auto normal = boundary_layout.sdf_normal[layout_index];
-                std::cout << "  boundary_layout idx=" << layout_index
+                std::cerr << "  boundary_layout idx=" << layout_index
                           << " guard=0x" << std::hex << header.guard << std::dec
                           << " dif=0x" << std::hex << header.dif << std::dec
                           << " material=" << header.material_index << '\n';
-                std::cout << "  sdf_distance="
+                std::cerr << "  sdf_distance="
                           << boundary_layout.sdf_distance[layout_index]
                           << " normal=(" << normal.x << ", " << normal.y
                           << ", " << normal.z << ")\n";
             } else {
-                std::cout << "  node not registered in boundary layout\n";
+                std::cerr << "  node not registered in boundary layout\n";
             }
         }
 
 
         //  set flag state to successful
         core::write_value(queue, error_flag_buffer, 0, id_success);
-        {
+        if (trace_enabled) {
             const cl_int pattern = static_cast<cl_int>(0xCDCDCDCD);
             queue.enqueueFillBuffer(
                     debug_info_buffer,
@@ -319,31 +397,46 @@ size_t run(const core::compute_context& cc,
         }
 
         //  run kernel
-        cl::Event pressure_event = kernel(
-                cl::EnqueueArgs(queue,
-                                cl::NDRange(mesh.get_structure()
-                                                    .get_condensed_nodes()
-                                                    .size())),
-                previous,
-                current,
-                node_buffer,
-                mesh.get_descriptor().dimensions,
-                boundary_headers_buffer,
-                boundary_sdf_distance_buffer,
-                boundary_sdf_normal_buffer,
-                boundary_coeff_offsets_buffer,
-                boundary_coeff_blocks_buffer,
-                boundary_filter_memories_buffer,
-                boundary_lookup_buffer,
-                error_flag_buffer,
-                debug_info_buffer,
-                num_prev,
-                trace_target,
-                trace_buffer,
-                trace_head_buffer,
-                trace_capacity_uint,
-                trace_enabled_flag,
-                static_cast<cl_uint>(step));
+        const auto pressure_range = cl::EnqueueArgs(
+                queue,
+                cl::NDRange(mesh.get_structure().get_condensed_nodes().size()));
+        cl::Event pressure_event =
+                trace_enabled
+                        ? (*debug_kernel)(pressure_range,
+                                          previous,
+                                          current,
+                                          node_buffer,
+                                          mesh.get_descriptor().dimensions,
+                                          boundary_headers_buffer,
+                                          boundary_sdf_distance_buffer,
+                                          boundary_sdf_normal_buffer,
+                                          boundary_coeff_offsets_buffer,
+                                          boundary_coeff_blocks_buffer,
+                                          boundary_filter_memories_buffer,
+                                          boundary_lookup_buffer,
+                                          error_flag_buffer,
+                                          debug_info_buffer,
+                                          num_prev,
+                                          trace_target,
+                                          trace_buffer,
+                                          trace_head_buffer,
+                                          trace_capacity_uint,
+                                          trace_enabled_flag,
+                                          static_cast<cl_uint>(step))
+                        : (*kernel)(pressure_range,
+                                    previous,
+                                    current,
+                                    node_buffer,
+                                    mesh.get_descriptor().dimensions,
+                                    boundary_headers_buffer,
+                                    boundary_sdf_distance_buffer,
+                                    boundary_sdf_normal_buffer,
+                                    boundary_coeff_offsets_buffer,
+                                    boundary_coeff_blocks_buffer,
+                                    boundary_filter_memories_buffer,
+                                    boundary_lookup_buffer,
+                                    error_flag_buffer,
+                                    num_prev);
         attach_trace("pressure",
                      mesh.get_structure().get_condensed_nodes().size(),
                      pressure_event);
@@ -361,11 +454,16 @@ size_t run(const core::compute_context& cc,
                 std::cerr << "[waveguide][" << stage
                           << "] error_flag=" << error_flag << '\n';
                 dump_trace(stage);
+                //  Scanning the whole mesh is slow, so only do it when
+                //  debugging.
                 const auto log_non_finite = [&](const char* label) {
+                    if (!trace_enabled) {
+                        return;
+                    }
                     const auto report = [&](const char* which,
                                             const cl::Buffer& buffer) {
                         auto values =
-                                core::read_from_buffer<float>(queue, buffer);
+                                read_pressures(queue, buffer, storage);
                         const auto it = std::find_if(
                                 values.begin(), values.end(), [](float v) {
                                     return !std::isfinite(v);
@@ -390,7 +488,6 @@ size_t run(const core::compute_context& cc,
                     report("current", current);
                     report("previous", previous);
                 };
-;
 
             if (error_flag & id_inf_error) {
                 log_non_finite("INF");
@@ -399,54 +496,57 @@ size_t run(const core::compute_context& cc,
             }
 
             if (error_flag & id_nan_error) {
-                auto debug_raw = core::read_from_buffer<cl_int>(
-                        queue, debug_info_buffer);
-                std::cerr << "  debug_raw[0..3]=";
-                for (int i = 0; i < 4 && i < (int)debug_raw.size(); ++i) {
-                    std::cerr << " 0x" << std::hex << debug_raw[i] << std::dec;
-                }
-                std::cerr << '\n';
-                auto debug_info =
-                        core::read_from_buffer<cl_int>(queue, debug_info_buffer);
-                if (!debug_info.empty()) {
-                    const auto bits_to_float = [](cl_int bits) {
-                        union {
-                            cl_uint u;
-                            float f;
-                        } converter{static_cast<cl_uint>(bits)};
-                        return converter.f;
-                    };
-                    const auto safe_get = [&](size_t index) -> cl_int {
-                        return debug_info.size() > index ? debug_info[index] : -1;
-                    };
-                    std::cerr << "[waveguide] nan-debug (size=" << debug_info.size()
-                              << ") code=" << safe_get(0)
-                              << " node=" << safe_get(1)
-                              << " boundary_index=" << safe_get(2)
-                              << " local_idx=" << safe_get(3)
-                              << " coeff_index=" << safe_get(4)
-                              << " filt_state_bits=" << safe_get(5)
-                              << " a0_bits=" << safe_get(6)
-                              << " b0_bits=" << safe_get(7)
-                              << " diff_bits=" << safe_get(8)
-                              << " filter_in_bits=" << safe_get(9)
-                              << " prev_bits=" << safe_get(10)
-                              << " next_bits=" << safe_get(11) << '\n';
-                    if (debug_info.size() > 11) {
-                        std::cerr << "  decoded: filt_state="
-                                  << bits_to_float(debug_info[5])
-                                  << " a0="
-                                  << bits_to_float(debug_info[6])
-                                  << " b0="
-                                  << bits_to_float(debug_info[7])
-                                  << " diff="
-                                  << bits_to_float(debug_info[8])
-                                  << " filter_input="
-                                  << bits_to_float(debug_info[9])
-                                  << " prev_pressure="
-                                  << bits_to_float(debug_info[10])
-                                  << " next_pressure="
-                                  << bits_to_float(debug_info[11]) << '\n';
+                //  Only the debug kernels record diagnostics.
+                if (trace_enabled) {
+                    auto debug_raw = core::read_from_buffer<cl_int>(
+                            queue, debug_info_buffer);
+                    std::cerr << "  debug_raw[0..3]=";
+                    for (int i = 0; i < 4 && i < (int)debug_raw.size(); ++i) {
+                        std::cerr << " 0x" << std::hex << debug_raw[i] << std::dec;
+                    }
+                    std::cerr << '\n';
+                    auto debug_info =
+                            core::read_from_buffer<cl_int>(queue, debug_info_buffer);
+                    if (!debug_info.empty()) {
+                        const auto bits_to_float = [](cl_int bits) {
+                            union {
+                                cl_uint u;
+                                float f;
+                            } converter{static_cast<cl_uint>(bits)};
+                            return converter.f;
+                        };
+                        const auto safe_get = [&](size_t index) -> cl_int {
+                            return debug_info.size() > index ? debug_info[index] : -1;
+                        };
+                        std::cerr << "[waveguide] nan-debug (size=" << debug_info.size()
+                                  << ") code=" << safe_get(0)
+                                  << " node=" << safe_get(1)
+                                  << " boundary_index=" << safe_get(2)
+                                  << " local_idx=" << safe_get(3)
+                                  << " coeff_index=" << safe_get(4)
+                                  << " filt_state_bits=" << safe_get(5)
+                                  << " a0_bits=" << safe_get(6)
+                                  << " b0_bits=" << safe_get(7)
+                                  << " diff_bits=" << safe_get(8)
+                                  << " filter_in_bits=" << safe_get(9)
+                                  << " prev_bits=" << safe_get(10)
+                                  << " next_bits=" << safe_get(11) << '\n';
+                        if (debug_info.size() > 11) {
+                            std::cerr << "  decoded: filt_state="
+                                      << bits_to_float(debug_info[5])
+                                      << " a0="
+                                      << bits_to_float(debug_info[6])
+                                      << " b0="
+                                      << bits_to_float(debug_info[7])
+                                      << " diff="
+                                      << bits_to_float(debug_info[8])
+                                      << " filter_input="
+                                      << bits_to_float(debug_info[9])
+                                      << " prev_pressure="
+                                      << bits_to_float(debug_info[10])
+                                      << " next_pressure="
+                                      << bits_to_float(debug_info[11]) << '\n';
+                        }
                     }
                 }
                 log_non_finite("NaN");
@@ -456,7 +556,9 @@ size_t run(const core::compute_context& cc,
 
             if (error_flag & id_outside_mesh_error) {
                 const auto debug_info =
-                        core::read_from_buffer<cl_int>(queue, debug_info_buffer);
+                        trace_enabled ? core::read_from_buffer<cl_int>(
+                                                queue, debug_info_buffer)
+                                      : util::aligned::vector<cl_int>{};
                 if (debug_info.size() >= 7) {
                     std::cerr << "[waveguide] outside-mesh debug: node="
                               << debug_info[1] << " locator=(" << debug_info[2]
@@ -480,33 +582,52 @@ size_t run(const core::compute_context& cc,
                 return;
             }
             core::write_value(queue, error_flag_buffer, 0, id_success);
-            const cl_int pattern = static_cast<cl_int>(0xCDCDCDCD);
-            queue.enqueueFillBuffer(
-                    debug_info_buffer, pattern, 0, sizeof(cl_int) * 12);
-            cl::Event stage_event =
-                    update_boundary_kernel(cl::EnqueueArgs(
-                                                   queue,
-                                                   cl::NDRange(boundary_count)),
-                                           previous_history,
-                                           current,
-                                           previous,
-                                           node_buffer,
-                                           mesh.get_descriptor().dimensions,
-                                           boundary_node_indices_buffer,
-                                           boundary_headers_buffer,
-                                           boundary_coeff_offsets_buffer,
-                                           boundary_coeff_blocks_buffer,
-                                           boundary_filter_memories_buffer,
-                                           boundary_lookup_buffer,
-                                           error_flag_buffer,
-                                           debug_info_buffer,
-                                           trace_target,
-                                           trace_buffer,
-                                           trace_head_buffer,
-                                           trace_capacity_uint,
-                                           trace_enabled_flag,
-                                           static_cast<cl_uint>(step),
-                                           static_cast<cl_uint>(boundary_count));
+            const auto boundary_range =
+                    cl::EnqueueArgs(queue, cl::NDRange(boundary_count));
+            cl::Event stage_event;
+            if (trace_enabled) {
+                const cl_int pattern = static_cast<cl_int>(0xCDCDCDCD);
+                queue.enqueueFillBuffer(
+                        debug_info_buffer, pattern, 0, sizeof(cl_int) * 12);
+                stage_event = (*debug_update_boundary_kernel)(
+                        boundary_range,
+                        previous_history,
+                        current,
+                        previous,
+                        node_buffer,
+                        mesh.get_descriptor().dimensions,
+                        boundary_node_indices_buffer,
+                        boundary_headers_buffer,
+                        boundary_coeff_offsets_buffer,
+                        boundary_coeff_blocks_buffer,
+                        boundary_filter_memories_buffer,
+                        boundary_lookup_buffer,
+                        error_flag_buffer,
+                        debug_info_buffer,
+                        trace_target,
+                        trace_buffer,
+                        trace_head_buffer,
+                        trace_capacity_uint,
+                        trace_enabled_flag,
+                        static_cast<cl_uint>(step),
+                        static_cast<cl_uint>(boundary_count));
+            } else {
+                stage_event = (*update_boundary_kernel)(
+                        boundary_range,
+                        previous_history,
+                        current,
+                        previous,
+                        node_buffer,
+                        mesh.get_descriptor().dimensions,
+                        boundary_node_indices_buffer,
+                        boundary_headers_buffer,
+                        boundary_coeff_offsets_buffer,
+                        boundary_coeff_blocks_buffer,
+                        boundary_filter_memories_buffer,
+                        boundary_lookup_buffer,
+                        error_flag_buffer,
+                        static_cast<cl_uint>(boundary_count));
+            }
             attach_trace(stage_name, boundary_count, stage_event);
             if (stage_event() != nullptr) {
                 stage_event.wait();
@@ -519,12 +640,401 @@ size_t run(const core::compute_context& cc,
         run_boundary_update("boundary");
 
         post(queue, current, step);
+        steps_timer.tick();
 
         std::swap(previous, current);
+
+        if (checkpoints && checkpoints->is_due(step + 1)) {
+            checkpoints->snapshot(queue,
+                                  previous,
+                                  current,
+                                  boundary_filter_memories_buffer,
+                                  step + 1);
+            last_checkpoint = step + 1;
+        }
+    }
+    if (checkpoints && !keep_going && last_checkpoint != step) {
+        //  Keep the work done so far, so that it can be resumed.
+        checkpoints->snapshot(queue,
+                              previous,
+                              current,
+                              boundary_filter_memories_buffer,
+                              step);
     }
     dump_trace("completed");
     return step;
 }
 
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run(const core::compute_context& cc,
+           const mesh& mesh,
+           step_preprocessor&& pre,
+           step_postprocessor&& post,
+           const std::atomic_bool& keep_going,
+           pressure_storage storage = pressure_storage::single,
+           checkpointer* checkpoints = nullptr) {
+    return run(cc,
+               mesh,
+               coefficient_overlay{mesh},
+               std::forward<step_preprocessor>(pre),
+               std::forward<step_postprocessor>(post),
+               keep_going,
+               storage,
+               checkpoints);
+}
+
+/// Runs one simulation per entry of `band_coefficients` in a single
+/// time-stepping pass. The bands share geometry and differ only in boundary
+/// coefficients, so each node's topology is loaded once per step and every
+/// band is advanced from it.
+///
+/// Every band is driven by the same soft source: each step adds the next
+/// sample of [input_begin, input_end) to `source_index` in all bands at once,
+/// and the run ends when the input does.
+///
+/// Pressure is stored as one plane per band. `post` is called once per step
+/// with a sub-buffer for each plane, which indexes exactly like the
+/// single-band pressure buffer:
+///     void post(cl::CommandQueue&, const std::vector<cl::Buffer>& planes,
+///               size_t)
+///
+/// returns:        the number of steps completed successfully
+template <typename It, typename step_postprocessor>
+size_t run_multiband(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        const util::aligned::vector<coefficient_overlay>& band_coefficients,
+        size_t source_index,
+        It input_begin,
+        It input_end,
+        step_postprocessor&& post,
+        const std::atomic_bool& keep_going) {
+    const auto& nodes = mesh.get_structure().get_condensed_nodes();
+    const auto& boundary_layout = mesh.get_structure().get_boundary_layout();
+    const auto num_nodes = nodes.size();
+    const auto boundary_count = boundary_layout.headers.size();
+    const auto bands = band_coefficients.size();
+
+    const program program{cc};
+    cl::CommandQueue queue{
+            cc.context, cc.device, core::profiling_queue_properties()};
+
+    //  Planes are sub-buffers of one allocation, so each must start on the
+    //  device's base address alignment.
+    const auto align_floats = std::max<size_t>(
+            1,
+            cc.device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() /
+                    (8 * sizeof(cl_float)));
+    const auto plane_stride =
+            (num_nodes + align_floats - 1) / align_floats * align_floats;
+    const auto total = plane_stride * bands;
+
+    const auto make_zeroed_buffer = [&] {
+        auto ret = cl::Buffer{
+                cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * total};
+        auto kernel = program.get_zero_buffer_kernel();
+        kernel(cl::EnqueueArgs{queue, cl::NDRange{total}}, ret);
+        return ret;
+    };
+
+    const auto make_planes = [&](cl::Buffer& buffer) {
+        std::vector<cl::Buffer> ret;
+        ret.reserve(bands);
+        for (size_t band = 0; band != bands; ++band) {
+            const cl_buffer_region region{
+                    sizeof(cl_float) * band * plane_stride,
+                    sizeof(cl_float) * num_nodes};
+            ret.emplace_back(buffer.createSubBuffer(
+                    CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region));
+        }
+        return ret;
+    };
+
+    auto previous = make_zeroed_buffer();
+    auto current = make_zeroed_buffer();
+    auto previous_history = make_zeroed_buffer();
+    auto previous_planes = make_planes(previous);
+    auto current_planes = make_planes(current);
+
+    //  One copy of the coefficient blocks and filter memories per band.
+    util::aligned::vector<coefficients_canonical> coeff_blocks;
+    util::aligned::vector<memory_canonical> filter_memories;
+    for (const auto& overlay : band_coefficients) {
+        const auto& blocks = overlay.get_coeff_blocks();
+        coeff_blocks.insert(coeff_blocks.end(), blocks.begin(), blocks.end());
+        filter_memories.insert(filter_memories.end(),
+                               boundary_layout.filter_memories.begin(),
+                               boundary_layout.filter_memories.end());
+    }
+    const auto coeff_stride =
+            static_cast<cl_uint>(boundary_layout.coeff_blocks.size());
+    const auto memory_stride =
+            static_cast<cl_uint>(boundary_layout.filter_memories.size());
+
+    //  Zero-sized buffers are invalid, so keep at least one element.
+    if (coeff_blocks.empty()) {
+        coeff_blocks.resize(1);
+    }
+    if (filter_memories.empty()) {
+        filter_memories.resize(1);
+    }
+
+    const auto node_buffer = core::load_to_buffer(cc, queue, nodes, true);
+    const auto load_or_placeholder = [&](const auto& v, bool read_only) {
+        using value_type = typename std::decay_t<decltype(v)>::value_type;
+        return v.empty() ? core::load_to_buffer(
+                                   cc,
+                                   queue,
+                                   util::aligned::vector<value_type>(1),
+                                   read_only)
+                         : core::load_to_buffer(cc, queue, v, read_only);
+    };
+    auto boundary_headers_buffer =
+            load_or_placeholder(boundary_layout.headers, false);
+    auto boundary_coeff_offsets_buffer =
+            load_or_placeholder(boundary_layout.coeff_block_offsets, false);
+    auto boundary_lookup_buffer =
+            load_or_placeholder(boundary_layout.node_lookup, true);
+    auto boundary_node_indices_buffer =
+            load_or_placeholder(boundary_layout.node_indices, true);
+    auto coeff_blocks_buffer =
+            core::load_to_buffer(cc, queue, coeff_blocks, false);
+    auto filter_memories_buffer =
+            core::load_to_buffer(cc, queue, filter_memories, false);
+
+    cl::Buffer error_flag_buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int)};
+
+    const auto check_error = [&] {
+        const auto error_flag =
+                core::read_value<error_code>(queue, error_flag_buffer, 0);
+        if (error_flag & id_inf_error) {
+            throw core::exceptions::value_is_inf(
+                    "Pressure value is inf, check filter coefficients.");
+        }
+        if (error_flag & id_nan_error) {
+            throw core::exceptions::value_is_nan(
+                    "Pressure value is nan, check filter coefficients.");
+        }
+        if (error_flag & id_outside_mesh_error) {
+            throw std::runtime_error("Tried to read non-existant node.");
+        }
+        if (error_flag & id_suspicious_boundary_error) {
+            throw std::runtime_error("Suspicious boundary read.");
+        }
+    };
+
+    auto kernel = program.get_multiband_kernel();
+    auto update_boundary_kernel = program.get_update_boundary_multiband_kernel();
+    auto source_kernel = program.get_add_to_node_multiband_kernel();
+
+    auto step = 0u;
+    util::instrumentation::batch_timer steps_timer{"waveguide/steps", 64};
+    for (; input_begin != input_end && keep_going; ++input_begin, ++step) {
+        source_kernel(cl::EnqueueArgs(queue, cl::NDRange(bands)),
+                      current,
+                      static_cast<cl_uint>(source_index),
+                      static_cast<cl_float>(*input_begin),
+                      static_cast<cl_uint>(plane_stride));
+
+        queue.enqueueCopyBuffer(
+                previous, previous_history, 0, 0, sizeof(cl_float) * total);
+
+        core::write_value(queue, error_flag_buffer, 0, id_success);
+
+        kernel(cl::EnqueueArgs(queue, cl::NDRange(num_nodes)),
+               previous,
+               current,
+               node_buffer,
+               mesh.get_descriptor().dimensions,
+               boundary_headers_buffer,
+               boundary_coeff_offsets_buffer,
+               coeff_blocks_buffer,
+               filter_memories_buffer,
+               boundary_lookup_buffer,
+               error_flag_buffer,
+               static_cast<cl_uint>(num_nodes),
+               static_cast<cl_uint>(bands),
+               static_cast<cl_uint>(plane_stride),
+               coeff_stride,
+               memory_stride);
+
+        if (boundary_count != 0) {
+            update_boundary_kernel(
+                    cl::EnqueueArgs(queue, cl::NDRange(boundary_count)),
+                    previous_history,
+                    current,
+                    previous,
+                    node_buffer,
+                    boundary_node_indices_buffer,
+                    boundary_headers_buffer,
+                    boundary_coeff_offsets_buffer,
+                    coeff_blocks_buffer,
+                    filter_memories_buffer,
+                    boundary_lookup_buffer,
+                    error_flag_buffer,
+                         static_cast<cl_uint>(boundary_count),
+                    static_cast<cl_uint>(bands),
+                    static_cast<cl_uint>(plane_stride),
+                    coeff_stride,
+                    memory_stride);
+        }
+
+        //  One read covers both kernels; the flag is sticky across them.
+        check_error();
+
+        post(queue, static_cast<const std::vector<cl::Buffer>&>(current_planes),
+             step);
+        steps_timer.tick();
+
+        std::swap(previous, current);
+        std::swap(previous_planes, current_planes);
+    }
+    return step;
+}
+
+/// As run, but only the nodes kept by `layout` are stored and updated.
+///
+/// `pre` and `post` receive the compacted pressure buffer, so sources and
+/// receivers must be placed using compute_compact_index and, for
+/// directional receivers, the layout's neighbour table.
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run_sparse(const core::compute_context& cc,
+                  const mesh& mesh,
+                  const sparse_layout& layout,
+                  const coefficient_overlay& coefficients,
+                  step_preprocessor&& pre,
+                  step_postprocessor&& post,
+                  const std::atomic_bool& keep_going) {
+    const auto& boundary_layout = layout.boundaries;
+    const auto num_nodes = layout.nodes.size();
+    const auto boundary_count = boundary_layout.headers.size();
+
+    const program program{cc, node_storage::sparse};
+    cl::CommandQueue queue{
+            cc.context, cc.device, core::profiling_queue_properties()};
+
+    const auto make_zeroed_buffer = [&] {
+        auto ret = cl::Buffer{
+                cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * num_nodes};
+        auto kernel = program.get_zero_buffer_kernel();
+        kernel(cl::EnqueueArgs{queue, cl::NDRange{num_nodes}}, ret);
+        return ret;
+    };
+
+    auto previous = make_zeroed_buffer();
+    auto current = make_zeroed_buffer();
+    auto previous_history = make_zeroed_buffer();
+
+    const auto load_or_placeholder = [&](const auto& v, bool read_only) {
+        using value_type = typename std::decay_t<decltype(v)>::value_type;
+        return v.empty() ? core::load_to_buffer(
+                                   cc,
+                                   queue,
+                                   util::aligned::vector<value_type>(1),
+                                   read_only)
+                         : core::load_to_buffer(cc, queue, v, read_only);
+    };
+    const auto node_buffer =
+            core::load_to_buffer(cc, queue, layout.nodes, true);
+    const auto neighbor_buffer =
+            core::load_to_buffer(cc, queue, layout.neighbors, true);
+    auto boundary_headers_buffer =
+            load_or_placeholder(boundary_layout.headers, false);
+    auto boundary_sdf_distance_buffer =
+            load_or_placeholder(boundary_layout.sdf_distance, false);
+    auto boundary_sdf_normal_buffer = load_or_placeholder(
+            util::map_to_vector(begin(boundary_layout.sdf_normal),
+                                end(boundary_layout.sdf_normal),
+                                core::to_cl_float3{}),
+            false);
+    auto boundary_coeff_offsets_buffer =
+            load_or_placeholder(boundary_layout.coeff_block_offsets, false);
+    auto coeff_blocks_buffer =
+            load_or_placeholder(coefficients.get_coeff_blocks(), false);
+    auto filter_memories_buffer =
+            load_or_placeholder(boundary_layout.filter_memories, false);
+    auto boundary_lookup_buffer =
+            load_or_placeholder(boundary_layout.node_lookup, true);
+    auto boundary_node_indices_buffer =
+            load_or_placeholder(boundary_layout.node_indices, true);
+
+    cl::Buffer error_flag_buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int)};
+
+    const auto check_error = [&] {
+        const auto error_flag =
+                core::read_value<error_code>(queue, error_flag_buffer, 0);
+        if (error_flag & id_inf_error) {
+            throw core::exceptions::value_is_inf(
+                    "Pressure value is inf, check filter coefficients.");
+        }
+        if (error_flag & id_nan_error) {
+            throw core::exceptions::value_is_nan(
+                    "Pressure value is nan, check filter coefficients.");
+        }
+        if (error_flag & id_outside_mesh_error) {
+            throw std::runtime_error("Tried to read non-existant node.");
+        }
+        if (error_flag & id_suspicious_boundary_error) {
+            throw std::runtime_error("Suspicious boundary read.");
+        }
+    };
+
+    auto kernel = program.get_sparse_kernel();
+    auto update_boundary_kernel = program.get_update_boundary_kernel();
+
+    auto step = 0u;
+    util::instrumentation::batch_timer steps_timer{"waveguide/steps", 64};
+    for (; pre(queue, current, step) && keep_going; ++step) {
+        queue.enqueueCopyBuffer(previous,
+                                previous_history,
+                                0,
+                                0,
+                                sizeof(cl_float) * num_nodes);
+
+        core::write_value(queue, error_flag_buffer, 0, id_success);
+
+        kernel(cl::EnqueueArgs(queue, cl::NDRange(num_nodes)),
+               previous,
+               current,
+               node_buffer,
+               neighbor_buffer,
+               boundary_headers_buffer,
+               boundary_sdf_distance_buffer,
+               boundary_sdf_normal_buffer,
+               boundary_coeff_offsets_buffer,
+               coeff_blocks_buffer,
+               filter_memories_buffer,
+               boundary_lookup_buffer,
+               error_flag_buffer,
+               static_cast<cl_uint>(num_nodes));
+
+        if (boundary_count != 0) {
+            update_boundary_kernel(
+                    cl::EnqueueArgs(queue, cl::NDRange(boundary_count)),
+                    previous_history,
+                    current,
+                    previous,
+                    node_buffer,
+                    mesh.get_descriptor().dimensions,
+                    boundary_node_indices_buffer,
+                    boundary_headers_buffer,
+                    boundary_coeff_offsets_buffer,
+                    coeff_blocks_buffer,
+                    filter_memories_buffer,
+                    boundary_lookup_buffer,
+                    error_flag_buffer,
+                    static_cast<cl_uint>(boundary_count));
+        }
+
+        check_error();
+
+        post(queue, current, step);
+        steps_timer.tick();
+
+        std::swap(previous, current);
+    }
+    return step;
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
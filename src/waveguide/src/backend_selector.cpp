@@ -20,6 +20,11 @@ waveguide_backend select_backend() {
                           << value << ")\n";
                 return waveguide_backend::bempp_cpu;
             }
+            if (value == "cpu") {
+                std::cerr << "[waveguide] Selecting CPU backend (WAYVERB_WG_BACKEND="
+                          << value << ")\n";
+                return waveguide_backend::cpu;
+            }
             if (value != "opencl") {
                 std::cerr << "[waveguide] Unknown WAYVERB_WG_BACKEND value '" << value
                           << "'. Falling back to OpenCL backend.\n";
@@ -30,5 +35,64 @@ waveguide_backend select_backend() {
     return backend;
 }
 
+node_storage select_node_storage() {
+    static const node_storage storage = [] {
+        const char* env = std::getenv("WAYVERB_WG_SPARSE");
+        if (env && *env && std::string{env} != "0") {
+            std::cerr << "[waveguide] Selecting sparse node storage "
+                         "(WAYVERB_WG_SPARSE="
+                      << env << ")\n";
+            return node_storage::sparse;
+        }
+        return node_storage::dense;
+    }();
+    return storage;
+}
+
+pressure_storage select_pressure_storage() {
+    static const pressure_storage storage = [] {
+        const char* env = std::getenv("WAYVERB_WG_HALF");
+        if (!(env && *env && std::string{env} != "0")) {
+            return pressure_storage::single;
+        }
+        if (select_node_storage() == node_storage::sparse) {
+            std::cerr << "[waveguide] sparse node storage is single precision "
+                         "only, ignoring WAYVERB_WG_HALF\n";
+            return pressure_storage::single;
+        }
+        std::cerr << "[waveguide] Selecting half precision pressure storage "
+                     "(WAYVERB_WG_HALF="
+                  << env << ")\n";
+        return pressure_storage::half;
+    }();
+    return storage;
+}
+
+node_ordering select_node_ordering() {
+    const char* env = std::getenv("WAYVERB_WG_SPARSE");
+    return env && std::string{env} == "morton" ? node_ordering::morton
+                                               : node_ordering::dense;
+}
+
+size_t select_subdomains() {
+    const char* env = std::getenv("WAYVERB_WG_SLABS");
+    const auto slabs = env ? std::strtoull(env, nullptr, 10) : 0;
+    return slabs != 0 ? slabs : 1;
+}
+
+std::optional<std::string> select_checkpoint_directory() {
+    const char* env = std::getenv("WAYVERB_CHECKPOINT");
+    if (env && *env) {
+        return std::string{env};
+    }
+    return std::nullopt;
+}
+
+size_t select_checkpoint_interval() {
+    const char* env = std::getenv("WAYVERB_CHECKPOINT_INTERVAL");
+    const auto interval = env ? std::strtoull(env, nullptr, 10) : 0;
+    return interval != 0 ? interval : 10000;
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
@@ -48,19 +48,6 @@ inline bool is_boundary_node(boundary_type bt) {
     return is_boundary<1>(bt) || is_boundary<2>(bt) || is_boundary<3>(bt);
 }
 
-uint64_t encode_morton3D(uint32_t x, uint32_t y, uint32_t z) {
-    auto part = [](uint32_t v) {
-        uint64_t x = v;
-        x = (x | (x << 32)) & 0x1F00000000FFFF;
-        x = (x | (x << 16)) & 0x1F0000FF0000FF;
-        x = (x | (x << 8)) & 0x100F00F00F00F00F;
-        x = (x | (x << 4)) & 0x10C30C30C30C30C3;
-        x = (x | (x << 2)) & 0x1249249249249249;
-        return x;
-    };
-    return (part(z) << 2) | (part(y) << 1) | part(x);
-}
-
 struct signed_distance_solver final {
     signed_distance_solver(
             const mesh_descriptor& descriptor,
@@ -277,10 +264,7 @@ boundary_layout build_boundary_layout(
         }
         const auto locator =
                 compute_locator(descriptor, static_cast<uint32_t>(idx));
-        const uint64_t morton = encode_morton3D(
-                static_cast<uint32_t>(locator.x),
-                static_cast<uint32_t>(locator.y),
-                static_cast<uint32_t>(locator.z));
+        const uint64_t morton = compute_morton_index(locator);
         entries.push_back(boundary_entry{
                 idx, locator, morton, static_cast<boundary_type>(type)});
     }
@@ -344,6 +328,7 @@ boundary_layout build_boundary_layout(
             } else {
                 layout.coeff_blocks.emplace_back(surface_coeffs[coeff_idx]);
             }
+            layout.coeff_block_surfaces.emplace_back(coeff_idx);
         }
 
         const uint32_t block_id = block_offset / kFaceBits.size();
@@ -363,5 +348,19 @@ boundary_layout build_boundary_layout(
     return layout;
 }
 
+util::aligned::vector<coefficients_canonical> make_coeff_blocks(
+        const boundary_layout& layout,
+        const util::aligned::vector<coefficients_canonical>& surface_coeffs) {
+    const auto coeff_identity = identity_coefficients();
+    util::aligned::vector<coefficients_canonical> ret;
+    ret.reserve(layout.coeff_block_surfaces.size());
+    for (const auto surface : layout.coeff_block_surfaces) {
+        ret.emplace_back(surface == std::numeric_limits<uint32_t>::max()
+                                 ? coeff_identity
+                                 : surface_coeffs.at(surface));
+    }
+    return ret;
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
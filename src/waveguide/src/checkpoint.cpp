@@ -0,0 +1,204 @@
+#include "waveguide/checkpoint.h"
+
+#include "cereal/archives/binary.hpp"
+#include "cereal/types/vector.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+
+constexpr std::uint32_t checkpoint_magic = 0x4b435657;  //  "WVCK"
+constexpr std::uint32_t checkpoint_version = 1;
+
+template <typename Archive, typename Checkpoint>
+void archive_fields(Archive& archive, Checkpoint& c) {
+    archive(c.run_key,
+            c.step,
+            c.previous,
+            c.current,
+            c.filter_memories,
+            c.receivers);
+}
+
+}  // namespace
+
+std::string make_checkpoint_path(const std::string& directory,
+                                 std::uint64_t run_key) {
+    std::filesystem::create_directories(directory);
+    std::ostringstream name;
+    name << "wayverb-" << std::hex << std::setw(16) << std::setfill('0')
+         << run_key << ".checkpoint";
+    return (std::filesystem::path{directory} / name.str()).string();
+}
+
+void write_checkpoint(const std::string& path, const checkpoint& c) {
+    const auto temporary = path + ".tmp";
+    {
+        std::ofstream file{temporary, std::ios::binary};
+        if (!file) {
+            throw std::runtime_error{"Can't open checkpoint file " +
+                                     temporary};
+        }
+        cereal::BinaryOutputArchive archive{file};
+        archive(checkpoint_magic, checkpoint_version);
+        archive_fields(archive, c);
+        if (!file) {
+            throw std::runtime_error{"Failed writing checkpoint " + temporary};
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error{"Can't replace checkpoint " + path};
+    }
+}
+
+checkpoint read_checkpoint(const std::string& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        throw std::runtime_error{"Can't open checkpoint file " + path};
+    }
+    cereal::BinaryInputArchive archive{file};
+    std::uint32_t magic{};
+    std::uint32_t version{};
+    archive(magic, version);
+    if (magic != checkpoint_magic || version != checkpoint_version) {
+        throw std::runtime_error{path + " is not a compatible checkpoint"};
+    }
+    checkpoint ret;
+    archive_fields(archive, ret);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+checkpointer::checkpointer(std::string path,
+                           size_t interval,
+                           std::uint64_t run_key)
+        : path_{std::move(path)}
+        , interval_{std::max<size_t>(1, interval)}
+        , run_key_{run_key} {
+    if (!std::ifstream{path_}) {
+        return;
+    }
+    try {
+        auto loaded = read_checkpoint(path_);
+        if (loaded.run_key == run_key_) {
+            std::cerr << "[waveguide] resuming from checkpoint " << path_
+                      << " at step " << loaded.step << '\n';
+            resume_ = std::move(loaded);
+        } else {
+            std::cerr << "[waveguide] ignoring checkpoint " << path_
+                      << ", it belongs to a different run\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[waveguide] ignoring checkpoint: " << e.what() << '\n';
+    }
+}
+
+checkpointer::~checkpointer() noexcept {
+    try {
+        wait();
+    } catch (const std::exception& e) {
+        std::cerr << "[waveguide] checkpoint failed: " << e.what() << '\n';
+    }
+}
+
+const checkpoint* checkpointer::get_resume() const {
+    return resume_ ? &*resume_ : nullptr;
+}
+
+bool checkpointer::is_due(size_t step) const {
+    return step != 0 && step % interval_ == 0;
+}
+
+void checkpointer::set_receiver_saver(
+        std::function<util::aligned::vector<std::uint8_t>()> saver) {
+    save_receivers_ = std::move(saver);
+}
+
+void checkpointer::wait() {
+    if (pending_.valid()) {
+        pending_.get();
+    }
+}
+
+void checkpointer::snapshot(cl::CommandQueue& queue,
+                            const cl::Buffer& previous,
+                            const cl::Buffer& current,
+                            const cl::Buffer& filter_memories,
+                            size_t step) {
+    //  The staging buffers are reused, so the last snapshot must be done.
+    try {
+        wait();
+    } catch (const std::exception& e) {
+        std::cerr << "[waveguide] checkpoint failed: " << e.what() << '\n';
+    }
+
+    const std::array<const cl::Buffer*, 3> sources{
+            {&previous, &current, &filter_memories}};
+
+    if (staging_.empty()) {
+        const auto context = queue.getInfo<CL_QUEUE_CONTEXT>();
+        const auto device = queue.getInfo<CL_QUEUE_DEVICE>();
+        transfer_queue_ = cl::CommandQueue{context, device};
+        for (const auto source : sources) {
+            staging_.emplace_back(context,
+                                  CL_MEM_READ_WRITE,
+                                  source->getInfo<CL_MEM_SIZE>());
+        }
+    }
+
+    checkpoint c;
+    c.run_key = run_key_;
+    c.step = step;
+    if (save_receivers_) {
+        c.receivers = save_receivers_();
+    }
+    const std::array<util::aligned::vector<std::uint8_t>*, 3> outputs{
+            {&c.previous, &c.current, &c.filter_memories}};
+
+    std::vector<cl::Event> reads(sources.size());
+    for (size_t i = 0; i != sources.size(); ++i) {
+        const auto bytes = staging_[i].getInfo<CL_MEM_SIZE>();
+        std::vector<cl::Event> copied(1);
+        queue.enqueueCopyBuffer(
+                *sources[i], staging_[i], 0, 0, bytes, nullptr, &copied[0]);
+        outputs[i]->resize(bytes);
+        transfer_queue_.enqueueReadBuffer(staging_[i],
+                                          CL_FALSE,
+                                          0,
+                                          bytes,
+                                          outputs[i]->data(),
+                                          &copied,
+                                          &reads[i]);
+    }
+    queue.flush();
+    transfer_queue_.flush();
+
+    //  Moving the checkpoint doesn't move its storage, so the reads above
+    //  still land in it.
+    pending_ = std::async(
+            std::launch::async,
+            [this, c = std::move(c), reads = std::move(reads)] {
+                cl::WaitForEvents(reads);
+                write_checkpoint(path_, c);
+            });
+}
+
+void checkpointer::discard() {
+    wait();
+    resume_.reset();
+    std::remove(path_.c_str());
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
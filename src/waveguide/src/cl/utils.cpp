@@ -68,6 +68,47 @@ uint neighbor_index(int3 locator, int3 dim, PortDirection pd) {
     return to_index(locator, dim);
 }
 
+//  Kernels find neighbouring nodes through node_locator and node_topology.
+//  On a dense mesh these are a grid position and the grid dimensions. With
+//  WAYVERB_SPARSE_NODES only inside and boundary nodes are stored, so they are
+//  the node's compacted index and a table of PORTS neighbours per node.
+#ifdef WAYVERB_SPARSE_NODES
+typedef uint node_locator;
+typedef const global uint* node_topology;
+
+node_locator make_node_locator(size_t index, node_topology topology);
+node_locator make_node_locator(size_t index, node_topology topology) {
+    (void)topology;
+    return (uint)index;
+}
+
+uint topology_neighbor(node_locator locator,
+                       node_topology topology,
+                       PortDirection pd);
+uint topology_neighbor(node_locator locator,
+                       node_topology topology,
+                       PortDirection pd) {
+    return topology[locator * PORTS + pd];
+}
+#else
+typedef int3 node_locator;
+typedef int3 node_topology;
+
+node_locator make_node_locator(size_t index, node_topology topology);
+node_locator make_node_locator(size_t index, node_topology topology) {
+    return to_locator(index, topology);
+}
+
+uint topology_neighbor(node_locator locator,
+                       node_topology topology,
+                       PortDirection pd);
+uint topology_neighbor(node_locator locator,
+                       node_topology topology,
+                       PortDirection pd) {
+    return neighbor_index(locator, topology, pd);
+}
+#endif
+
 float3 compute_node_position(const mesh_descriptor descriptor, int3 locator);
 float3 compute_node_position(const mesh_descriptor descriptor, int3 locator) {
     return descriptor.min_corner + convert_float3(locator) * descriptor.spacing;
@@ -0,0 +1,37 @@
+#include "waveguide/coefficient_overlay.h"
+
+#include <stdexcept>
+
+namespace wayverb {
+namespace waveguide {
+
+coefficient_overlay::coefficient_overlay(const mesh& mesh)
+        : surface_coefficients_(mesh.get_structure().get_coefficients())
+        , coeff_blocks_(
+                  mesh.get_structure().get_boundary_layout().coeff_blocks) {}
+
+coefficient_overlay::coefficient_overlay(
+        const mesh& mesh,
+        util::aligned::vector<coefficients_canonical> surface_coefficients)
+        : surface_coefficients_(std::move(surface_coefficients)) {
+    if (surface_coefficients_.size() !=
+        mesh.get_structure().get_coefficients().size()) {
+        throw std::runtime_error(
+                "Coefficient overlay must have one entry per mesh surface.");
+    }
+    coeff_blocks_ = make_coeff_blocks(mesh.get_structure().get_boundary_layout(),
+                                      surface_coefficients_);
+}
+
+const util::aligned::vector<coefficients_canonical>&
+coefficient_overlay::get_surface_coefficients() const {
+    return surface_coefficients_;
+}
+
+const util::aligned::vector<coefficients_canonical>&
+coefficient_overlay::get_coeff_blocks() const {
+    return coeff_blocks_;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -1,5 +1,7 @@
 #include "waveguide/config.h"
 
+#include "core/exceptions.h"
+
 #include <cmath>
 
 #include "samplerate.h"
@@ -26,10 +28,36 @@ double grid_spacing(double speed_of_sound, double time_step) {
 
 }  // namespace config
 
-util::aligned::vector<float> adjust_sampling_rate(const float* data,
-                                                  size_t size,
-                                                  double in_sr,
-                                                  double out_sr) {
+namespace {
+
+void correct_output_level(util::aligned::vector<float>& signal,
+                          double ratio) {
+    const auto volume_scale = 1 / ratio;
+    for (auto& i : signal) {
+        i *= volume_scale;
+    }
+}
+
+}  // namespace
+
+util::aligned::vector<float> adjust_sampling_rate(
+        const float* data,
+        size_t size,
+        double in_sr,
+        double out_sr,
+        core::resampler_quality quality) {
+    try {
+        auto out_signal = core::resample(data, size, in_sr, out_sr, quality);
+        correct_output_level(out_signal, out_sr / in_sr);
+        return out_signal;
+    } catch (const core::exceptions::inexact_ratio&) {
+        //  libsamplerate handles arbitrary ratios exactly, just more slowly.
+        return adjust_sampling_rate_libsamplerate(data, size, in_sr, out_sr);
+    }
+}
+
+util::aligned::vector<float> adjust_sampling_rate_libsamplerate(
+        const float* data, size_t size, double in_sr, double out_sr) {
     if (!(in_sr && out_sr)) {
         throw std::runtime_error{
                 "Sample rate of 0 gives few hints about how to proceed."};
@@ -46,12 +74,7 @@ util::aligned::vector<float> adjust_sampling_rate(const float* data,
                               ratio};
     src_simple(&sample_rate_info, SRC_SINC_BEST_QUALITY, 1);
 
-    //  Correct output level.
-    const auto volume_scale = 1 / ratio;
-    for (auto& i : out_signal) {
-        i *= volume_scale;
-    }
-
+    correct_output_level(out_signal, ratio);
     return out_signal;
 }
 
@@ -0,0 +1,578 @@
+#include "waveguide/cpu_waveguide.h"
+
+#include "core/conversions.h"
+#include "core/exceptions.h"
+
+#include "utilities/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+
+//  The update below mirrors the condensed_waveguide and update_boundaries
+//  kernels in program.cpp, minus the debugging and tracing paths. Keep the
+//  two in step.
+
+const auto courant = 1.0f / std::sqrt(3.0f);
+constexpr auto courant_sq = 1.0f / 3.0f;
+constexpr auto filter_order = memory_canonical::order;
+constexpr auto filter_memory_limit = 1.0e30f;
+constexpr auto no_entry = ~cl_uint{0};
+
+/// The ports which face the boundary, in port order.
+/// Empty for nodes which take the normal update.
+struct boundary_faces final {
+    std::array<cl_uint, 3> ports{};
+    size_t count{0};
+};
+
+boundary_faces get_boundary_faces(cl_int type) {
+    if (type & (id_inside | id_reentrant)) {
+        return {};
+    }
+    boundary_faces ret{};
+    for (auto i = 0u; i != num_ports; ++i) {
+        if (type & port_index_to_boundary_type(i)) {
+            if (ret.count == ret.ports.size()) {
+                return {};
+            }
+            ret.ports[ret.count++] = i;
+        }
+    }
+    //  Opposing faces on the same axis have no inner direction.
+    for (auto i = 1u; i < ret.count; ++i) {
+        if (ret.ports[i] / 2 == ret.ports[i - 1] / 2) {
+            return {};
+        }
+    }
+    return ret;
+}
+
+bool faces_axis(const boundary_faces& faces, cl_uint port) {
+    for (auto i = 0u; i != faces.count; ++i) {
+        if (faces.ports[i] / 2 == port / 2) {
+            return true;
+        }
+    }
+    return false;
+}
+
+filt_real filter_step_canonical(filt_real input,
+                                memory_canonical& m,
+                                const coefficients_canonical& c) {
+    const auto denom0 = std::abs(c.a[0]) > filt_real{1e-12} ? c.a[0] : 1;
+    const filt_real output = (input * c.b[0] + m.array[0]) / denom0;
+    for (auto i = 0u; i != filter_order - 1; ++i) {
+        const filt_real b = c.b[i + 1] == 0 ? 0 : c.b[i + 1] * input;
+        const filt_real a = c.a[i + 1] == 0 ? 0 : c.a[i + 1] * output;
+        m.array[i] = b - a + m.array[i + 1];
+    }
+    const filt_real b_last =
+            c.b[filter_order] == 0 ? 0 : c.b[filter_order] * input;
+    const filt_real a_last =
+            c.a[filter_order] == 0 ? 0 : c.a[filter_order] * output;
+    m.array[filter_order - 1] = b_last - a_last;
+    return output;
+}
+
+bool memory_out_of_range(filt_real value) {
+    const auto f = static_cast<float>(value);
+    return !std::isfinite(f) || std::abs(f) > filter_memory_limit;
+}
+
+void ghost_point_pressure_update(float next_pressure,
+                                 float prev_pressure,
+                                 memory_canonical& filter_memory,
+                                 const coefficients_canonical& boundary) {
+    auto a0 = boundary.a[0];
+    auto b0 = boundary.b[0];
+    if (!std::isfinite(a0)) {
+        a0 = 1;
+    }
+    if (!std::isfinite(b0)) {
+        b0 = 1;
+    }
+    if (std::abs(static_cast<float>(b0)) < 1.0e-12f &&
+        std::abs(static_cast<float>(a0)) < 1.0e-12f) {
+        return;
+    }
+
+    auto filt_state = filter_memory.array[0];
+    if (!std::isfinite(filt_state)) {
+        filt_state = 0;
+    }
+    if (std::any_of(std::begin(filter_memory.array),
+                    std::begin(filter_memory.array) + filter_order,
+                    memory_out_of_range)) {
+        std::fill(std::begin(filter_memory.array),
+                  std::begin(filter_memory.array) + filter_order,
+                  0);
+        filt_state = 0;
+    }
+
+    const auto delta = prev_pressure - next_pressure;
+    if (delta == 0.0f && static_cast<float>(filt_state) == 0.0f) {
+        filter_memory.array[0] = 0;
+        return;
+    }
+
+    const auto safe_b0 = std::abs(static_cast<float>(b0)) > 1.0e-12f
+                                 ? static_cast<float>(b0)
+                                 : 1.0f;
+    const auto denom = std::max(safe_b0 * courant, 1.0e-12f);
+    const auto diff = std::fma(static_cast<float>(a0) * delta,
+                               1.0f / denom,
+                               static_cast<float>(filt_state) / safe_b0);
+    if (!std::isfinite(diff)) {
+        filter_memory.array[0] = std::numeric_limits<filt_real>::quiet_NaN();
+        return;
+    }
+
+    auto local_memory = filter_memory;
+    filter_step_canonical(-diff, local_memory, boundary);
+    for (auto k = 0u; k != filter_order; ++k) {
+        if (memory_out_of_range(local_memory.array[k])) {
+            local_memory.array[k] = 0;
+        }
+    }
+    std::copy(std::begin(local_memory.array),
+              std::begin(local_memory.array) + filter_order,
+              std::begin(filter_memory.array));
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+class cpu_waveguide::impl final {
+    /// A block of the mesh, plus the halo needed to step it block_steps times.
+    struct tile final {
+        /// The compact index of each local node. Nodes in the tile's core come
+        /// first, then the halo in order of distance from the core.
+        util::aligned::vector<cl_uint> nodes;
+        /// extent[d] is the number of local nodes within d nodes of the core.
+        util::aligned::vector<size_t> extent;
+        util::aligned::vector<cl_int> types;
+        /// num_ports local indices per local node.
+        util::aligned::vector<cl_uint> neighbors;
+        /// The local boundary slot of each local node, or no_entry.
+        util::aligned::vector<cl_uint> slots;
+        /// The local index and boundary layout index of each boundary slot,
+        /// in local order.
+        util::aligned::vector<cl_uint> boundary_nodes;
+        util::aligned::vector<cl_uint> boundary_entries;
+
+        //  Working storage.
+        util::aligned::vector<float> previous;
+        util::aligned::vector<float> current;
+        util::aligned::vector<float> previous_history;
+        util::aligned::vector<memory_canonical> memories;
+    };
+
+    struct state final {
+        util::aligned::vector<float> previous;
+        util::aligned::vector<float> current;
+        util::aligned::vector<memory_canonical> memories;
+    };
+
+public:
+    impl(const sparse_layout& layout,
+         const coefficient_overlay& coefficients,
+         size_t block_steps,
+         size_t tile_size)
+            : layout_{layout}
+            , coeff_blocks_{coefficients.get_coeff_blocks()}
+            , block_steps_{block_steps} {
+        if (block_steps == 0 || tile_size == 0) {
+            throw std::runtime_error{
+                    "Block steps and tile size must be non-zero."};
+        }
+        if (coeff_blocks_.size() !=
+            layout.boundaries.coeff_blocks.size()) {
+            throw std::runtime_error{
+                    "Coefficients do not match the layout's boundaries."};
+        }
+
+        const auto dimensions = core::to_ivec3{}(layout.descriptor.dimensions);
+        const auto tiles = (dimensions + static_cast<int>(tile_size) - 1) /
+                           static_cast<int>(tile_size);
+
+        std::vector<util::aligned::vector<cl_uint>> cores(tiles.x * tiles.y *
+                                                          tiles.z);
+        for (auto i = 0u; i != layout.dense_indices.size(); ++i) {
+            const auto t = compute_locator(layout.descriptor,
+                                           layout.dense_indices[i]) /
+                           static_cast<int>(tile_size);
+            cores[t.x + tiles.x * (t.y + tiles.y * t.z)].emplace_back(i);
+        }
+        cores.erase(std::remove_if(begin(cores),
+                                   end(cores),
+                                   [](const auto& i) { return i.empty(); }),
+                    end(cores));
+
+        auto built = util::parallel_map(pool_, cores.size(), [&](auto i) {
+            return make_tile(cores[i]);
+        });
+        tiles_.assign(std::make_move_iterator(begin(built)),
+                      std::make_move_iterator(end(built)));
+    }
+
+    size_t get_block_steps() const { return block_steps_; }
+
+    double compute_redundancy() const {
+        auto updates = 0.0;
+        for (const auto& tile : tiles_) {
+            for (auto d = 0u; d != block_steps_; ++d) {
+                updates += tile.extent[d];
+            }
+        }
+        return updates / (layout_.nodes.size() * block_steps_);
+    }
+
+    util::aligned::vector<util::aligned::vector<float>> run(
+            size_t source,
+            const util::aligned::vector<float>& signal,
+            const util::aligned::vector<size_t>& receivers,
+            const std::atomic_bool& keep_going,
+            const std::function<void(size_t)>& block_callback) {
+        const auto num_nodes = layout_.nodes.size();
+        const auto outside = [&](auto i) { return num_nodes <= i; };
+        if (outside(source) ||
+            std::any_of(begin(receivers), end(receivers), outside)) {
+            throw std::runtime_error{"Node is outside the layout."};
+        }
+
+        //  Where the source and receivers live in each tile.
+        util::aligned::vector<cl_uint> sources;
+        std::vector<util::aligned::vector<std::pair<size_t, cl_uint>>>
+                outputs(tiles_.size());
+        for (auto i = 0u; i != tiles_.size(); ++i) {
+            const auto& nodes = tiles_[i].nodes;
+            const auto find_local = [&](auto first, auto last, auto node) {
+                const auto it = std::find(first, last, node);
+                return it == last ? no_entry
+                                  : static_cast<cl_uint>(it - begin(nodes));
+            };
+            sources.emplace_back(
+                    find_local(begin(nodes), end(nodes), source));
+            const auto core_end = begin(nodes) + tiles_[i].extent.front();
+            for (auto j = 0u; j != receivers.size(); ++j) {
+                const auto local =
+                        find_local(begin(nodes), core_end, receivers[j]);
+                if (local != no_entry) {
+                    outputs[i].emplace_back(j, local);
+                }
+            }
+        }
+
+        util::aligned::vector<util::aligned::vector<float>> ret(
+                receivers.size(), util::aligned::vector<float>(signal.size()));
+
+        //  Tiles read the halo from `in` while other tiles write their cores
+        //  to `out`, so the global state is double-buffered.
+        state in{util::aligned::vector<float>(num_nodes),
+                 util::aligned::vector<float>(num_nodes),
+                 layout_.boundaries.filter_memories};
+        auto out = in;
+
+        auto step = size_t{0};
+        while (step != signal.size() && keep_going) {
+            const auto steps = std::min(block_steps_, signal.size() - step);
+            util::parallel_for(pool_, tiles_.size(), [&](auto i) {
+                run_block(tiles_[i],
+                          in,
+                          out,
+                          step,
+                          steps,
+                          sources[i],
+                          signal,
+                          outputs[i],
+                          ret);
+            });
+            std::swap(in, out);
+            step += steps;
+            if (block_callback) {
+                block_callback(step);
+            }
+        }
+
+        for (auto& i : ret) {
+            i.resize(step);
+        }
+        return ret;
+    }
+
+private:
+    tile make_tile(const util::aligned::vector<cl_uint>& core) const {
+        tile ret{};
+        ret.nodes = core;
+
+        //  Grow the halo a ring at a time, so that nodes end up sorted by
+        //  distance from the core.
+        std::unordered_map<cl_uint, cl_uint> local;
+        for (auto i = 0u; i != core.size(); ++i) {
+            local.emplace(core[i], i);
+        }
+        ret.extent.emplace_back(core.size());
+        for (auto d = 0u; d != block_steps_; ++d) {
+            const auto ring_begin = d == 0 ? 0 : ret.extent[d - 1];
+            const auto ring_end = ret.extent[d];
+            for (auto i = ring_begin; i != ring_end; ++i) {
+                for (auto port = 0u; port != num_ports; ++port) {
+                    const auto neighbor =
+                            layout_.neighbors[ret.nodes[i] * num_ports + port];
+                    if (neighbor != no_neighbor &&
+                        local.emplace(neighbor, ret.nodes.size()).second) {
+                        ret.nodes.emplace_back(neighbor);
+                    }
+                }
+            }
+            ret.extent.emplace_back(ret.nodes.size());
+        }
+
+        //  Nodes in the outermost ring are read but never updated, so their
+        //  neighbours may be left out of the tile.
+        const auto& lookup = layout_.boundaries.node_lookup;
+        for (auto i = 0u; i != ret.nodes.size(); ++i) {
+            const auto node = ret.nodes[i];
+            ret.types.emplace_back(layout_.nodes[node].boundary_type);
+            for (auto port = 0u; port != num_ports; ++port) {
+                const auto it =
+                        local.find(layout_.neighbors[node * num_ports + port]);
+                ret.neighbors.emplace_back(it == end(local) ? no_neighbor
+                                                            : it->second);
+            }
+
+            const auto entry = lookup.empty() ? no_entry : lookup[node];
+            ret.slots.emplace_back(entry == no_entry
+                                           ? no_entry
+                                           : ret.boundary_nodes.size());
+            if (entry != no_entry) {
+                ret.boundary_nodes.emplace_back(i);
+                ret.boundary_entries.emplace_back(entry);
+            }
+        }
+
+        ret.previous.resize(ret.nodes.size());
+        ret.current.resize(ret.nodes.size());
+        ret.previous_history.resize(ret.boundary_nodes.size());
+        ret.memories.resize(ret.boundary_nodes.size() * num_ports);
+        return ret;
+    }
+
+    const coefficients_canonical& get_coefficients(const tile& tile,
+                                                   cl_uint slot,
+                                                   cl_uint face) const {
+        const auto entry = tile.boundary_entries[slot];
+        return coeff_blocks_[layout_.boundaries.coeff_block_offsets[entry] +
+                             face];
+    }
+
+    static float normal_waveguide_update(const tile& tile,
+                                         size_t node,
+                                         float prev_pressure) {
+        auto ret = 0.0f;
+        for (auto port = 0u; port != num_ports; ++port) {
+            const auto neighbor = tile.neighbors[node * num_ports + port];
+            if (neighbor != no_neighbor) {
+                ret += tile.current[neighbor];
+            }
+        }
+        ret /= num_ports / 2;
+        return ret - prev_pressure;
+    }
+
+    float boundary_update(const tile& tile,
+                          size_t node,
+                          const boundary_faces& faces,
+                          float prev_pressure) const {
+        const auto read = [&](auto port) {
+            const auto neighbor = tile.neighbors[node * num_ports + port];
+            return neighbor == no_neighbor ? 0.0f : tile.current[neighbor];
+        };
+
+        auto inner = 0.0f;
+        for (auto i = 0u; i != faces.count; ++i) {
+            inner += 2 * read(faces.ports[i]);
+        }
+        auto surrounding = 0.0f;
+        for (auto port = 0u; port != num_ports; ++port) {
+            if (!faces_axis(faces, port)) {
+                if (tile.neighbors[node * num_ports + port] == no_neighbor) {
+                    surrounding = 0;
+                    break;
+                }
+                surrounding += read(port);
+            }
+        }
+        const auto current_weighting = courant_sq * (inner + surrounding);
+
+        const auto slot = tile.slots[node];
+        auto filter_sum = 0.0f;
+        auto coeff_sum = 0.0f;
+        for (auto i = 0u; i != faces.count; ++i) {
+            const auto face = faces.ports[i];
+            const auto& boundary = get_coefficients(tile, slot, face);
+            const auto a0 = static_cast<float>(boundary.a[0]);
+            const auto b0 = static_cast<float>(boundary.b[0]);
+            if (std::abs(b0) > 1.0e-12f) {
+                const auto& memory = tile.memories[slot * num_ports + face];
+                filter_sum += static_cast<float>(memory.array[0]) / b0;
+                coeff_sum += a0 / b0;
+            }
+        }
+        const auto filter_weighting = courant_sq * filter_sum;
+        const auto coeff_weighting = coeff_sum * courant;
+
+        const auto numerator = current_weighting + filter_weighting +
+                               (coeff_weighting - 1.0f) * prev_pressure;
+        auto denom = 1.0f + coeff_weighting;
+        if (!std::isfinite(denom) || std::abs(denom) < 1.0e-12f) {
+            denom = denom >= 0 ? 1.0f : -1.0f;
+        }
+        const auto ret = numerator / denom;
+        return std::isfinite(ret) ? ret : 0.0f;
+    }
+
+    float next_waveguide_pressure(const tile& tile, size_t node) const {
+        const auto prev_pressure = tile.previous[node];
+        const auto faces = get_boundary_faces(tile.types[node]);
+        if (faces.count == 0 || tile.slots[node] == no_entry) {
+            return normal_waveguide_update(tile, node, prev_pressure);
+        }
+        return boundary_update(tile, node, faces, prev_pressure);
+    }
+
+    void update_boundaries(tile& tile, size_t slots) const {
+        for (auto slot = 0u; slot != slots; ++slot) {
+            const auto node = tile.boundary_nodes[slot];
+            const auto faces = get_boundary_faces(tile.types[node]);
+            for (auto i = 0u; i != faces.count; ++i) {
+                const auto face = faces.ports[i];
+                ghost_point_pressure_update(
+                        tile.previous[node],
+                        tile.previous_history[slot],
+                        tile.memories[slot * num_ports + face],
+                        get_coefficients(tile, slot, face));
+            }
+        }
+    }
+
+    void run_block(
+            tile& tile,
+            const state& in,
+            state& out,
+            size_t first_step,
+            size_t steps,
+            cl_uint source,
+            const util::aligned::vector<float>& signal,
+            const util::aligned::vector<std::pair<size_t, cl_uint>>& outputs,
+            util::aligned::vector<util::aligned::vector<float>>& ret) const {
+        for (auto i = 0u; i != tile.nodes.size(); ++i) {
+            tile.previous[i] = in.previous[tile.nodes[i]];
+            tile.current[i] = in.current[tile.nodes[i]];
+        }
+        for (auto slot = 0u; slot != tile.boundary_entries.size(); ++slot) {
+            std::copy_n(begin(in.memories) +
+                                tile.boundary_entries[slot] * num_ports,
+                        num_ports,
+                        begin(tile.memories) + slot * num_ports);
+        }
+
+        for (auto k = 0u; k != steps; ++k) {
+            const auto step = first_step + k;
+            if (source != no_entry) {
+                tile.current[source] += signal[step];
+            }
+            for (const auto& output : outputs) {
+                ret[output.first][step] = tile.current[output.second];
+            }
+
+            //  Only nodes which can still influence the core are updated.
+            const auto active = tile.extent[steps - 1 - k];
+            const auto slots = static_cast<size_t>(
+                    std::lower_bound(begin(tile.boundary_nodes),
+                                     end(tile.boundary_nodes),
+                                     active) -
+                    begin(tile.boundary_nodes));
+
+            for (auto slot = 0u; slot != slots; ++slot) {
+                tile.previous_history[slot] =
+                        tile.previous[tile.boundary_nodes[slot]];
+            }
+            for (auto i = 0u; i != active; ++i) {
+                tile.previous[i] = next_waveguide_pressure(tile, i);
+            }
+            update_boundaries(tile, slots);
+
+            std::swap(tile.previous, tile.current);
+        }
+
+        const auto core = tile.extent.front();
+        for (auto i = 0u; i != core; ++i) {
+            const auto pressure = tile.current[i];
+            if (std::isinf(pressure)) {
+                throw core::exceptions::value_is_inf(
+                        "Pressure value is inf, check filter coefficients.");
+            }
+            if (std::isnan(pressure)) {
+                throw core::exceptions::value_is_nan(
+                        "Pressure value is nan, check filter coefficients.");
+            }
+            out.previous[tile.nodes[i]] = tile.previous[i];
+            out.current[tile.nodes[i]] = pressure;
+        }
+        for (auto slot = 0u; slot != tile.boundary_entries.size() &&
+                             tile.boundary_nodes[slot] < core;
+             ++slot) {
+            std::copy_n(begin(tile.memories) + slot * num_ports,
+                        num_ports,
+                        begin(out.memories) +
+                                tile.boundary_entries[slot] * num_ports);
+        }
+    }
+
+    const sparse_layout& layout_;
+    util::aligned::vector<coefficients_canonical> coeff_blocks_;
+    size_t block_steps_;
+    util::thread_pool pool_;
+    util::aligned::vector<tile> tiles_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+cpu_waveguide::cpu_waveguide(const sparse_layout& layout,
+                             const coefficient_overlay& coefficients,
+                             size_t block_steps,
+                             size_t tile_size)
+        : pimpl_{std::make_unique<impl>(
+                  layout, coefficients, block_steps, tile_size)} {}
+
+cpu_waveguide::~cpu_waveguide() noexcept = default;
+
+util::aligned::vector<util::aligned::vector<float>> cpu_waveguide::run(
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<size_t>& receivers,
+        const std::atomic_bool& keep_going,
+        const std::function<void(size_t)>& block_callback) {
+    return pimpl_->run(source, signal, receivers, keep_going, block_callback);
+}
+
+size_t cpu_waveguide::get_block_steps() const {
+    return pimpl_->get_block_steps();
+}
+
+double cpu_waveguide::compute_redundancy() const {
+    return pimpl_->compute_redundancy();
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
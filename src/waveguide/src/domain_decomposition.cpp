@@ -0,0 +1,551 @@
+#include "waveguide/domain_decomposition.h"
+#include "waveguide/boundary_guard.h"
+#include "waveguide/program.h"
+
+#include "core/conversions.h"
+#include "core/exceptions.h"
+
+#include "utilities/map_to_vector.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+
+/// Splits planes into `num_slabs` contiguous ranges with roughly equal node
+/// counts, each holding at least one stored node. Returns the first plane of
+/// each range, followed by the end plane.
+/// There must be at least `num_slabs` planes which hold nodes.
+util::aligned::vector<size_t> split_planes(
+        const util::aligned::vector<size_t>& plane_counts, size_t num_slabs) {
+    const auto planes = plane_counts.size();
+    const auto total =
+            std::accumulate(begin(plane_counts), end(plane_counts), size_t{0});
+    auto remaining = static_cast<size_t>(std::count_if(
+            begin(plane_counts), end(plane_counts), [](auto i) {
+                return i != 0;
+            }));
+
+    util::aligned::vector<size_t> ret{0};
+    size_t cumulative = 0;
+    bool slab_has_nodes = false;
+    for (size_t plane = 0; plane != planes; ++plane) {
+        const auto slab = ret.size();
+        if (slab == num_slabs) {
+            break;
+        }
+        if (plane_counts[plane] != 0) {
+            cumulative += plane_counts[plane];
+            remaining -= 1;
+            slab_has_nodes = true;
+        }
+        if (!slab_has_nodes) {
+            continue;
+        }
+        //  Every remaining slab needs at least one plane with nodes.
+        const auto must_split = remaining == num_slabs - slab;
+        if (must_split || cumulative * num_slabs >= total * slab) {
+            ret.emplace_back(plane + 1);
+            slab_has_nodes = false;
+        }
+    }
+    ret.emplace_back(planes);
+    return ret;
+}
+
+subdomain make_subdomain(const sparse_layout& full,
+                         const util::aligned::vector<size_t>& planes,
+                         size_t begin_plane,
+                         size_t end_plane,
+                         util::aligned::vector<cl_uint>& local_indices) {
+    const auto select_planes = [&](size_t b, size_t e) {
+        util::aligned::vector<cl_uint> ret;
+        for (size_t i = 0; i != planes.size(); ++i) {
+            if (b <= planes[i] && planes[i] < e) {
+                ret.emplace_back(i);
+            }
+        }
+        //  Plane-major, and in storage order within each plane, so that the
+        //  edge planes of one slab line up with the halos of the next.
+        std::stable_sort(begin(ret), end(ret), [&](auto lhs, auto rhs) {
+            return planes[lhs] < planes[rhs];
+        });
+        return ret;
+    };
+
+    const auto owned = select_planes(begin_plane, end_plane);
+    const auto lower = begin_plane == 0
+                               ? util::aligned::vector<cl_uint>{}
+                               : select_planes(begin_plane - 1, begin_plane);
+    const auto upper = select_planes(end_plane, end_plane + 1);
+
+    util::aligned::vector<cl_uint> members;
+    members.reserve(owned.size() + lower.size() + upper.size());
+    members.insert(end(members), begin(owned), end(owned));
+    members.insert(end(members), begin(lower), end(lower));
+    members.insert(end(members), begin(upper), end(upper));
+
+    for (size_t i = 0; i != members.size(); ++i) {
+        local_indices[members[i]] = i;
+    }
+
+    subdomain ret{};
+    ret.owned_nodes = owned.size();
+    ret.lower_halo_nodes = lower.size();
+    ret.upper_halo_nodes = upper.size();
+    ret.begin_plane = begin_plane;
+    ret.end_plane = end_plane;
+
+    auto& layout = ret.layout;
+    layout.descriptor = full.descriptor;
+    layout.ordering = full.ordering;
+    layout.neighbors.resize(members.size() * num_ports, no_neighbor);
+    for (size_t i = 0; i != members.size(); ++i) {
+        const auto member = members[i];
+        layout.dense_indices.emplace_back(full.dense_indices[member]);
+        layout.nodes.emplace_back(full.nodes[member]);
+        for (size_t port = 0; port != num_ports; ++port) {
+            const auto neighbor = full.neighbors[member * num_ports + port];
+            layout.neighbors[i * num_ports + port] =
+                    neighbor == no_neighbor ? no_neighbor
+                                            : local_indices[neighbor];
+        }
+    }
+
+    //  Only owned nodes are updated, so only they keep boundary entries.
+    const auto& source = full.boundaries;
+    auto& boundary = layout.boundaries;
+    boundary.node_lookup.assign(members.size(),
+                                std::numeric_limits<uint32_t>::max());
+    for (size_t i = 0; i != owned.size(); ++i) {
+        const auto entry = source.node_lookup[owned[i]];
+        if (entry == std::numeric_limits<uint32_t>::max()) {
+            continue;
+        }
+        const auto local_entry = boundary.headers.size();
+        boundary.node_lookup[i] = local_entry;
+        boundary.node_indices.emplace_back(i);
+        boundary.headers.emplace_back(source.headers[entry]);
+        boundary.headers.back().guard = make_boundary_guard_tag(i);
+        boundary.sdf_distance.emplace_back(source.sdf_distance[entry]);
+        boundary.sdf_normal.emplace_back(source.sdf_normal[entry]);
+        boundary.coeff_block_offsets.emplace_back(local_entry * num_ports);
+        ret.source_coeff_block_offsets.emplace_back(
+                source.coeff_block_offsets[entry]);
+        for (size_t face = 0; face != num_ports; ++face) {
+            boundary.coeff_blocks.emplace_back(
+                    source.coeff_blocks[source.coeff_block_offsets[entry] +
+                                        face]);
+            boundary.coeff_block_surfaces.emplace_back(
+                    source.coeff_block_surfaces.empty()
+                            ? std::numeric_limits<uint32_t>::max()
+                            : source.coeff_block_surfaces
+                                      [source.coeff_block_offsets[entry] +
+                                       face]);
+            boundary.filter_memories.emplace_back(
+                    source.filter_memories[entry * num_ports + face]);
+        }
+    }
+
+    for (const auto member : members) {
+        local_indices[member] = no_neighbor;
+    }
+
+    return ret;
+}
+
+/// The coefficient blocks of one slab, gathered from a full overlay.
+util::aligned::vector<coefficients_canonical> gather_coeff_blocks(
+        const subdomain& subdomain, const coefficient_overlay& coefficients) {
+    const auto& blocks = coefficients.get_coeff_blocks();
+    util::aligned::vector<coefficients_canonical> ret;
+    ret.reserve(subdomain.source_coeff_block_offsets.size() * num_ports);
+    for (const auto offset : subdomain.source_coeff_block_offsets) {
+        ret.insert(end(ret),
+                   begin(blocks) + offset,
+                   begin(blocks) + offset + num_ports);
+    }
+    return ret;
+}
+
+/// Device state for one slab.
+class slab_runner final {
+public:
+    slab_runner(const core::compute_context& cc,
+                const program& program,
+                const subdomain& subdomain,
+                const coefficient_overlay& coefficients)
+            : subdomain_{&subdomain}
+            , queue_{cc.context, cc.device}
+            , kernel_{program.get_sparse_kernel()}
+            , update_boundary_kernel_{program.get_update_boundary_kernel()} {
+        const auto& layout = subdomain.layout;
+        const auto& boundary = layout.boundaries;
+        const auto num_nodes = layout.nodes.size();
+
+        const auto make_zeroed_buffer = [&] {
+            auto ret = cl::Buffer{cc.context,
+                                  CL_MEM_READ_WRITE,
+                                  sizeof(cl_float) * num_nodes};
+            auto kernel = program.get_zero_buffer_kernel();
+            kernel(cl::EnqueueArgs{queue_, cl::NDRange{num_nodes}}, ret);
+            return ret;
+        };
+
+        previous_ = make_zeroed_buffer();
+        current_ = make_zeroed_buffer();
+        previous_history_ = make_zeroed_buffer();
+
+        const auto load_or_placeholder = [&](const auto& v, bool read_only) {
+            using value_type = typename std::decay_t<decltype(v)>::value_type;
+            return v.empty() ? core::load_to_buffer(
+                                       cc,
+                                       queue_,
+                                       util::aligned::vector<value_type>(1),
+                                       read_only)
+                             : core::load_to_buffer(cc, queue_, v, read_only);
+        };
+        nodes_ = core::load_to_buffer(cc, queue_, layout.nodes, true);
+        neighbors_ =
+                core::load_to_buffer(cc, queue_, layout.neighbors, true);
+        headers_ = load_or_placeholder(boundary.headers, false);
+        sdf_distance_ = load_or_placeholder(boundary.sdf_distance, false);
+        sdf_normal_ = load_or_placeholder(
+                util::map_to_vector(begin(boundary.sdf_normal),
+                                    end(boundary.sdf_normal),
+                                    core::to_cl_float3{}),
+                false);
+        coeff_offsets_ =
+                load_or_placeholder(boundary.coeff_block_offsets, false);
+        coeff_blocks_ = load_or_placeholder(
+                gather_coeff_blocks(subdomain, coefficients), false);
+        filter_memories_ =
+                load_or_placeholder(boundary.filter_memories, false);
+        lookup_ = load_or_placeholder(boundary.node_lookup, true);
+        node_indices_ = load_or_placeholder(boundary.node_indices, true);
+        error_flag_ = cl::Buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int)};
+        core::write_value(queue_, error_flag_, 0, id_success);
+    }
+
+    cl::CommandQueue& get_queue() { return queue_; }
+    cl::Buffer& get_current() { return current_; }
+
+    /// Enqueues one step, without waiting for it to finish.
+    void enqueue_step() {
+        const auto owned = subdomain_->owned_nodes;
+        const auto boundary_count =
+                subdomain_->layout.boundaries.headers.size();
+        if (owned == 0) {
+            return;
+        }
+
+        queue_.enqueueCopyBuffer(previous_,
+                                 previous_history_,
+                                 0,
+                                 0,
+                                 sizeof(cl_float) * owned);
+
+        core::write_value(queue_, error_flag_, 0, id_success);
+
+        kernel_(cl::EnqueueArgs(queue_, cl::NDRange(owned)),
+                previous_,
+                current_,
+                nodes_,
+                neighbors_,
+                headers_,
+                sdf_distance_,
+                sdf_normal_,
+                coeff_offsets_,
+                coeff_blocks_,
+                filter_memories_,
+                lookup_,
+                error_flag_,
+                static_cast<cl_uint>(owned));
+
+        if (boundary_count != 0) {
+            update_boundary_kernel_(
+                    cl::EnqueueArgs(queue_, cl::NDRange(boundary_count)),
+                    previous_history_,
+                    current_,
+                    previous_,
+                    nodes_,
+                    subdomain_->layout.descriptor.dimensions,
+                    node_indices_,
+                    headers_,
+                    coeff_offsets_,
+                    coeff_blocks_,
+                    filter_memories_,
+                    lookup_,
+                    error_flag_,
+                    static_cast<cl_uint>(boundary_count));
+        }
+
+        std::swap(previous_, current_);
+    }
+
+    /// Blocks until the last step has finished, and throws if it failed.
+    void check_error() {
+        const auto error_flag =
+                core::read_value<error_code>(queue_, error_flag_, 0);
+        if (error_flag & id_inf_error) {
+            throw core::exceptions::value_is_inf(
+                    "Pressure value is inf, check filter coefficients.");
+        }
+        if (error_flag & id_nan_error) {
+            throw core::exceptions::value_is_nan(
+                    "Pressure value is nan, check filter coefficients.");
+        }
+        if (error_flag & id_outside_mesh_error) {
+            throw std::runtime_error("Tried to read non-existant node.");
+        }
+        if (error_flag & id_suspicious_boundary_error) {
+            throw std::runtime_error("Suspicious boundary read.");
+        }
+    }
+
+    /// Copies `count` node pressures from the current field, starting at
+    /// `offset`, into `output` without waiting.
+    void enqueue_read(size_t offset, size_t count, float* output) {
+        if (count != 0) {
+            queue_.enqueueReadBuffer(current_,
+                                     CL_FALSE,
+                                     sizeof(cl_float) * offset,
+                                     sizeof(cl_float) * count,
+                                     output);
+        }
+    }
+
+    void enqueue_write(size_t offset, size_t count, const float* input) {
+        if (count != 0) {
+            queue_.enqueueWriteBuffer(current_,
+                                      CL_FALSE,
+                                      sizeof(cl_float) * offset,
+                                      sizeof(cl_float) * count,
+                                      input);
+        }
+    }
+
+private:
+    const subdomain* subdomain_;
+    cl::CommandQueue queue_;
+    decltype(std::declval<const program&>().get_sparse_kernel()) kernel_;
+    decltype(std::declval<const program&>().get_update_boundary_kernel())
+            update_boundary_kernel_;
+
+    cl::Buffer previous_;
+    cl::Buffer current_;
+    cl::Buffer previous_history_;
+    cl::Buffer nodes_;
+    cl::Buffer neighbors_;
+    cl::Buffer headers_;
+    cl::Buffer sdf_distance_;
+    cl::Buffer sdf_normal_;
+    cl::Buffer coeff_offsets_;
+    cl::Buffer coeff_blocks_;
+    cl::Buffer filter_memories_;
+    cl::Buffer lookup_;
+    cl::Buffer node_indices_;
+    cl::Buffer error_flag_;
+};
+
+}  // namespace
+
+domain_decomposition decompose(const mesh& mesh, size_t num_subdomains) {
+    const auto full = make_sparse_layout(mesh, node_ordering::dense);
+    const auto& descriptor = full.descriptor;
+
+    const auto dims = core::to_ivec3{}(descriptor.dimensions);
+    size_t axis = 0;
+    for (size_t i = 1; i != 3; ++i) {
+        if (dims[axis] < dims[i]) {
+            axis = i;
+        }
+    }
+    const size_t num_planes = dims[axis];
+
+    util::aligned::vector<size_t> planes;
+    planes.reserve(full.dense_indices.size());
+    util::aligned::vector<size_t> plane_counts(num_planes, 0);
+    for (const auto i : full.dense_indices) {
+        const auto plane = compute_locator(descriptor, i)[axis];
+        planes.emplace_back(plane);
+        plane_counts[plane] += 1;
+    }
+
+    //  Planes in the padding around the room hold no nodes, and a slab made
+    //  only of those would have nothing to update.
+    const auto occupied_planes = static_cast<size_t>(std::count_if(
+            begin(plane_counts), end(plane_counts), [](auto i) {
+                return i != 0;
+            }));
+    if (num_subdomains == 0 || occupied_planes < num_subdomains) {
+        throw std::runtime_error{
+                "Can't split a mesh into more slabs than it has planes "
+                "holding nodes."};
+    }
+
+    const auto splits = split_planes(plane_counts, num_subdomains);
+
+    domain_decomposition ret{descriptor, axis};
+    util::aligned::vector<cl_uint> local_indices(full.nodes.size(),
+                                                 no_neighbor);
+    for (size_t i = 0; i != num_subdomains; ++i) {
+        ret.subdomains.emplace_back(make_subdomain(
+                full, planes, splits[i], splits[i + 1], local_indices));
+    }
+    return ret;
+}
+
+node_owner compute_owner(const domain_decomposition& decomposition,
+                         size_t dense_index) {
+    const size_t plane = compute_locator(decomposition.descriptor,
+                                         dense_index)[decomposition.axis];
+    for (size_t i = 0; i != decomposition.subdomains.size(); ++i) {
+        const auto& subdomain = decomposition.subdomains[i];
+        if (subdomain.begin_plane <= plane && plane < subdomain.end_plane) {
+            const auto& indices = subdomain.layout.dense_indices;
+            const auto owned_end = begin(indices) + subdomain.owned_nodes;
+            const auto it = std::find(begin(indices), owned_end, dense_index);
+            if (it != owned_end) {
+                return {i,
+                        static_cast<cl_uint>(
+                                std::distance(begin(indices), it))};
+            }
+        }
+    }
+    throw std::runtime_error{"Node is not part of the decomposed mesh."};
+}
+
+util::aligned::vector<util::aligned::vector<float>> run_decomposed(
+        const util::aligned::vector<core::compute_context>& contexts,
+        const domain_decomposition& decomposition,
+        const coefficient_overlay& coefficients,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<size_t>& receivers,
+        const std::atomic_bool& keep_going,
+        const std::function<void(cl::CommandQueue& queue,
+                                 const cl::Buffer& buffer,
+                                 size_t step)>& step_callback) {
+    if (contexts.empty()) {
+        throw std::runtime_error{"No compute contexts supplied."};
+    }
+
+    const auto& subdomains = decomposition.subdomains;
+
+    util::aligned::vector<program> programs;
+    programs.reserve(contexts.size());
+    for (const auto& cc : contexts) {
+        programs.emplace_back(cc, node_storage::sparse);
+    }
+
+    util::aligned::vector<slab_runner> slabs;
+    slabs.reserve(subdomains.size());
+    for (size_t i = 0; i != subdomains.size(); ++i) {
+        const auto context = i % contexts.size();
+        slabs.emplace_back(contexts[context],
+                           programs[context],
+                           subdomains[i],
+                           coefficients);
+    }
+
+    //  The source must also be driven in any halo which copies it, or
+    //  neighbouring slabs would miss this step's input.
+    util::aligned::vector<node_owner> source_copies{
+            compute_owner(decomposition, source)};
+    for (size_t i = 0; i != subdomains.size(); ++i) {
+        const auto& indices = subdomains[i].layout.dense_indices;
+        const auto halo = std::find(
+                begin(indices) + subdomains[i].owned_nodes, end(indices), source);
+        if (halo != end(indices)) {
+            source_copies.emplace_back(node_owner{
+                    i,
+                    static_cast<cl_uint>(std::distance(begin(indices), halo))});
+        }
+    }
+    const auto receiver_owners =
+            util::map_to_vector(begin(receivers), end(receivers), [&](auto i) {
+                return compute_owner(decomposition, i);
+            });
+
+    //  Host staging for the halos. staging[i] holds slab i's lower halo, then
+    //  its upper halo, as read from its neighbours.
+    auto staging = util::map_to_vector(
+            begin(subdomains), end(subdomains), [](const auto& s) {
+                return util::aligned::vector<float>(s.lower_halo_nodes +
+                                                    s.upper_halo_nodes);
+            });
+
+    util::aligned::vector<util::aligned::vector<float>> ret(receivers.size());
+    util::aligned::vector<float> receiver_values(receivers.size());
+
+    for (size_t step = 0; step != signal.size() && keep_going; ++step) {
+        for (const auto& copy : source_copies) {
+            auto& slab = slabs[copy.subdomain];
+            const auto pressure = core::read_value<cl_float>(
+                    slab.get_queue(), slab.get_current(), copy.index);
+            core::write_value(slab.get_queue(),
+                              slab.get_current(),
+                              copy.index,
+                              pressure + signal[step]);
+        }
+
+        for (auto& slab : slabs) {
+            slab.enqueue_step();
+        }
+
+        //  Read each slab's edge planes into its neighbours' staging.
+        for (size_t i = 0; i != slabs.size(); ++i) {
+            const auto& s = subdomains[i];
+            if (s.lower_halo_nodes != 0) {
+                slabs[i - 1].enqueue_read(
+                        subdomains[i - 1].owned_nodes - s.lower_halo_nodes,
+                        s.lower_halo_nodes,
+                        staging[i].data());
+            }
+            if (s.upper_halo_nodes != 0) {
+                slabs[i + 1].enqueue_read(0,
+                                          s.upper_halo_nodes,
+                                          staging[i].data() +
+                                                  s.lower_halo_nodes);
+            }
+        }
+        for (size_t i = 0; i != receivers.size(); ++i) {
+            slabs[receiver_owners[i].subdomain].enqueue_read(
+                    receiver_owners[i].index, 1, &receiver_values[i]);
+        }
+
+        for (auto& slab : slabs) {
+            slab.check_error();
+        }
+
+        for (size_t i = 0; i != slabs.size(); ++i) {
+            const auto& s = subdomains[i];
+            slabs[i].enqueue_write(s.owned_nodes,
+                                   s.lower_halo_nodes + s.upper_halo_nodes,
+                                   staging[i].data());
+        }
+        for (size_t i = 0; i != receivers.size(); ++i) {
+            ret[i].emplace_back(receiver_values[i]);
+        }
+        //  The writes must complete before staging is reused.
+        for (auto& slab : slabs) {
+            slab.get_queue().finish();
+        }
+
+        if (step_callback) {
+            step_callback(slabs.front().get_queue(),
+                          slabs.front().get_current(),
+                          step);
+        }
+    }
+
+    return ret;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,266 @@
+#include "waveguide/field_snapshot.h"
+
+#include "core/cl/common.h"
+#include "core/program_wrapper.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+
+constexpr auto source = R"(
+kernel void decimate_pressure(const global float* pressure,
+                              int half_storage,
+                              int3 dimensions,
+                              int factor,
+                              int3 decimated,
+                              global float* output) {
+    const size_t index = get_global_id(0);
+    const int3 cell = (int3)((int)(index % decimated.x),
+                             (int)((index / decimated.x) % decimated.y),
+                             (int)(index / (decimated.x * decimated.y)));
+    if (decimated.z <= cell.z) {
+        return;
+    }
+
+    const int3 first = cell * factor;
+    const int3 last = min(first + factor, dimensions);
+
+    //  The signed value of largest magnitude, so that the sign of the wave
+    //  survives decimation.
+    float peak = 0;
+    for (int z = first.z; z != last.z; ++z) {
+        for (int y = first.y; y != last.y; ++y) {
+            for (int x = first.x; x != last.x; ++x) {
+                const size_t node = x + dimensions.x * (y + dimensions.y * z);
+                const float value =
+                        half_storage
+                                ? vload_half(node, (const global half*)pressure)
+                                : pressure[node];
+                if (fabs(peak) < fabs(value)) {
+                    peak = value;
+                }
+            }
+        }
+    }
+    output[index] = peak;
+}
+)";
+
+}  // namespace
+
+mesh_descriptor compute_decimated_descriptor(const mesh_descriptor& descriptor,
+                                             size_t factor) {
+    auto ret = descriptor;
+    const auto offset = descriptor.spacing * (factor - 1) * 0.5f;
+    for (auto i = 0; i != 3; ++i) {
+        ret.min_corner.s[i] += offset;
+        ret.dimensions.s[i] =
+                (descriptor.dimensions.s[i] + factor - 1) / factor;
+    }
+    ret.spacing = descriptor.spacing * factor;
+    return ret;
+}
+
+size_t select_snapshot_factor() {
+    const char* env = std::getenv("WAYVERB_VIZ_DOWNSAMPLE");
+    const auto factor = env ? std::strtoull(env, nullptr, 10) : 1;
+    return factor != 0 ? factor : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class field_snapshotter::impl final {
+    /// A reduced field on the device, and the pinned host memory it is read
+    /// back into.
+    struct slot final {
+        cl::Buffer reduced;
+        cl::Buffer pinned;
+        float* host{};
+        cl::Event ready;
+        size_t step{};
+        bool busy{false};
+    };
+
+public:
+    impl(const core::compute_context& cc,
+         const mesh_descriptor& descriptor,
+         size_t factor,
+         callback_type callback,
+         pressure_storage storage)
+            : program_{cc, source}
+            , kernel_{program_.get_kernel<cl::Buffer,
+                                          cl_int,
+                                          cl_int3,
+                                          cl_int,
+                                          cl_int3,
+                                          cl::Buffer>("decimate_pressure")}
+            , half_storage_{storage == pressure_storage::half}
+            , dimensions_{descriptor.dimensions}
+            , factor_{static_cast<cl_int>(factor)}
+            , descriptor_{compute_decimated_descriptor(descriptor, factor)}
+            , nodes_{compute_num_nodes(descriptor_)}
+            , map_queue_{cc.context, cc.device}
+            , callback_{std::move(callback)} {
+        const auto bytes = sizeof(cl_float) * nodes_;
+        for (auto& slot : slots_) {
+            slot.reduced = cl::Buffer{cc.context, CL_MEM_WRITE_ONLY, bytes};
+            slot.pinned = cl::Buffer{
+                    cc.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes};
+            slot.host = static_cast<float*>(map_queue_.enqueueMapBuffer(
+                    slot.pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes));
+        }
+        worker_ = std::thread{[this] { deliver(); }};
+    }
+
+    ~impl() noexcept {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            quit_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+
+        try {
+            for (auto& slot : slots_) {
+                map_queue_.enqueueUnmapMemObject(slot.pinned, slot.host);
+            }
+            map_queue_.finish();
+        } catch (const std::exception& e) {
+            std::cerr << "[waveguide] snapshot cleanup failed: " << e.what()
+                      << '\n';
+        }
+    }
+
+    const mesh_descriptor& get_descriptor() const { return descriptor_; }
+
+    bool take(cl::CommandQueue& queue, const cl::Buffer& pressure, size_t step) {
+        slot* free_slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            for (auto& slot : slots_) {
+                if (!slot.busy) {
+                    free_slot = &slot;
+                    break;
+                }
+            }
+            if (!free_slot) {
+                return false;
+            }
+            free_slot->busy = true;
+        }
+
+        kernel_(cl::EnqueueArgs{queue, cl::NDRange{nodes_}},
+                pressure,
+                half_storage_,
+                dimensions_,
+                factor_,
+                descriptor_.dimensions,
+                free_slot->reduced);
+        free_slot->ready = core::read_from_buffer_async(
+                queue, free_slot->reduced, 0, nodes_, free_slot->host);
+        queue.flush();
+
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            free_slot->step = step;
+            pending_.emplace_back(free_slot);
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+private:
+    void deliver() {
+        for (;;) {
+            slot* next = nullptr;
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                cv_.wait(lock, [&] { return quit_ || !pending_.empty(); });
+                if (pending_.empty()) {
+                    return;
+                }
+                next = pending_.front();
+                pending_.pop_front();
+            }
+
+            util::aligned::vector<float> pressures;
+            size_t step{};
+            try {
+                next->ready.wait();
+                pressures.assign(next->host, next->host + nodes_);
+                step = next->step;
+            } catch (const std::exception& e) {
+                std::cerr << "[waveguide] snapshot failed: " << e.what()
+                          << '\n';
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                next->busy = false;
+            }
+
+            if (!pressures.empty()) {
+                callback_(std::move(pressures), step);
+            }
+        }
+    }
+
+    core::program_wrapper program_;
+    decltype(std::declval<const core::program_wrapper&>()
+                     .get_kernel<cl::Buffer,  /// pressure
+                                 cl_int,      /// half_storage
+                                 cl_int3,     /// dimensions
+                                 cl_int,      /// factor
+                                 cl_int3,     /// decimated
+                                 cl::Buffer   /// output
+                                 >("")) kernel_;
+    cl_int half_storage_;
+    cl_int3 dimensions_;
+    cl_int factor_;
+    mesh_descriptor descriptor_;
+    size_t nodes_;
+
+    cl::CommandQueue map_queue_;
+    std::array<slot, 2> slots_;
+
+    callback_type callback_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<slot*> pending_;
+    bool quit_{false};
+    std::thread worker_;
+};
+
+field_snapshotter::field_snapshotter(const core::compute_context& cc,
+                                     const mesh_descriptor& descriptor,
+                                     size_t factor,
+                                     callback_type callback,
+                                     pressure_storage storage)
+        : pimpl_{std::make_unique<impl>(
+                  cc, descriptor, factor, std::move(callback), storage)} {}
+
+field_snapshotter::~field_snapshotter() noexcept = default;
+
+const mesh_descriptor& field_snapshotter::get_descriptor() const {
+    return pimpl_->get_descriptor();
+}
+
+bool field_snapshotter::take(cl::CommandQueue& queue,
+                             const cl::Buffer& pressure,
+                             size_t step) {
+    return pimpl_->take(queue, pressure, step);
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
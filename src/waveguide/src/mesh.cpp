@@ -8,11 +8,13 @@
 
 #include "waveguide/cl/utils.h"
 
+#include "core/cl/profiling.h"
 #include "core/conversions.h"
 #include "core/scene_data_loader.h"
 #include "core/spatial_division/scene_buffers.h"
 #include "core/spatial_division/voxelised_scene_data.h"
 
+#include "utilities/instrumentation.h"
 #include "utilities/popcount.h"
 
 #include <cmath>
@@ -25,22 +27,35 @@ namespace waveguide {
 
 mesh::mesh(mesh_descriptor descriptor, vectors vectors)
         : descriptor_(std::move(descriptor))
-        , vectors_(std::move(vectors)) {}
+        , vectors_(std::make_shared<class vectors>(std::move(vectors))) {}
 
 const mesh_descriptor& mesh::get_descriptor() const { return descriptor_; }
-const vectors& mesh::get_structure() const { return vectors_; }
+const vectors& mesh::get_structure() const { return *vectors_; }
+
+std::shared_ptr<const vectors> mesh::get_shared_structure() const {
+    return vectors_;
+}
+
+vectors& mesh::get_unique_structure() {
+    //  Copy on write, so that other meshes sharing the structure are
+    //  unaffected.
+    if (vectors_.use_count() != 1) {
+        vectors_ = std::make_shared<vectors>(*vectors_);
+    }
+    return *vectors_;
+}
 
 bool is_inside(const mesh& m, size_t node_index) {
     return is_inside(m.get_structure().get_condensed_nodes()[node_index]);
 }
 
 void mesh::set_coefficients(coefficients_canonical coefficients) {
-    vectors_.set_coefficients(coefficients);
+    get_unique_structure().set_coefficients(coefficients);
 }
 
 void mesh::set_coefficients(
         util::aligned::vector<coefficients_canonical> coefficients) {
-    vectors_.set_coefficients(std::move(coefficients));
+    get_unique_structure().set_coefficients(std::move(coefficients));
 }
 
 double estimate_volume(const mesh& mesh) {
@@ -63,6 +78,7 @@ mesh compute_mesh(
                 voxelised,
         float mesh_spacing,
         float speed_of_sound) {
+    const util::instrumentation::scoped_timer timer{"mesh/setup"};
     const bool force_identity_coeffs =
             std::getenv("WAYVERB_FORCE_IDENTITY_COEFFS") != nullptr;
     const auto program = setup_program{cc};
@@ -92,14 +108,15 @@ mesh compute_mesh(
         //  find whether each node is inside or outside the model
         {
             auto kernel = program.get_node_inside_kernel();
-            kernel(enqueue(),
-                   node_buffer,
-                   desc,
-                   buffers.get_voxel_index_buffer(),
-                   buffers.get_global_aabb(),
-                   buffers.get_side(),
-                   buffers.get_triangles_buffer(),
-                   buffers.get_vertices_buffer());
+            core::profile_event("mesh/node_inside",
+                                kernel(enqueue(),
+                                       node_buffer,
+                                       desc,
+                                       buffers.get_voxel_index_buffer(),
+                                       buffers.get_global_aabb(),
+                                       buffers.get_side(),
+                                       buffers.get_triangles_buffer(),
+                                       buffers.get_vertices_buffer()));
         }
 
 #ifndef NDEBUG
@@ -119,7 +136,8 @@ mesh compute_mesh(
         //  find node boundary type
         {
             auto kernel = program.get_node_boundary_kernel();
-            kernel(enqueue(), node_buffer, desc);
+            core::profile_event("mesh/node_boundary",
+                                kernel(enqueue(), node_buffer, desc));
         }
 
         return core::read_from_buffer<condensed_node>(queue, node_buffer);
@@ -128,8 +146,10 @@ mesh compute_mesh(
     //  IMPORTANT
     //  compute_boundary_index_data mutates the nodes array, so it must
     //  be run before condensing the nodes.
-    auto boundary_indices =
-            compute_boundary_index_data(cc.device, buffers, desc, nodes);
+    auto boundary_indices = [&] {
+        const util::instrumentation::scoped_timer timer{"mesh/boundary_index"};
+        return compute_boundary_index_data(cc.device, buffers, desc, nodes);
+    }();
 
     auto coefficients = util::map_to_vector(
             begin(voxelised.get_scene_data().get_surfaces()),
@@ -178,8 +198,11 @@ mesh compute_mesh(
                 return coeffs;
             });
 
-    auto boundary_layout = build_boundary_layout(
-            desc, nodes, boundary_indices, coefficients, voxelised);
+    auto boundary_layout = [&] {
+        const util::instrumentation::scoped_timer timer{"mesh/boundary_layout"};
+        return build_boundary_layout(
+                desc, nodes, boundary_indices, coefficients, voxelised);
+    }();
 
     auto v = vectors{std::move(nodes),
                      std::move(coefficients),
@@ -205,13 +228,16 @@ voxels_and_mesh compute_voxels_and_mesh(const core::compute_context& cc,
         } catch (...) {
         }
     }
-    auto voxelised = make_voxelised_scene_data(
-            scene,
-            pad,
-            waveguide::compute_adjusted_boundary(
-                    core::geo::compute_aabb(scene.get_vertices()),
-                    anchor,
-                    mesh_spacing));
+    auto voxelised = [&] {
+        const util::instrumentation::scoped_timer timer{"mesh/voxelise"};
+        return make_voxelised_scene_data(
+                scene,
+                pad,
+                waveguide::compute_adjusted_boundary(
+                        core::geo::compute_aabb(scene.get_vertices()),
+                        anchor,
+                        mesh_spacing));
+    }();
     auto mesh = compute_mesh(cc, voxelised, mesh_spacing, speed_of_sound);
     return {std::move(voxelised), std::move(mesh)};
 }
@@ -63,6 +63,21 @@ std::array<cl_uint, 6> compute_neighbors(const mesh_descriptor& d,
     return ret;
 }
 
+std::uint64_t compute_morton_index(const glm::ivec3& locator) {
+    //  Spreads the low 21 bits of v so that there are two zero bits between
+    //  each.
+    const auto part = [](std::uint32_t v) {
+        std::uint64_t x = v;
+        x = (x | (x << 32)) & 0x1F00000000FFFF;
+        x = (x | (x << 16)) & 0x1F0000FF0000FF;
+        x = (x | (x << 8)) & 0x100F00F00F00F00F;
+        x = (x | (x << 4)) & 0x10C30C30C30C30C3;
+        x = (x | (x << 2)) & 0x1249249249249249;
+        return x;
+    };
+    return (part(locator.z) << 2) | (part(locator.y) << 1) | part(locator.x);
+}
+
 core::geo::box compute_aabb(const mesh_descriptor& d) {
     return core::geo::box{
             core::to_vec3{}(d.min_corner),
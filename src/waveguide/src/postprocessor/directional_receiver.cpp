@@ -3,6 +3,8 @@
 
 #include "core/cl/common.h"
 
+#include <algorithm>
+
 namespace wayverb {
 namespace waveguide {
 namespace postprocessor {
@@ -11,12 +13,29 @@ directional_receiver::directional_receiver(
         const mesh_descriptor& mesh_descriptor,
         double sample_rate,
         double ambient_density,
-        size_t output_node)
-        : mesh_spacing_{mesh_descriptor.spacing}
+        size_t output_node,
+        pressure_storage storage)
+        : directional_receiver{mesh_descriptor.spacing,
+                               sample_rate,
+                               ambient_density,
+                               output_node,
+                               compute_neighbors(mesh_descriptor,
+                                                 output_node),
+                               storage} {}
+
+directional_receiver::directional_receiver(
+        double mesh_spacing,
+        double sample_rate,
+        double ambient_density,
+        size_t output_node,
+        std::array<unsigned, 6> surrounding_nodes,
+        pressure_storage storage)
+        : mesh_spacing_{mesh_spacing}
         , sample_rate_{sample_rate}
         , ambient_density_{ambient_density}
         , output_node_{output_node}
-        , surrounding_nodes_{compute_neighbors(mesh_descriptor, output_node)} {
+        , surrounding_nodes_{surrounding_nodes}
+        , storage_{storage} {
     for (const auto& i : surrounding_nodes_) {
         if (i == ~cl_uint{0}) {
             throw std::runtime_error(
@@ -28,22 +47,34 @@ directional_receiver::directional_receiver(
 
 directional_receiver::return_type directional_receiver::operator()(
         cl::CommandQueue& queue, const cl::Buffer& buffer, size_t /*unused*/) {
-    //  copy out node pressure
-    const auto pressure =
-            core::read_value<cl_float>(queue, buffer, output_node_);
+    //  copy out node pressure and surrounding pressures, all at once
+    constexpr auto num_surrounding = 6;
+    std::array<size_t, num_surrounding + 1> nodes;
+    nodes[0] = output_node_;
+    std::copy(begin(surrounding_nodes_),
+              end(surrounding_nodes_),
+              begin(nodes) + 1);
+    std::array<float, num_surrounding + 1> pressures;
+    read_pressures(queue,
+                   buffer,
+                   nodes.data(),
+                   nodes.size(),
+                   pressures.data(),
+                   storage_);
+    return (*this)(pressures);
+}
 
-    //  copy out surrounding pressures
+directional_receiver::return_type directional_receiver::operator()(
+        const std::array<float, 7>& pressures) {
+    constexpr auto num_surrounding = 6;
+    const auto pressure = pressures[0];
 
     //  pressure difference vector is obtained by subtracting the central
     //  junction pressure from the pressure values of neighboring junctions
     //  and dividing these terms by the spatial sampling period
-    constexpr auto num_surrounding = 6;
     std::array<cl_float, num_surrounding> surrounding;
     for (auto i = 0ul; i != num_surrounding; ++i) {
-        surrounding[i] = (core::read_value<cl_float>(
-                                  queue, buffer, surrounding_nodes_[i]) -
-                          pressure) /
-                         mesh_spacing_;
+        surrounding[i] = (pressures[i + 1] - pressure) / mesh_spacing_;
     }
 
     //  The approximation of the pressure gradient is obtained by
@@ -70,6 +101,12 @@ directional_receiver::return_type directional_receiver::operator()(
 
 size_t directional_receiver::get_output_node() const { return output_node_; }
 
+glm::dvec3 directional_receiver::get_velocity() const { return velocity_; }
+
+void directional_receiver::set_velocity(const glm::dvec3& velocity) {
+    velocity_ = velocity;
+}
+
 }  // namespace postprocessor
 }  // namespace waveguide
 }  // namespace wayverb
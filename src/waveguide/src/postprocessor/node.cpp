@@ -8,13 +8,14 @@ namespace wayverb {
 namespace waveguide {
 namespace postprocessor {
 
-node::node(size_t output_node)
-        : output_node_{output_node} {}
+node::node(size_t output_node, pressure_storage storage)
+        : output_node_{output_node}
+        , storage_{storage} {}
 
 node::return_type node::operator()(cl::CommandQueue& queue,
                                    const cl::Buffer& buffer,
                                    size_t step) const {
-    return core::read_value<cl_float>(queue, buffer, output_node_);
+    return read_pressure(queue, buffer, output_node_, storage_);
 }
 
 size_t node::get_output_node() const { return output_node_; }
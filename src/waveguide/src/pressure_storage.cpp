@@ -0,0 +1,154 @@
+#include "waveguide/pressure_storage.h"
+
+#include "core/cl/common.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace wayverb {
+namespace waveguide {
+
+size_t pressure_size(pressure_storage storage) {
+    return storage == pressure_storage::half ? sizeof(std::uint16_t)
+                                             : sizeof(cl_float);
+}
+
+std::uint16_t float_to_half(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+    const auto exponent = static_cast<int>((bits >> 23) & 0xffu);
+    auto mantissa = bits & 0x7fffffu;
+
+    //  Inf and nan. Nans keep a payload bit so they stay nan.
+    if (exponent == 0xff) {
+        return sign | 0x7c00u | (mantissa ? 0x200u : 0u);
+    }
+
+    //  Rebias from 127 to 15.
+    const auto half_exponent = exponent - 127 + 15;
+    if (half_exponent >= 0x1f) {
+        return sign | 0x7c00u;
+    }
+
+    if (half_exponent <= 0) {
+        //  Subnormal (or zero) in half precision.
+        if (half_exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000u;
+        const auto shift = static_cast<unsigned>(14 - half_exponent);
+        const auto half_mantissa = mantissa >> shift;
+        const auto remainder = mantissa & ((1u << shift) - 1);
+        const auto halfway = 1u << (shift - 1);
+        auto ret = half_mantissa;
+        if (remainder > halfway ||
+            (remainder == halfway && (half_mantissa & 1u))) {
+            ++ret;
+        }
+        return sign | static_cast<std::uint16_t>(ret);
+    }
+
+    auto ret = static_cast<std::uint32_t>(half_exponent << 10) |
+               (mantissa >> 13);
+    const auto remainder = mantissa & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (ret & 1u))) {
+        //  May carry into the exponent, up to and including inf, which is
+        //  the correctly rounded result.
+        ++ret;
+    }
+    return sign | static_cast<std::uint16_t>(ret);
+}
+
+float half_to_float(std::uint16_t value) {
+    const auto sign = static_cast<std::uint32_t>(value & 0x8000u) << 16;
+    auto exponent = static_cast<std::uint32_t>((value >> 10) & 0x1fu);
+    auto mantissa = static_cast<std::uint32_t>(value & 0x3ffu);
+
+    std::uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        //  Normalise the subnormal.
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400u)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+    }
+
+    float ret;
+    std::memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+
+float read_pressure(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t node,
+                    pressure_storage storage) {
+    return storage == pressure_storage::half
+                   ? half_to_float(core::read_value<std::uint16_t>(
+                             queue, buffer, node))
+                   : core::read_value<cl_float>(queue, buffer, node);
+}
+
+void read_pressures(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    const size_t* nodes,
+                    size_t count,
+                    float* output,
+                    pressure_storage storage) {
+    if (count == 0) {
+        return;
+    }
+
+    //  The queue is in-order, so once the last read is done they all are.
+    cl::Event last;
+    if (storage == pressure_storage::half) {
+        std::vector<std::uint16_t> halves(count);
+        for (size_t i = 0; i != count; ++i) {
+            last = core::read_value_async(queue, buffer, nodes[i], halves[i]);
+        }
+        last.wait();
+        std::transform(begin(halves), end(halves), output, half_to_float);
+    } else {
+        for (size_t i = 0; i != count; ++i) {
+            last = core::read_value_async(queue, buffer, nodes[i], output[i]);
+        }
+        last.wait();
+    }
+}
+
+void write_pressure(cl::CommandQueue& queue,
+                    cl::Buffer& buffer,
+                    size_t node,
+                    float value,
+                    pressure_storage storage) {
+    if (storage == pressure_storage::half) {
+        core::write_value(queue, buffer, node, float_to_half(value));
+    } else {
+        core::write_value(queue, buffer, node, value);
+    }
+}
+
+util::aligned::vector<float> read_pressures(cl::CommandQueue& queue,
+                                            const cl::Buffer& buffer,
+                                            pressure_storage storage) {
+    if (storage == pressure_storage::single) {
+        return core::read_from_buffer<cl_float>(queue, buffer);
+    }
+    const auto halves = core::read_from_buffer<std::uint16_t>(queue, buffer);
+    util::aligned::vector<float> ret(halves.size());
+    std::transform(begin(halves), end(halves), begin(ret), half_to_float);
+    return ret;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
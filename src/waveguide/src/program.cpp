@@ -11,6 +11,19 @@ namespace waveguide {
 constexpr auto source = R"(
 #define courant (1.0f / sqrt(3.0f))
 #define courant_sq (1.0f / 3.0f)
+
+//  Pressure fields are stored as float, or as half with
+//  WAYVERB_HALF_PRESSURE. Either way, arithmetic is done in float.
+#ifdef WAYVERB_HALF_PRESSURE
+typedef half pressure_t;
+#define load_pressure(buffer, index) vload_half((index), (buffer))
+#define store_pressure(buffer, index, value) \
+    vstore_half((value), (index), (buffer))
+#else
+typedef float pressure_t;
+#define load_pressure(buffer, index) ((buffer)[(index)])
+#define store_pressure(buffer, index, value) ((buffer)[(index)] = (value))
+#endif
 #define WAYVERB_OFFSET_OF(type, member)                                        \
     ((uint)((__constant char*)&(((__constant type*)0)->member) -               \
             (__constant char*)((__constant type*)0)))
@@ -128,6 +141,10 @@ int boundary_local_index(uint boundary_type, uint boundary_bit) {
     return (int)popcount(lower);
 }
 
+//  NaN diagnostics and per-node traces are only recorded by the debug variant
+//  of the program (WAYVERB_WG_DEBUG). In the production variant these are
+//  empty, and the kernels below take no debug or trace arguments.
+
 inline void record_nan(global int* debug_info,
                        int code,
                        uint global_index,
@@ -141,6 +158,7 @@ inline void record_nan(global int* debug_info,
                        float filter_input_bits,
                        float prev_bits,
                        float next_bits) {
+#ifdef WAYVERB_WG_DEBUG
     if (debug_info == 0) {
         return;
     }
@@ -159,6 +177,7 @@ inline void record_nan(global int* debug_info,
         debug_info[10] = (int)as_uint(prev_bits);
         debug_info[11] = (int)as_uint(next_bits);
     }
+#endif
 }
 
 inline void record_pressure_nan(global int* debug_info,
@@ -166,6 +185,7 @@ inline void record_pressure_nan(global int* debug_info,
                                 uint global_index,
                                 float prev_bits,
                                 float next_bits) {
+#ifdef WAYVERB_WG_DEBUG
     if (debug_info == 0) {
         return;
     }
@@ -182,6 +202,7 @@ inline void record_pressure_nan(global int* debug_info,
             debug_info[i] = 0;
         }
     }
+#endif
 }
 
 typedef struct {
@@ -220,6 +241,7 @@ inline void trace_write(__global trace_record_t* records,
                         float diff,
                         float a0,
                         float b0) {
+#ifdef WAYVERB_WG_DEBUG
     if (!enabled || records == 0 || head == 0 || capacity == 0) {
         return;
     }
@@ -239,6 +261,7 @@ inline void trace_write(__global trace_record_t* records,
     rec.a0 = a0;
     rec.b0 = b0;
     records[slot] = rec;
+#endif
 }
 
 filt_real filter_step_canonical_private(
@@ -665,22 +688,23 @@ PROCESS_BOUNDARY_FACES_TEMPLATE(3);
     float CAT(get_summed_surrounding_, dimensions)(                          \
             const global condensed_node* nodes,                              \
             CAT(InnerNodeDirections, dimensions) pd,                         \
-            const global float* current,                                     \
-            int3 locator,                                                    \
-            int3 dim,                                                        \
+            const global pressure_t* current,                                \
+            node_locator locator,                                            \
+            node_topology dim,                                               \
             volatile global int* error_flag);                                \
     float CAT(get_summed_surrounding_, dimensions)(                          \
             const global condensed_node* nodes,                              \
             CAT(InnerNodeDirections, dimensions) pd,                         \
-            const global float* current,                                     \
-            int3 locator,                                                    \
-            int3 dim,                                                        \
+            const global pressure_t* current,                                \
+            node_locator locator,                                            \
+            node_topology dim,                                               \
             volatile global int* error_flag) {                               \
         float ret = 0;                                                       \
         CAT(SurroundingPorts, dimensions)                                    \
         on_boundary = CAT(on_boundary_, dimensions)(pd);                     \
         for (int i = 0; i != CAT(NUM_SURROUNDING_PORTS_, dimensions); ++i) { \
-            uint index = neighbor_index(locator, dim, on_boundary.array[i]); \
+            uint index =                                                     \
+                    topology_neighbor(locator, dim, on_boundary.array[i]);   \
             if (index == no_neighbor) {                                      \
                 atomic_or(error_flag, id_outside_mesh_error);                \
                 return 0;                                                    \
@@ -689,7 +713,7 @@ PROCESS_BOUNDARY_FACES_TEMPLATE(3);
             if (boundary_type == id_none || boundary_type == id_inside) {    \
                 atomic_or(error_flag, id_suspicious_boundary_error);         \
             }                                                                \
-            ret += current[index];                                           \
+            ret += load_pressure(current, index);                            \
         }                                                                    \
         return ret;                                                          \
     }
@@ -699,15 +723,15 @@ TEMPLATE_SUM_SURROUNDING_PORTS(2);
 
 float get_summed_surrounding_3(const global condensed_node* nodes,
                                InnerNodeDirections3 i,
-                               const global float* current,
-                               int3 locator,
-                               int3 dimensions,
+                               const global pressure_t* current,
+                               node_locator locator,
+                               node_topology dimensions,
                                volatile global int* error_flag);
 float get_summed_surrounding_3(const global condensed_node* nodes,
                                InnerNodeDirections3 i,
-                               const global float* current,
-                               int3 locator,
-                               int3 dimensions,
+                               const global pressure_t* current,
+                               node_locator locator,
+                               node_topology dimensions,
                                volatile global int* error_flag) {
     return 0;
 }
@@ -715,38 +739,38 @@ float get_summed_surrounding_3(const global condensed_node* nodes,
 ////////////////////////////////////////////////////////////////////////////////
 
 float get_inner_pressure(const global condensed_node* nodes,
-                         const global float* current,
-                         int3 locator,
-                         int3 dim,
+                         const global pressure_t* current,
+                         node_locator locator,
+                         node_topology dim,
                          PortDirection bt,
                          volatile global int* error_flag);
 float get_inner_pressure(const global condensed_node* nodes,
-                         const global float* current,
-                         int3 locator,
-                         int3 dim,
+                         const global pressure_t* current,
+                         node_locator locator,
+                         node_topology dim,
                          PortDirection bt,
                          volatile global int* error_flag) {
-    uint neighbor = neighbor_index(locator, dim, bt);
+    uint neighbor = topology_neighbor(locator, dim, bt);
     if (neighbor == no_neighbor) {
         atomic_or(error_flag, id_outside_mesh_error);
         return 0;
     }
-    return current[neighbor];
+    return load_pressure(current, neighbor);
 }
 
 #define GET_CURRENT_SURROUNDING_WEIGHTING_TEMPLATE(dimensions)                 \
     float CAT(get_current_surrounding_weighting_, dimensions)(                 \
             const global condensed_node* nodes,                                \
-            const global float* current,                                       \
-            int3 locator,                                                      \
-            int3 dim,                                                          \
+            const global pressure_t* current,                                  \
+            node_locator locator,                                              \
+            node_topology dim,                                                 \
             CAT(InnerNodeDirections, dimensions) ind,                          \
             volatile global int* error_flag);                                  \
     float CAT(get_current_surrounding_weighting_, dimensions)(                 \
             const global condensed_node* nodes,                                \
-            const global float* current,                                       \
-            int3 locator,                                                      \
-            int3 dim,                                                          \
+            const global pressure_t* current,                                  \
+            node_locator locator,                                              \
+            node_topology dim,                                                 \
             CAT(InnerNodeDirections, dimensions) ind,                          \
             volatile global int* error_flag) {                                 \
         float sum = 0;                                                         \
@@ -809,12 +833,12 @@ inline float solve_boundary_pressure(
     return ret;
 }
 
-float boundary_1(const global float* current,
+float boundary_1(const global pressure_t* current,
                  float prev_pressure,
                  condensed_node node,
                  const global condensed_node* nodes,
-                 int3 locator,
-                 int3 dim,
+                 node_locator locator,
+                 node_topology dim,
                  boundary_header header,
                  uint layout_index,
                  const global uint* coeff_offsets,
@@ -849,12 +873,12 @@ float boundary_1(const global float* current,
                                    1);
 }
 
-float boundary_2(const global float* current,
+float boundary_2(const global pressure_t* current,
                  float prev_pressure,
                  condensed_node node,
                  const global condensed_node* nodes,
-                 int3 locator,
-                 int3 dim,
+                 node_locator locator,
+                 node_topology dim,
                  boundary_header header,
                  uint layout_index,
                  const global uint* coeff_offsets,
@@ -889,12 +913,12 @@ float boundary_2(const global float* current,
                                    2);
 }
 
-float boundary_3(const global float* current,
+float boundary_3(const global pressure_t* current,
                  float prev_pressure,
                  condensed_node node,
                  const global condensed_node* nodes,
-                 int3 locator,
-                 int3 dim,
+                 node_locator locator,
+                 node_topology dim,
                  boundary_header header,
                  uint layout_index,
                  const global uint* coeff_offsets,
@@ -934,18 +958,18 @@ float boundary_3(const global float* current,
 #define ENABLE_BOUNDARIES (1)
 
 float normal_waveguide_update(float prev_pressure,
-                              const global float* current,
-                              int3 dimensions,
-                              int3 locator);
+                              const global pressure_t* current,
+                              node_topology dimensions,
+                              node_locator locator);
 float normal_waveguide_update(float prev_pressure,
-                              const global float* current,
-                              int3 dimensions,
-                              int3 locator) {
+                              const global pressure_t* current,
+                              node_topology dimensions,
+                              node_locator locator) {
     float ret = 0;
     for (int i = 0; i != PORTS; ++i) {
-        uint port_index = neighbor_index(locator, dimensions, i);
+        uint port_index = topology_neighbor(locator, dimensions, i);
         if (port_index != no_neighbor) {
-            ret += current[port_index];
+            ret += load_pressure(current, port_index);
         }
     }
 
@@ -958,9 +982,9 @@ float next_waveguide_pressure(
         const condensed_node node,
         const global condensed_node* nodes,
         float prev_pressure,
-        const global float* current,
-        int3 dimensions,
-        int3 locator,
+        const global pressure_t* current,
+        node_topology dimensions,
+        node_locator locator,
         const global boundary_header* boundary_headers,
         const global uint* coeff_offsets,
         const global coefficients_canonical* coeff_blocks,
@@ -973,9 +997,9 @@ float next_waveguide_pressure(
         const condensed_node node,
         const global condensed_node* nodes,
         float prev_pressure,
-        const global float* current,
-        int3 dimensions,
-        int3 locator,
+        const global pressure_t* current,
+        node_topology dimensions,
+        node_locator locator,
         const global boundary_header* boundary_headers,
         const global uint* coeff_offsets,
         const global coefficients_canonical* coeff_blocks,
@@ -1064,16 +1088,26 @@ float next_waveguide_pressure(
             prev_pressure, current, dimensions, locator);
 }
 
-kernel void zero_buffer(global float* buffer) {
+kernel void zero_buffer(global pressure_t* buffer) {
     const size_t thread = get_global_id(0);
-    buffer[thread] = 0.0f;
+    store_pressure(buffer, thread, 0.0f);
+}
+
+/// Adds `value` to the same node in every band's plane, one band per work
+/// item.
+kernel void add_to_node_multiband(global pressure_t* current,
+                                  const uint node,
+                                  const float value,
+                                  const uint plane_stride) {
+    const uint index = get_global_id(0) * plane_stride + node;
+    store_pressure(current, index, load_pressure(current, index) + value);
 }
 
 kernel void condensed_waveguide(
-        global float* previous,
-        const global float* current,
+        global pressure_t* previous,
+        const global pressure_t* current,
         const global condensed_node* nodes,
-        int3 dimensions,
+        node_topology dimensions,
         const global boundary_header* boundary_headers,
         const global float* boundary_sdf_distance,
         const global float3* boundary_sdf_normal,
@@ -1082,6 +1116,7 @@ kernel void condensed_waveguide(
         global memory_canonical* filter_memories,
         const global uint* boundary_lookup,
         volatile global int* error_flag,
+#ifdef WAYVERB_WG_DEBUG
         global int* debug_info,
         const uint num_prev,
         const uint trace_target,
@@ -1090,6 +1125,16 @@ kernel void condensed_waveguide(
         const uint trace_capacity,
         const uint trace_enabled,
         const uint step_index) {
+#else
+        const uint num_prev) {
+    global int* debug_info = 0;
+    const uint trace_target = ~0u;
+    __global trace_record_t* trace_records = 0;
+    __global uint* trace_head = 0;
+    const uint trace_capacity = 0;
+    const uint trace_enabled = 0;
+    const uint step_index = 0;
+#endif
     (void)boundary_sdf_distance;
     (void)boundary_sdf_normal;
     const size_t index = get_global_id(0);
@@ -1105,10 +1150,10 @@ kernel void condensed_waveguide(
     }
 
     const condensed_node node = nodes[index];
-    const int3 locator = to_locator(index, dimensions);
+    const node_locator locator = make_node_locator(index, dimensions);
 
-    const float prev_pressure = previous[index];
-    const float current_pressure = current[index];
+    const float prev_pressure = load_pressure(previous, index);
+    const float current_pressure = load_pressure(current, index);
     const float next_pressure = next_waveguide_pressure(node,
                                                         nodes,
                                                         prev_pressure,
@@ -1155,13 +1200,13 @@ kernel void condensed_waveguide(
         atomic_or(error_flag, id_nan_error);
     }
 
-    previous[index] = next_pressure;
+    store_pressure(previous, index, next_pressure);
 }
 
 kernel void update_boundaries(
-        const global float* previous_history,
-        const global float* current,
-        global float* next,
+        const global pressure_t* previous_history,
+        const global pressure_t* current,
+        global pressure_t* next,
         const global condensed_node* nodes,
         int3 grid_dimensions,
         const global uint* boundary_node_indices,
@@ -1171,6 +1216,7 @@ kernel void update_boundaries(
         global memory_canonical* filter_memories,
         const global uint* boundary_lookup,
         volatile global int* error_flag,
+#ifdef WAYVERB_WG_DEBUG
         global int* debug_info,
         const uint trace_target,
         __global trace_record_t* trace_records,
@@ -1179,6 +1225,16 @@ kernel void update_boundaries(
         const uint trace_enabled,
         const uint step_index,
         const uint boundary_count) {
+#else
+        const uint boundary_count) {
+    global int* debug_info = 0;
+    const uint trace_target = ~0u;
+    __global trace_record_t* trace_records = 0;
+    __global uint* trace_head = 0;
+    const uint trace_capacity = 0;
+    const uint trace_enabled = 0;
+    const uint step_index = 0;
+#endif
     const uint layout_index = (uint)get_global_id(0);
     if (layout_index >= boundary_count) {
         return;
@@ -1201,9 +1257,9 @@ kernel void update_boundaries(
     const int boundary_bits = node.boundary_type &
             (id_nx | id_px | id_ny | id_py | id_nz | id_pz);
     const int boundary_faces = popcount(boundary_bits);
-    const float prev_pressure = previous_history[global_index];
-    const float current_pressure = current[global_index];
-    const float next_pressure = next[global_index];
+    const float prev_pressure = load_pressure(previous_history, global_index);
+    const float current_pressure = load_pressure(current, global_index);
+    const float next_pressure = load_pressure(next, global_index);
     const int trace_kind = boundary_faces == 1
             ? TRACE_KIND_BOUNDARY_1
             : boundary_faces == 2 ? TRACE_KIND_BOUNDARY_2
@@ -1273,6 +1329,298 @@ kernel void update_boundaries(
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+//  Multi-band variants. Pressure buffers hold one plane of `plane_stride`
+//  floats per band, and the coefficient blocks and filter memories hold one
+//  copy per band, so a band is just an offset into each buffer and the
+//  single-band boundary code is reused unchanged. Topology (node type,
+//  locator, neighbour indices, boundary lookup) is loaded once per node and
+//  shared by every band.
+
+kernel void condensed_waveguide_multiband(
+        global pressure_t* previous,
+        const global pressure_t* current,
+        const global condensed_node* nodes,
+        node_topology dimensions,
+        const global boundary_header* boundary_headers,
+        const global uint* coeff_offsets,
+        const global coefficients_canonical* coeff_blocks,
+        global memory_canonical* filter_memories,
+        const global uint* boundary_lookup,
+        volatile global int* error_flag,
+#ifdef WAYVERB_WG_DEBUG
+        global int* debug_info,
+#endif
+        const uint num_prev,
+        const uint bands,
+        const uint plane_stride,
+        const uint coeff_stride,
+        const uint memory_stride) {
+#ifndef WAYVERB_WG_DEBUG
+    global int* debug_info = 0;
+#endif
+    const size_t index = get_global_id(0);
+
+    if (index >= num_prev) {
+        atomic_or(error_flag, id_outside_range_error);
+        return;
+    }
+
+    //  Everything that depends only on the node, including the boundary
+    //  header, is loaded once and shared by every band.
+    const condensed_node node = nodes[index];
+    const node_locator locator = make_node_locator(index, dimensions);
+
+    const int boundary_bits = node.boundary_type &
+            (id_nx | id_px | id_ny | id_py | id_nz | id_pz);
+    const int boundary_faces = popcount(boundary_bits);
+    bool interior = boundary_faces == 0 || boundary_faces > 3 ||
+                    (node.boundary_type & id_inside) ||
+                    (node.boundary_type & id_reentrant);
+
+#if ENABLE_BOUNDARIES
+    uint layout_index = 0xFFFFFFFFu;
+    boundary_header header;
+    if (!interior) {
+        layout_index = boundary_lookup[index];
+        if (layout_index != 0xFFFFFFFFu) {
+            header = boundary_headers[layout_index];
+        }
+        if (layout_index == 0xFFFFFFFFu ||
+            header.guard != ((uint)index ^ 0xA5A5A5A5u)) {
+            atomic_or(error_flag, id_suspicious_boundary_error);
+            interior = true;
+        }
+    }
+#else
+    interior = true;
+#endif
+
+    uint neighbors[PORTS];
+    if (interior) {
+        for (int i = 0; i != PORTS; ++i) {
+            neighbors[i] = topology_neighbor(locator, dimensions, i);
+        }
+    }
+
+    for (uint band = 0; band != bands; ++band) {
+        const uint plane = band * plane_stride;
+        const float prev_pressure = load_pressure(previous, plane + index);
+
+        float next_pressure = 0;
+        if (interior) {
+            for (int i = 0; i != PORTS; ++i) {
+                if (neighbors[i] != no_neighbor) {
+                    next_pressure +=
+                            load_pressure(current, plane + neighbors[i]);
+                }
+            }
+            next_pressure = next_pressure / (PORTS / 2) - prev_pressure;
+        }
+#if ENABLE_BOUNDARIES
+        else {
+            const global coefficients_canonical* band_coeff_blocks =
+                    coeff_blocks + band * coeff_stride;
+            global memory_canonical* band_filter_memories =
+                    filter_memories + band * memory_stride;
+            switch (boundary_faces) {
+                case 1:
+                    next_pressure = boundary_1(current + plane,
+                                               prev_pressure,
+                                               node,
+                                               nodes,
+                                               locator,
+                                               dimensions,
+                                               header,
+                                               layout_index,
+                                               coeff_offsets,
+                                               band_coeff_blocks,
+                                               band_filter_memories,
+                                               error_flag,
+                                               debug_info,
+                                               (uint)index);
+                    break;
+                case 2:
+                    next_pressure = boundary_2(current + plane,
+                                               prev_pressure,
+                                               node,
+                                               nodes,
+                                               locator,
+                                               dimensions,
+                                               header,
+                                               layout_index,
+                                               coeff_offsets,
+                                               band_coeff_blocks,
+                                               band_filter_memories,
+                                               error_flag,
+                                               debug_info,
+                                               (uint)index);
+                    break;
+                default:
+                    next_pressure = boundary_3(current + plane,
+                                               prev_pressure,
+                                               node,
+                                               nodes,
+                                               locator,
+                                               dimensions,
+                                               header,
+                                               layout_index,
+                                               coeff_offsets,
+                                               band_coeff_blocks,
+                                               band_filter_memories,
+                                               error_flag,
+                                               debug_info,
+                                               (uint)index);
+                    break;
+            }
+        }
+#endif
+
+        if (isinf(next_pressure)) {
+            atomic_or(error_flag, id_inf_error);
+        }
+        if (isnan(next_pressure)) {
+            record_pressure_nan(debug_info,
+                                100,
+                                (uint)index,
+                                prev_pressure,
+                                next_pressure);
+            atomic_or(error_flag, id_nan_error);
+        }
+
+        store_pressure(previous, plane + index, next_pressure);
+    }
+}
+
+kernel void update_boundaries_multiband(
+        const global pressure_t* previous_history,
+        const global pressure_t* current,
+        global pressure_t* next,
+        const global condensed_node* nodes,
+        const global uint* boundary_node_indices,
+        const global boundary_header* boundary_headers,
+        const global uint* coeff_offsets,
+        const global coefficients_canonical* coeff_blocks,
+        global memory_canonical* filter_memories,
+        const global uint* boundary_lookup,
+        volatile global int* error_flag,
+#ifdef WAYVERB_WG_DEBUG
+        global int* debug_info,
+#endif
+        const uint boundary_count,
+        const uint bands,
+        const uint plane_stride,
+        const uint coeff_stride,
+        const uint memory_stride) {
+#ifndef WAYVERB_WG_DEBUG
+    global int* debug_info = 0;
+#endif
+    const uint layout_index = (uint)get_global_id(0);
+    if (layout_index >= boundary_count) {
+        return;
+    }
+
+    const uint global_index = boundary_node_indices[layout_index];
+    if (boundary_lookup[global_index] != layout_index) {
+        atomic_or(error_flag, id_suspicious_boundary_error);
+        return;
+    }
+
+    const boundary_header header = boundary_headers[layout_index];
+    if (header.guard != (global_index ^ 0xA5A5A5A5u)) {
+        atomic_or(error_flag, id_suspicious_boundary_error);
+        return;
+    }
+
+    const condensed_node node = nodes[global_index];
+    const int boundary_faces = popcount(node.boundary_type &
+            (id_nx | id_px | id_ny | id_py | id_nz | id_pz));
+    const int trace_kind = boundary_faces == 1
+            ? TRACE_KIND_BOUNDARY_1
+            : boundary_faces == 2 ? TRACE_KIND_BOUNDARY_2
+                                  : TRACE_KIND_BOUNDARY_3;
+
+    for (uint band = 0; band != bands; ++band) {
+        const uint plane = band * plane_stride;
+        const float prev_pressure =
+                load_pressure(previous_history, plane + global_index);
+        const float current_pressure =
+                load_pressure(current, plane + global_index);
+        const float next_pressure = load_pressure(next, plane + global_index);
+        const global coefficients_canonical* band_blocks =
+                coeff_blocks + band * coeff_stride;
+        global memory_canonical* band_memories =
+                filter_memories + band * memory_stride;
+
+        switch (boundary_faces) {
+            case 1:
+                process_boundary_faces_1(
+                        get_inner_node_directions_1(node.boundary_type),
+                        trace_kind,
+                        prev_pressure,
+                        current_pressure,
+                        next_pressure,
+                        layout_index,
+                        global_index,
+                        0u,
+                        0xFFFFFFFFu,
+                        0u,
+                        band_blocks,
+                        coeff_offsets,
+                        band_memories,
+                        error_flag,
+                        debug_info,
+                        0,
+                        0,
+                        0u);
+                break;
+            case 2:
+                process_boundary_faces_2(
+                        get_inner_node_directions_2(node.boundary_type),
+                        trace_kind,
+                        prev_pressure,
+                        current_pressure,
+                        next_pressure,
+                        layout_index,
+                        global_index,
+                        0u,
+                        0xFFFFFFFFu,
+                        0u,
+                        band_blocks,
+                        coeff_offsets,
+                        band_memories,
+                        error_flag,
+                        debug_info,
+                        0,
+                        0,
+                        0u);
+                break;
+            default:
+                process_boundary_faces_3(
+                        get_inner_node_directions_3(node.boundary_type),
+                        trace_kind,
+                        prev_pressure,
+                        current_pressure,
+                        next_pressure,
+                        layout_index,
+                        global_index,
+                        0u,
+                        0xFFFFFFFFu,
+                        0u,
+                        band_blocks,
+                        coeff_offsets,
+                        band_memories,
+                        error_flag,
+                        debug_info,
+                        0,
+                        0,
+                        0u);
+                break;
+        }
+    }
+}
+
 typedef struct {
     uint sz_memory_canonical;
     uint sz_coefficients_canonical;
@@ -1307,18 +1655,40 @@ kernel void layout_probe(__global layout_info_t* out_info) {
 }
 
 kernel void probe_previous(
-        const global float* previous, uint probe_index, global float* out) {
+        const global pressure_t* previous, uint probe_index, global float* out) {
     if (get_global_id(0) == 0) {
-        out[0] = previous[probe_index];
+        out[0] = load_pressure(previous, probe_index);
     }
 }
 
+//  Copies a compacted pressure buffer into a dense one, for callers which
+//  index pressure by dense mesh position. Cells which are not stored are left
+//  untouched.
+kernel void scatter_sparse(const global pressure_t* sparse,
+                           const global uint* dense_indices,
+                           global pressure_t* dense) {
+    const size_t index = get_global_id(0);
+    store_pressure(dense, dense_indices[index], load_pressure(sparse, index));
+}
+
 )";
 
-program::program(const core::compute_context& cc)
+program::program(const core::compute_context& cc,
+                 node_storage storage,
+                 kernel_variant variant,
+                 pressure_storage pressure)
         : program_wrapper_{
                   cc,
                   std::vector<std::string>{
+                          storage == node_storage::sparse
+                                  ? "#define WAYVERB_SPARSE_NODES\n"
+                                  : "",
+                          variant == kernel_variant::debug
+                                  ? "#define WAYVERB_WG_DEBUG\n"
+                                  : "",
+                          pressure == pressure_storage::half
+                                  ? "#define WAYVERB_HALF_PRESSURE\n"
+                                  : "",
                           cl_sources::filter_constants,
                           core::cl_representation_v<filt_real>,
                           core::cl_representation_v<memory_biquad>,
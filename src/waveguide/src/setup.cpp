@@ -76,6 +76,8 @@ const util::aligned::vector<coefficients_canonical>& vectors::get_coefficients()
 
 void vectors::set_coefficients(coefficients_canonical c) {
     std::fill(begin(coefficients_), end(coefficients_), c);
+    boundary_layout_.coeff_blocks =
+            make_coeff_blocks(boundary_layout_, coefficients_);
 }
 
 void vectors::set_coefficients(
@@ -86,6 +88,8 @@ void vectors::set_coefficients(
                 "one in order to maintain object invariants.");
     }
     coefficients_ = std::move(c);
+    boundary_layout_.coeff_blocks =
+            make_coeff_blocks(boundary_layout_, coefficients_);
 }
 
 }  // namespace waveguide
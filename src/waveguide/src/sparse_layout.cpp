@@ -0,0 +1,137 @@
+#include "waveguide/sparse_layout.h"
+#include "waveguide/boundary_guard.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+
+/// A key which sorts nodes into storage order.
+std::uint64_t compute_order_key(const mesh_descriptor& descriptor,
+                                node_ordering ordering,
+                                size_t dense_index) {
+    switch (ordering) {
+        case node_ordering::dense: return dense_index;
+        case node_ordering::morton:
+            return compute_morton_index(
+                    compute_locator(descriptor, dense_index));
+    }
+    return dense_index;
+}
+
+}  // namespace
+
+sparse_layout make_sparse_layout(const mesh& mesh, node_ordering ordering) {
+    const auto& descriptor = mesh.get_descriptor();
+    const auto& dense_nodes = mesh.get_structure().get_condensed_nodes();
+    const auto& dense_boundary = mesh.get_structure().get_boundary_layout();
+
+    sparse_layout ret{descriptor, ordering};
+    for (size_t i = 0; i != dense_nodes.size(); ++i) {
+        if (dense_nodes[i].boundary_type != id_none) {
+            ret.dense_indices.emplace_back(i);
+        }
+    }
+
+    if (ordering != node_ordering::dense) {
+        util::aligned::vector<std::pair<std::uint64_t, cl_uint>> keyed;
+        keyed.reserve(ret.dense_indices.size());
+        for (const auto i : ret.dense_indices) {
+            keyed.emplace_back(compute_order_key(descriptor, ordering, i), i);
+        }
+        std::sort(begin(keyed), end(keyed));
+        for (size_t i = 0; i != keyed.size(); ++i) {
+            ret.dense_indices[i] = keyed[i].second;
+        }
+    }
+
+    //  A full dense-to-compact table is only needed while building.
+    util::aligned::vector<cl_uint> compact_indices(dense_nodes.size(),
+                                                   no_neighbor);
+    for (size_t i = 0; i != ret.dense_indices.size(); ++i) {
+        compact_indices[ret.dense_indices[i]] = i;
+        ret.nodes.emplace_back(dense_nodes[ret.dense_indices[i]]);
+    }
+
+    ret.neighbors.resize(ret.dense_indices.size() * num_ports);
+    for (size_t i = 0; i != ret.dense_indices.size(); ++i) {
+        const auto dense_neighbors =
+                compute_neighbors(descriptor, ret.dense_indices[i]);
+        for (size_t port = 0; port != num_ports; ++port) {
+            ret.neighbors[i * num_ports + port] =
+                    dense_neighbors[port] == no_neighbor
+                            ? no_neighbor
+                            : compact_indices[dense_neighbors[port]];
+        }
+    }
+
+    //  The geometry and coefficients of the boundary layout are unchanged,
+    //  only the node indices (and the guards derived from them) move.
+    ret.boundaries = dense_boundary;
+    auto& boundary = ret.boundaries;
+    for (size_t i = 0; i != boundary.node_indices.size(); ++i) {
+        const auto compact = compact_indices[boundary.node_indices[i]];
+        boundary.node_indices[i] = compact;
+        boundary.headers[i].guard = make_boundary_guard_tag(compact);
+    }
+    boundary.node_lookup.assign(ret.dense_indices.size(),
+                                std::numeric_limits<uint32_t>::max());
+    for (size_t i = 0; i != ret.dense_indices.size(); ++i) {
+        boundary.node_lookup[i] =
+                dense_boundary.node_lookup[ret.dense_indices[i]];
+    }
+
+    return ret;
+}
+
+cl_uint compute_compact_index(const sparse_layout& layout,
+                              size_t dense_index) {
+    const auto key_of = [&](size_t i) {
+        return compute_order_key(layout.descriptor, layout.ordering, i);
+    };
+    const auto key = key_of(dense_index);
+    const auto it = std::lower_bound(
+            begin(layout.dense_indices),
+            end(layout.dense_indices),
+            key,
+            [&](auto stored, auto k) { return key_of(stored) < k; });
+    if (it == end(layout.dense_indices) || *it != dense_index) {
+        return no_neighbor;
+    }
+    return std::distance(begin(layout.dense_indices), it);
+}
+
+std::array<cl_uint, num_ports> compute_neighbors(const sparse_layout& layout,
+                                                 size_t compact_index) {
+    std::array<cl_uint, num_ports> ret;
+    std::copy_n(begin(layout.neighbors) + compact_index * num_ports,
+                num_ports,
+                begin(ret));
+    return ret;
+}
+
+double compute_occupancy(const sparse_layout& layout, const mesh& mesh) {
+    const auto total = mesh.get_structure().get_condensed_nodes().size();
+    return total ? layout.dense_indices.size() / static_cast<double>(total)
+                 : 0.0;
+}
+
+double compute_mean_neighbor_distance(const sparse_layout& layout) {
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = 0; i != layout.neighbors.size(); ++i) {
+        const auto neighbor = layout.neighbors[i];
+        if (neighbor != no_neighbor) {
+            const auto self = i / num_ports;
+            sum += neighbor > self ? neighbor - self : self - neighbor;
+            count += 1;
+        }
+    }
+    return count ? sum / count : 0.0;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
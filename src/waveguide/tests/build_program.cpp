@@ -11,6 +11,9 @@ TEST(build_program, waveguide) {
         try {
             const compute_context cc{dev};
             ASSERT_NO_THROW(program{cc});
+            ASSERT_NO_THROW((program{cc, node_storage::sparse}));
+            ASSERT_NO_THROW((program{
+                    cc, node_storage::dense, kernel_variant::debug}));
             initialized_device = true;
         } catch (const std::exception& e) {
             GTEST_LOG_(WARNING) << "Skipping device " << static_cast<int>(dev)
@@ -1,3 +1,5 @@
+#include "waveguide/coefficient_overlay.h"
+#include "waveguide/fitted_boundary.h"
 #include "waveguide/mesh.h"
 
 #include "core/cl/common.h"
@@ -69,4 +71,36 @@ TEST_F(mesh_fixture, position_index) {
     }
 }
 
+TEST_F(mesh_fixture, shared_structure) {
+    const auto mesh{get_mesh(voxelised)};
+
+    //  Copies share the node structure.
+    auto copy{mesh};
+    ASSERT_EQ(&mesh.get_structure(), &copy.get_structure());
+
+    //  Overlays leave the mesh alone.
+    const auto num_surfaces{mesh.get_structure().get_coefficients().size()};
+    const coefficient_overlay overlay{
+            mesh,
+            util::aligned::vector<coefficients_canonical>(
+                    num_surfaces, to_flat_coefficients(0.5))};
+    ASSERT_EQ(overlay.get_coeff_blocks().size(),
+              mesh.get_structure().get_boundary_layout().coeff_blocks.size());
+    ASSERT_EQ(&mesh.get_structure(), &copy.get_structure());
+
+    //  Changing a copy's coefficients detaches it.
+    copy.set_coefficients(to_flat_coefficients(0.5));
+    ASSERT_NE(&mesh.get_structure(), &copy.get_structure());
+    ASSERT_EQ(mesh.get_structure().get_condensed_nodes(),
+              copy.get_structure().get_condensed_nodes());
+}
+
+TEST(morton_index, interleaves_axes) {
+    ASSERT_EQ(compute_morton_index(glm::ivec3{1, 0, 0}), 1u);
+    ASSERT_EQ(compute_morton_index(glm::ivec3{0, 1, 0}), 2u);
+    ASSERT_EQ(compute_morton_index(glm::ivec3{0, 0, 1}), 4u);
+    ASSERT_EQ(compute_morton_index(glm::ivec3{2, 0, 0}), 8u);
+    ASSERT_EQ(compute_morton_index(glm::ivec3{3, 3, 3}), 63u);
+}
+
 }  // namespace
@@ -43,3 +43,44 @@ TEST(sample_rate_conversion, convert) {
 
     scale_and_write(scale, "impulse", output, output_sr);
 }
+
+TEST(sample_rate_conversion, matches_libsamplerate) {
+    //  A band-limited signal should come out of both converters with the
+    //  same level and timing.
+    const auto input_sr = 7373.5;
+    const auto output_sr = 44100.0;
+
+    std::vector<float> input(4000);
+    for (size_t i = 0; i != input.size(); ++i) {
+        input[i] = std::sin(2 * M_PI * 500 * i / input_sr);
+    }
+
+    const auto polyphase = wayverb::waveguide::adjust_sampling_rate(
+            input, input_sr, output_sr);
+    const auto reference =
+            wayverb::waveguide::adjust_sampling_rate_libsamplerate(
+                    input.data(), input.size(), input_sr, output_sr);
+
+    ASSERT_EQ(polyphase.size(), reference.size());
+
+    const auto margin = polyphase.size() / 8;
+    for (auto i = margin; i != polyphase.size() - margin; ++i) {
+        ASSERT_NEAR(polyphase[i], reference[i], 1.0e-3);
+    }
+}
+
+TEST(sample_rate_conversion, falls_back_for_inexact_ratios) {
+    //  No rational bank is close enough for this ratio over this length, so
+    //  the output should come from libsamplerate instead.
+    std::vector<float> input(100000, 0.0);
+    input[200] = 1.0;
+    const auto input_sr = 20000.0;
+    const auto output_sr = 20001.0;
+
+    const auto output = wayverb::waveguide::adjust_sampling_rate(
+            input, input_sr, output_sr);
+    const auto reference =
+            wayverb::waveguide::adjust_sampling_rate_libsamplerate(
+                    input.data(), input.size(), input_sr, output_sr);
+    ASSERT_EQ(output, reference);
+}
@@ -1,10 +1,15 @@
+#include "waveguide/checkpoint.h"
 #include "waveguide/config.h"
+#include "waveguide/cpu_waveguide.h"
+#include "waveguide/domain_decomposition.h"
+#include "waveguide/field_snapshot.h"
 #include "waveguide/filters.h"
 #include "waveguide/fitted_boundary.h"
 #include "waveguide/make_transparent.h"
 #include "waveguide/mesh.h"
 #include "waveguide/postprocessor/node.h"
 #include "waveguide/preprocessor/soft_source.h"
+#include "waveguide/pressure_storage.h"
 #include "waveguide/program.h"
 #include "waveguide/setup.h"
 #include "waveguide/waveguide.h"
@@ -20,13 +25,103 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <optional>
 #include <random>
+#include <set>
 
 using namespace wayverb::waveguide;
 using namespace wayverb::core;
 
 static constexpr auto samplerate = 44100.0;
 
+namespace {
+
+/// A small room, for tests which compare two ways of running the same
+/// simulation. The box is smaller than the voxelised region, so some of the
+/// mesh lies outside the room.
+struct small_room final {
+    static constexpr glm::vec3 source{1, 0.7, 0.4};
+    static constexpr glm::vec3 receiver{1.2, 0.8, 0.6};
+
+    small_room()
+            : voxelised{compute_voxels_and_mesh(
+                      cc,
+                      geo::get_scene_data(
+                              geo::box{glm::vec3{0, 0, 0},
+                                       glm::vec3{2, 1.5, 1}},
+                              make_surface<simulation_bands>(0.1, 0)),
+                      source,
+                      samplerate,
+                      340.0)}
+            , source_index{
+                      compute_index(get_mesh().get_descriptor(), source)}
+            , receiver_index{
+                      compute_index(get_mesh().get_descriptor(), receiver)} {}
+
+    const mesh& get_mesh() const { return voxelised.mesh; }
+
+    /// A unit impulse followed by silence.
+    static util::aligned::vector<float> impulse(size_t steps) {
+        util::aligned::vector<float> ret(steps, 0.0f);
+        ret.front() = 1.0f;
+        return ret;
+    }
+
+    /// The receiver's pressure at each step of a dense run.
+    util::aligned::vector<float> run_dense(
+            const util::aligned::vector<float>& input,
+            pressure_storage storage = pressure_storage::single) const {
+        auto prep = preprocessor::make_soft_source(
+                source_index, input.begin(), input.end(), storage);
+        callback_accumulator<postprocessor::node> output{receiver_index,
+                                                         storage};
+        run(cc,
+            get_mesh(),
+            prep,
+            [&](auto& queue, const auto& buffer, auto step) {
+                output(queue, buffer, step);
+            },
+            true,
+            storage);
+        return output.get_output();
+    }
+
+    /// The receiver's pressure at each step of a run storing only the nodes
+    /// kept by `layout`.
+    util::aligned::vector<float> run_compact(
+            const sparse_layout& layout,
+            const util::aligned::vector<float>& input) const {
+        auto prep = preprocessor::make_soft_source(
+                compute_compact_index(layout, source_index),
+                input.begin(),
+                input.end());
+        callback_accumulator<postprocessor::node> output{
+                compute_compact_index(layout, receiver_index)};
+        const auto completed = run_sparse(
+                cc,
+                get_mesh(),
+                layout,
+                coefficient_overlay{get_mesh()},
+                prep,
+                [&](auto& queue, const auto& buffer, auto step) {
+                    output(queue, buffer, step);
+                },
+                true);
+        EXPECT_EQ(completed, input.size());
+        return output.get_output();
+    }
+
+    const compute_context cc{};
+    const voxels_and_mesh voxelised;
+    const size_t source_index;
+    const size_t receiver_index;
+};
+
+}  // namespace
+
 TEST(peak_filter_coefficients, peak_filter_coefficients) {
     static std::default_random_engine engine{std::random_device()()};
     static std::uniform_real_distribution<cl_float> range{0, 0.5};
@@ -138,3 +233,379 @@ TEST(run_waveguide, run_waveguide) {
         std::cout << "value: " << val << '\n';
     }
 }
+
+TEST(run_waveguide, multiband_matches_single_band) {
+    const auto steps = 200;
+
+    const compute_context cc{};
+
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{2, 2, 2}};
+    constexpr glm::vec3 source{1, 1, 0.8};
+    constexpr glm::vec3 receiver{1, 1, 1.2};
+
+    const auto scene_data =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.01, 0));
+    auto voxels_and_mesh = compute_voxels_and_mesh(
+            cc, scene_data, source, samplerate, 340.0);
+    auto& mesh = voxels_and_mesh.mesh;
+
+    const auto source_index = compute_index(mesh.get_descriptor(), source);
+    const auto receiver_index = compute_index(mesh.get_descriptor(), receiver);
+
+    util::aligned::vector<float> input(steps, 0.0f);
+    input.front() = 1.0f;
+
+    const auto num_surfaces = mesh.get_structure().get_coefficients().size();
+    const util::aligned::vector<util::aligned::vector<coefficients_canonical>>
+            band_surface_coefficients{
+                    util::aligned::vector<coefficients_canonical>(
+                            num_surfaces, to_flat_coefficients(0.01)),
+                    util::aligned::vector<coefficients_canonical>(
+                            num_surfaces, to_flat_coefficients(0.5))};
+
+    //  Reference: one full run per band.
+    util::aligned::vector<util::aligned::vector<float>> expected;
+    for (const auto& coefficients : band_surface_coefficients) {
+        mesh.set_coefficients(coefficients);
+        auto prep = preprocessor::make_soft_source(
+                source_index, input.begin(), input.end());
+        callback_accumulator<postprocessor::node> output{receiver_index};
+        run(cc,
+            mesh,
+            prep,
+            [&](auto& queue, const auto& buffer, auto step) {
+                output(queue, buffer, step);
+            },
+            true);
+        expected.emplace_back(output.get_output());
+    }
+
+    const auto band_coefficients = util::map_to_vector(
+            begin(band_surface_coefficients),
+            end(band_surface_coefficients),
+            [&](const auto& i) { return coefficient_overlay{mesh, i}; });
+
+    std::vector<callback_accumulator<postprocessor::node>> outputs;
+    outputs.reserve(band_coefficients.size());
+    for (size_t i = 0; i != band_coefficients.size(); ++i) {
+        outputs.emplace_back(receiver_index);
+    }
+
+    const auto completed = run_multiband(
+            cc,
+            mesh,
+            band_coefficients,
+            source_index,
+            input.begin(),
+            input.end(),
+            [&](auto& queue, const auto& planes, auto step) {
+                for (size_t i = 0; i != planes.size(); ++i) {
+                    outputs[i](queue, planes[i], step);
+                }
+            },
+            true);
+    ASSERT_EQ(completed, steps);
+
+    for (size_t band = 0; band != band_coefficients.size(); ++band) {
+        const auto& actual = outputs[band].get_output();
+        ASSERT_EQ(actual.size(), expected[band].size());
+        for (size_t i = 0; i != actual.size(); ++i) {
+            ASSERT_NEAR(actual[i], expected[band][i], 1.0e-5)
+                    << "band " << band << " step " << i;
+        }
+    }
+
+    //  The bands really are different.
+    ASSERT_NE(expected[0], expected[1]);
+}
+
+TEST(run_waveguide, sparse_matches_dense) {
+    const small_room room;
+    const auto input = small_room::impulse(200);
+    const auto& mesh = room.get_mesh();
+
+    const auto expected = room.run_dense(input);
+
+    for (const auto ordering : {node_ordering::dense, node_ordering::morton}) {
+        const auto layout = make_sparse_layout(mesh, ordering);
+        ASSERT_LT(layout.dense_indices.size(),
+                  mesh.get_structure().get_condensed_nodes().size());
+
+        const auto actual = room.run_compact(layout, input);
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t i = 0; i != actual.size(); ++i) {
+            ASSERT_NEAR(actual[i], expected[i], 1.0e-5)
+                    << "ordering " << static_cast<int>(ordering) << " step "
+                    << i;
+        }
+    }
+}
+
+TEST(cpu_waveguide, blocked_matches_opencl) {
+    const small_room room;
+    const auto input = small_room::impulse(200);
+
+    const auto layout =
+            make_sparse_layout(room.get_mesh(), node_ordering::morton);
+    const auto source_index = compute_compact_index(layout, room.source_index);
+    const auto receiver_index =
+            compute_compact_index(layout, room.receiver_index);
+
+    const auto expected = room.run_compact(layout, input);
+
+    const std::atomic_bool keep_going{true};
+    const auto run_cpu = [&](size_t block_steps) {
+        //  Small tiles, so that the mesh is split into several.
+        cpu_waveguide waveguide{
+                layout, coefficient_overlay{room.get_mesh()}, block_steps, 8};
+        return waveguide
+                .run(source_index, input, {receiver_index}, keep_going)
+                .front();
+    };
+
+    const auto per_step = run_cpu(1);
+    ASSERT_EQ(per_step.size(), expected.size());
+    for (size_t i = 0; i != per_step.size(); ++i) {
+        ASSERT_NEAR(per_step[i], expected[i], 1.0e-4) << "step " << i;
+    }
+
+    for (const auto block_steps : {2, 4, 8}) {
+        ASSERT_EQ(run_cpu(block_steps), per_step)
+                << "block steps " << block_steps;
+    }
+
+    //  Blocks report their progress, and the last one may be short.
+    util::aligned::vector<size_t> reported;
+    cpu_waveguide waveguide{
+            layout, coefficient_overlay{room.get_mesh()}, 64, 8};
+    waveguide.run(source_index,
+                  input,
+                  {receiver_index},
+                  keep_going,
+                  [&](auto steps) { reported.emplace_back(steps); });
+    ASSERT_EQ(reported, (util::aligned::vector<size_t>{64, 128, 192, 200}));
+}
+
+TEST(domain_decomposition, matches_undivided) {
+    const small_room room;
+    const auto input = small_room::impulse(200);
+    const auto& mesh = room.get_mesh();
+
+    const auto expected = room.run_compact(make_sparse_layout(mesh), input);
+
+    //  Several slabs share one device, each with its own queue.
+    const std::atomic_bool keep_going{true};
+    for (const size_t slabs : {1, 2, 3, 5}) {
+        const auto decomposition = decompose(mesh, slabs);
+        ASSERT_EQ(decomposition.subdomains.size(), slabs);
+
+        const auto output = run_decomposed({room.cc},
+                                           decomposition,
+                                           coefficient_overlay{mesh},
+                                           room.source_index,
+                                           input,
+                                           {room.receiver_index},
+                                           keep_going)
+                                    .front();
+        ASSERT_EQ(output.size(), expected.size());
+        for (size_t i = 0; i != output.size(); ++i) {
+            ASSERT_NEAR(output[i], expected[i], 1.0e-6)
+                    << "slabs " << slabs << ", step " << i;
+        }
+    }
+}
+
+TEST(domain_decomposition, no_empty_slabs) {
+    const small_room room;
+    const auto& mesh = room.get_mesh();
+
+    //  The room is smaller than the mesh, so the outer planes hold no nodes.
+    const auto axis = decompose(mesh, 1).axis;
+    const auto layout = make_sparse_layout(mesh);
+    std::set<size_t> occupied;
+    for (const auto i : layout.dense_indices) {
+        occupied.insert(compute_locator(layout.descriptor, i)[axis]);
+    }
+
+    const auto decomposition = decompose(mesh, occupied.size());
+    for (const auto& subdomain : decomposition.subdomains) {
+        ASSERT_NE(subdomain.owned_nodes, 0u);
+    }
+    ASSERT_THROW(decompose(mesh, occupied.size() + 1), std::runtime_error);
+}
+
+TEST(run_waveguide, resume_from_checkpoint) {
+    const auto steps = 300;
+    const auto cancel_after = 130;
+    const auto path = make_checkpoint_path(SCRATCH_PATH, 1);
+    ASSERT_NE(path, make_checkpoint_path(SCRATCH_PATH, 2));
+    std::remove(path.c_str());
+
+    const small_room room;
+    const auto input = small_room::impulse(steps);
+
+    const auto run_from = [&](size_t first,
+                              std::atomic_bool& keep_going,
+                              checkpointer* checkpoints,
+                              std::optional<size_t> cancel_step) {
+        auto prep = preprocessor::make_soft_source(
+                room.source_index, input.begin() + first, input.end());
+        callback_accumulator<postprocessor::node> output{room.receiver_index};
+        const auto completed = run(
+                room.cc,
+                room.get_mesh(),
+                prep,
+                [&](auto& queue, const auto& buffer, auto step) {
+                    output(queue, buffer, step);
+                    if (cancel_step && step == *cancel_step) {
+                        keep_going = false;
+                    }
+                },
+                keep_going,
+                pressure_storage::single,
+                checkpoints);
+        EXPECT_EQ(completed, cancel_step ? *cancel_step + 1 : steps);
+        return output.get_output();
+    };
+
+    std::atomic_bool keep_going{true};
+    const auto expected = run_from(0, keep_going, nullptr, std::nullopt);
+
+    //  Periodic checkpoints, then a final one when the run is cancelled.
+    {
+        checkpointer checkpoints{path, 50, 1};
+        ASSERT_EQ(checkpoints.get_resume(), nullptr);
+        run_from(0, keep_going, &checkpoints, cancel_after);
+    }
+
+    checkpointer checkpoints{path, 50, 1};
+    ASSERT_NE(checkpoints.get_resume(), nullptr);
+    ASSERT_EQ(checkpoints.get_resume()->step, cancel_after + 1);
+
+    keep_going = true;
+    const auto resumed =
+            run_from(cancel_after + 1, keep_going, &checkpoints, std::nullopt);
+    ASSERT_EQ(resumed.size(), steps - (cancel_after + 1));
+    for (size_t i = 0; i != resumed.size(); ++i) {
+        ASSERT_EQ(resumed[i], expected[cancel_after + 1 + i]) << "step " << i;
+    }
+
+    checkpoints.discard();
+    ASSERT_EQ(checkpointer(path, 50, 1).get_resume(), nullptr);
+}
+
+TEST(field_snapshot, decimates_to_signed_peaks) {
+    const compute_context cc{};
+    const mesh_descriptor descriptor{
+            {{0, 0, 0}}, {{5, 4, 3}}, 0.1f};
+    const size_t factor = 2;
+
+    util::aligned::vector<float> pressures(compute_num_nodes(descriptor));
+    std::default_random_engine engine{std::random_device{}()};
+    std::uniform_real_distribution<float> dist{-1, 1};
+    std::generate(begin(pressures), end(pressures), [&] { return dist(engine); });
+
+    const auto decimated = compute_decimated_descriptor(descriptor, factor);
+    ASSERT_EQ(decimated.dimensions.s[0], 3);
+    ASSERT_EQ(decimated.dimensions.s[1], 2);
+    ASSERT_EQ(decimated.dimensions.s[2], 2);
+    ASSERT_FLOAT_EQ(decimated.spacing, 0.2f);
+    ASSERT_EQ(compute_decimated_descriptor(descriptor, 1), descriptor);
+
+    util::aligned::vector<float> expected(compute_num_nodes(decimated));
+    for (size_t i = 0; i != pressures.size(); ++i) {
+        const auto locator = compute_locator(descriptor, i);
+        auto& peak = expected[compute_index(
+                decimated, glm::ivec3{locator / static_cast<int>(factor)})];
+        if (std::abs(peak) < std::abs(pressures[i])) {
+            peak = pressures[i];
+        }
+    }
+
+    cl::CommandQueue queue{cc.context, cc.device};
+    const auto buffer = load_to_buffer(cc.context, pressures, true);
+
+    util::aligned::vector<float> delivered;
+    size_t delivered_step{};
+    {
+        field_snapshotter snapshotter{
+                cc, descriptor, factor, [&](auto snapshot, auto step) {
+                    delivered = std::move(snapshot);
+                    delivered_step = step;
+                }};
+        ASSERT_EQ(snapshotter.get_descriptor(), decimated);
+        ASSERT_TRUE(snapshotter.take(queue, buffer, 7));
+    }
+
+    ASSERT_EQ(delivered_step, 7u);
+    ASSERT_EQ(delivered, expected);
+}
+
+TEST(field_snapshot, reads_half_storage) {
+    const compute_context cc{};
+    const mesh_descriptor descriptor{
+            {{0, 0, 0}}, {{5, 4, 3}}, 0.1f};
+    const size_t factor = 2;
+
+    std::default_random_engine engine{std::random_device{}()};
+    std::uniform_real_distribution<float> dist{-1, 1};
+    util::aligned::vector<std::uint16_t> pressures(compute_num_nodes(descriptor));
+    std::generate(begin(pressures), end(pressures), [&] {
+        return float_to_half(dist(engine));
+    });
+
+    const auto decimated = compute_decimated_descriptor(descriptor, factor);
+    util::aligned::vector<float> expected(compute_num_nodes(decimated));
+    for (size_t i = 0; i != pressures.size(); ++i) {
+        const auto locator = compute_locator(descriptor, i);
+        auto& peak = expected[compute_index(
+                decimated, glm::ivec3{locator / static_cast<int>(factor)})];
+        const auto pressure = half_to_float(pressures[i]);
+        if (std::abs(peak) < std::abs(pressure)) {
+            peak = pressure;
+        }
+    }
+
+    cl::CommandQueue queue{cc.context, cc.device};
+    const auto buffer = load_to_buffer(cc.context, pressures, true);
+
+    util::aligned::vector<float> delivered;
+    {
+        field_snapshotter snapshotter{
+                cc,
+                descriptor,
+                factor,
+                [&](auto snapshot, auto) { delivered = std::move(snapshot); },
+                pressure_storage::half};
+        ASSERT_TRUE(snapshotter.take(queue, buffer, 0));
+    }
+
+    ASSERT_EQ(delivered, expected);
+}
+
+TEST(pressure_storage, half_round_trip) {
+    for (const auto value : {0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, 6.1035156e-5f}) {
+        ASSERT_EQ(half_to_float(float_to_half(value)), value);
+    }
+    //  Ties round to even.
+    ASSERT_EQ(half_to_float(float_to_half(1.0f + 1.0f / 2048)), 1.0f);
+    ASSERT_TRUE(std::isinf(half_to_float(float_to_half(1.0e6f))));
+    ASSERT_TRUE(std::isnan(half_to_float(float_to_half(NAN))));
+}
+
+TEST(run_waveguide, half_storage_matches_single) {
+    const small_room room;
+    const auto input = small_room::impulse(400);
+
+    const auto single = room.run_dense(input, pressure_storage::single);
+    const auto half = room.run_dense(input, pressure_storage::half);
+    ASSERT_EQ(single.size(), half.size());
+
+    const auto peak = std::abs(*std::max_element(
+            single.begin(), single.end(), [](auto a, auto b) {
+                return std::abs(a) < std::abs(b);
+            }));
+    for (size_t i = 0; i != single.size(); ++i) {
+        ASSERT_NEAR(half[i], single[i], peak * 1.0e-2) << "step " << i;
+    }
+}